@@ -0,0 +1,330 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "ctlscript.h"
+#include "timer.h"
+
+#define EXPAND_BUF_SIZE	(CTLSCRIPT_MAX_LINE * 4)
+
+static void scriptError(struct ctlscript *scr, const char *msg, const char *arg)
+{
+	fprintf(stderr, "%s:%d: %s%s%s\n", scr->filename, scr->lineno, msg, arg ? ": " : "", arg ? arg : "");
+}
+
+void ctlscript_init(struct ctlscript *scr, ctlscript_step_func step, void *ctx)
+{
+	memset(scr, 0, sizeof(struct ctlscript));
+	scr->step = step;
+	scr->ctx = ctx;
+	scr->on_error = CTLSCRIPT_STOP_ON_ERROR;
+}
+
+static struct ctlscript_var *findVar(struct ctlscript *scr, const char *name)
+{
+	int i;
+
+	for (i=0; i<scr->n_vars; i++) {
+		if (!strcmp(scr->vars[i].name, name)) {
+			return &scr->vars[i];
+		}
+	}
+
+	return NULL;
+}
+
+int ctlscript_setVar(struct ctlscript *scr, const char *name, const char *value)
+{
+	struct ctlscript_var *var;
+	const char *c;
+
+	if (!*name || strlen(name) >= CTLSCRIPT_MAX_NAME) {
+		fprintf(stderr, "Invalid variable name '%s'\n", name);
+		return -1;
+	}
+	for (c = name; *c; c++) {
+		if (!isalnum((unsigned char)*c) && *c != '_') {
+			fprintf(stderr, "Invalid variable name '%s'\n", name);
+			return -1;
+		}
+	}
+	if (strlen(value) >= CTLSCRIPT_MAX_VALUE) {
+		fprintf(stderr, "Value too long for variable '%s'\n", name);
+		return -1;
+	}
+
+	var = findVar(scr, name);
+	if (!var) {
+		if (scr->n_vars >= CTLSCRIPT_MAX_VARS) {
+			fprintf(stderr, "Too many variables\n");
+			return -1;
+		}
+		var = &scr->vars[scr->n_vars++];
+		strcpy(var->name, name);
+	}
+	strcpy(var->value, value);
+
+	return 0;
+}
+
+int ctlscript_setVarArg(struct ctlscript *scr, const char *assignment)
+{
+	char name[CTLSCRIPT_MAX_NAME];
+	const char *eq;
+
+	eq = strchr(assignment, '=');
+	if (!eq || eq == assignment || (eq - assignment) >= CTLSCRIPT_MAX_NAME) {
+		fprintf(stderr, "Invalid variable assignment '%s' (expected name=value)\n", assignment);
+		return -1;
+	}
+	memcpy(name, assignment, eq - assignment);
+	name[eq - assignment] = 0;
+
+	return ctlscript_setVar(scr, name, eq + 1);
+}
+
+/* Expand the variable reference at *p ($name, ${name} or $$). *p is moved past it. */
+static const char *expandVar(struct ctlscript *scr, const char **p)
+{
+	char name[CTLSCRIPT_MAX_NAME];
+	struct ctlscript_var *var;
+	const char *s = *p + 1;
+	int len = 0, braces = 0;
+
+	if (*s == '$') {
+		*p = s + 1;
+		return "$";
+	}
+
+	if (*s == '{') {
+		braces = 1;
+		s++;
+	}
+
+	while (isalnum((unsigned char)s[len]) || s[len] == '_') {
+		if (len >= CTLSCRIPT_MAX_NAME - 1) {
+			scriptError(scr, "Variable name too long", NULL);
+			return NULL;
+		}
+		name[len] = s[len];
+		len++;
+	}
+	name[len] = 0;
+
+	if (!len || (braces && s[len] != '}')) {
+		scriptError(scr, "Invalid variable reference", NULL);
+		return NULL;
+	}
+
+	*p = s + len + braces;
+
+	var = findVar(scr, name);
+	if (!var) {
+		scriptError(scr, "Undefined variable", name);
+		return NULL;
+	}
+
+	return var->value;
+}
+
+/* Split a line in arguments, expanding variables. The arguments are
+ * stored in buf. Returns the number of arguments, or -1 on error. */
+static int tokenize(struct ctlscript *scr, const char *line, char *buf, int buflen, char **argv, int max_args)
+{
+	const char *p = line, *value;
+	char *out = buf, *end = buf + buflen;
+	char quote;
+	int argc = 0, n;
+
+	while (1) {
+		while (isspace((unsigned char)*p))
+			p++;
+		if (!*p || *p == '#')
+			break;
+
+		if (argc >= max_args) {
+			scriptError(scr, "Too many arguments", NULL);
+			return -1;
+		}
+		argv[argc++] = out;
+
+		quote = 0;
+		while (*p && (quote || !isspace((unsigned char)*p))) {
+			if (*p == '"' || *p == '\'') {
+				if (!quote) {
+					quote = *p++;
+					continue;
+				}
+				if (quote == *p) {
+					quote = 0;
+					p++;
+					continue;
+				}
+			}
+
+			if (*p == '$' && quote != '\'') {
+				value = expandVar(scr, &p);
+				if (!value)
+					return -1;
+				n = strlen(value);
+				if (out + n >= end)
+					goto too_long;
+				memcpy(out, value, n);
+				out += n;
+				continue;
+			}
+
+			if (out + 1 >= end)
+				goto too_long;
+			*out++ = *p++;
+		}
+
+		if (quote) {
+			scriptError(scr, "Unterminated quote", NULL);
+			return -1;
+		}
+		if (out >= end)
+			goto too_long;
+		*out++ = 0;
+	}
+
+	return argc;
+
+too_long:
+	scriptError(scr, "Line too long after variable expansion", NULL);
+	return -1;
+}
+
+static int runDirective(struct ctlscript *scr, int argc, char **argv)
+{
+	int i;
+
+	if (!strcmp(argv[0], "set")) {
+		if (argc != 3) {
+			scriptError(scr, "Usage", "set name value");
+			return -1;
+		}
+		return ctlscript_setVar(scr, argv[1], argv[2]);
+	}
+
+	if (!strcmp(argv[0], "on_error")) {
+		if (argc == 2 && !strcmp(argv[1], "stop")) {
+			scr->on_error = CTLSCRIPT_STOP_ON_ERROR;
+		} else if (argc == 2 && !strcmp(argv[1], "continue")) {
+			scr->on_error = CTLSCRIPT_CONTINUE;
+		} else {
+			scriptError(scr, "Usage", "on_error stop|continue");
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!strcmp(argv[0], "echo")) {
+		for (i=1; i<argc; i++) {
+			printf("%s%s", argv[i], i < argc-1 ? " " : "");
+		}
+		printf("\n");
+		return 0;
+	}
+
+	scriptError(scr, "Unknown directive", argv[0]);
+	return -1;
+}
+
+int ctlscript_run(struct ctlscript *scr, const char *filename)
+{
+	FILE *fp;
+	char line[CTLSCRIPT_MAX_LINE];
+	char buf[EXPAND_BUF_SIZE];
+	char *argv[CTLSCRIPT_MAX_ARGS + 2];
+	uint64_t t_script, t_step;
+	int argc, res, error = 0;
+
+	if (!strcmp(filename, "-")) {
+		fp = stdin;
+		filename = "stdin";
+	} else {
+		fp = fopen(filename, "r");
+		if (!fp) {
+			perror(filename);
+			return -1;
+		}
+	}
+
+	scr->filename = filename;
+	scr->lineno = 0;
+	scr->n_steps = 0;
+	scr->n_failed = 0;
+
+	t_script = getMicroseconds();
+
+	while (fgets(line, sizeof(line), fp)) {
+		scr->lineno++;
+
+		if (!strchr(line, '\n') && !feof(fp)) {
+			scriptError(scr, "Line too long", NULL);
+			error = 1;
+			break;
+		}
+
+		argc = tokenize(scr, line, buf, sizeof(buf), argv + 1, CTLSCRIPT_MAX_ARGS);
+		if (argc < 0) {
+			error = 1;
+			break;
+		}
+		if (argc == 0)
+			continue;
+
+		if (argv[1][0] != '-') {
+			if (runDirective(scr, argc, argv + 1)) {
+				error = 1;
+				break;
+			}
+			continue;
+		}
+
+		argv[0] = (char*)filename;
+		argv[argc + 1] = NULL;
+
+		scr->n_steps++;
+		t_step = getMicroseconds();
+		res = scr->step(argc + 1, argv, scr->ctx);
+		t_step = getMicroseconds() - t_step;
+
+		if (res) {
+			scr->n_failed++;
+			printf("[%s:%d] Step %d failed (%d) after %.3f ms\n", filename, scr->lineno, scr->n_steps, res, t_step / 1000.0);
+			if (scr->on_error == CTLSCRIPT_STOP_ON_ERROR) {
+				error = 1;
+				break;
+			}
+		} else {
+			printf("[%s:%d] Step %d done in %.3f ms\n", filename, scr->lineno, scr->n_steps, t_step / 1000.0);
+		}
+	}
+
+	printf("Script: %d step(s), %d failed, %.3f ms\n", scr->n_steps, scr->n_failed,
+			(getMicroseconds() - t_script) / 1000.0);
+
+	if (fp != stdin) {
+		fclose(fp);
+	}
+
+	return (error || scr->n_failed) ? -1 : 0;
+}
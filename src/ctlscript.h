@@ -0,0 +1,86 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef _ctlscript_h__
+#define _ctlscript_h__
+
+#define CTLSCRIPT_MAX_VARS		64
+#define CTLSCRIPT_MAX_NAME		32
+#define CTLSCRIPT_MAX_VALUE		256
+#define CTLSCRIPT_MAX_LINE		1024
+#define CTLSCRIPT_MAX_ARGS		64
+
+#define CTLSCRIPT_STOP_ON_ERROR	0
+#define CTLSCRIPT_CONTINUE		1
+
+/* Called for each step with the step arguments. argv[0] is the script
+ * name, as for main(). Must return non-zero if the step failed. */
+typedef int (*ctlscript_step_func)(int argc, char **argv, void *ctx);
+
+struct ctlscript_var {
+	char name[CTLSCRIPT_MAX_NAME];
+	char value[CTLSCRIPT_MAX_VALUE];
+};
+
+/**
+ * \brief A gcn64ctl script
+ *
+ * Scripts are line based:
+ *
+ *   # Comment
+ *   set chn 1
+ *   set file "pak 1.mpk"
+ *   on_error continue
+ *   echo Dumping to $file
+ *   --suspend_polling
+ *   --n64_mempak_dump -c $chn -o $file
+ *   --resume_polling
+ *
+ * Lines starting with - are steps, given to the step function. $name or
+ * ${name} is replaced by the variable value. Double quotes group words
+ * (variables are still expanded), single quotes also prevent expansion.
+ * on_error stop (the default) ends the script at the first failed step.
+ */
+struct ctlscript {
+	ctlscript_step_func step;
+	void *ctx;
+	int on_error;
+
+	int n_vars;
+	struct ctlscript_var vars[CTLSCRIPT_MAX_VARS];
+
+	/* Position, for error messages */
+	const char *filename;
+	int lineno;
+
+	/* Results */
+	int n_steps;
+	int n_failed;
+};
+
+void ctlscript_init(struct ctlscript *scr, ctlscript_step_func step, void *ctx);
+int ctlscript_setVar(struct ctlscript *scr, const char *name, const char *value);
+
+/** \brief Set a variable from a name=value string (eg: from the command-line) */
+int ctlscript_setVarArg(struct ctlscript *scr, const char *assignment);
+
+/** \brief Run a script
+ * \param filename The script. "-" for stdin.
+ * \return 0 if all steps succeeded, -1 otherwise
+ */
+int ctlscript_run(struct ctlscript *scr, const char *filename);
+
+#endif // _ctlscript_h__
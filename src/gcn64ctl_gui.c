@@ -52,6 +52,7 @@ static void setvisible_psx_adapter_widgets(struct application *app, int visible)
 	GtkWidget *widgets[] = {
 		GET_ELEMENT(GtkWidget, btn_write_psx_memcard),
 		GET_ELEMENT(GtkWidget, btn_read_psx_memcard),
+		GET_ELEMENT(GtkWidget, btn_psx_memcard_saves),
 		NULL
 	};
 	int i;
@@ -102,6 +103,7 @@ void deselect_adapter(struct application *app)
 	printf("deselect adapter\n");
 
 	if (app->current_adapter_handle) {
+		adapter_worker_stop(app);
 		rnt_closeDevice(app->current_adapter_handle);
 		app->current_adapter_handle = NULL;
 		desensitize_adapter_widgets(app);
@@ -139,19 +141,14 @@ void errorPopup(struct application *app, const char *message)
 	gtk_widget_destroy(dialog);
 }
 
-static gboolean periodic_updater(gpointer data)
+/* Called by the adapter I/O thread (from the main loop) when the controller types change */
+void updateControllerTypes(struct application *app)
 {
-	struct application *app = data;
-	int i;
 	GET_UI_ELEMENT(GtkLabel, label_controller_type);
 	GET_UI_ELEMENT(GtkLabel, label_controller_type2);
 	GET_UI_ELEMENT(GtkButton, btn_rumble_test);
 
-	if (app->current_adapter_handle && !app->inhibit_periodic_updates) {
-		for (i=0; i<MAX_CONTROLLER_TYPES; i++) {
-			app->controller_type[i] = rnt_getControllerType(app->current_adapter_handle, i);
-		}
-
+	if (app->current_adapter_handle) {
 		gtk_label_set_text(label_controller_type, rnt_controllerName(app->controller_type[0]));
 		gtk_label_set_text(label_controller_type2, rnt_controllerName(app->controller_type[1]));
 
@@ -178,7 +175,6 @@ static gboolean periodic_updater(gpointer data)
 		}
 
 	}
-	return TRUE;
 }
 
 void syncGuiToCurrentAdapter(struct application *app)
@@ -532,7 +528,7 @@ void syncGuiToCurrentAdapter(struct application *app)
 	}
 
 
-	periodic_updater(app);
+	updateControllerTypes(app);
 }
 
 G_MODULE_EXPORT void snesMouseSpeedChanged(GtkWidget *win, gpointer data)
@@ -837,6 +833,118 @@ G_MODULE_EXPORT void config_checkbox_changed(GtkWidget *win, gpointer data)
 	}
 }
 
+static void appendDeviceRow(GtkListStore *list_store, GtkTreeIter *iter, const struct rnt_adap_info *info)
+{
+	gtk_list_store_append(list_store, iter);
+	if (sizeof(wchar_t)==4) {
+		gtk_list_store_set(list_store, iter,
+						0, g_ucs4_to_utf8((void*)info->str_serial, -1, NULL, NULL, NULL),
+						1, g_ucs4_to_utf8((void*)info->str_prodname, -1, NULL, NULL, NULL),
+						3, g_memdup(info, sizeof(struct rnt_adap_info)),
+							-1);
+	} else {
+		gtk_list_store_set(list_store, iter,
+						0, g_utf16_to_utf8((void*)info->str_serial, -1, NULL, NULL, NULL),
+						1, g_utf16_to_utf8((void*)info->str_prodname, -1, NULL, NULL, NULL),
+						3, g_memdup(info, sizeof(struct rnt_adap_info)),
+							-1);
+	}
+}
+
+static int findDeviceRow(GtkListStore *list_store, GtkTreeIter *iter, const char *path)
+{
+	GtkTreeModel *model = GTK_TREE_MODEL(list_store);
+	struct rnt_adap_info *info;
+	gboolean valid;
+
+	for (valid = gtk_tree_model_get_iter_first(model, iter); valid; valid = gtk_tree_model_iter_next(model, iter)) {
+		gtk_tree_model_get(model, iter, 3, &info, -1);
+		if (info && !strcmp(info->str_path, path)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+struct hotplug_event {
+	struct application *app;
+	int event;
+	struct rnt_adap_info info;
+};
+
+/* Main loop side of adapterHotplug(). Events still pending when the monitor
+ * is stopped are discarded. */
+static gboolean hotplugEvent(gpointer data)
+{
+	struct hotplug_event *ev = data;
+	struct application *app = ev->app;
+	GtkListStore *list_store;
+	struct rnt_adap_info *row_info;
+	GtkTreeIter iter;
+
+	if (!app->monitor)
+		goto done;
+
+	list_store = GTK_LIST_STORE( gtk_builder_get_object(app->builder, "adaptersList") );
+
+	if (ev->event == RNT_MONITOR_ADDED) {
+		// The list may have been rebuilt since
+		if (!findDeviceRow(list_store, &iter, ev->info.str_path)) {
+			printf("Device '%ls' connected\n", ev->info.str_prodname);
+			appendDeviceRow(list_store, &iter, &ev->info);
+		}
+		goto done;
+	}
+
+	if (!findDeviceRow(list_store, &iter, ev->info.str_path))
+		goto done;
+
+	printf("Device '%ls' disconnected\n", ev->info.str_prodname);
+	if (app->current_adapter_handle && !strcmp(app->current_adapter_info.str_path, ev->info.str_path)) {
+		deselect_adapter(app);
+	}
+	gtk_tree_model_get(GTK_TREE_MODEL(list_store), &iter, 3, &row_info, -1);
+	gtk_list_store_remove(list_store, &iter);
+	g_free(row_info);
+
+done:
+	free(ev);
+	return FALSE;
+}
+
+/* Called by app->monitor (in the monitor thread) when adapters are connected or disconnected */
+static void adapterHotplug(int event, const struct rnt_adap_info *info, void *ctx)
+{
+	struct hotplug_event *ev;
+
+	ev = malloc(sizeof(struct hotplug_event));
+	if (!ev) {
+		perror("malloc");
+		return;
+	}
+	ev->app = ctx;
+	ev->event = event;
+	ev->info = *info;
+
+	gdk_threads_add_idle(hotplugEvent, ev);
+}
+
+static gpointer monitorThread(gpointer data)
+{
+	struct application *app = data;
+
+	while (!g_atomic_int_get(&app->monitor_stop)) {
+		// Adapters come and go during firmware updates. The list is rebuilt after.
+		if (!g_atomic_int_get(&app->inhibit_periodic_updates)) {
+			rnt_monitor_process(app->monitor);
+		}
+		g_usleep(MONITOR_TICK_MS * 1000);
+	}
+
+	return NULL;
+}
+
 gboolean rebuild_device_list_store(gpointer data, wchar_t *auto_select_serial)
 {
 	struct application *app = data;
@@ -857,20 +965,7 @@ gboolean rebuild_device_list_store(gpointer data, wchar_t *auto_select_serial)
 	while (rnt_listDevices(&info, listctx)) {
 		GtkTreeIter iter;
 		printf("Device '%ls'\n", info.str_prodname);
-		gtk_list_store_append(list_store, &iter);
-		if (sizeof(wchar_t)==4) {
-			gtk_list_store_set(list_store, &iter,
-							0, g_ucs4_to_utf8((void*)info.str_serial, -1, NULL, NULL, NULL),
-							1, g_ucs4_to_utf8((void*)info.str_prodname, -1, NULL, NULL, NULL),
-							3, g_memdup(&info, sizeof(struct rnt_adap_info)),
-								-1);
-		} else {
-			gtk_list_store_set(list_store, &iter,
-							0, g_utf16_to_utf8((void*)info.str_serial, -1, NULL, NULL, NULL),
-							1, g_utf16_to_utf8((void*)info.str_prodname, -1, NULL, NULL, NULL),
-							3, g_memdup(&info, sizeof(struct rnt_adap_info)),
-								-1);
-		}
+		appendDeviceRow(list_store, &iter, &info);
 		if (app->current_adapter_handle) {
 			if (!wcscmp(app->current_adapter_info.str_serial, info.str_serial)) {
 				gtk_combo_box_set_active_iter(cb_adapter_list, &iter);
@@ -900,6 +995,13 @@ G_MODULE_EXPORT void onMainWindowShow(GtkWidget *win, gpointer data)
 	}
 
 	rebuild_device_list_store(data, NULL);
+
+	// The adapters already in the list are skipped when the monitor first reports them.
+	app->monitor = rnt_monitor_new(adapterHotplug, app, 0);
+	if (app->monitor) {
+		app->monitor_stop = 0;
+		app->monitor_thread = g_thread_new("monitor", monitorThread, app);
+	}
 }
 
 G_MODULE_EXPORT void adapterSelected(GtkComboBox *cb, gpointer data)
@@ -912,6 +1014,7 @@ G_MODULE_EXPORT void adapterSelected(GtkComboBox *cb, gpointer data)
 	struct rnt_adap_info *info;
 
 	if (app->current_adapter_handle) {
+		adapter_worker_stop(app);
 		rnt_closeDevice(app->current_adapter_handle);
 		app->current_adapter_handle = NULL;
 
@@ -933,6 +1036,7 @@ G_MODULE_EXPORT void adapterSelected(GtkComboBox *cb, gpointer data)
 		// was only fetched after opening)
 		rnt_getInfo(app->current_adapter_handle, &app->current_adapter_info);
 
+		adapter_worker_start(app);
 		syncGuiToCurrentAdapter(app);
 		gtk_widget_set_sensitive(adapter_details, TRUE);
 		// TODO : Should only be available for adapters with an N64 port
@@ -942,6 +1046,15 @@ G_MODULE_EXPORT void adapterSelected(GtkComboBox *cb, gpointer data)
 
 G_MODULE_EXPORT void onMainWindowHide(GtkWidget *win, gpointer data)
 {
+	struct application *app = data;
+
+	if (app->monitor) {
+		g_atomic_int_set(&app->monitor_stop, 1);
+		g_thread_join(app->monitor_thread);
+		rnt_monitor_free(app->monitor);
+		app->monitor = NULL;
+	}
+	adapter_worker_stop(data);
 	rnt_shutdown();
 }
 
@@ -965,17 +1078,65 @@ G_MODULE_EXPORT void onFileRescan(GtkWidget *wid, gpointer data)
 	rebuild_device_list_store(data, NULL);
 }
 
+static gboolean mempak_io_showProgress(gpointer data)
+{
+	struct application *app = data;
+	GET_UI_ELEMENT(GtkProgressBar, mempak_io_progress);
+
+	g_atomic_int_set(&app->mempak_io_progress_pending, 0);
+	gtk_progress_bar_set_fraction(mempak_io_progress, g_atomic_int_get(&app->mempak_io_progress)/((gdouble)MEMPAK_MEM_SIZE));
+
+	return FALSE;
+}
+
+/* Called from the adapter I/O thread */
 static int mempak_io_progress_cb(int progress, void *ctx)
 {
 	struct application *app = ctx;
-	GET_UI_ELEMENT(GtkProgressBar, mempak_io_progress);
 
-	gtk_progress_bar_set_fraction(mempak_io_progress, progress/((gdouble)MEMPAK_MEM_SIZE));
-	while (gtk_events_pending()) {
-		gtk_main_iteration_do(FALSE);
+	g_atomic_int_set(&app->mempak_io_progress, progress);
+	if (g_atomic_int_compare_and_exchange(&app->mempak_io_progress_pending, 0, 1)) {
+		gdk_threads_add_idle(mempak_io_showProgress, app);
 	}
 
-	return app->stop_mempak_io;
+	return g_atomic_int_get(&app->stop_mempak_io);
+}
+
+struct mempak_io_job {
+	struct application *app;
+	mempak_structure_t *mpk;
+	uiio *u;
+};
+
+static int mempak_upload_job(rnt_hdl_t hdl, void *data)
+{
+	struct mempak_io_job *job = data;
+	int res;
+
+	rnt_suspendPolling(hdl, 1);
+	res = gcn64lib_mempak_upload(hdl, 0, job->mpk, mempak_io_progress_cb, job->app);
+	rnt_suspendPolling(hdl, 0);
+
+	return res;
+}
+
+static int mempak_download_job(rnt_hdl_t hdl, void *data)
+{
+	struct mempak_io_job *job = data;
+	int res;
+
+	rnt_suspendPolling(hdl, 1);
+	res = gcn64lib_mempak_download(hdl, 0, &job->mpk, mempak_io_progress_cb, job->app);
+	rnt_suspendPolling(hdl, 0);
+
+	return res;
+}
+
+static int mempak_erase_job(rnt_hdl_t hdl, void *data)
+{
+	struct mempak_io_job *job = data;
+
+	return mempak_fill(hdl, 0, 0xFF, 0, job->u);
 }
 
 G_MODULE_EXPORT void mempak_io_stop(GtkWidget *wid, gpointer data)
@@ -987,14 +1148,15 @@ G_MODULE_EXPORT void mempak_io_stop(GtkWidget *wid, gpointer data)
 G_MODULE_EXPORT void erase_n64_pak(GtkWidget *wid, gpointer data)
 {
 	struct application *app = data;
-	uiio *u = getUIIO_gtk(NULL, app->mainwindow);
+	struct mempak_io_job job = { .app = app };
 
 	if (!app->current_adapter_handle)
 		return;
 
-	u->caption = "Erasing Controller Pak...";
+	job.u = getUIIO_gtk(NULL, app->mainwindow);
+	job.u->caption = "Erasing Controller Pak...";
 
-	mempak_fill(app->current_adapter_handle, 0, 0xFF, 0, u);
+	adapter_worker_call(app, mempak_erase_job, &job);
 }
 
 G_MODULE_EXPORT void write_n64_pak(GtkWidget *wid, gpointer data)
@@ -1004,6 +1166,7 @@ G_MODULE_EXPORT void write_n64_pak(GtkWidget *wid, gpointer data)
 	GET_UI_ELEMENT(GtkDialog, mempak_io_dialog);
 	GET_UI_ELEMENT(GtkLabel, mempak_op_label);
 	GtkWidget *confirm_dialog;
+	struct mempak_io_job job = { .app = app };
 	gint res;
 
 	gtk_widget_show(GTK_WIDGET(win_mempak_edit));
@@ -1026,9 +1189,8 @@ G_MODULE_EXPORT void write_n64_pak(GtkWidget *wid, gpointer data)
 			gtk_label_set_text(mempak_op_label, "Writing memory pack...");
 			gtk_widget_show(GTK_WIDGET(mempak_io_dialog));
 
-			rnt_suspendPolling(app->current_adapter_handle, 1);
-			res = gcn64lib_mempak_upload(app->current_adapter_handle, 0, mpke_getCurrentMempak(app), mempak_io_progress_cb, app);
-			rnt_suspendPolling(app->current_adapter_handle, 0);
+			job.mpk = mpke_getCurrentMempak(app);
+			res = adapter_worker_call(app, mempak_upload_job, &job);
 			gtk_widget_hide(GTK_WIDGET(mempak_io_dialog));
 
 			if (res != 0) {
@@ -1056,7 +1218,7 @@ G_MODULE_EXPORT void read_n64_pak(GtkWidget *wid, gpointer data)
 	GET_UI_ELEMENT(GtkWindow, win_mempak_edit);
 	GET_UI_ELEMENT(GtkDialog, mempak_io_dialog);
 	GET_UI_ELEMENT(GtkLabel, mempak_op_label);
-	mempak_structure_t *mpk;
+	struct mempak_io_job job = { .app = app };
 	int res;
 
 	printf("N64 read mempak\n");
@@ -1067,9 +1229,7 @@ G_MODULE_EXPORT void read_n64_pak(GtkWidget *wid, gpointer data)
 	gtk_label_set_text(mempak_op_label, "Reading memory pack...");
 
 	app->stop_mempak_io = 0;
-	rnt_suspendPolling(app->current_adapter_handle, 1);
-	res = gcn64lib_mempak_download(app->current_adapter_handle, 0, &mpk, mempak_io_progress_cb, app);
-	rnt_suspendPolling(app->current_adapter_handle, 0);
+	res = adapter_worker_call(app, mempak_download_job, &job);
 
 	gtk_widget_hide(GTK_WIDGET(mempak_io_dialog));
 	if (res != 0) {
@@ -1083,7 +1243,7 @@ G_MODULE_EXPORT void read_n64_pak(GtkWidget *wid, gpointer data)
 		}
 	}
 	else {
-		mpke_replaceMpk(app, mpk, NULL);
+		mpke_replaceMpk(app, job.mpk, NULL);
 		gtk_widget_show(GTK_WIDGET(win_mempak_edit));
 	}
 }
@@ -1143,6 +1303,7 @@ main( int    argc,
 	gtk_style_context_add_provider_for_screen(gdk_screen_get_default(), GTK_STYLE_PROVIDER(cssProvider), GTK_STYLE_PROVIDER_PRIORITY_USER);
 
 	app.mpke = mpkedit_new(&app);
+	app.fwcatalog = fwcatalog_open(NULL, NULL);
 
     /* Get main window pointer from UI */
     window = GTK_WINDOW( gtk_builder_get_object( app.builder, "mainWindow" ) );
@@ -1151,8 +1312,6 @@ main( int    argc,
     /* Connect signals */
     gtk_builder_connect_signals( app.builder, &app );
 
-	g_timeout_add_seconds(1, periodic_updater, &app);
-
     /* Show window. All other widgets are automatically shown by GtkBuilder */
     gtk_widget_show( GTK_WIDGET(window) );
 
@@ -1164,6 +1323,7 @@ main( int    argc,
     gtk_main();
 
 	mpkedit_free(app.mpke);
+	fwcatalog_free(app.fwcatalog);
 
     return( 0 );
 }
@@ -11,11 +11,16 @@
 #include "gui_fwupd.h"
 #include "gui_logger.h"
 #include "gui_dfu_programmer.h"
+#include "fwcatalog.h"
+#include "gui_adapter_worker.h"
+#include "rnt_monitor.h"
 
 #define GET_ELEMENT(TYPE, ELEMENT)	(TYPE *)gtk_builder_get_object(app->builder, #ELEMENT)
 #define GET_UI_ELEMENT(TYPE, ELEMENT)   TYPE *ELEMENT = GET_ELEMENT(TYPE, ELEMENT)
 
 #define MAX_CONTROLLER_TYPES	2
+// How often hotplug events are checked
+#define MONITOR_TICK_MS			100
 
 struct application {
 	GtkBuilder *builder;
@@ -23,6 +28,8 @@ struct application {
 
 	rnt_hdl_t current_adapter_handle;
 	struct rnt_adap_info current_adapter_info;
+	// I/O thread for current_adapter_handle
+	struct adapter_worker *worker;
 
 	GThreadFunc updater_thread_func;
 	GThread *updater_thread;
@@ -35,6 +42,7 @@ struct application {
 
 	struct mpkedit_data *mpke;
 	int stop_mempak_io;
+	int mempak_io_progress, mempak_io_progress_pending;
 	int inhibit_periodic_updates;
 	int controller_type[MAX_CONTROLLER_TYPES];
 	int firmware_maj, firmware_min, firmware_build;
@@ -42,6 +50,15 @@ struct application {
 
 	// for gui_gc2n64_manager
 	struct x2gcn64_adapter_info inf;
+
+	// Firmwares available, indexed once at startup
+	struct fwcatalog *fwcatalog;
+
+	// Updates the adapter list when adapters are connected or disconnected.
+	// Runs in its own thread, as listing the adapters can take a while.
+	struct rnt_monitor *monitor;
+	GThread *monitor_thread;
+	gint monitor_stop;
 };
 
 void errorPopup(struct application *app, const char *message);
@@ -53,6 +70,9 @@ void deselect_adapter(struct application *app);
 /** Based on app->current_adapter_handle, update GUI elements */
 void syncGuiToCurrentAdapter(struct application *app);
 
+/** Update the GUI elements for app->controller_type */
+void updateControllerTypes(struct application *app);
+
 /** Scan for device and rebuild the list for the UI */
 gboolean rebuild_device_list_store(gpointer data, wchar_t *auto_select_serial);
 
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <gtk/gtk.h>
+#include "requests.h"
+#include "gcn64ctl_gui.h"
+#include "gui_adapter_worker.h"
+
+#define CONTROLLER_POLL_INTERVAL_US	1000000
+
+#define RQ_JOB		0
+#define RQ_REFRESH	1
+#define RQ_STOP		2
+
+struct adapter_worker {
+	struct application *app;
+	rnt_hdl_t hdl;
+	GThread *thread;
+	GAsyncQueue *queue;
+	gint refcount;
+
+	/* Only accessed from the main loop. Notifications still pending when
+	 * the worker is stopped are discarded. */
+	int stopped;
+
+	/* Only accessed from the worker thread */
+	int controller_type[MAX_CONTROLLER_TYPES];
+};
+
+struct adapter_request {
+	int type;
+	struct adapter_worker *worker;
+	adapter_job_func func;
+	void *data;
+	adapter_done_func done;
+	void *done_data;
+	int result;
+};
+
+struct controller_types_notification {
+	struct adapter_worker *worker;
+	int controller_type[MAX_CONTROLLER_TYPES];
+};
+
+static void workerUnref(struct adapter_worker *w)
+{
+	if (g_atomic_int_dec_and_test(&w->refcount)) {
+		g_async_queue_unref(w->queue);
+		free(w);
+	}
+}
+
+static gboolean controllerTypesChanged(gpointer data)
+{
+	struct controller_types_notification *n = data;
+	struct adapter_worker *w = n->worker;
+	int i;
+
+	if (!w->stopped) {
+		for (i=0; i<MAX_CONTROLLER_TYPES; i++) {
+			w->app->controller_type[i] = n->controller_type[i];
+		}
+		updateControllerTypes(w->app);
+	}
+
+	workerUnref(w);
+	free(n);
+
+	return FALSE;
+}
+
+static void pollControllerTypes(struct adapter_worker *w)
+{
+	struct controller_types_notification *n;
+	int types[MAX_CONTROLLER_TYPES];
+	int i, changed = 0;
+
+	for (i=0; i<MAX_CONTROLLER_TYPES; i++) {
+		types[i] = rnt_getControllerType(w->hdl, i);
+		if (types[i] != w->controller_type[i]) {
+			w->controller_type[i] = types[i];
+			changed = 1;
+		}
+	}
+
+	if (!changed)
+		return;
+
+	n = malloc(sizeof(struct controller_types_notification));
+	if (!n) {
+		perror("malloc");
+		return;
+	}
+	n->worker = w;
+	for (i=0; i<MAX_CONTROLLER_TYPES; i++) {
+		n->controller_type[i] = types[i];
+	}
+
+	g_atomic_int_inc(&w->refcount);
+	gdk_threads_add_idle(controllerTypesChanged, n);
+}
+
+static gboolean requestDone(gpointer data)
+{
+	struct adapter_request *rq = data;
+
+	rq->done(rq->result, rq->done_data);
+	workerUnref(rq->worker);
+	free(rq);
+
+	return FALSE;
+}
+
+static gpointer workerThread(gpointer data)
+{
+	struct adapter_worker *w = data;
+	struct adapter_request *rq;
+	gint64 now, next_poll;
+
+	next_poll = g_get_monotonic_time();
+
+	while (1) {
+		now = g_get_monotonic_time();
+		if (now >= next_poll) {
+			if (!g_atomic_int_get(&w->app->inhibit_periodic_updates)) {
+				pollControllerTypes(w);
+			}
+			next_poll = now + CONTROLLER_POLL_INTERVAL_US;
+		}
+
+		rq = g_async_queue_timeout_pop(w->queue, next_poll - now);
+		if (!rq)
+			continue;
+
+		switch (rq->type)
+		{
+			case RQ_STOP:
+				free(rq);
+				return NULL;
+
+			case RQ_REFRESH:
+				next_poll = 0;
+				free(rq);
+				break;
+
+			case RQ_JOB:
+				rq->result = rq->func(w->hdl, rq->data);
+				if (rq->done) {
+					gdk_threads_add_idle(requestDone, rq);
+				} else {
+					workerUnref(w);
+					free(rq);
+				}
+				break;
+		}
+	}
+
+	return NULL;
+}
+
+static void pushRequest(struct adapter_worker *w, int type)
+{
+	struct adapter_request *rq;
+
+	rq = calloc(1, sizeof(struct adapter_request));
+	if (!rq) {
+		perror("calloc");
+		return;
+	}
+	rq->type = type;
+	g_async_queue_push(w->queue, rq);
+}
+
+int adapter_worker_start(struct application *app)
+{
+	struct adapter_worker *w;
+	int i;
+
+	if (app->worker || !app->current_adapter_handle)
+		return -1;
+
+	w = calloc(1, sizeof(struct adapter_worker));
+	if (!w) {
+		perror("calloc");
+		return -1;
+	}
+
+	w->app = app;
+	w->hdl = app->current_adapter_handle;
+	w->queue = g_async_queue_new();
+	w->refcount = 1;
+	// Force a first notification
+	for (i=0; i<MAX_CONTROLLER_TYPES; i++) {
+		w->controller_type[i] = -1;
+		app->controller_type[i] = CTL_TYPE_NONE;
+	}
+
+	w->thread = g_thread_new("adapter_io", workerThread, w);
+	app->worker = w;
+
+	return 0;
+}
+
+void adapter_worker_stop(struct application *app)
+{
+	struct adapter_worker *w = app->worker;
+
+	if (!w)
+		return;
+
+	/* Jobs already queued are completed first */
+	pushRequest(w, RQ_STOP);
+	g_thread_join(w->thread);
+
+	w->stopped = 1;
+	app->worker = NULL;
+	workerUnref(w);
+}
+
+int adapter_worker_submit(struct application *app, adapter_job_func func, void *data, adapter_done_func done, void *done_data)
+{
+	struct adapter_worker *w = app->worker;
+	struct adapter_request *rq;
+
+	if (!w) {
+		int res = func(app->current_adapter_handle, data);
+		if (done) {
+			done(res, done_data);
+		}
+		return 0;
+	}
+
+	rq = calloc(1, sizeof(struct adapter_request));
+	if (!rq) {
+		perror("calloc");
+		return -1;
+	}
+	rq->type = RQ_JOB;
+	rq->worker = w;
+	rq->func = func;
+	rq->data = data;
+	rq->done = done;
+	rq->done_data = done_data;
+
+	g_atomic_int_inc(&w->refcount);
+	g_async_queue_push(w->queue, rq);
+
+	return 0;
+}
+
+struct sync_call {
+	GMainLoop *loop;
+	int result;
+};
+
+static void syncCallDone(int result, void *data)
+{
+	struct sync_call *call = data;
+
+	call->result = result;
+	g_main_loop_quit(call->loop);
+}
+
+int adapter_worker_call(struct application *app, adapter_job_func func, void *data)
+{
+	struct sync_call call;
+
+	if (!app->worker) {
+		return func(app->current_adapter_handle, data);
+	}
+
+	call.loop = g_main_loop_new(NULL, FALSE);
+	call.result = -1;
+
+	if (0 == adapter_worker_submit(app, func, data, syncCallDone, &call)) {
+		g_main_loop_run(call.loop);
+	}
+	g_main_loop_unref(call.loop);
+
+	return call.result;
+}
+
+void adapter_worker_refresh(struct application *app)
+{
+	if (app->worker) {
+		pushRequest(app->worker, RQ_REFRESH);
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef _gui_adapter_worker_h__
+#define _gui_adapter_worker_h__
+
+#include <glib.h>
+#include "raphnetadapter.h"
+
+struct application;
+struct adapter_worker;
+
+/** \brief A job to run on the adapter I/O thread. Must not touch GTK. */
+typedef int (*adapter_job_func)(rnt_hdl_t hdl, void *data);
+/** \brief Called from the GTK main loop with the value returned by the job. */
+typedef void (*adapter_done_func)(int result, void *data);
+
+/** \brief Start the I/O thread for app->current_adapter_handle
+ *
+ * The thread polls the controller types every second (unless
+ * app->inhibit_periodic_updates is set) and calls updateControllerTypes()
+ * from the main loop when they change.
+ */
+int adapter_worker_start(struct application *app);
+
+/** \brief Stop the I/O thread. Must be done before closing or replacing the adapter handle. */
+void adapter_worker_stop(struct application *app);
+
+/** \brief Queue a job. done (may be NULL) is called from the main loop once it has run.
+ * \return 0 if the job was queued, -1 otherwise (done will not be called) */
+int adapter_worker_submit(struct application *app, adapter_job_func func, void *data, adapter_done_func done, void *done_data);
+
+/** \brief Run a job on the I/O thread and return its result
+ *
+ * The main loop keeps running (redraws, dialogs, cancel buttons) until
+ * the job is done. Without a worker, the job is simply called.
+ */
+int adapter_worker_call(struct application *app, adapter_job_func func, void *data);
+
+/** \brief Poll the controller types as soon as the I/O thread is idle */
+void adapter_worker_refresh(struct application *app);
+
+#endif // _gui_adapter_worker_h__
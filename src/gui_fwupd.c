@@ -20,6 +20,7 @@ static void update_preview_cb(GtkFileChooser *chooser, gpointer data)
 	char *full_filename, *path, *listfile, *filename, *filename_lowercase;
 	GET_UI_ELEMENT(GtkLabel, lbl_firmware_preview);
 	GKeyFile *kfile;
+	const struct fwcatalog_entry *entry;
 	int ok = 0;
 
 	printf("Update preview callback\n");
@@ -28,6 +29,21 @@ static void update_preview_cb(GtkFileChooser *chooser, gpointer data)
 	if (!full_filename)
 		return;
 
+	// Firmwares from the firmwares directory are in the catalog
+	entry = fwcatalog_findByPath(app->fwcatalog, full_filename);
+	if (entry && entry->version[0]) {
+		gchar *preview;
+
+		preview = g_strdup_printf("Version: %s\nDate: %s\nRelease notes:\n\n%s\n",
+					entry->version, entry->date, entry->notes ? entry->notes : "");
+		gtk_label_set_text(lbl_firmware_preview, preview);
+		gtk_file_chooser_set_preview_widget_active(chooser, 1);
+
+		g_free(preview);
+		g_free(full_filename);
+		return;
+	}
+
 	filename = g_path_get_basename(full_filename);
 	filename_lowercase = g_ascii_strdown(filename, -1);
 
@@ -75,25 +91,16 @@ static void update_preview_cb(GtkFileChooser *chooser, gpointer data)
 
 void fwupd_firmwareFolderShortcutAndSet(GtkFileChooser *chooser, struct application *app, const char *sig)
 {
-	const char *locations[] = {
-		"firmwares", // For windows installations
-		"../firmwares", // For linux compiled and run-in-place build
-		NULL
-	};
 	const char *basepath = NULL;
 	char adap_sig[64];
-	int i;
 	gchar *firmware_directory;
 	GET_UI_ELEMENT(GtkLabel, lbl_firmware_preview);
 
 	printf("Adding firmwares shortcut...\n");
 
-	/* First locate the directory where firmwares are kept */
-	for (i=0; locations[i]; i++) {
-		if (g_file_test(locations[i], G_FILE_TEST_EXISTS | G_FILE_TEST_IS_DIR)) {
-			basepath = locations[i];
-			break;
-		}
+	/* The directory where firmwares are kept was located when building the catalog */
+	if (app->fwcatalog) {
+		basepath = app->fwcatalog->basedir;
 	}
 
 	// None of the base directories were found. Give up.
@@ -383,6 +390,8 @@ G_MODULE_EXPORT void recover_usbadapter_firmware(GtkWidget *w, gpointer data)
 		updatelog_append("Signature OK\n");
 #endif
 
+		// The update thread reopens the adapter. The I/O thread must not use the old handle.
+		adapter_worker_stop(app);
 		res = update_progress_dialog_run(app, mainWindow, basename, gcn64usb_updateFunc);
 #if 0
 		/* Prepare the update dialog widgets... */
@@ -410,6 +419,7 @@ G_MODULE_EXPORT void recover_usbadapter_firmware(GtkWidget *w, gpointer data)
 		updatelog_append("Update dialog done\n");
 
 		rebuild_device_list_store(data, NULL);
+		adapter_worker_start(app);
 		syncGuiToCurrentAdapter(app);
 		app->inhibit_periodic_updates = 0;
 	}
@@ -494,7 +504,7 @@ G_MODULE_EXPORT void update_usbadapter_firmware(GtkWidget *w, gpointer data)
 		updatelog_appendln("Selected file: %s", filename);
 
 		updatelog_append("Checking file for signature...\n");
-		if (!check_ihex_for_signature(filename, adap_sig)) {
+		if (!fwcatalog_checkSignature(app->fwcatalog, filename, adap_sig)) {
 			const char *errstr = "Signature not found - This file is invalid or not meant for this adapter";
 			errorPopup(app, errstr);
 			updatelog_appendln(errstr);
@@ -510,6 +520,8 @@ G_MODULE_EXPORT void update_usbadapter_firmware(GtkWidget *w, gpointer data)
 			app->at90usb1287 = 0;
 		}
 
+		// The update thread reopens the adapter. The I/O thread must not use the old handle.
+		adapter_worker_stop(app);
 		res = update_progress_dialog_run(app, mainWindow, basename, gcn64usb_updateFunc);
 #if 0
 		/* Prepare the update dialog widgets... */
@@ -537,6 +549,7 @@ G_MODULE_EXPORT void update_usbadapter_firmware(GtkWidget *w, gpointer data)
 		updatelog_append("Update dialog done\n");
 
 		rebuild_device_list_store(data, NULL);
+		adapter_worker_start(app);
 		syncGuiToCurrentAdapter(app);
 		app->inhibit_periodic_updates = 0;
 	}
@@ -138,7 +138,7 @@ G_MODULE_EXPORT void gc2n64_manager_upgrade(GtkWidget *win, gpointer data)
 		updatelog_appendln("Selected file: %s", filename);
 
 		//if (!check_ihex_for_signature(filename, "41d938a8-6f8a-11e5-a45e-001bfca3c593")) {
-		if (!check_ihex_for_signature(filename, sig)) {
+		if (!fwcatalog_checkSignature(app->fwcatalog, filename, sig)) {
 			const char *errstr = "Signature not found - This file is invalid or not meant for this adapter";
 			errorPopup(app, errstr);
 			updatelog_appendln(errstr);
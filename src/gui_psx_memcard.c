@@ -5,6 +5,70 @@
 #include "gui_psx_memcard.h"
 #include "uiio_gtk.h"
 #include "psxlib.h"
+#include "psxmc_fs.h"
+
+/* Memory card transfers run on the adapter I/O thread */
+struct psx_job {
+	struct psx_memorycard *mc_data;
+	struct psxmc_fs *fs;
+	uint16_t mask;
+	uiio *u;
+};
+
+static int readCard_job(rnt_hdl_t hdl, void *data)
+{
+	struct psx_job *job = data;
+	int res;
+
+	rnt_suspendPolling(hdl, 1);
+	res = psxlib_readMemoryCard(hdl, 0, job->mc_data, job->u);
+	rnt_suspendPolling(hdl, 0);
+
+	return res;
+}
+
+static int writeCard_job(rnt_hdl_t hdl, void *data)
+{
+	struct psx_job *job = data;
+	int res;
+
+	rnt_suspendPolling(hdl, 1);
+	res = psxlib_writeMemoryCard(hdl, 0, job->mc_data, job->u);
+	rnt_suspendPolling(hdl, 0);
+
+	return res;
+}
+
+static int loadTitles_job(rnt_hdl_t hdl, void *data)
+{
+	struct psx_job *job = data;
+
+	return psxmc_loadTitles(hdl, 0, job->fs, job->u);
+}
+
+static int loadBlocks_job(rnt_hdl_t hdl, void *data)
+{
+	struct psx_job *job = data;
+
+	return psxmc_loadBlocks(hdl, 0, job->fs, job->mask, job->u);
+}
+
+static int commit_job(rnt_hdl_t hdl, void *data)
+{
+	struct psx_job *job = data;
+
+	return psxmc_commit(hdl, 0, job->fs, job->u);
+}
+
+static int defragment_job(rnt_hdl_t hdl, void *data)
+{
+	struct psx_job *job = data;
+	int res;
+
+	res = psxmc_defragment(hdl, 0, job->fs, job->u);
+
+	return res < 0 ? res : 0;
+}
 
 G_MODULE_EXPORT void read_psx_memcard(GtkWidget *wid, gpointer data)
 {
@@ -16,6 +80,7 @@ G_MODULE_EXPORT void read_psx_memcard(GtkWidget *wid, gpointer data)
 	GET_UI_ELEMENT(GtkFileFilter, psxcard_raw_filter);
 	gint res;
 	struct psx_memorycard *mc_data;
+	struct psx_job job = { .u = u };
 
 	if (!app->current_adapter_handle)
 		return;
@@ -27,9 +92,8 @@ G_MODULE_EXPORT void read_psx_memcard(GtkWidget *wid, gpointer data)
 	}
 
 	app->inhibit_periodic_updates = 1;
-	rnt_suspendPolling(app->current_adapter_handle, 1);
-	res = psxlib_readMemoryCard(app->current_adapter_handle, 0, mc_data, u);
-	rnt_suspendPolling(app->current_adapter_handle, 0);
+	job.mc_data = mc_data;
+	res = adapter_worker_call(app, readCard_job, &job);
 	app->inhibit_periodic_updates = 0;
 
 	if (res < 0) {
@@ -81,6 +145,7 @@ G_MODULE_EXPORT void write_psx_memcard(GtkWidget *wid, gpointer data)
 	GET_UI_ELEMENT(GtkFileFilter, psxcard_raw_filter);
 	gint res;
 	struct psx_memorycard *mc_data;
+	struct psx_job job = { .u = u };
 
 	if (!app->current_adapter_handle)
 		return;
@@ -133,14 +198,13 @@ G_MODULE_EXPORT void write_psx_memcard(GtkWidget *wid, gpointer data)
 
 		if (res == GTK_RESPONSE_ACCEPT) {
 			app->inhibit_periodic_updates = 1;
-			rnt_suspendPolling(app->current_adapter_handle, 1);
-			res = psxlib_writeMemoryCard(app->current_adapter_handle, 0, mc_data, u);
+			job.mc_data = mc_data;
+			res = adapter_worker_call(app, writeCard_job, &job);
 			if (res < 0) {
 				if (res != PSXLIB_ERR_USER_CANCELLED) {
 					u->error(psxlib_getErrorString(res));
 				}
 			}
-			rnt_suspendPolling(app->current_adapter_handle, 0);
 			app->inhibit_periodic_updates = 0;
 		}
 	}
@@ -149,3 +213,215 @@ G_MODULE_EXPORT void write_psx_memcard(GtkWidget *wid, gpointer data)
 	g_free(mc_data);
 
 }
+
+#define RESPONSE_EXTRACT	1
+#define RESPONSE_INSERT		2
+#define RESPONSE_DELETE		3
+#define RESPONSE_DEFRAG		4
+
+static void psx_saves_sync_store(struct psxmc_fs *fs, GtkListStore *store, GtkLabel *status)
+{
+	struct psxmc_save saves[PSXLIB_MC_N_DIR_FRAMES];
+	GtkTreeIter iter;
+	char buf[64];
+	int i, n;
+
+	gtk_list_store_clear(store);
+
+	n = psxmc_listSaves(fs, saves, PSXLIB_MC_N_DIR_FRAMES);
+	for (i=0; i<n; i++) {
+		gtk_list_store_append(store, &iter);
+		gtk_list_store_set(store, &iter,
+							0, saves[i].first_block,
+							1, saves[i].filename,
+							2, saves[i].n_blocks,
+							3, saves[i].title,
+							-1);
+	}
+
+	snprintf(buf, sizeof(buf), "Free blocks: %d / %d", psxmc_getFreeBlocks(fs), PSXLIB_MC_N_DIR_FRAMES);
+	gtk_label_set_text(status, buf);
+}
+
+static int psx_saves_get_selection(GtkTreeView *view)
+{
+	GtkTreeSelection *sel = gtk_tree_view_get_selection(view);
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+	gint block;
+
+	if (!gtk_tree_selection_get_selected(sel, &model, &iter))
+		return -1;
+
+	gtk_tree_model_get(model, &iter, 0, &block, -1);
+
+	return block;
+}
+
+static char *psx_saves_choose_file(struct application *app, GtkWindow *parent, GtkFileChooserAction action, const char *current_name)
+{
+	GET_UI_ELEMENT(GtkFileFilter, psx_save_filter);
+	GtkWidget *dialog;
+	char *filename = NULL;
+
+	dialog = gtk_file_chooser_dialog_new(action == GTK_FILE_CHOOSER_ACTION_SAVE ? "Save file" : "Load file",
+										parent,
+										action,
+										"_Cancel",
+										GTK_RESPONSE_CANCEL,
+										action == GTK_FILE_CHOOSER_ACTION_SAVE ? "_Save" : "_Open",
+										GTK_RESPONSE_ACCEPT,
+										NULL);
+	gtk_file_chooser_set_filter(GTK_FILE_CHOOSER(dialog), psx_save_filter);
+	if (current_name) {
+		gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), current_name);
+	}
+
+	if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+		filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+	}
+	gtk_widget_destroy(dialog);
+
+	return filename;
+}
+
+/* Save-level access to the memory card. Only the directory and title frames are
+ * read when the dialog opens. Other sectors are read and written as needed. */
+G_MODULE_EXPORT void manage_psx_memcard_saves(GtkWidget *wid, gpointer data)
+{
+	struct application *app = data;
+	uiio *u = getUIIO_gtk(NULL, app->mainwindow);
+	rnt_hdl_t hdl = app->current_adapter_handle;
+	struct psxmc_fs *fs;
+	struct psxmc_save save;
+	GtkWidget *dialog, *content, *view, *scroll, *status;
+	GtkListStore *store;
+	GtkCellRenderer *renderer;
+	char *filename;
+	char namebuf[PSXMC_FILENAME_MAXCHARS + 5];
+	struct psx_job job = { .u = u };
+	gint response;
+	int block, res;
+
+	if (!hdl)
+		return;
+
+	fs = g_malloc0(sizeof(struct psxmc_fs));
+	if (!fs) {
+		u->perror("Could not allocate memory for card contents");
+		return;
+	}
+	psxmc_init(fs);
+	job.fs = fs;
+
+	app->inhibit_periodic_updates = 1;
+	rnt_suspendPolling(hdl, 1);
+
+	res = adapter_worker_call(app, loadTitles_job, &job);
+	if (res < 0) {
+		if (res != PSXLIB_ERR_USER_CANCELLED) {
+			u->error(psxlib_getErrorString(res));
+		}
+		goto done;
+	}
+
+	dialog = gtk_dialog_new_with_buttons("PSX memory card saves",
+										app->mainwindow,
+										GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+										"_Extract...", RESPONSE_EXTRACT,
+										"_Insert...", RESPONSE_INSERT,
+										"_Delete", RESPONSE_DELETE,
+										"De_fragment", RESPONSE_DEFRAG,
+										"_Close", GTK_RESPONSE_CLOSE,
+										NULL);
+	gtk_window_set_default_size(GTK_WINDOW(dialog), 600, 400);
+
+	store = gtk_list_store_new(4, G_TYPE_INT, G_TYPE_STRING, G_TYPE_INT, G_TYPE_STRING);
+	view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+	g_object_unref(store);
+
+	renderer = gtk_cell_renderer_text_new();
+	gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(view), -1, "Block", renderer, "text", 0, NULL);
+	gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(view), -1, "Filename", renderer, "text", 1, NULL);
+	gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(view), -1, "Blocks", renderer, "text", 2, NULL);
+	gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(view), -1, "Title", renderer, "text", 3, NULL);
+
+	scroll = gtk_scrolled_window_new(NULL, NULL);
+	gtk_container_add(GTK_CONTAINER(scroll), view);
+	status = gtk_label_new("");
+
+	content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+	gtk_box_pack_start(GTK_BOX(content), scroll, TRUE, TRUE, 0);
+	gtk_box_pack_start(GTK_BOX(content), status, FALSE, FALSE, 0);
+	gtk_widget_show_all(dialog);
+
+	psx_saves_sync_store(fs, store, GTK_LABEL(status));
+
+	while (1) {
+		response = gtk_dialog_run(GTK_DIALOG(dialog));
+		if (response < RESPONSE_EXTRACT || response > RESPONSE_DEFRAG)
+			break;
+
+		res = 0;
+		block = psx_saves_get_selection(GTK_TREE_VIEW(view));
+
+		switch (response)
+		{
+			case RESPONSE_EXTRACT:
+				if (block < 0 || psxmc_getSave(fs, block, &save))
+					break;
+				snprintf(namebuf, sizeof(namebuf), "%s.mcs", save.filename);
+				filename = psx_saves_choose_file(app, GTK_WINDOW(dialog), GTK_FILE_CHOOSER_ACTION_SAVE, namebuf);
+				if (!filename)
+					break;
+				res = psxlib_getSaveBlocks(&fs->card, block, &job.mask);
+				if (res == 0) {
+					res = adapter_worker_call(app, loadBlocks_job, &job);
+				}
+				if (res == 0) {
+					res = psxmc_exportSave(fs, block, filename);
+				}
+				g_free(filename);
+				break;
+
+			case RESPONSE_INSERT:
+				filename = psx_saves_choose_file(app, GTK_WINDOW(dialog), GTK_FILE_CHOOSER_ACTION_OPEN, NULL);
+				if (!filename)
+					break;
+				res = psxmc_importSave(fs, filename, NULL);
+				if (res == 0) {
+					res = adapter_worker_call(app, commit_job, &job);
+				}
+				g_free(filename);
+				break;
+
+			case RESPONSE_DELETE:
+				if (block < 0)
+					break;
+				if (UIIO_YES != u->ask(UIIO_NOYES, "Delete the save starting at block %d?", block))
+					break;
+				res = psxmc_deleteSave(fs, block);
+				if (res == 0) {
+					res = adapter_worker_call(app, commit_job, &job);
+				}
+				break;
+
+			case RESPONSE_DEFRAG:
+				res = adapter_worker_call(app, defragment_job, &job);
+				break;
+		}
+
+		if (res < 0 && res != PSXLIB_ERR_USER_CANCELLED) {
+			u->error(psxlib_getErrorString(res));
+		}
+
+		psx_saves_sync_store(fs, store, GTK_LABEL(status));
+	}
+
+	gtk_widget_destroy(dialog);
+
+done:
+	rnt_suspendPolling(hdl, 0);
+	app->inhibit_periodic_updates = 0;
+	g_free(fs);
+}
@@ -7,6 +7,36 @@
 #include "xferpak_tools.h"
 #include "uiio_gtk.h"
 
+/* Cartridge transfers run on the adapter I/O thread */
+struct xferpak_job {
+	xferpak *xpak;
+	struct gbcart_info *cartinfo;
+	unsigned char *mem;
+	const char *filename;
+	uiio *u;
+};
+
+static int readRAM_job(rnt_hdl_t hdl, void *data)
+{
+	struct xferpak_job *job = data;
+
+	return xferpak_gb_readRAM(job->xpak, job->cartinfo, &job->mem);
+}
+
+static int readROM_job(rnt_hdl_t hdl, void *data)
+{
+	struct xferpak_job *job = data;
+
+	return xferpak_gb_readROM(job->xpak, job->cartinfo, &job->mem);
+}
+
+static int writeRAM_job(rnt_hdl_t hdl, void *data)
+{
+	struct xferpak_job *job = data;
+
+	return gcn64lib_xferpak_writeRAM_from_file(hdl, 0, job->filename, 1, job->u);
+}
+
 G_MODULE_EXPORT void gui_xferpak_readram(GtkWidget *win, gpointer data)
 {
 	struct application *app = data;
@@ -18,8 +48,8 @@ G_MODULE_EXPORT void gui_xferpak_readram(GtkWidget *win, gpointer data)
 	GET_UI_ELEMENT(GtkFileFilter, gbram_filter);
 	char namebuf[128];
 	struct gbcart_info cartinfo;
+	struct xferpak_job job = { };
 	gint res;
-	unsigned char *mem;
 	u->caption = "Reading cartridge RAM...";
 
 	if (!app->current_adapter_handle)
@@ -80,7 +110,9 @@ G_MODULE_EXPORT void gui_xferpak_readram(GtkWidget *win, gpointer data)
 		gtk_widget_hide(dialog);
 
 		filename = gtk_file_chooser_get_filename(chooser);
-		mem_size = xferpak_gb_readRAM(xpak, &cartinfo, &mem);
+		job.xpak = xpak;
+		job.cartinfo = &cartinfo;
+		mem_size = adapter_worker_call(app, readRAM_job, &job);
 		if (mem_size < 0) {
 			if (mem_size != XFERPAK_USER_CANCELLED) {
 				u->error(xferpak_errStr(mem_size));
@@ -90,12 +122,12 @@ G_MODULE_EXPORT void gui_xferpak_readram(GtkWidget *win, gpointer data)
 			fptr = fopen(filename, "wb");
 			if (fptr) {
 				printf("Writing to '%s'\n", filename);
-				fwrite(mem, mem_size, 1, fptr);
+				fwrite(job.mem, mem_size, 1, fptr);
 				fclose(fptr);
 			} else {
 				u->perror(filename);
 			}
-			free(mem);
+			free(job.mem);
 		}
 		g_free(filename);
 	}
@@ -118,8 +150,8 @@ G_MODULE_EXPORT void gui_xferpak_readrom(GtkWidget *win, gpointer data)
 	GET_UI_ELEMENT(GtkFileFilter, gbrom_filter);
 	char namebuf[128];
 	struct gbcart_info cartinfo;
+	struct xferpak_job job = { };
 	gint res;
-	unsigned char *mem;
 	u->caption = "Reading cartridge ROM...";
 
 	if (!app->current_adapter_handle)
@@ -170,7 +202,9 @@ G_MODULE_EXPORT void gui_xferpak_readrom(GtkWidget *win, gpointer data)
 		gtk_widget_hide(dialog);
 
 		filename = gtk_file_chooser_get_filename(chooser);
-		mem_size = xferpak_gb_readROM(xpak, &cartinfo, &mem);
+		job.xpak = xpak;
+		job.cartinfo = &cartinfo;
+		mem_size = adapter_worker_call(app, readROM_job, &job);
 		if (mem_size < 0) {
 			if (mem_size != XFERPAK_USER_CANCELLED) {
 				u->error(xferpak_errStr(mem_size));
@@ -180,12 +214,12 @@ G_MODULE_EXPORT void gui_xferpak_readrom(GtkWidget *win, gpointer data)
 			fptr = fopen(filename, "wb");
 			if (fptr) {
 				printf("Writing to '%s'\n", filename);
-				fwrite(mem, mem_size, 1, fptr);
+				fwrite(job.mem, mem_size, 1, fptr);
 				fclose(fptr);
 			} else {
 				u->perror(filename);
 			}
-			free(mem);
+			free(job.mem);
 		}
 		g_free(filename);
 	}
@@ -207,6 +241,7 @@ G_MODULE_EXPORT void gui_xferpak_writeram(GtkWidget *win, gpointer data)
 	GtkFileChooserAction action = GTK_FILE_CHOOSER_ACTION_OPEN;
 	GET_UI_ELEMENT(GtkFileFilter, gbram_filter);
 	struct gbcart_info cartinfo;
+	struct xferpak_job job = { };
 	gint res;
 	u->caption = "Writing cartridge RAM...";
 
@@ -264,7 +299,9 @@ G_MODULE_EXPORT void gui_xferpak_writeram(GtkWidget *win, gpointer data)
 		gtk_widget_hide(dialog);
 
 		filename = gtk_file_chooser_get_filename(chooser);
-		res = gcn64lib_xferpak_writeRAM_from_file(app->current_adapter_handle, 0, filename, 1, u);
+		job.filename = filename;
+		job.u = u;
+		res = adapter_worker_call(app, writeRAM_job, &job);
 		g_free(filename);
 	}
 	gtk_widget_destroy(dialog);
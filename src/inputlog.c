@@ -0,0 +1,813 @@
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "inputlog.h"
+#include "sipoll.h"
+#include "gcn64_protocol.h"
+#include "wusbmotelib.h"
+
+#define LOG_MAGIC		"RNTILOG"
+#define LOG_VERSION		1
+#define INDEX_MAGIC		"RNTIIDX"
+#define HEADER_SIZE		16
+#define TRAILER_SIZE	16
+#define MAX_RUN			255
+#define IO_BUFFER_SIZE	(1024*1024)
+
+#define TAG_SOURCE	0x01
+#define TAG_SYNC	0x02
+#define TAG_KEY		0x03
+#define TAG_DELTA	0x04
+#define TAG_REPEAT	0x05
+#define TAG_INDEX	0x06
+
+struct source_state {
+	struct inputlog_source info;
+	uint64_t last_t;
+	int64_t last_dt;
+	int len;
+	uint8_t data[INPUTLOG_MAX_FRAME];
+	int need_key; // Writing: the next frame must be a KEY. Reading: no KEY seen yet.
+	// Writing: repeats not written yet. Reading: repeats left in the current REPEAT record.
+	int run;
+	int64_t run_dd[MAX_RUN];
+};
+
+struct index_entry {
+	uint64_t offset, timestamp;
+};
+
+struct inputlog {
+	FILE *fptr;
+	char *iobuf;
+	int writing, error;
+	uint64_t start_us; // Writing: monotonic time of timestamp 0
+	uint64_t start_time;
+	int n_sources;
+	struct source_state sources[INPUTLOG_MAX_SOURCES];
+	uint64_t sync_t;
+	int synced;
+	uint64_t offset; // Writing: bytes written
+	struct index_entry *index;
+	int n_index, alloc_index;
+	int index_complete; // Reading: the index was loaded from the file
+	uint64_t records_start;
+	int repeat_source; // Reading: source of the current REPEAT record, or -1
+};
+
+static const char *source_names[] = {
+	[INPUTLOG_SRC_N64] = "n64",
+	[INPUTLOG_SRC_GC] = "gc",
+	[INPUTLOG_SRC_PSX] = "psx",
+	[INPUTLOG_SRC_WII] = "wii",
+	[INPUTLOG_SRC_DC] = "dc",
+	[INPUTLOG_SRC_DB9] = "db9",
+};
+
+const char *inputlog_sourceName(int type)
+{
+	if (type <= 0 || type >= sizeof(source_names)/sizeof(source_names[0]))
+		return "unknown";
+
+	return source_names[type];
+}
+
+static uint64_t zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static void putByte(struct inputlog *log, uint8_t b)
+{
+	if (putc(b, log->fptr) == EOF) {
+		log->error = 1;
+	}
+	log->offset++;
+}
+
+static void putBytes(struct inputlog *log, const uint8_t *data, int len)
+{
+	if (fwrite(data, len, 1, log->fptr) != 1) {
+		log->error = 1;
+	}
+	log->offset += len;
+}
+
+static void putVarint(struct inputlog *log, uint64_t v)
+{
+	while (v >= 0x80) {
+		putByte(log, (v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	putByte(log, v);
+}
+
+static void putLE64(struct inputlog *log, uint64_t v)
+{
+	int i;
+
+	for (i=0; i<8; i++) {
+		putByte(log, v >> (i*8));
+	}
+}
+
+static int getByte(struct inputlog *log, uint8_t *b)
+{
+	int c = getc(log->fptr);
+
+	if (c == EOF)
+		return -1;
+
+	*b = c;
+	return 0;
+}
+
+static int getVarint(struct inputlog *log, uint64_t *v)
+{
+	uint8_t b;
+	int shift;
+
+	*v = 0;
+	for (shift = 0; shift < 64; shift += 7) {
+		if (getByte(log, &b))
+			return -1;
+		*v |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return 0;
+	}
+
+	return -1;
+}
+
+static uint64_t leToU64(const uint8_t *buf)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i=7; i>=0; i--) {
+		v = v << 8 | buf[i];
+	}
+
+	return v;
+}
+
+static int addIndexEntry(struct inputlog *log, uint64_t offset, uint64_t timestamp)
+{
+	struct index_entry *index;
+
+	if (log->n_index && log->index[log->n_index - 1].offset >= offset)
+		return 0; // Already known (reading a log without index)
+
+	if (log->n_index >= log->alloc_index) {
+		index = realloc(log->index, (log->alloc_index + 1024) * sizeof(struct index_entry));
+		if (!index) {
+			perror("realloc");
+			return -1;
+		}
+		log->index = index;
+		log->alloc_index += 1024;
+	}
+	log->index[log->n_index].offset = offset;
+	log->index[log->n_index].timestamp = timestamp;
+	log->n_index++;
+
+	return 0;
+}
+
+static struct inputlog *allocLog(const char *filename, const char *mode)
+{
+	struct inputlog *log;
+
+	log = calloc(1, sizeof(struct inputlog));
+	if (!log) {
+		perror("calloc");
+		return NULL;
+	}
+
+	log->fptr = fopen(filename, mode);
+	if (!log->fptr) {
+		perror(filename);
+		free(log);
+		return NULL;
+	}
+
+	log->iobuf = malloc(IO_BUFFER_SIZE);
+	if (log->iobuf) {
+		setvbuf(log->fptr, log->iobuf, _IOFBF, IO_BUFFER_SIZE);
+	}
+	log->repeat_source = -1;
+
+	return log;
+}
+
+static void freeLog(struct inputlog *log)
+{
+	fclose(log->fptr);
+	free(log->iobuf);
+	free(log->index);
+	free(log);
+}
+
+struct inputlog *inputlog_create(const char *filename, uint64_t start_us)
+{
+	struct inputlog *log;
+
+	log = allocLog(filename, "wb");
+	if (!log)
+		return NULL;
+
+	log->writing = 1;
+	log->start_us = start_us;
+	log->start_time = time(NULL);
+
+	putBytes(log, (const uint8_t*)LOG_MAGIC, 7);
+	putByte(log, LOG_VERSION);
+	putLE64(log, log->start_time);
+
+	if (log->error) {
+		perror(filename);
+		freeLog(log);
+		return NULL;
+	}
+
+	return log;
+}
+
+int inputlog_addSource(struct inputlog *log, int type, int chn, int flags, int param)
+{
+	struct source_state *s;
+
+	if (log->synced || log->n_sources >= INPUTLOG_MAX_SOURCES) {
+		fprintf(stderr, "inputlog: Cannot add a source now\n");
+		return -1;
+	}
+
+	s = &log->sources[log->n_sources];
+	s->info.type = type;
+	s->info.chn = chn;
+	s->info.flags = flags;
+	s->info.param = param;
+
+	putByte(log, TAG_SOURCE);
+	putByte(log, log->n_sources);
+	putByte(log, type);
+	putByte(log, chn);
+	putByte(log, flags);
+	putVarint(log, param);
+
+	return log->error ? -1 : log->n_sources++;
+}
+
+static void flushRun(struct inputlog *log, int id)
+{
+	struct source_state *s = &log->sources[id];
+	int i;
+
+	if (!s->run)
+		return;
+
+	putByte(log, TAG_REPEAT);
+	putByte(log, id);
+	putByte(log, s->run);
+	for (i=0; i<s->run; i++) {
+		putVarint(log, zigzag(s->run_dd[i]));
+	}
+	s->run = 0;
+}
+
+static void writeSync(struct inputlog *log, uint64_t t)
+{
+	int i;
+
+	for (i=0; i<log->n_sources; i++) {
+		flushRun(log, i);
+		log->sources[i].need_key = 1;
+	}
+
+	if (addIndexEntry(log, log->offset, t)) {
+		log->error = 1;
+	}
+	putByte(log, TAG_SYNC);
+	putVarint(log, t);
+	log->sync_t = t;
+	log->synced = 1;
+
+	// So an interrupted recording loses at most one sync interval
+	fflush(log->fptr);
+}
+
+int inputlog_write(struct inputlog *log, int source, uint64_t timestamp, const uint8_t *data, int len)
+{
+	struct source_state *s;
+	uint64_t t, dt;
+	uint8_t bitmap[INPUTLOG_MAX_FRAME / 8];
+	int i;
+
+	if (!log->writing || source < 0 || source >= log->n_sources || len < 1 || len > INPUTLOG_MAX_FRAME) {
+		return -1;
+	}
+	s = &log->sources[source];
+
+	t = timestamp > log->start_us ? timestamp - log->start_us : 0;
+	if (!log->synced || t >= log->sync_t + INPUTLOG_SYNC_INTERVAL_US) {
+		writeSync(log, t);
+	}
+	// Frames acquired before the sync (eg: by another thread) are moved to the sync
+	if (t < log->sync_t)
+		t = log->sync_t;
+	if (t < s->last_t)
+		t = s->last_t;
+	dt = t - s->last_t;
+
+	if (s->need_key || len != s->len) {
+		flushRun(log, source);
+		putByte(log, TAG_KEY);
+		putByte(log, source);
+		putVarint(log, t - log->sync_t);
+		putByte(log, len);
+		putBytes(log, data, len);
+		s->need_key = 0;
+		s->last_dt = 0;
+	}
+	else if (!memcmp(data, s->data, len)) {
+		if (s->run == MAX_RUN) {
+			flushRun(log, source);
+		}
+		s->run_dd[s->run++] = (int64_t)dt - s->last_dt;
+		s->last_dt = dt;
+	}
+	else {
+		flushRun(log, source);
+		memset(bitmap, 0, sizeof(bitmap));
+		for (i=0; i<len; i++) {
+			if (data[i] != s->data[i]) {
+				bitmap[i/8] |= 1 << (i%8);
+			}
+		}
+		putByte(log, TAG_DELTA);
+		putByte(log, source);
+		putVarint(log, dt);
+		putBytes(log, bitmap, (len + 7) / 8);
+		for (i=0; i<len; i++) {
+			if (data[i] != s->data[i]) {
+				putByte(log, data[i]);
+			}
+		}
+		s->last_dt = dt;
+	}
+
+	s->last_t = t;
+	s->len = len;
+	memcpy(s->data, data, len);
+
+	return log->error ? -1 : 0;
+}
+
+uint64_t inputlog_size(struct inputlog *log)
+{
+	return log->offset;
+}
+
+static int closeWriter(struct inputlog *log)
+{
+	uint64_t index_offset, prev_offset = 0, prev_t = 0;
+	int i;
+
+	for (i=0; i<log->n_sources; i++) {
+		flushRun(log, i);
+	}
+
+	index_offset = log->offset;
+	putByte(log, TAG_INDEX);
+	putVarint(log, log->n_index);
+	for (i=0; i<log->n_index; i++) {
+		putVarint(log, log->index[i].offset - prev_offset);
+		putVarint(log, log->index[i].timestamp - prev_t);
+		prev_offset = log->index[i].offset;
+		prev_t = log->index[i].timestamp;
+	}
+	putLE64(log, index_offset);
+	putBytes(log, (const uint8_t*)INDEX_MAGIC, 8);
+
+	if (fflush(log->fptr)) {
+		log->error = 1;
+	}
+
+	return log->error ? -1 : 0;
+}
+
+/* Load the index at the end of the file. Returns 0 if there is none. */
+static int loadIndex(struct inputlog *log)
+{
+	uint8_t trailer[TRAILER_SIZE], tag;
+	uint64_t count, offset = 0, t = 0, v;
+	int i;
+
+	if (fseeko(log->fptr, -TRAILER_SIZE, SEEK_END))
+		return 0;
+	if (fread(trailer, TRAILER_SIZE, 1, log->fptr) != 1)
+		return 0;
+	if (memcmp(trailer + 8, INDEX_MAGIC, 8))
+		return 0;
+
+	if (fseeko(log->fptr, leToU64(trailer), SEEK_SET))
+		return 0;
+	if (getByte(log, &tag) || tag != TAG_INDEX || getVarint(log, &count))
+		return 0;
+
+	for (i=0; i<count; i++) {
+		if (getVarint(log, &v))
+			return 0;
+		offset += v;
+		if (getVarint(log, &v))
+			return 0;
+		t += v;
+		if (addIndexEntry(log, offset, t))
+			return -1;
+	}
+	log->index_complete = 1;
+
+	return 0;
+}
+
+struct inputlog *inputlog_open(const char *filename)
+{
+	struct inputlog *log;
+	uint8_t header[HEADER_SIZE], b[4];
+	uint64_t param;
+	struct source_state *s;
+	int c;
+
+	log = allocLog(filename, "rb");
+	if (!log)
+		return NULL;
+
+	if (fread(header, HEADER_SIZE, 1, log->fptr) != 1 || memcmp(header, LOG_MAGIC, 7)) {
+		fprintf(stderr, "%s: Not an input log\n", filename);
+		goto error;
+	}
+	if (header[7] != LOG_VERSION) {
+		fprintf(stderr, "%s: Unsupported version %d\n", filename, header[7]);
+		goto error;
+	}
+	log->start_time = leToU64(header + 8);
+
+	if (loadIndex(log)) {
+		goto error;
+	}
+	if (!log->index_complete) {
+		fprintf(stderr, "%s: No index (the recording was interrupted?)\n", filename);
+	}
+
+	fseeko(log->fptr, HEADER_SIZE, SEEK_SET);
+	while ((c = getc(log->fptr)) == TAG_SOURCE) {
+		if (fread(b, 4, 1, log->fptr) != 1 || getVarint(log, &param) ||
+				b[0] != log->n_sources || b[0] >= INPUTLOG_MAX_SOURCES) {
+			fprintf(stderr, "%s: Invalid source\n", filename);
+			goto error;
+		}
+		s = &log->sources[log->n_sources++];
+		s->info.type = b[1];
+		s->info.chn = b[2];
+		s->info.flags = b[3];
+		s->info.param = param;
+		s->need_key = 1;
+	}
+	if (c != EOF) {
+		ungetc(c, log->fptr);
+	}
+	log->records_start = ftello(log->fptr);
+
+	return log;
+
+error:
+	freeLog(log);
+	return NULL;
+}
+
+static void copyFrame(struct inputlog *log, int id, struct inputlog_frame *frame)
+{
+	struct source_state *s = &log->sources[id];
+
+	frame->source = id;
+	frame->timestamp = s->last_t;
+	frame->len = s->len;
+	memcpy(frame->data, s->data, s->len);
+}
+
+static int readKey(struct inputlog *log, struct inputlog_frame *frame)
+{
+	struct source_state *s;
+	uint8_t id, len;
+	uint64_t dt;
+
+	if (getByte(log, &id) || getVarint(log, &dt) || getByte(log, &len))
+		return -1;
+	if (id >= log->n_sources || !len || len > INPUTLOG_MAX_FRAME)
+		return -2;
+
+	s = &log->sources[id];
+	if (fread(s->data, len, 1, log->fptr) != 1)
+		return -1;
+
+	s->len = len;
+	s->last_t = log->sync_t + dt;
+	s->last_dt = 0;
+	s->need_key = 0;
+	copyFrame(log, id, frame);
+
+	return 0;
+}
+
+static int readDelta(struct inputlog *log, struct inputlog_frame *frame)
+{
+	struct source_state *s;
+	uint8_t id, bitmap[INPUTLOG_MAX_FRAME / 8];
+	uint64_t dt;
+	int i;
+
+	if (getByte(log, &id) || getVarint(log, &dt))
+		return -1;
+	if (id >= log->n_sources || log->sources[id].need_key)
+		return -2;
+
+	s = &log->sources[id];
+	if (fread(bitmap, (s->len + 7) / 8, 1, log->fptr) != 1)
+		return -1;
+	for (i=0; i<s->len; i++) {
+		if ((bitmap[i/8] & (1 << (i%8))) && getByte(log, &s->data[i]))
+			return -1;
+	}
+
+	s->last_t += dt;
+	s->last_dt = dt;
+	copyFrame(log, id, frame);
+
+	return 0;
+}
+
+int inputlog_read(struct inputlog *log, struct inputlog_frame *frame)
+{
+	struct source_state *s;
+	uint64_t v;
+	uint8_t id, count;
+	off_t offset = 0;
+	int c, res;
+
+	while (1)
+	{
+		if (log->repeat_source >= 0) {
+			s = &log->sources[log->repeat_source];
+			if (getVarint(log, &v)) {
+				res = -1;
+				break;
+			}
+			s->last_dt += unzigzag(v);
+			s->last_t += s->last_dt;
+			copyFrame(log, log->repeat_source, frame);
+			if (--s->run == 0) {
+				log->repeat_source = -1;
+			}
+			return 1;
+		}
+
+		// Sync points are indexed as they are read when the log has no index
+		if (!log->index_complete) {
+			offset = ftello(log->fptr);
+		}
+
+		c = getc(log->fptr);
+		switch (c)
+		{
+			case EOF:
+			case TAG_INDEX:
+				return 0;
+
+			case TAG_SYNC:
+				if (getVarint(log, &v)) {
+					res = -1;
+					break;
+				}
+				log->sync_t = v;
+				if (!log->index_complete && addIndexEntry(log, offset, v)) {
+					return -1;
+				}
+				continue;
+
+			case TAG_KEY:
+				res = readKey(log, frame);
+				break;
+
+			case TAG_DELTA:
+				res = readDelta(log, frame);
+				break;
+
+			case TAG_REPEAT:
+				if (getByte(log, &id) || getByte(log, &count)) {
+					res = -1;
+					break;
+				}
+				if (id >= log->n_sources || !count || log->sources[id].need_key) {
+					res = -2;
+					break;
+				}
+				log->sources[id].run = count;
+				log->repeat_source = id;
+				continue;
+
+			default:
+				res = -2;
+				break;
+		}
+
+		break;
+	}
+
+	if (res == -1) {
+		// An interrupted recording ends with an incomplete record
+		fprintf(stderr, "inputlog: Incomplete record at the end of the log\n");
+		return 0;
+	}
+	if (res < 0) {
+		fprintf(stderr, "inputlog: Invalid record\n");
+		return -1;
+	}
+
+	return 1;
+}
+
+int inputlog_seek(struct inputlog *log, uint64_t timestamp)
+{
+	struct inputlog_frame frame;
+	uint64_t offset = log->records_start;
+	int i;
+
+	if (log->writing)
+		return -1;
+
+	// Without an index, read until a sync point past the timestamp is found
+	if (!log->index_complete) {
+		while (!log->n_index || log->index[log->n_index - 1].timestamp <= timestamp) {
+			if (inputlog_read(log, &frame) <= 0)
+				break;
+		}
+	}
+
+	for (i=0; i<log->n_index && log->index[i].timestamp <= timestamp; i++) {
+		offset = log->index[i].offset;
+	}
+
+	if (fseeko(log->fptr, offset, SEEK_SET)) {
+		perror("fseek");
+		return -1;
+	}
+
+	log->repeat_source = -1;
+	for (i=0; i<log->n_sources; i++) {
+		log->sources[i].need_key = 1;
+		log->sources[i].run = 0;
+	}
+
+	return 0;
+}
+
+int inputlog_numSources(struct inputlog *log)
+{
+	return log->n_sources;
+}
+
+const struct inputlog_source *inputlog_getSource(struct inputlog *log, int id)
+{
+	if (id < 0 || id >= log->n_sources)
+		return NULL;
+
+	return &log->sources[id].info;
+}
+
+uint64_t inputlog_startTime(struct inputlog *log)
+{
+	return log->start_time;
+}
+
+int inputlog_close(struct inputlog *log)
+{
+	int res = 0;
+
+	if (!log)
+		return 0;
+
+	if (log->writing) {
+		res = closeWriter(log);
+	}
+	freeLog(log);
+
+	return res;
+}
+
+int inputlog_decode(const struct inputlog_source *src, const struct inputlog_frame *frame, struct inputlog_controls *ctl)
+{
+	const uint8_t *d = frame->data;
+	struct sipoll_status st = { };
+	classic_pad_data classic;
+	nunchuk_pad_data nunchuk;
+	int i;
+
+	memset(ctl, 0, sizeof(struct inputlog_controls));
+
+	switch (src->type)
+	{
+		case INPUTLOG_SRC_N64:
+			if (frame->len < N64_GET_STATUS_REPLY_LENGTH)
+				return -1;
+			ctl->buttons = d[0] << 8 | d[1];
+			ctl->n_sticks = 1;
+			ctl->stick[0][0] = (int8_t)d[2];
+			ctl->stick[0][1] = (int8_t)d[3];
+			break;
+
+		case INPUTLOG_SRC_GC:
+			if (frame->len < GC_GETSTATUS_REPLY_LENGTH)
+				return -1;
+			memcpy(st.raw, d, GC_GETSTATUS_REPLY_LENGTH);
+			sipoll_decode(SIPOLL_GC, src->param, &st);
+			ctl->buttons = st.buttons;
+			ctl->n_sticks = 2;
+			ctl->stick[0][0] = st.x;
+			ctl->stick[0][1] = st.y;
+			ctl->stick[1][0] = st.cx;
+			ctl->stick[1][1] = st.cy;
+			break;
+
+		case INPUTLOG_SRC_PSX:
+			// Buttons are active low. Analog controllers add the right, then the left stick.
+			if (frame->len < 2)
+				return -1;
+			ctl->buttons = ~(d[0] | d[1] << 8) & 0xffff;
+			if (frame->len >= 6) {
+				ctl->n_sticks = 2;
+				ctl->stick[0][0] = d[4] - 0x80;
+				ctl->stick[0][1] = d[5] - 0x80;
+				ctl->stick[1][0] = d[2] - 0x80;
+				ctl->stick[1][1] = d[3] - 0x80;
+			}
+			break;
+
+		case INPUTLOG_SRC_WII:
+			if (frame->len < 6)
+				return -1;
+			switch (src->param)
+			{
+				case ID_CLASSIC:
+				case ID_CLASSIC_PRO:
+					wusbmotelib_bufferToClassicPadData(d, &classic, src->param, src->flags & INPUTLOG_FLAG_HIGH_RES);
+					ctl->buttons = classic.buttons;
+					ctl->n_sticks = 2;
+					ctl->stick[0][0] = classic.lx;
+					ctl->stick[0][1] = classic.ly;
+					ctl->stick[1][0] = classic.rx;
+					ctl->stick[1][1] = classic.ry;
+					break;
+
+				case ID_NUNCHUK:
+					wusbmotelib_bufferToNunchukPadData(d, &nunchuk);
+					ctl->buttons = nunchuk.buttons;
+					ctl->n_sticks = 1;
+					ctl->stick[0][0] = nunchuk.sx;
+					ctl->stick[0][1] = nunchuk.sy;
+					break;
+
+				default:
+					return -1;
+			}
+			break;
+
+		case INPUTLOG_SRC_DC:
+			// Frame header and function code, then buttons (active low), triggers and stick
+			if (frame->len < 14)
+				return -1;
+			ctl->buttons = ~(d[8] | d[9] << 8) & 0xffff;
+			ctl->n_sticks = 1;
+			ctl->stick[0][0] = d[12] - 0x80;
+			ctl->stick[0][1] = d[13] - 0x80;
+			break;
+
+		case INPUTLOG_SRC_DB9:
+			// Digital only. The first byte is the request code.
+			for (i=1; i<frame->len && i<5; i++) {
+				ctl->buttons |= (uint32_t)d[i] << ((i-1)*8);
+			}
+			break;
+
+		default:
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,116 @@
+#ifndef _inputlog_h__
+#define _inputlog_h__
+
+#include <stdint.h>
+
+/* Source types */
+#define INPUTLOG_SRC_N64	1
+#define INPUTLOG_SRC_GC		2 // param: status mode (0-4)
+#define INPUTLOG_SRC_PSX	3 // param: port
+#define INPUTLOG_SRC_WII	4 // param: extension ID
+#define INPUTLOG_SRC_DC		5
+#define INPUTLOG_SRC_DB9	6
+
+/* Source flags */
+#define INPUTLOG_FLAG_HIGH_RES	0x01 // Wii classic controller high resolution reports
+
+#define INPUTLOG_MAX_SOURCES	16
+#define INPUTLOG_MAX_FRAME		64
+#define INPUTLOG_MAX_STICKS		2
+
+// A sync point (full frame of each source, and an index entry) is written at this interval
+#define INPUTLOG_SYNC_INTERVAL_US	1000000
+
+/**
+ * Log file format
+ *
+ * Header: "RNTILOG" and a version byte, then the start time (UTC seconds,
+ * 64-bit little endian). Then records, each starting with a tag byte. Numbers
+ * are LEB128 varints. Timestamps are in microseconds since the start.
+ *
+ *  SOURCE: id, type, channel, flags, param (varint). Only before the first frame.
+ *  SYNC: timestamp. The next frame of each source is a KEY.
+ *  KEY: source, time since the SYNC, length, data
+ *  DELTA: source, time since the previous frame, bitmap of the changed bytes, changed bytes
+ *  REPEAT: source, count, then for each frame (same data as the previous one) the
+ *          difference between its interval and the previous interval (zigzag).
+ *  INDEX: count, then (offset, timestamp) of each SYNC, both relative to the previous entry.
+ *
+ * The file ends with the offset of the INDEX record (64-bit little endian) and
+ * "RNTIIDX". A log that was not closed properly has no index, but can still be
+ * read up to its last complete record.
+ *
+ * Frames of a source are in order, but since repeated frames are buffered
+ * until the data changes, frames of different sources may be interleaved
+ * out of order (never across a SYNC).
+ */
+struct inputlog;
+
+struct inputlog_source {
+	int type, chn, flags, param;
+};
+
+struct inputlog_frame {
+	int source;
+	uint64_t timestamp; // microseconds since the start of the recording
+	int len;
+	uint8_t data[INPUTLOG_MAX_FRAME];
+};
+
+/** \brief Controls decoded from a frame */
+struct inputlog_controls {
+	uint32_t buttons; // Set bits are pressed
+	int n_sticks;
+	int stick[INPUTLOG_MAX_STICKS][2]; // X and Y, 0 at center (approximately)
+};
+
+/** \brief Create a log file
+ * \param start_us Monotonic time (getMicroseconds()) the timestamps are relative to
+ */
+struct inputlog *inputlog_create(const char *filename, uint64_t start_us);
+
+/** \brief Declare a source (before writing frames)
+ * \return The source id, or -1 on error
+ */
+int inputlog_addSource(struct inputlog *log, int type, int chn, int flags, int param);
+
+/** \brief Add a frame
+ * \param timestamp Monotonic time (getMicroseconds())
+ * \return 0 on success, -1 on error
+ */
+int inputlog_write(struct inputlog *log, int source, uint64_t timestamp, const uint8_t *data, int len);
+
+/** \brief Number of bytes written so far */
+uint64_t inputlog_size(struct inputlog *log);
+
+/** \brief Open a log file for reading */
+struct inputlog *inputlog_open(const char *filename);
+
+/** \brief Read the next frame
+ * \return 1 if a frame was read, 0 at the end of the log, -1 on error
+ */
+int inputlog_read(struct inputlog *log, struct inputlog_frame *frame);
+
+/** \brief Continue reading from the last sync point at or before timestamp
+ * \return 0 on success, -1 on error
+ */
+int inputlog_seek(struct inputlog *log, uint64_t timestamp);
+
+int inputlog_numSources(struct inputlog *log);
+const struct inputlog_source *inputlog_getSource(struct inputlog *log, int id);
+/** \brief UTC time the recording started (seconds) */
+uint64_t inputlog_startTime(struct inputlog *log);
+
+/** \brief Close a log. When writing, also writes the index.
+ * \return 0 on success, -1 if the log could not be completed
+ */
+int inputlog_close(struct inputlog *log);
+
+const char *inputlog_sourceName(int type);
+
+/** \brief Decode the buttons and sticks of a frame
+ * \return 0 on success, -1 if the frame is too short or the source has no known format
+ */
+int inputlog_decode(const struct inputlog_source *src, const struct inputlog_frame *frame, struct inputlog_controls *ctl);
+
+#endif // _inputlog_h__
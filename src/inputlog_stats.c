@@ -0,0 +1,309 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "inputlog.h"
+#include "stickstats.h"
+
+// Intervals are counted in buckets for the percentiles (the last one collects everything above)
+#define INTERVAL_BUCKET_US	50
+#define INTERVAL_BUCKETS	2000
+// An interval longer than this is a gap in the recording
+#define GAP_US				50000
+// A button state shorter than this is a bounce
+#define BOUNCE_US			5000
+
+struct button_stats {
+	uint64_t last_change;
+	int presses, bounces;
+	uint64_t shortest;
+};
+
+struct source_stats {
+	uint64_t samples, changes, decode_errors;
+	uint64_t first_t, prev_t;
+	double mean, m2; // Interval mean and sum of squared differences (Welford)
+	uint64_t min_interval, max_interval, gaps;
+	uint32_t interval_hist[INTERVAL_BUCKETS];
+	int n_sticks; // Sticks with statistics (initialized)
+	struct stickstats sticks[INPUTLOG_MAX_STICKS];
+	int decoded; // A frame was decoded (prev_buttons is valid)
+	uint32_t prev_buttons;
+	struct button_stats buttons[32];
+};
+
+static void addInterval(struct source_stats *st, uint64_t interval)
+{
+	uint64_t n = st->samples - 1; // Number of intervals including this one
+	double delta;
+	int bucket;
+
+	delta = interval - st->mean;
+	st->mean += delta / n;
+	st->m2 += delta * (interval - st->mean);
+
+	if (n == 1 || interval < st->min_interval)
+		st->min_interval = interval;
+	if (interval > st->max_interval)
+		st->max_interval = interval;
+	if (interval >= GAP_US)
+		st->gaps++;
+
+	bucket = interval / INTERVAL_BUCKET_US;
+	if (bucket >= INTERVAL_BUCKETS)
+		bucket = INTERVAL_BUCKETS - 1;
+	st->interval_hist[bucket]++;
+}
+
+/* Reach of a good stick, if known (for grading) */
+static int nominalRange(const struct inputlog_source *src, int stick)
+{
+	switch (src->type)
+	{
+		case INPUTLOG_SRC_N64: return STICKSTATS_RANGE_N64;
+		case INPUTLOG_SRC_GC: return stick == 0 ? STICKSTATS_RANGE_GC : 0;
+		default: return 0;
+	}
+}
+
+static void addButtons(struct source_stats *st, uint32_t buttons, uint64_t t)
+{
+	uint32_t changed = buttons ^ st->prev_buttons;
+	struct button_stats *b;
+	uint64_t duration;
+	int i;
+
+	if (!changed)
+		return;
+
+	st->changes++;
+	for (i=0; i<32; i++) {
+		if (!(changed & (1u << i)))
+			continue;
+
+		b = &st->buttons[i];
+		if (b->last_change) {
+			duration = t - b->last_change;
+			if (duration < BOUNCE_US)
+				b->bounces++;
+			if (!b->shortest || duration < b->shortest)
+				b->shortest = duration;
+		}
+		if (buttons & (1u << i))
+			b->presses++;
+		b->last_change = t ? t : 1;
+	}
+	st->prev_buttons = buttons;
+}
+
+static int addFrame(struct source_stats *st, const struct inputlog_source *src, const struct inputlog_frame *frame)
+{
+	struct inputlog_controls ctl;
+	int i;
+
+	st->samples++;
+	if (st->samples == 1) {
+		st->first_t = frame->timestamp;
+	} else {
+		addInterval(st, frame->timestamp - st->prev_t);
+	}
+	st->prev_t = frame->timestamp;
+
+	if (inputlog_decode(src, frame, &ctl)) {
+		st->decode_errors++;
+		return 0;
+	}
+
+	if (st->decoded) {
+		addButtons(st, ctl.buttons, frame->timestamp);
+	} else {
+		st->prev_buttons = ctl.buttons;
+		st->decoded = 1;
+	}
+
+	for (i=0; i<ctl.n_sticks; i++) {
+		if (i >= st->n_sticks) {
+			if (stickstats_init(&st->sticks[i], nominalRange(src, i)))
+				return -1;
+			st->n_sticks++;
+		}
+		stickstats_add(&st->sticks[i], ctl.stick[i][0], ctl.stick[i][1]);
+	}
+
+	return 0;
+}
+
+/* Upper bound of the bucket holding the percentile */
+static double histPercentile(const struct source_stats *st, uint64_t total, int pct)
+{
+	uint64_t rank = (pct * total + 99) / 100, count = 0;
+	int i;
+
+	for (i=0; i<INTERVAL_BUCKETS; i++) {
+		count += st->interval_hist[i];
+		if (count >= rank)
+			break;
+	}
+
+	if ((i + 1) * INTERVAL_BUCKET_US > st->max_interval)
+		return st->max_interval;
+
+	return (i + 1) * INTERVAL_BUCKET_US;
+}
+
+static void printStats(int id, const struct inputlog_source *src, const struct source_stats *st)
+{
+	uint64_t intervals = st->samples > 1 ? st->samples - 1 : 0;
+	double duration = (st->prev_t - st->first_t) / 1000000.0;
+	const struct button_stats *b;
+	struct stickstats_report rep;
+	char name[32];
+	int i;
+
+	printf("Source %d: %s, channel %d", id, inputlog_sourceName(src->type), src->chn);
+	if (src->type == INPUTLOG_SRC_GC) {
+		printf(", mode %d", src->param);
+	} else if (src->type != INPUTLOG_SRC_N64 && src->param) {
+		printf(", param 0x%04x", src->param);
+	}
+	printf("\n");
+
+	if (!st->samples) {
+		printf("  No samples\n");
+		return;
+	}
+
+	printf("  Samples: %llu over %.1f s", (unsigned long long)st->samples, duration);
+	if (duration > 0) {
+		printf(" (%.1f Hz)", intervals / duration);
+	}
+	printf(", %llu changes", (unsigned long long)st->changes);
+	if (st->decode_errors) {
+		printf(", %llu not decoded", (unsigned long long)st->decode_errors);
+	}
+	printf("\n");
+
+	if (intervals) {
+		printf("  Interval: mean %.0f us, jitter (stddev) %.0f us, min %llu, p50 <= %.0f, p99 <= %.0f, max %llu us, gaps over %d ms: %llu\n",
+			st->mean, sqrt(st->m2 / intervals), (unsigned long long)st->min_interval,
+			histPercentile(st, intervals, 50), histPercentile(st, intervals, 99),
+			(unsigned long long)st->max_interval, GAP_US / 1000, (unsigned long long)st->gaps);
+	}
+
+	for (i=0; i<st->n_sticks; i++) {
+		if (!stickstats_analyze(&st->sticks[i], &rep)) {
+			snprintf(name, sizeof(name), "  Stick %d", i);
+			stickstats_printReport(stdout, name, &rep);
+		}
+	}
+
+	for (i=0; i<32; i++) {
+		b = &st->buttons[i];
+		if (!b->presses)
+			continue;
+		printf("  Button bit %2d: %d presses, %d bounces (under %d ms), shortest state %.1f ms\n",
+				i, b->presses, b->bounces, BOUNCE_US / 1000, b->shortest / 1000.0);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct inputlog *log;
+	struct inputlog_frame frame;
+	struct source_stats *stats;
+	const struct inputlog_source *src;
+	uint64_t start = 0, end = UINT64_MAX, frames = 0;
+	time_t start_time;
+	int i, j, n_sources, res, retval = 0;
+
+	if (argc < 2) {
+		printf("Usage: ./inputlog_stats file [start_s [end_s]]\n");
+		printf("\n");
+		printf("Computes stick range, rest noise, circularity, button bounce and sample rate\n");
+		printf("statistics for each source of a log recorded with gcn64ctl --record.\n");
+		return 1;
+	}
+
+	if (argc > 2) {
+		start = atof(argv[2]) * 1000000;
+	}
+	if (argc > 3) {
+		end = atof(argv[3]) * 1000000;
+	}
+
+	log = inputlog_open(argv[1]);
+	if (!log) {
+		return 1;
+	}
+
+	n_sources = inputlog_numSources(log);
+	stats = calloc(n_sources ? n_sources : 1, sizeof(struct source_stats));
+	if (!stats) {
+		perror("calloc");
+		inputlog_close(log);
+		return 1;
+	}
+
+	start_time = inputlog_startTime(log);
+	printf("Recorded %s", ctime(&start_time));
+
+	if (start && inputlog_seek(log, start)) {
+		retval = 1;
+		goto done;
+	}
+
+	while ((res = inputlog_read(log, &frame)) > 0) {
+		if (frame.timestamp < start)
+			continue;
+		if (frame.timestamp > end) {
+			// Sources are never out of order by more than a sync interval
+			if (frame.timestamp > end + INPUTLOG_SYNC_INTERVAL_US)
+				break;
+			continue;
+		}
+
+		if (addFrame(&stats[frame.source], inputlog_getSource(log, frame.source), &frame)) {
+			retval = 1;
+			goto done;
+		}
+		frames++;
+	}
+	if (res < 0) {
+		retval = 1;
+	}
+
+	printf("%llu frames\n\n", (unsigned long long)frames);
+	for (i=0; i<n_sources; i++) {
+		src = inputlog_getSource(log, i);
+		printStats(i, src, &stats[i]);
+		printf("\n");
+	}
+
+done:
+	for (i=0; i<n_sources; i++) {
+		for (j=0; j<stats[i].n_sticks; j++) {
+			stickstats_free(&stats[i].sticks[j]);
+		}
+	}
+	free(stats);
+	inputlog_close(log);
+
+	return retval;
+}
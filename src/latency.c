@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "latency.h"
+#include "gcn64_protocol.h"
+#include "gcn64lib.h"
+#include "psxlib.h"
+#include "maplelib.h"
+#include "requests.h"
+#include "timer.h"
+#include "delay.h"
+
+#define STATE_MAX			8
+// Give up on a configuration when the controller does not answer at all
+#define MAX_CONSECUTIVE_ERRORS	100
+#define CSV_HEADER			"poll_interval,holdoff,samples,errors,changes,rate_hz,mean_us,stddev_us,p50_us,p99_us,max_us,detect_mean_us,detect_p99_us,detect_max_us"
+
+/* Samples the controller once. Stores the bytes used to detect changes
+ * (the digital buttons: analog axes are too noisy) and returns their
+ * number, or -1 on error. */
+typedef int (*latency_sample_func)(rnt_hdl_t hdl, int channel, uint8_t *state);
+
+struct interval_list {
+	uint32_t *values;
+	int count, alloc;
+};
+
+static int sampleN64(rnt_hdl_t hdl, int channel, uint8_t *state)
+{
+	unsigned char buf[64] = { N64_GET_STATUS };
+
+	if (gcn64lib_rawSiCommand(hdl, channel, buf, 1, buf, sizeof(buf)) != N64_GET_STATUS_REPLY_LENGTH)
+		return -1;
+
+	memcpy(state, buf, 2);
+	return 2;
+}
+
+static int sampleGC(rnt_hdl_t hdl, int channel, uint8_t *state)
+{
+	unsigned char buf[64] = { GC_GETSTATUS1, GC_GETSTATUS2_MODE(0), GC_GETSTATUS3(0) };
+
+	if (gcn64lib_rawSiCommand(hdl, channel, buf, 3, buf, sizeof(buf)) != GC_GETSTATUS_REPLY_LENGTH)
+		return -1;
+
+	memcpy(state, buf, 2);
+	return 2;
+}
+
+static int samplePSX(rnt_hdl_t hdl, int channel, uint8_t *state)
+{
+	uint8_t data[32];
+	uint16_t id;
+
+	if (psxlib_pollStatus(hdl, channel, PSXLIB_PORT_1, 0, 0, &id, data, sizeof(data)) < 2)
+		return -1;
+
+	memcpy(state, data, 2);
+	return 2;
+}
+
+static int sampleDC(rnt_hdl_t hdl, int channel, uint8_t *state)
+{
+	uint8_t buf[64];
+	int res;
+
+	res = maple_sendFrame1W(hdl, channel,
+			MAPLE_CMD_GET_CONDITION,
+			MAPLE_ADDR_PORTB | MAPLE_ADDR_MAIN,
+			MAPLE_ADDR_PORTB | MAPLE_DC_ADDR,
+			MAPLE_FUNC_CONTROLLER,
+			buf, sizeof(buf), MAPLE_FLAG_KEEP_DATA);
+
+	// Frame header and function code, then the buttons
+	if (res < 10 || buf[0] == 0x86)
+		return -1;
+
+	memcpy(state, buf + 8, 2);
+	return 2;
+}
+
+static const struct {
+	const char *name;
+	latency_sample_func func;
+} paths[] = {
+	[LATENCY_PATH_N64] = { "n64", sampleN64 },
+	[LATENCY_PATH_GC] = { "gc", sampleGC },
+	[LATENCY_PATH_PSX] = { "psx", samplePSX },
+	[LATENCY_PATH_DC] = { "dc", sampleDC },
+};
+
+int latency_parsePath(const char *name)
+{
+	int i;
+
+	for (i=0; i<sizeof(paths)/sizeof(paths[0]); i++) {
+		if (!strcmp(paths[i].name, name))
+			return i;
+	}
+
+	return -1;
+}
+
+/* Parse a comma separated list of values (0-255). Returns the number of values, or -1 on error. */
+static int parseValues(const char *list, int *values, int max)
+{
+	const char *p = list;
+	char *end;
+	long v;
+	int n = 0;
+
+	while (*p) {
+		v = strtol(p, &end, 0);
+		if (end == p || v < 0 || v > 255 || (*end && *end != ',')) {
+			fprintf(stderr, "Invalid value list: %s\n", list);
+			return -1;
+		}
+		if (n >= max) {
+			fprintf(stderr, "Too many values (max %d): %s\n", max, list);
+			return -1;
+		}
+		values[n++] = v;
+		p = *end ? end + 1 : end;
+	}
+
+	return n;
+}
+
+static int addInterval(struct interval_list *l, uint32_t value)
+{
+	uint32_t *values;
+
+	if (l->count >= l->alloc) {
+		values = realloc(l->values, (l->alloc ? l->alloc * 2 : 4096) * sizeof(uint32_t));
+		if (!values) {
+			perror("realloc");
+			return -1;
+		}
+		l->values = values;
+		l->alloc = l->alloc ? l->alloc * 2 : 4096;
+	}
+	l->values[l->count++] = value;
+
+	return 0;
+}
+
+static void addToHistogram(int *histogram, uint32_t us)
+{
+	int bucket = us / LATENCY_BUCKET_US;
+
+	if (bucket >= LATENCY_N_BUCKETS)
+		bucket = LATENCY_N_BUCKETS - 1;
+
+	histogram[bucket]++;
+}
+
+static int compareIntervals(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile of sorted values */
+static double percentile(const uint32_t *sorted, int n, int pct)
+{
+	int rank = (pct * n + 99) / 100;
+
+	if (rank < 1)
+		rank = 1;
+
+	return sorted[rank - 1];
+}
+
+/* Sorts the values. Returns the mean and sets the other statistics. */
+static double computeStats(struct interval_list *l, double *stddev, double *p50, double *p99, double *max)
+{
+	double mean, sum = 0, sq = 0;
+	int i;
+
+	*stddev = *p50 = *p99 = *max = 0;
+	if (!l->count)
+		return 0;
+
+	qsort(l->values, l->count, sizeof(uint32_t), compareIntervals);
+	for (i=0; i<l->count; i++) {
+		sum += l->values[i];
+	}
+	mean = sum / l->count;
+	for (i=0; i<l->count; i++) {
+		sq += (l->values[i] - mean) * (l->values[i] - mean);
+	}
+
+	*stddev = sqrt(sq / l->count);
+	*p50 = percentile(l->values, l->count, 50);
+	*p99 = percentile(l->values, l->count, 99);
+	*max = l->values[l->count - 1];
+
+	return mean;
+}
+
+/* Returns 0 on success, -1 if the controller does not answer */
+static int measure(rnt_hdl_t hdl, int channel, latency_sample_func sample, int duration_ms,
+						struct interval_list *inter, struct interval_list *detect, struct latency_result *res)
+{
+	uint8_t state[STATE_MAX], last_state[STATE_MAX];
+	uint64_t t, last_t = 0, start, end;
+	int n, last_n = 0, consecutive_errors = 0;
+	double unused;
+
+	inter->count = detect->count = 0;
+
+	start = getMicroseconds();
+	end = start + (uint64_t)duration_ms * 1000;
+	while ((t = getMicroseconds()) < end)
+	{
+		n = sample(hdl, channel, state);
+		if (n < 0) {
+			res->errors++;
+			if (++consecutive_errors >= MAX_CONSECUTIVE_ERRORS && !res->samples) {
+				fprintf(stderr, "No answer from the controller\n");
+				return -1;
+			}
+			continue;
+		}
+		consecutive_errors = 0;
+		// The sample is taken somewhere during the exchange
+		t = (t + getMicroseconds()) / 2;
+
+		res->samples++;
+		if (last_t) {
+			addInterval(inter, t - last_t);
+			addToHistogram(res->histogram, t - last_t);
+
+			// The change happened after the previous sample
+			if (n != last_n || memcmp(state, last_state, n)) {
+				res->changes++;
+				addInterval(detect, t - last_t);
+				addToHistogram(res->detect_histogram, t - last_t);
+			}
+		}
+
+		memcpy(last_state, state, n);
+		last_n = n;
+		last_t = t;
+	}
+
+	res->rate_hz = res->samples * 1000.0 / duration_ms;
+	res->mean_us = computeStats(inter, &res->stddev_us, &res->p50_us, &res->p99_us, &res->max_us);
+	res->detect_mean_us = computeStats(detect, &unused, &unused, &res->detect_p99_us, &res->detect_max_us);
+
+	return 0;
+}
+
+static void printHistogram(const char *title, const int *histogram)
+{
+	int i, total = 0, peak = 0;
+
+	for (i=0; i<LATENCY_N_BUCKETS; i++) {
+		total += histogram[i];
+		if (histogram[i] > peak)
+			peak = histogram[i];
+	}
+	if (!total)
+		return;
+
+	printf("  %s:\n", title);
+	for (i=0; i<LATENCY_N_BUCKETS; i++) {
+		if (!histogram[i])
+			continue;
+
+		if (i == LATENCY_N_BUCKETS - 1) {
+			printf("    %6.2f+      ms ", i * LATENCY_BUCKET_US / 1000.0);
+		} else {
+			printf("    %6.2f-%-6.2f ms ", i * LATENCY_BUCKET_US / 1000.0, (i + 1) * LATENCY_BUCKET_US / 1000.0);
+		}
+		printf("%6d %5.1f%% ", histogram[i], histogram[i] * 100.0 / total);
+		printf("%.*s\n", histogram[i] * 40 / peak, "########################################");
+	}
+}
+
+static void printResult(const struct latency_result *r)
+{
+	printf("  Samples: %d (%.1f Hz), errors: %d, changes: %d\n", r->samples, r->rate_hz, r->errors, r->changes);
+	printf("  Inter-arrival: mean %.0f us, jitter (stddev) %.0f us, p50 %.0f us, p99 %.0f us, max %.0f us\n",
+			r->mean_us, r->stddev_us, r->p50_us, r->p99_us, r->max_us);
+	if (r->changes) {
+		printf("  Change detection window: mean %.0f us, p99 %.0f us, max %.0f us\n",
+				r->detect_mean_us, r->detect_p99_us, r->detect_max_us);
+	}
+	printHistogram("Inter-arrival", r->histogram);
+	printHistogram("Change detection window", r->detect_histogram);
+}
+
+static void printSetting(const char *name, int value, const char *unit)
+{
+	if (value < 0) {
+		printf("%s unchanged", name);
+	} else {
+		printf("%s %d%s", name, value, unit);
+	}
+}
+
+static int writeResults(const char *filename, const struct latency_result *results, int n)
+{
+	FILE *fptr;
+	const struct latency_result *r;
+	int i;
+
+	fptr = fopen(filename, "w");
+	if (!fptr) {
+		perror(filename);
+		return -1;
+	}
+
+	fprintf(fptr, "%s\n", CSV_HEADER);
+	for (i=0; i<n; i++) {
+		r = &results[i];
+		fprintf(fptr, "%d,%d,%d,%d,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+			r->poll_interval, r->holdoff, r->samples, r->errors, r->changes, r->rate_hz,
+			r->mean_us, r->stddev_us, r->p50_us, r->p99_us, r->max_us,
+			r->detect_mean_us, r->detect_p99_us, r->detect_max_us);
+	}
+
+	fclose(fptr);
+	printf("Results written to %s\n", filename);
+
+	return 0;
+}
+
+/* Reads a one byte setting. Returns the value, or -1 if it cannot be read. */
+static int readSetting(rnt_hdl_t hdl, unsigned char param)
+{
+	unsigned char buf[32];
+
+	if (rnt_getConfig(hdl, param, buf, sizeof(buf)) < 1)
+		return -1;
+
+	return buf[0];
+}
+
+static int writeSetting(rnt_hdl_t hdl, unsigned char param, int value)
+{
+	unsigned char v = value;
+
+	return rnt_setConfig(hdl, param, &v, 1);
+}
+
+int latency_run(rnt_hdl_t hdl, int channel, const struct latency_opts *opts, const char *outfile)
+{
+	struct rnt_adap_info inf;
+	int intervals[LATENCY_MAX_VALUES] = { -1 }, holdoffs[LATENCY_MAX_VALUES] = { -1 };
+	int n_intervals = 1, n_holdoffs = 1;
+	int orig_interval = -1, orig_holdoff = -1;
+	unsigned char interval_param = CFG_PARAM_POLL_INTERVAL0 + channel;
+	struct interval_list inter = { }, detect = { };
+	struct latency_result *results;
+	int i, j, n = 0, duration, retval = 0;
+
+	if (opts->path < 0 || opts->path >= sizeof(paths)/sizeof(paths[0])) {
+		fprintf(stderr, "Invalid sampling path\n");
+		return -1;
+	}
+	duration = opts->duration > 0 ? opts->duration : LATENCY_DEFAULT_DURATION;
+
+	if (rnt_getInfo(hdl, &inf)) {
+		return -1;
+	}
+
+	if (opts->poll_intervals) {
+		if (!(inf.caps.features & RNTF_POLL_RATE)) {
+			fprintf(stderr, "This adapter does not support setting the poll interval\n");
+			return -1;
+		}
+		if (channel < 0 || channel > 3) {
+			fprintf(stderr, "No poll interval setting for channel %d\n", channel);
+			return -1;
+		}
+		n_intervals = parseValues(opts->poll_intervals, intervals, LATENCY_MAX_VALUES);
+		if (n_intervals <= 0)
+			return -1;
+		orig_interval = readSetting(hdl, interval_param);
+	}
+
+	if (opts->holdoffs) {
+		if (!(inf.caps.features & RNTF_BUTTON_HOLDOFF)) {
+			fprintf(stderr, "This adapter does not support button hold-off\n");
+			return -1;
+		}
+		n_holdoffs = parseValues(opts->holdoffs, holdoffs, LATENCY_MAX_VALUES);
+		if (n_holdoffs <= 0)
+			return -1;
+		orig_holdoff = readSetting(hdl, CFG_PARAM_BUTTON_HOLDOFF);
+	}
+
+	results = calloc(n_intervals * n_holdoffs, sizeof(struct latency_result));
+	if (!results) {
+		perror("calloc");
+		return -1;
+	}
+
+	printf("Sampling the %s controller on channel %d, %d second(s) per configuration.\n", paths[opts->path].name, channel, duration);
+	printf("Press buttons during the test to measure change detection.\n");
+
+	for (i=0; i<n_intervals; i++) {
+		for (j=0; j<n_holdoffs; j++) {
+			struct latency_result *r = &results[n];
+
+			r->poll_interval = intervals[i];
+			r->holdoff = holdoffs[j];
+
+			if (r->poll_interval >= 0 && writeSetting(hdl, interval_param, r->poll_interval)) {
+				fprintf(stderr, "Could not set the poll interval\n");
+				retval = -1;
+				goto restore;
+			}
+			if (r->holdoff >= 0 && writeSetting(hdl, CFG_PARAM_BUTTON_HOLDOFF, r->holdoff)) {
+				fprintf(stderr, "Could not set the button hold-off\n");
+				retval = -1;
+				goto restore;
+			}
+			_delay_us(LATENCY_SETTLE_MS * 1000);
+
+			printf("\n[");
+			printSetting("Poll interval", r->poll_interval, " ms");
+			printf(", ");
+			printSetting("button hold-off", r->holdoff, "");
+			printf("]\n");
+			fflush(stdout);
+
+			if (measure(hdl, channel, paths[opts->path].func, duration * 1000, &inter, &detect, r)) {
+				retval = -1;
+				goto restore;
+			}
+			printResult(r);
+			n++;
+		}
+	}
+
+	if (n > 1) {
+		printf("\nSummary:\n");
+		printf("  %-8s %-8s %10s %12s %12s %12s\n", "interval", "holdoff", "rate (Hz)", "jitter (us)", "p99 (us)", "detect (us)");
+		for (i=0; i<n; i++) {
+			printf("  %-8d %-8d %10.1f %12.0f %12.0f %12.0f\n", results[i].poll_interval, results[i].holdoff,
+					results[i].rate_hz, results[i].stddev_us, results[i].p99_us, results[i].detect_p99_us);
+		}
+	}
+
+	if (outfile && writeResults(outfile, results, n)) {
+		retval = -1;
+	}
+
+restore:
+	if (orig_interval >= 0) {
+		writeSetting(hdl, interval_param, orig_interval);
+	}
+	if (orig_holdoff >= 0) {
+		writeSetting(hdl, CFG_PARAM_BUTTON_HOLDOFF, orig_holdoff);
+	}
+
+	free(inter.values);
+	free(detect.values);
+	free(results);
+
+	return retval;
+}
@@ -0,0 +1,60 @@
+#ifndef _latency_h__
+#define _latency_h__
+
+#include "raphnetadapter.h"
+
+#define LATENCY_DEFAULT_DURATION	5 // seconds, per configuration
+#define LATENCY_BUCKET_US			250
+#define LATENCY_N_BUCKETS			24 // The last one collects everything above
+// Time given to the adapter to apply a new configuration before sampling
+#define LATENCY_SETTLE_MS			100
+#define LATENCY_MAX_VALUES			16
+
+/* Sampling paths */
+#define LATENCY_PATH_N64	0
+#define LATENCY_PATH_GC		1
+#define LATENCY_PATH_PSX	2
+#define LATENCY_PATH_DC		3
+
+struct latency_opts {
+	int path;
+	int duration; // seconds per configuration. 0 for the default.
+	const char *poll_intervals; // Comma separated values (ms) to sweep, or NULL to keep the current setting
+	const char *holdoffs; // Comma separated button hold-off values to sweep, or NULL
+};
+
+/** \brief Timing achieved with one configuration */
+struct latency_result {
+	int poll_interval; // -1 when not changed
+	int holdoff; // -1 when not changed
+	int samples, errors, changes;
+	double rate_hz;
+	/* Inter-arrival of samples */
+	double mean_us, stddev_us, p50_us, p99_us, max_us;
+	/* Change detection window (time since the last sample without the change) */
+	double detect_mean_us, detect_p99_us, detect_max_us;
+	int histogram[LATENCY_N_BUCKETS];
+	int detect_histogram[LATENCY_N_BUCKETS];
+};
+
+/** \brief Get a path from its name (n64, gc, psx, dc)
+ * \return The path, or -1 if unknown
+ */
+int latency_parsePath(const char *name);
+
+/**
+ * \brief Measure the input sampling timing for each configuration
+ *
+ * The controller on the channel is sampled back to back through the raw
+ * path for opts->duration seconds per configuration, with the adapter
+ * polling left active so the configured poll interval and hold-off are in
+ * effect. Every combination of the listed poll intervals (applied to
+ * CFG_PARAM_POLL_INTERVAL0 + channel) and button hold-off values is tried,
+ * and the original settings are restored at the end.
+ *
+ * \param outfile Where to write the results as CSV. May be NULL.
+ * \return 0 on success, -1 on error
+ */
+int latency_run(rnt_hdl_t hdl, int channel, const struct latency_opts *opts, const char *outfile);
+
+#endif // _latency_h__
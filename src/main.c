@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <wchar.h>
+#include <limits.h>
 
 #include "hexdump.h"
 #include "raphnetadapter.h"
@@ -30,6 +31,7 @@
 #include "requests.h"
 #include "gcn64_protocol.h"
 #include "perftest.h"
+#include "latency.h"
 #include "usbtest.h"
 #include "biosensor.h"
 #include "xferpak.h"
@@ -40,6 +42,11 @@
 #include "pcelib.h"
 #include "pollraw.h"
 #include "psxlib.h"
+#include "psxmc_fs.h"
+#include "fwcatalog.h"
+#include "fwfleet.h"
+#include "rntd.h"
+#include "ctlscript.h"
 
 static void printUsage(void)
 {
@@ -49,12 +56,29 @@ static void printUsage(void)
 	printf("Options:\n");
 	printf("  -h, --help            Print help\n");
 	printf("  -l, --list            List devices\n");
+	printf("      --fw_catalog      List the firmware files found in the firmwares directory\n");
+	printf("      --daemon          Keep the adapters open and serve them to other instances (--via_daemon)\n");
+	printf("      --via_daemon      Use the adapters through the daemon\n");
+	printf("      --socket path     Daemon socket (default: $GCN64CTL_SOCKET, $XDG_RUNTIME_DIR/gcn64ctl.sock\n");
+	printf("                        or /tmp/gcn64ctl-<uid>.sock)\n");
+	printf("      --stand_in        Add a simulated adapter (serial SIM001), for testing\n");
+	printf("      --stand_ins n     Add n simulated adapters (serials SIM001, SIM002...)\n");
+	printf("      --refresh_caps    Query the adapter capabilities instead of using the cached ones\n");
+	printf("      --no_caps_cache   Do not use or update the adapter capability cache\n");
+	printf("      --script file     Run the commands from a script file (- for stdin) after those of the\n");
+	printf("                        command-line, without reopening the adapter. One command per line, eg:\n");
+	printf("                          set chn 1\n");
+	printf("                          on_error continue\n");
+	printf("                          --n64_mempak_dump -c $chn -o pak$chn.mpk\n");
+	printf("      --script_var name=value  Define a script variable\n");
+	printf("      --script_continue Keep running the script after a failed step (see also on_error)\n");
 	printf("  -s serial             Operate on specified device (required unless -f is specified)\n");
 	printf("  -f, --force           If no serial is specified, use first device detected.\n");
 	printf("  -o, --outfile file    Output file for read operations (eg: --n64-mempak-dump)\n");
 	//printf("  -i, --infile file     Input file for write operations (eg: --gc_to_n64_update)\n");
 	printf("      --nonstop         Continue testing forever or until an error occurs.\n");
 	printf("      --noconfirm       Skip asking the user for confirmation.\n");
+	printf("      --machine_progress  Report progress as tab-separated lines, for scripts.\n");
 	printf("  -c, --channel chn     Specify channel to use where applicable (for multi-player adapters\n");
 	printf("                        and raw commands, development commands and GC2N64 I/O)\n");
 	printf("  -v, --verbose         Increase output verbosity.\n");
@@ -99,7 +123,21 @@ static void printUsage(void)
 	printf("  --n64_init_rumble                  Send rumble pack init command\n");
 	printf("  --n64_control_rumble value         Turn rumble on when value != 0\n");
 	printf("  --biosensor                        Display heart beat using bio sensor\n");
-	printf("  --perftest                         Do a performance test (raw IO timing)\n");
+	printf("  --perftest                         Run the benchmark suite (use with --outfile to save the results,\n");
+	printf("                                     as CSV if the name ends with .csv, JSON otherwise)\n");
+	printf("      --perftest_iterations n        Timed iterations per test (default: %d)\n", PERFTEST_DEFAULT_ITERATIONS);
+	printf("      --perftest_warmup n            Untimed iterations before each test (default: %d)\n", PERFTEST_DEFAULT_WARMUP);
+	printf("      --perftest_tests list          Tests to run, by name or prefix. Ex: echo,raw_si,blockio_1\n");
+	printf("                                     (version, echo, raw_si, blockio, mempak_read, mempak_write,\n");
+	printf("                                     psx_read, i2c. All but mempak_write by default.)\n");
+	printf("      --perftest_compare file        Compare the results with a baseline and report regressions.\n");
+	printf("                                     Without --perftest, compares the results from --infile.\n");
+	printf("      --perftest_threshold pct       Slow down considered a regression (default: %d%%)\n", PERFTEST_DEFAULT_THRESHOLD);
+	printf("  --latency_test path                Measure the sampling rate, jitter and change detection through\n");
+	printf("                                     a raw path (n64, gc, psx, dc). Use with --outfile for a CSV report.\n");
+	printf("      --latency_duration s           Seconds per configuration (default: %d)\n", LATENCY_DEFAULT_DURATION);
+	printf("      --latency_poll_intervals list  Poll intervals (ms) to sweep. Ex: 1,2,5\n");
+	printf("      --latency_holdoffs list        Button hold-off values to sweep. Ex: 0,10,30\n");
 	printf("\n");
 	printf("Raw Wiimote extension commands (for WUSBMote v2 adapters):\n");
 	printf("  --disable_encryption               Perform the steps to disable encryption on a controller\n");
@@ -119,8 +157,17 @@ static void printUsage(void)
 	printf("                                     compatiblity with adapter type)\n");
 	printf("  --x2gcn64_echotest                 Perform a communication test (usable with --nonstop)\n");
 	printf("  --x2gcn64_fw_dump                  Display the firmware content in hex.\n");
+	printf("  --x2gcn64_read_flash file          Save the firmware to a file (.hex extension: Intel hex, otherwise\n");
+	printf("                                     binary). The bootloader is entered and left as needed.\n");
+	printf("  --x2gcn64_compare file.hex         Compare the firmware with a hex file and show the pages which differ\n");
 	printf("  --x2gcn64_enter_bootloader         Jump to the bootloader.\n");
 	printf("  --x2gcn64_boot_application         Exit bootloader and start application.\n");
+	printf("  --fleet_update file.hex            Update all the adapters this firmware is for, on all the USB\n");
+	printf("                                     adapters found (-s and -f are not needed)\n");
+	printf("      --fleet_jobs n                 Adapters updated at the same time (default: %d)\n", FWFLEET_DEFAULT_JOBS);
+	printf("      --fleet_retries n              Retries allowed per adapter (default: %d)\n", FWFLEET_DEFAULT_RETRIES);
+	printf("  --fleet_audit                      Read back the firmware of all the adapters found and identify it\n");
+	printf("      --fleet_expect file.hex        Also report the adapters (and pages) which differ from this firmware\n");
 	printf("\n");
 
 	printf("GC to N64 adapter commands: (For GC to N64 adapter connected to GC/N64 to USB adapter)\n");
@@ -131,7 +178,17 @@ static void printUsage(void)
 
 	printf("PSX controller and memory card commands:\n");
 	printf("  --psx_mc_dump                      Dump a memory card (Use with --outfile to write to a file)\n");
+	printf("  --psx_mc_dump_save block           Dump a memory card, but only read the save starting at block (1-15)\n");
+	printf("      --psx_mc_sparse                With --psx_mc_dump, only read blocks in use. Others are zero-filled\n");
+	printf("                                     and listed in outfile.skipped.\n");
 	printf("  --psx_mc_write file                Write a file to a memory card\n");
+	printf("      --psx_mc_diff                  With --psx_mc_write, read each sector first and only write those which differ\n");
+	printf("      --psx_mc_known file            With --psx_mc_write, only write sectors which differ from this image of the card\n");
+	printf("  --psx_mc_ls                        List the saves on a memory card\n");
+	printf("  --psx_mc_extract block             Extract the save starting at block to a .mcs file (use with --outfile)\n");
+	printf("  --psx_mc_insert file.mcs           Write a single-save file (.mcs) to free blocks of a memory card\n");
+	printf("  --psx_mc_rm block                  Delete the save starting at block\n");
+	printf("  --psx_mc_defrag                    Move saves to contiguous blocks\n");
 	printf("\n");
 
 	printf("Development/Experimental/Research commands: (use at your own risk)\n");
@@ -143,16 +200,25 @@ static void printUsage(void)
 	printf("  --n64_mempak_stresstest            Perform a set of controller pak tests (WARNING: Erases the pack with random data)\n");
 	printf("  --n64_mempak_fill_with_ff          Fill a controller pak with 0xFF (WARNING: Erases your data)\n");
 	printf("  --i2c_detect                       Try reading one byte from each I2C address (For WUSBMote v2)\n");
+	printf("      --i2c_gap us                   Fixed delay between I2C exchanges. By default, the delay adapts to the device.\n");
 	printf("  --gc_pollraw mode                  Read and display raw values from a gamecube controller (mode range is 0-7)\n");
 	printf("  --gc_pollraw_keyboard              Read and display raw values from a gamecube keyboard\n");
 	printf("  --n64_pollraw                      Read and display raw values from a N64 controller\n");
 	printf("  --n64_pollraw_keyboard             Read and display raw values from a N64 keyboard\n");
+	printf("  --multi_pollraw ports              Read and display several controllers at once, with one request per\n");
+	printf("                                     frame. Ports are channel:type[:gc_mode], types are n64, gc,\n");
+	printf("                                     gc_keyboard and n64_keyboard. Ex: 0:n64,1:gc,2:gc:3\n");
 	printf("  --psx_pollraw                      Read and display raw values from a Playstation controller\n");
 	printf("  --wii_pollraw                      Read and display raw values from a Wii Classic Controller\n");
 	printf("  --enable_highres                   Enable high resolution analog for Wii Classic controllers\n");
+	printf("  --wii_poll_rate hz                 Sampling rate for --wii_pollraw (default: as fast as possible)\n");
 	printf("  --db9_pollraw                      Read and display raw values from a DB9 adapter\n");
 	printf("  --dc_pollraw                       Read and display raw values from a Dreamcast controller\n");
 	printf("  --dc_pollraw_mouse                 Read and display raw values from a Dreamcast mouse\n");
+	printf("      --record file                  Also record the samples to a compact log (analyze it with\n");
+	printf("                                     inputlog_stats). Not for keyboards and the Dreamcast mouse.\n");
+	printf("      --stick_stats file             With --n64_pollraw or --gc_pollraw, accumulate stick statistics in\n");
+	printf("                                     a file (across sessions) and print a grade report at the end.\n");
 	printf("  --usbtest                          Perform a test transfer between host and adapter\n");
 	printf("  --debug                            Read debug values from adapter.\n");
 }
@@ -228,10 +294,53 @@ static void printUsage(void)
 #define OPT_N64_POLLRAW					362
 #define OPT_DC_POLLRAW					363
 #define OPT_DC_POLLRAW_MOUSE			364
+#define OPT_PSX_MC_DUMP_SAVE			365
+#define OPT_PSX_MC_SPARSE				366
+#define OPT_PSX_MC_DIFF					367
+#define OPT_PSX_MC_KNOWN				368
+#define OPT_PSX_MC_LS					369
+#define OPT_PSX_MC_EXTRACT				370
+#define OPT_PSX_MC_INSERT				371
+#define OPT_PSX_MC_RM					372
+#define OPT_PSX_MC_DEFRAG				373
+#define OPT_I2C_GAP						374
+#define OPT_WII_POLL_RATE				375
+#define OPT_FW_CATALOG					376
+#define OPT_MACHINE_PROGRESS			377
+#define OPT_DAEMON						378
+#define OPT_VIA_DAEMON					379
+#define OPT_SOCKET						380
+#define OPT_STAND_IN					381
+#define OPT_SCRIPT						382
+#define OPT_SCRIPT_VAR					383
+#define OPT_SCRIPT_CONTINUE				384
+#define OPT_REFRESH_CAPS				385
+#define OPT_NO_CAPS_CACHE				386
+#define OPT_PERFTEST_ITERATIONS			387
+#define OPT_PERFTEST_WARMUP				388
+#define OPT_PERFTEST_TESTS				389
+#define OPT_PERFTEST_COMPARE			390
+#define OPT_PERFTEST_THRESHOLD			391
+#define OPT_MULTI_POLLRAW				392
+#define OPT_LATENCY_TEST				393
+#define OPT_LATENCY_DURATION			394
+#define OPT_LATENCY_POLL_INTERVALS		395
+#define OPT_LATENCY_HOLDOFFS			396
+#define OPT_RECORD						397
+#define OPT_STICK_STATS					398
+#define OPT_FLEET_UPDATE				399
+#define OPT_FLEET_JOBS					400
+#define OPT_FLEET_RETRIES				401
+#define OPT_STAND_INS					402
+#define OPT_GC_TO_N64_READ_FLASH		403
+#define OPT_GC_TO_N64_COMPARE			404
+#define OPT_FLEET_AUDIT					405
+#define OPT_FLEET_EXPECT				406
 
 struct option longopts[] = {
 	{ "help", 0, NULL, 'h' },
 	{ "list", 0, NULL, 'l' },
+	{ "fw_catalog", 0, NULL, OPT_FW_CATALOG },
 	{ "force", 0, NULL, 'f' },
 	{ "channel", 1, NULL, OPT_CHANNEL },
 	{ "set_serial", 1, NULL, OPT_SET_SERIAL },
@@ -250,8 +359,11 @@ struct option longopts[] = {
 	{ "gc_pollraw_keyboard", 0, NULL, OPT_GC_POLLRAW_KEYBOARD },
 	{ "n64_pollraw_keyboard", 0, NULL, OPT_N64_POLLRAW_KEYBOARD },
 	{ "n64_pollraw", 0, NULL, OPT_N64_POLLRAW },
+	{ "multi_pollraw", required_argument, NULL, OPT_MULTI_POLLRAW },
 	{ "psx_pollraw", 0, NULL, OPT_PSX_POLLRAW },
 	{ "dc_pollraw", 0, NULL, OPT_DC_POLLRAW },
+	{ "record", required_argument, NULL, OPT_RECORD },
+	{ "stick_stats", required_argument, NULL, OPT_STICK_STATS },
 	{ "dc_pollraw_mouse", 0, NULL, OPT_DC_POLLRAW_MOUSE },
 	{ "n64_getcaps", 0, NULL, OPT_N64_GETCAPS },
 	{ "gc_getid", 0, NULL, OPT_GC_GETID },
@@ -270,6 +382,8 @@ struct option longopts[] = {
 	{ "x2gcn64_echotest", 0, NULL, OPT_GC_TO_N64_TEST },
 	{ "x2gcn64_update", 1, NULL, OPT_GC_TO_N64_UPDATE },
 	{ "x2gcn64_fw_dump", 0, NULL, OPT_GC_TO_N64_DUMP },
+	{ "x2gcn64_read_flash", required_argument, NULL, OPT_GC_TO_N64_READ_FLASH },
+	{ "x2gcn64_compare", required_argument, NULL, OPT_GC_TO_N64_COMPARE },
 	{ "x2gcn64_enter_bootloader", 0, NULL, OPT_GC_TO_N64_ENTER_BOOTLOADER },
 	{ "x2gcn64_boot_application", 0, NULL, OPT_GC_TO_N64_BOOT_APPLICATION },
 	{ "gc_to_n64_read_mapping", 1, NULL, OPT_GC_TO_N64_READ_MAPPING },
@@ -282,6 +396,15 @@ struct option longopts[] = {
 	{ "n64_init_rumble", 0, NULL, OPT_N64_INIT_RUMBLE },
 	{ "n64_control_rumble", 1, NULL, OPT_N64_CONTROL_RUMBLE },
 	{ "perftest", 0, NULL, OPT_PERFTEST },
+	{ "perftest_iterations", required_argument, NULL, OPT_PERFTEST_ITERATIONS },
+	{ "perftest_warmup", required_argument, NULL, OPT_PERFTEST_WARMUP },
+	{ "perftest_tests", required_argument, NULL, OPT_PERFTEST_TESTS },
+	{ "perftest_compare", required_argument, NULL, OPT_PERFTEST_COMPARE },
+	{ "perftest_threshold", required_argument, NULL, OPT_PERFTEST_THRESHOLD },
+	{ "latency_test", required_argument, NULL, OPT_LATENCY_TEST },
+	{ "latency_duration", required_argument, NULL, OPT_LATENCY_DURATION },
+	{ "latency_poll_intervals", required_argument, NULL, OPT_LATENCY_POLL_INTERVALS },
+	{ "latency_holdoffs", required_argument, NULL, OPT_LATENCY_HOLDOFFS },
 	{ "biosensor", 0, NULL, OPT_BIOSENSOR },
 	{ "xfer_info", 0, NULL, OPT_XFERPAK_INFO },
 	{ "xfer_dump_rom", required_argument, NULL, OPT_XFERPAK_DUMP_ROM },
@@ -291,17 +414,44 @@ struct option longopts[] = {
 	{ "n64_mempak_stresstest", 0, NULL, OPT_N64_MEMPAK_STRESSTEST },
 	{ "n64_mempak_fill_with_ff", 0, NULL, OPT_N64_MEMPAK_FF_FILL },
 	{ "i2c_detect", 0, NULL, OPT_I2C_DETECT },
+	{ "i2c_gap", required_argument, NULL, OPT_I2C_GAP },
 	{ "disable_encryption", 0, NULL, OPT_DISABLE_ENCRYPTION },
 	{ "dump_wiimote_extmem", 0, NULL, OPT_DUMP_WIIMOTE_EXTENSION_MEMORY },
 	{ "noconfirm", 0, NULL, OPT_NO_CONFIRM },
+	{ "machine_progress", 0, NULL, OPT_MACHINE_PROGRESS },
+	{ "daemon", 0, NULL, OPT_DAEMON },
+	{ "via_daemon", 0, NULL, OPT_VIA_DAEMON },
+	{ "socket", required_argument, NULL, OPT_SOCKET },
+	{ "stand_in", 0, NULL, OPT_STAND_IN },
+	{ "stand_ins", required_argument, NULL, OPT_STAND_INS },
+	{ "fleet_update", required_argument, NULL, OPT_FLEET_UPDATE },
+	{ "fleet_jobs", required_argument, NULL, OPT_FLEET_JOBS },
+	{ "fleet_retries", required_argument, NULL, OPT_FLEET_RETRIES },
+	{ "fleet_audit", no_argument, NULL, OPT_FLEET_AUDIT },
+	{ "fleet_expect", required_argument, NULL, OPT_FLEET_EXPECT },
+	{ "script", required_argument, NULL, OPT_SCRIPT },
+	{ "script_var", required_argument, NULL, OPT_SCRIPT_VAR },
+	{ "script_continue", 0, NULL, OPT_SCRIPT_CONTINUE },
+	{ "refresh_caps", 0, NULL, OPT_REFRESH_CAPS },
+	{ "no_caps_cache", 0, NULL, OPT_NO_CAPS_CACHE },
 	{ "pce_rawtest", 0, NULL, OPT_PCE_RAWTEST },
 	{ "usbtest", 0, NULL, OPT_USB_TEST },
 	{ "psx_mc_dump", 0, NULL, OPT_PSX_MC_DUMP },
 	{ "psx_mc_write", required_argument, NULL, OPT_PSX_MC_WRITE },
+	{ "psx_mc_dump_save", required_argument, NULL, OPT_PSX_MC_DUMP_SAVE },
+	{ "psx_mc_sparse", 0, NULL, OPT_PSX_MC_SPARSE },
+	{ "psx_mc_diff", 0, NULL, OPT_PSX_MC_DIFF },
+	{ "psx_mc_known", required_argument, NULL, OPT_PSX_MC_KNOWN },
+	{ "psx_mc_ls", 0, NULL, OPT_PSX_MC_LS },
+	{ "psx_mc_extract", required_argument, NULL, OPT_PSX_MC_EXTRACT },
+	{ "psx_mc_insert", required_argument, NULL, OPT_PSX_MC_INSERT },
+	{ "psx_mc_rm", required_argument, NULL, OPT_PSX_MC_RM },
+	{ "psx_mc_defrag", 0, NULL, OPT_PSX_MC_DEFRAG },
 	{ "db9_pollraw", 0, NULL, OPT_DB9_POLLRAW },
 	{ "n64_crca", required_argument, NULL, OPT_N64_CRCA },
 	{ "n64_crcd", required_argument, NULL, OPT_N64_CRCD },
 	{ "enable_highres", 0, NULL, OPT_HIGHRES },
+	{ "wii_poll_rate", required_argument, NULL, OPT_WII_POLL_RATE },
 	{ "debug", 0, NULL, OPT_DEBUG },
 	{ "verbose", 0, NULL, 'v' },
 	{ },
@@ -309,8 +459,15 @@ struct option longopts[] = {
 
 static int mempak_progress_cb(int addr, void *ctx)
 {
-	printf("\r%s 0x%04x / 0x%04x  ", (char*)ctx, addr, MEMPAK_MEM_SIZE); fflush(stdout);
-	return 0;
+	return uiio_progressUpdate(ctx, addr);
+}
+
+static void mempak_progressStart(uiio *u, const char *caption)
+{
+	u->caption = caption;
+	u->progress_type = PROGRESS_TYPE_ADDRESS;
+	u->multi_progress = 0;
+	uiio_progressStart(u, MEMPAK_MEM_SIZE, 1);
 }
 
 static int listDevices(void)
@@ -339,183 +496,239 @@ static int listDevices(void)
 	return n_found;
 }
 
-int main(int argc, char **argv)
+static void printSkippedBlocks(const char *label, uint16_t skipped_blocks)
 {
-	rnt_hdl_t hdl;
-	struct rnt_adap_list_ctx *listctx;
-	int opt, retval = 0;
-	struct rnt_adap_info inf;
-	struct rnt_adap_info *selected_device = NULL;
-	int verbose = 0, use_first = 0, serial_specified = 0;
-	int nonstop = 0;
-	int enable_highres = 0;
-	int noconfirm = 0;
-	int cmd_list = 0;
-#define TARGET_SERIAL_CHARS 128
-	wchar_t target_serial[TARGET_SERIAL_CHARS];
-	const char *short_optstr = "hls:vfo:c:";
-	const char *outfile = NULL;
-	const char *infile = NULL;
-	int channel = 0;
-	int res;
-
-	while((opt = getopt_long(argc, argv, short_optstr, longopts, NULL)) != -1) {
-		switch(opt)
-		{
-			case 's':
-				{
-					mbstate_t ps;
-					memset(&ps, 0, sizeof(ps));
-					if (mbsrtowcs(target_serial, (const char **)&optarg, TARGET_SERIAL_CHARS, &ps) < 1) {
-						fprintf(stderr, "Invalid serial number specified\n");
-						return -1;
-					}
-					serial_specified = 1;
-				}
-				break;
-			case 'f':
-				use_first = 1;
-				break;
-			case 'v':
-				verbose++;
-				break;
-			case 'h':
-				printUsage();
-				return 0;
-			case 'l':
-				cmd_list = 1;
-				break;
-			case 'o':
-				outfile = optarg;
-				printf("Output file: %s\n", outfile);
-				break;
-			case 'i':
-				infile = optarg;
-				printf("Input file: %s\n", infile);
-				break;
-			case OPT_CHANNEL:
-				channel = atoi(optarg);
-				printf("SI channel: %d\n", channel);
-				break;
-			case OPT_NONSTOP:
-				nonstop = 1;
-				break;
-			case OPT_NO_CONFIRM:
-				noconfirm = 1;
-				break;
-			case '?':
-				fprintf(stderr, "Unrecognized argument. Try -h\n");
-				return -1;
-
-			case OPT_N64_CRCA:
-				{
-					long addr;
-					char *e;
+	int block;
 
-					addr = strtol(optarg, &e, 0);
-					if (e==optarg) {
-						fprintf(stderr, "Invalid address\n");
-						return 1;
-					}
-					if (addr < 0 || addr > 0xffff) {
-						fprintf(stderr, "Address out of range\n");
-						return 1;
-					}
+	if (!skipped_blocks)
+		return;
 
-					printf("Computing pak address crc for 0x%04x\n", (uint16_t)addr);
-					printf("CRCA: 0x%04x\n", pak_address_crc(addr));
-					return 0;
-				}
-				break;
+	printf("%s:", label);
+	for (block = 0; block < PSXLIB_MC_N_BLOCKS; block++) {
+		if (skipped_blocks & (1 << block))
+			printf(" %d", block);
+	}
+	printf("\n");
+}
 
-			case OPT_N64_CRCD:
-				{
-					uint8_t inbuf[64];
-					int inlen;
-					int v, i;
-					uint8_t crc;
+static int psxMemcardFsCommand(rnt_hdl_t hdl, int channel, int opt, const char *arg, const char *outfile)
+{
+	struct psxmc_fs *fs;
+	struct psxmc_save saves[PSXLIB_MC_N_DIR_FRAMES];
+	uint16_t mask;
+	int i, n, block = 0, res;
+
+	fs = malloc(sizeof(struct psxmc_fs));
+	if (!fs) {
+		perror("malloc");
+		return -1;
+	}
+	psxmc_init(fs);
 
-					if (strlen(optarg) % 2) {
-						fprintf(stderr, "Error: An even number of nibbles must be specified, and no space between bytes. Ex: 1301 not 13 01\n");
-						return -1;
-					}
+	rnt_suspendPolling(hdl, 1);
 
-					inlen = strlen(optarg)/2;
-					if (inlen > sizeof(inbuf)) {
-						fprintf(stderr, "Error: Too many bytes. Max %d\n", (int)sizeof(inbuf));
-						return -1;
-					}
+	res = psxmc_loadTitles(hdl, channel, fs, NULL);
+	if (res)
+		goto done;
 
-					for (i=0; i<inlen; i++) {
-						sscanf(optarg + (i*2), "%02x", &v);
-						inbuf[i] = v;
-					}
+	switch (opt)
+	{
+		case OPT_PSX_MC_LS:
+			n = psxmc_listSaves(fs, saves, PSXLIB_MC_N_DIR_FRAMES);
+			if (n < 0) {
+				res = n;
+				break;
+			}
+			for (i=0; i<n; i++) {
+				printf("Block %2d: %-20s (%d block%s) %s\n", saves[i].first_block, saves[i].filename,
+							saves[i].n_blocks, saves[i].n_blocks > 1 ? "s":"", saves[i].title);
+			}
+			printf("Free blocks: %d / %d\n", psxmc_getFreeBlocks(fs), PSXLIB_MC_N_DIR_FRAMES);
+			break;
 
-					printf("Computing pak data CRC[%d] : ", inlen);
-					printHexBuf(inbuf, inlen);
+		case OPT_PSX_MC_EXTRACT:
+			if (!outfile) {
+				fprintf(stderr, "An output file must be specified (--outfile)\n");
+				res = PSXLIB_ERR_BAD_PARAM;
+				break;
+			}
+			block = atoi(arg);
+			res = psxmc_getSave(fs, block, &saves[0]);
+			if (res)
+				break;
+			res = psxlib_getSaveBlocks(&fs->card, block, &mask);
+			if (res)
+				break;
+			res = psxmc_loadBlocks(hdl, channel, fs, mask, NULL);
+			if (res)
+				break;
+			res = psxmc_exportSave(fs, block, outfile);
+			if (res == 0) {
+				printf("Wrote %s (%s)\n", outfile, saves[0].filename);
+			}
+			break;
 
-					crc = pak_data_crc(inbuf, inlen);
+		case OPT_PSX_MC_INSERT:
+			res = psxmc_importSave(fs, arg, &block);
+			if (res)
+				break;
+			printf("Save will start at block %d (%d sectors to write)\n", block, psxmc_countDirty(fs));
+			res = psxmc_commit(hdl, channel, fs, NULL);
+			break;
 
-					printf("CRCD: 0x%02x\n", crc);
-					return 0;
-				}
+		case OPT_PSX_MC_RM:
+			res = psxmc_deleteSave(fs, atoi(arg));
+			if (res)
 				break;
+			res = psxmc_commit(hdl, channel, fs, NULL);
+			break;
 
-			case OPT_HIGHRES:
-				enable_highres = 1;
+		case OPT_PSX_MC_DEFRAG:
+			res = psxmc_defragment(hdl, channel, fs, NULL);
+			if (res < 0)
 				break;
-		}
+			printf("%d save(s) moved\n", res);
+			res = 0;
+			break;
 	}
 
-	rnt_init(verbose);
-
-	if (cmd_list) {
-		printf("Simply listing the devices...\n");
-		res = listDevices();
-		if (res > 0) {
-			printf("Found %d devices\n", res);
-			return 0;
-		} else {
-			printf("No device found\n");
-			return 1;
-		}
-	}
+done:
+	rnt_suspendPolling(hdl, 0);
+	free(fs);
 
-	if (!serial_specified && !use_first) {
-		fprintf(stderr, "A serial number or -f must be used. Try -h for more information.\n");
+	if (res) {
+		fprintf(stderr, "%s\n", psxlib_getErrorString(res));
 		return 1;
 	}
 
-	listctx = rnt_allocListCtx();
-	while ((selected_device = rnt_listDevices(&inf, listctx)))
+	return 0;
+}
+
+static const char *short_optstr = "hls:vfo:c:";
+
+/* Options which affect how the commands are executed */
+struct cmd_settings {
+	int verbose;
+	int nonstop;
+	int noconfirm;
+	int enable_highres;
+	int wii_poll_rate;
+	int psx_mc_sparse;
+	int psx_mc_diff;
+	const char *psx_mc_known;
+	int i2c_gap; // -1 when not set
+	const char *record_file;
+	const char *stick_stats_file;
+	const char *outfile;
+	const char *infile;
+	int channel;
+	struct perftest_opts perftest;
+	struct latency_opts latency;
+};
+
+/* Returns 1 if opt is a setting */
+static int parseSetting(int opt, struct cmd_settings *settings)
+{
+	switch (opt)
 	{
-		if (serial_specified) {
-			if (0 == wcscmp(inf.str_serial, target_serial)) {
-				break;
-			}
-		}
-		else {
-			// use_first == 1
-			printf("Will use device '%ls' serial '%ls'\n", inf.str_prodname, inf.str_serial);
+		case 'v':
+			settings->verbose++;
 			break;
-		}
+		case 'o':
+			settings->outfile = optarg;
+			printf("Output file: %s\n", settings->outfile);
+			break;
+		case 'i':
+			settings->infile = optarg;
+			printf("Input file: %s\n", settings->infile);
+			break;
+		case OPT_CHANNEL:
+			settings->channel = atoi(optarg);
+			printf("SI channel: %d\n", settings->channel);
+			break;
+		case OPT_NONSTOP:
+			settings->nonstop = 1;
+			break;
+		case OPT_NO_CONFIRM:
+			settings->noconfirm = 1;
+			break;
+		case OPT_HIGHRES:
+			settings->enable_highres = 1;
+			break;
+		case OPT_WII_POLL_RATE:
+			settings->wii_poll_rate = atoi(optarg);
+			break;
+		case OPT_PSX_MC_SPARSE:
+			settings->psx_mc_sparse = 1;
+			break;
+		case OPT_PSX_MC_DIFF:
+			settings->psx_mc_diff = 1;
+			break;
+		case OPT_PSX_MC_KNOWN:
+			settings->psx_mc_known = optarg;
+			break;
+		case OPT_I2C_GAP:
+			settings->i2c_gap = atoi(optarg);
+			break;
+		case OPT_RECORD:
+			settings->record_file = optarg;
+			break;
+		case OPT_STICK_STATS:
+			settings->stick_stats_file = optarg;
+			break;
+		case OPT_PERFTEST_ITERATIONS:
+			settings->perftest.iterations = atoi(optarg);
+			break;
+		case OPT_PERFTEST_WARMUP:
+			settings->perftest.warmup = atoi(optarg);
+			break;
+		case OPT_PERFTEST_TESTS:
+			settings->perftest.tests = optarg;
+			break;
+		case OPT_PERFTEST_COMPARE:
+			settings->perftest.baseline = optarg;
+			break;
+		case OPT_PERFTEST_THRESHOLD:
+			settings->perftest.threshold = atoi(optarg);
+			break;
+		case OPT_LATENCY_DURATION:
+			settings->latency.duration = atoi(optarg);
+			break;
+		case OPT_LATENCY_POLL_INTERVALS:
+			settings->latency.poll_intervals = optarg;
+			break;
+		case OPT_LATENCY_HOLDOFFS:
+			settings->latency.holdoffs = optarg;
+			break;
+		default:
+			return 0;
 	}
-	rnt_freeListCtx(listctx);
 
-	if (!selected_device) {
-		if (serial_specified) {
-			fprintf(stderr, "Device not found\n");
-		} else {
-			fprintf(stderr, "No device found\n");
-		}
-		return 1;
-	}
+	return 1;
+}
 
-	hdl = rnt_openDevice(selected_device);
-	if (!hdl) {
-		printf("Error opening device. (Do you have permissions?)\n");
-		return 1;
+/* Execute the commands in argv, in order. Returns non-zero if any of them failed. */
+static int runCommands(rnt_hdl_t hdl, int argc, char **argv, const struct cmd_settings *settings)
+{
+	int verbose = settings->verbose;
+	int nonstop = settings->nonstop;
+	int noconfirm = settings->noconfirm;
+	int enable_highres = settings->enable_highres;
+	int wii_poll_rate = settings->wii_poll_rate;
+	int psx_mc_sparse = settings->psx_mc_sparse;
+	int psx_mc_diff = settings->psx_mc_diff;
+	const char *psx_mc_known = settings->psx_mc_known;
+	const char *outfile = settings->outfile;
+	int channel = settings->channel;
+	int opt, retval = 0, failed = 0;
+	int res;
+
+	// Settings held by the libraries
+	if (settings->i2c_gap >= 0) {
+		wusbmotelib_setI2CGap(settings->i2c_gap, 0);
 	}
+	pollraw_setRecordFile(settings->record_file);
+	pollraw_setStickStatsFile(settings->stick_stats_file);
 
 	optind = 1;
 	while((opt = getopt_long(argc, argv, short_optstr, longopts, NULL)) != -1)
@@ -530,26 +743,34 @@ int main(int argc, char **argv)
 			case OPT_SET_MODE:
 				cmd[0] = atoi(optarg);
 				printf("Setting mode to %d\n", cmd[0]);
-				rnt_setConfig(hdl, CFG_PARAM_MODE, cmd, 1);
+				if (rnt_setConfig(hdl, CFG_PARAM_MODE, cmd, 1)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_GET_MODE:
 				n = rnt_getConfig(hdl, CFG_PARAM_MODE, cmd, sizeof(cmd));
 				if (n == 1) {
 					printf("Current mode: %d\n", cmd[0]);
+				} else {
+					retval = 1;
 				}
 				break;
 
 			case OPT_SET_POLL_INTERVAL:
 				cmd[0] = atoi(optarg);
 				printf("Setting poll interval to %d ms\n", cmd[0]);
-				rnt_setConfig(hdl, CFG_PARAM_POLL_INTERVAL0, cmd, 1);
+				if (rnt_setConfig(hdl, CFG_PARAM_POLL_INTERVAL0, cmd, 1)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_GET_POLL_INTERVAL:
 				n = rnt_getConfig(hdl, CFG_PARAM_POLL_INTERVAL0, cmd, sizeof(cmd));
 				if (n == 1) {
 					printf("Poll interval: %d ms\n", cmd[0]);
+				} else {
+					retval = 1;
 				}
 				break;
 
@@ -559,7 +780,9 @@ int main(int argc, char **argv)
 					fprintf(stderr, "Serial number must be 6 characters\n");
 					return -1;
 				}
-				rnt_setConfig(hdl, CFG_PARAM_SERIAL, (void*)optarg, 6);
+				if (rnt_setConfig(hdl, CFG_PARAM_SERIAL, (void*)optarg, 6)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_GET_SERIAL:
@@ -567,25 +790,35 @@ int main(int argc, char **argv)
 				if (n==6) {
 					cmd[6] = 0;
 					printf("Serial: %s\n", cmd);
+				} else {
+					retval = 1;
 				}
 				break;
 
 			case OPT_BOOTLOADER:
 				printf("Sending 'jump to bootloader' command...");
-				rnt_bootloader(hdl);
+				if (rnt_bootloader(hdl)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_RESET:
 				printf("Sending 'reset firmware' command...");
-				rnt_reset(hdl);
+				if (rnt_reset(hdl)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_SUSPEND_POLLING:
-				rnt_suspendPolling(hdl, 1);
+				if (rnt_suspendPolling(hdl, 1)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_RESUME_POLLING:
-				rnt_suspendPolling(hdl, 0);
+				if (rnt_suspendPolling(hdl, 0)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_N64_INIT_RUMBLE:
@@ -596,9 +829,8 @@ int main(int argc, char **argv)
 
 					n = gcn64lib_mempak_writeBlock(hdl, channel, 0x8000, cmdbuf);
 					if (n < 0) {
-						printHexBuf(cmd, n);
-					} else {
 						printf("Error %d\n", n);
+						retval = 1;
 					}
 
 				}
@@ -614,16 +846,21 @@ int main(int argc, char **argv)
 					n = gcn64lib_mempak_writeBlock(hdl, channel, 0xC000, cmdbuf);
 					if (n < 0) {
 						printf("Error %d\n", n);
+						retval = 1;
 					}
 				}
 				break;
 
 			case OPT_BIOSENSOR:
-				gcn64lib_biosensorMonitor(hdl, channel);
+				if (gcn64lib_biosensorMonitor(hdl, channel)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_XFERPAK_INFO:
-				gcn64lib_xferpak_printInfo(hdl, channel);
+				if (gcn64lib_xferpak_printInfo(hdl, channel)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_XFERPAK_DUMP_ROM:
@@ -633,6 +870,8 @@ int main(int argc, char **argv)
 
 				if (res == 0) {
 					printf("Wrote %s\n", optarg);
+				} else {
+					retval = 1;
 				}
 				break;
 
@@ -643,6 +882,8 @@ int main(int argc, char **argv)
 
 				if (res == 0) {
 					printf("Wrote %s\n", optarg);
+				} else {
+					retval = 1;
 				}
 				break;
 
@@ -653,6 +894,8 @@ int main(int argc, char **argv)
 
 				if (res == 0) {
 					printf("Wrote %s to cartridge\n", optarg);
+				} else {
+					retval = 1;
 				}
 				break;
 
@@ -662,6 +905,8 @@ int main(int argc, char **argv)
 				if (n >= 0) {
 					printf("N64 Get status[%d]: ", n);
 					printHexBuf(cmd, n);
+				} else {
+					retval = 1;
 				}
 				break;
 
@@ -671,6 +916,8 @@ int main(int argc, char **argv)
 				if (n >= 0) {
 					printf("GC Get origins answer[%d]: ", n);
 					printHexBuf(cmd, n);
+				} else {
+					retval = 1;
 				}
 				break;
 
@@ -682,6 +929,8 @@ int main(int argc, char **argv)
 				if (n >= 0) {
 					printf("GC Calibrate command answer[%d]: ", n);
 					printHexBuf(cmd, n);
+				} else {
+					retval = 1;
 				}
 				break;
 
@@ -690,7 +939,7 @@ int main(int argc, char **argv)
 				break;
 
 			case OPT_WII_POLLRAW:
-				retval = pollraw_wii(hdl, channel, enable_highres);
+				retval = pollraw_wii(hdl, channel, enable_highres, wii_poll_rate);
 				break;
 
 			case OPT_GC_POLLRAW:
@@ -709,6 +958,10 @@ int main(int argc, char **argv)
 				retval = pollraw_n64(hdl, channel);
 				break;
 
+			case OPT_MULTI_POLLRAW:
+				retval = pollraw_multi(hdl, optarg);
+				break;
+
 			case OPT_PSX_POLLRAW:
 				retval = pollraw_psx(hdl, channel);
 				break;
@@ -730,6 +983,8 @@ int main(int argc, char **argv)
 				if (n >= 0) {
 					printf("GC Get status[%d]: ", n);
 					printHexBuf(cmd, n);
+				} else {
+					retval = 1;
 				}
 				break;
 
@@ -804,8 +1059,9 @@ int main(int argc, char **argv)
 					int res;
 
 					printf("Reading mempak...\n");
-					res = gcn64lib_mempak_download(hdl, channel, &pak, mempak_progress_cb, "Reading address");
-					printf("\n");
+					mempak_progressStart(getUIIO(NULL), "Reading address");
+					res = gcn64lib_mempak_download(hdl, channel, &pak, mempak_progress_cb, getUIIO(NULL));
+					uiio_progressEnd(getUIIO(NULL), res ? "Error" : "Done");
 					switch (res)
 					{
 						case 0:
@@ -820,6 +1076,7 @@ int main(int argc, char **argv)
 										printf("Wrote file '%s' in %s format\n", outfile, mempak_format2string(file_format));
 									} else {
 										fprintf(stderr, "error writing file\n");
+										retval = 1;
 									}
 								}
 							} else { // No outfile
@@ -829,13 +1086,16 @@ int main(int argc, char **argv)
 							break;
 						case -1:
 							fprintf(stderr, "No mempak detected\n");
+							retval = 1;
 							break;
 						case -2:
 							fprintf(stderr, "I/O error reading pak\n");
+							retval = 1;
 							break;
 						default:
 						case -3:
 							fprintf(stderr, "Error\n");
+							retval = 1;
 							break;
 
 					}
@@ -856,8 +1116,9 @@ int main(int argc, char **argv)
 					}
 
 					printf("Writing to mempak...\n");
-					res = gcn64lib_mempak_upload(hdl, channel, pak, mempak_progress_cb, "Writing address");
-					printf("\n");
+					mempak_progressStart(getUIIO(NULL), "Writing address");
+					res = gcn64lib_mempak_upload(hdl, channel, pak, mempak_progress_cb, getUIIO(NULL));
+					uiio_progressEnd(getUIIO(NULL), res ? "Error" : "Done");
 					if (res) {
 						switch(res)
 						{
@@ -870,6 +1131,7 @@ int main(int argc, char **argv)
 							default:
 								fprintf(stderr, "Error uploading mempak\n");
 						}
+						retval = 1;
 					} else {
 						printf("Mempak uploaded\n");
 					}
@@ -914,23 +1176,33 @@ int main(int argc, char **argv)
 				break;
 
 			case OPT_SI8BIT_SCAN:
-				gcn64lib_8bit_scan(hdl, channel, 0, 255);
+				if (gcn64lib_8bit_scan(hdl, channel, 0, 255)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_SI16BIT_SCAN:
-				gcn64lib_16bit_scan(hdl, channel, 0, 0xffff);
+				if (gcn64lib_16bit_scan(hdl, channel, 0, 0xffff)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_I2C_DETECT:
-				wusbmotelib_i2c_detect(hdl, channel, NULL, 1);
+				if (wusbmotelib_i2c_detect(hdl, channel, NULL, 1)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_GC_TO_N64_INFO:
 				{
 					struct x2gcn64_adapter_info inf;
+					int i;
 
 					res = x2gcn64_adapter_getInfo(hdl, channel, &inf);
 					if (res == 0) {
+						for (i=0; i<GC2N64_NUM_MAPPINGS; i++) {
+							gc2n64_adapter_getInfoMapping(hdl, channel, &inf, i);
+						}
 						x2gcn64_adapter_printInfo(&inf);
 					} else {
 						retval = 1;
@@ -959,25 +1231,46 @@ int main(int argc, char **argv)
 				break;
 
 			case OPT_GC_TO_N64_UPDATE:
-				x2gcn64_adapter_updateFirmware(hdl, channel, optarg, NULL);
+				if (x2gcn64_adapter_updateFirmware(hdl, channel, optarg, NULL)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_GC_TO_N64_DUMP:
-				x2gcn64_adapter_dumpFlash(hdl, channel);
+				if (x2gcn64_adapter_dumpFlash(hdl, channel)) {
+					retval = 1;
+				}
+				break;
+
+			case OPT_GC_TO_N64_READ_FLASH:
+				if (x2gcn64_adapter_saveFlash(hdl, channel, optarg)) {
+					retval = 1;
+				}
+				break;
+
+			case OPT_GC_TO_N64_COMPARE:
+				if (x2gcn64_adapter_compareFlash(hdl, channel, optarg)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_GC_TO_N64_ENTER_BOOTLOADER:
 				x2gcn64_adapter_enterBootloader(hdl, channel);
-				x2gcn64_adapter_waitForBootloader(hdl, channel, 5);
+				if (x2gcn64_adapter_waitForBootloader(hdl, channel, 5)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_GC_TO_N64_BOOT_APPLICATION:
-				x2gcn64_adapter_bootApplication(hdl, channel);
+				if (x2gcn64_adapter_bootApplication(hdl, channel)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_GC_TO_N64_READ_MAPPING:
 				{
 					struct x2gcn64_adapter_info inf;
+					struct gc2n64_adapter_mapping *mapping;
 					int map_id;
 
 					map_id = atoi(optarg);
@@ -986,13 +1279,22 @@ int main(int argc, char **argv)
 						return -1;
 					}
 
-					x2gcn64_adapter_getInfo(hdl, channel, &inf);
-					printf("Mapping %d : { ", map_id);
-					gc2n64_adapter_printMapping(&inf.app.gc2n64.mappings[map_id-1]);
+					if (x2gcn64_adapter_getInfo(hdl, channel, &inf)) {
+						return -1;
+					}
+					mapping = gc2n64_adapter_getInfoMapping(hdl, channel, &inf, map_id-1);
+					if (!mapping) {
+						fprintf(stderr, "Could not read mapping\n");
+						return -1;
+					}
+					printf("Mapping %d : { ", map_id);
+					gc2n64_adapter_printMapping(mapping);
 					printf(" }\n");
 					if (outfile) {
 						printf("Writing mapping to file '%s'\n", outfile);
-						gc2n64_adapter_saveMapping(&inf.app.gc2n64.mappings[map_id-1], outfile);
+						if (gc2n64_adapter_saveMapping(mapping, outfile)) {
+							retval = 1;
+						}
 					}
 				}
 				break;
@@ -1012,7 +1314,10 @@ int main(int argc, char **argv)
 					gc2n64_adapter_printMapping(mapping);
 					printf(" }\n");
 
-					gc2n64_adapter_setMapping(hdl, channel, mapping);
+					if (gc2n64_adapter_setMapping(hdl, channel, mapping)) {
+						fprintf(stderr, "Failed to set mapping\n");
+						retval = 1;
+					}
 
 					free(mapping);
 				}
@@ -1033,6 +1338,7 @@ int main(int argc, char **argv)
 						printf("Stored mapping to slot %d (%s)\n", slot, gc2n64_adapter_getMappingSlotName(slot, 0));
 					} else {
 						printf("Error storing mapping\n");
+						retval = 1;
 					}
 				}
 				break;
@@ -1043,6 +1349,8 @@ int main(int argc, char **argv)
 
 					if (0 == rnt_getVersion(hdl, version, sizeof(version))) {
 						printf("Firmware version: %s\n", version);
+					} else {
+						retval = 1;
 					}
 				}
 				break;
@@ -1053,6 +1361,8 @@ int main(int argc, char **argv)
 
 					if (0 == rnt_getSignatureCompat(hdl, sig, sizeof(sig))) {
 						printf("Signature: %s\n", sig);
+					} else {
+						retval = 1;
 					}
 				}
 				break;
@@ -1061,12 +1371,31 @@ int main(int argc, char **argv)
 				{
 					int type;
 					type = rnt_getControllerType(hdl, channel);
+					if (type < 0) {
+						retval = 1;
+						break;
+					}
 					printf("Controller type 0x%02x: %s\n", type, rnt_controllerName(type));
 				}
 				break;
 
 			case OPT_PERFTEST:
-				perftest1(hdl, channel);
+				if (perftest_run(hdl, channel, &settings->perftest, outfile)) {
+					retval = 1;
+				}
+				break;
+
+			case OPT_LATENCY_TEST:
+				{
+					struct latency_opts lopts = settings->latency;
+
+					lopts.path = latency_parsePath(optarg);
+					if (lopts.path < 0) {
+						fprintf(stderr, "Unknown path '%s' (n64, gc, psx or dc)\n", optarg);
+						return -1;
+					}
+					retval = latency_run(hdl, channel, &lopts, outfile);
+				}
 				break;
 
 			case OPT_DISABLE_ENCRYPTION:
@@ -1078,7 +1407,9 @@ int main(int argc, char **argv)
 				break;
 
 			case OPT_PCE_RAWTEST:
-				pcelib_rawpoll(hdl);
+				if (pcelib_rawpoll(hdl)) {
+					retval = 1;
+				}
 				break;
 
 			case OPT_USB_TEST:
@@ -1096,7 +1427,9 @@ int main(int argc, char **argv)
 					uint8_t rxbuf[32];
 
 					res = rnt_exchange(hdl, cmd, 1, rxbuf, sizeof(rxbuf));
-					if (res < 2) {
+					if (res < 0) {
+						retval = 1;
+					} else if (res < 2) {
 						printf("No data\n");
 					} else {
 						printf("Debug data[%d] : ", res-1);
@@ -1106,20 +1439,33 @@ int main(int argc, char **argv)
 				break;
 
 			case OPT_PSX_MC_DUMP:
+			case OPT_PSX_MC_DUMP_SAVE:
 				{
 					struct psx_memorycard mc_data;
-					int res;
+					int res, mode, block = 0;
+
+					if (opt == OPT_PSX_MC_DUMP_SAVE) {
+						mode = PSXLIB_READ_SAVE;
+						block = atoi(optarg);
+					} else {
+						mode = psx_mc_sparse ? PSXLIB_READ_USED : PSXLIB_READ_ALL;
+					}
 
 					rnt_suspendPolling(hdl, 1);
-					res = psxlib_readMemoryCard(hdl, channel, &mc_data, NULL);
+					res = psxlib_readMemoryCardEx(hdl, channel, &mc_data, mode, block, NULL);
 					rnt_suspendPolling(hdl, 0);
 
 					if (res == 0) {
+						printSkippedBlocks("Skipped blocks (zero-filled)", mc_data.skipped_blocks);
+
 						// Todo: filename-based format selection
-						psxlib_writeMemoryCardToFile(&mc_data, outfile, PSXLIB_FILE_FORMAT_RAW);
+						if (psxlib_writeMemoryCardToFile(&mc_data, outfile, PSXLIB_FILE_FORMAT_RAW)) {
+							retval = 1;
+						}
 					}
 					else {
 						fprintf(stderr, "%s\n", psxlib_getErrorString(res));
+						retval = 1;
 					}
 
 				}
@@ -1128,6 +1474,8 @@ int main(int argc, char **argv)
 			case OPT_PSX_MC_WRITE:
 				{
 					struct psx_memorycard mc_data;
+					struct psx_memorycard *known = NULL;
+					struct psxlib_write_stats stats = { };
 
 					retval = psxlib_loadMemoryCardFromFile(optarg, PSXLIB_FILE_FORMAT_AUTO, &mc_data);
 					if (retval < 0) {
@@ -1135,10 +1483,33 @@ int main(int argc, char **argv)
 						break;
 					}
 
+					if (psx_mc_known) {
+						known = malloc(sizeof(struct psx_memorycard));
+						if (!known) {
+							perror("malloc");
+							retval = -1;
+							break;
+						}
+						retval = psxlib_loadMemoryCardFromFile(psx_mc_known, PSXLIB_FILE_FORMAT_AUTO, known);
+						if (retval < 0) {
+							fprintf(stderr, "%s: %s\n", psx_mc_known, psxlib_getErrorString(retval));
+							free(known);
+							break;
+						}
+						// Sparse images: the zero-filled blocks are not the card contents
+						printSkippedBlocks("Blocks missing from the known image (treated as unknown)", known->skipped_blocks);
+					}
+					printSkippedBlocks("Blocks missing from the image (not written)", mc_data.skipped_blocks);
+
 					rnt_suspendPolling(hdl, 1);
-					retval = psxlib_writeMemoryCard(hdl, channel, &mc_data, NULL);
+					retval = psxlib_writeMemoryCardEx(hdl, channel, &mc_data, known,
+								psx_mc_diff ? PSXLIB_WRITE_COMPARE : PSXLIB_WRITE_ALL, &stats, NULL);
 					rnt_suspendPolling(hdl, 0);
 
+					free(known);
+
+					printf("Sectors written: %d, unchanged: %d\n", stats.written, stats.skipped);
+
 					if (retval < 0) {
 						fprintf(stderr, "%s\n", psxlib_getErrorString(retval));
 						break;
@@ -1147,11 +1518,45 @@ int main(int argc, char **argv)
 				break;
 		}
 
+		switch (opt)
+		{
+			case OPT_PSX_MC_LS:
+			case OPT_PSX_MC_EXTRACT:
+			case OPT_PSX_MC_INSERT:
+			case OPT_PSX_MC_RM:
+			case OPT_PSX_MC_DEFRAG:
+				retval = psxMemcardFsCommand(hdl, channel, opt, optarg, outfile);
+				break;
+		}
+
+		if (verbose) {
+			switch (opt)
+			{
+				case OPT_PSX_MC_DUMP:
+				case OPT_PSX_MC_DUMP_SAVE:
+				case OPT_PSX_MC_WRITE:
+				case OPT_PSX_MC_LS:
+				case OPT_PSX_MC_EXTRACT:
+				case OPT_PSX_MC_INSERT:
+				case OPT_PSX_MC_RM:
+				case OPT_PSX_MC_DEFRAG:
+					{
+						struct psxlib_chunk_plan plan;
+
+						psxlib_getChunkPlan(hdl, &plan);
+						psxlib_printChunkPlan(&plan);
+					}
+					break;
+			}
+		}
+
 		if (do_exchange) {
 			int i;
 			n = rnt_exchange(hdl, cmd, cmdlen, cmd, sizeof(cmd));
-			if (n<0)
+			if (n<0) {
+				retval = 1;
 				break;
+			}
 
 			printf("Result: %d bytes: ", n);
 			for (i=0; i<n; i++) {
@@ -1159,6 +1564,414 @@ int main(int argc, char **argv)
 			}
 			printf("\n");
 		}
+
+		// Commands which succeed must not hide an earlier failure
+		if (retval) {
+			failed = retval;
+		}
+	}
+
+	return failed ? failed : retval;
+}
+
+/* Options which only make sense on the command-line */
+static int isGlobalOption(int opt)
+{
+	switch (opt)
+	{
+		case 's':
+		case 'f':
+		case 'l':
+		case 'h':
+		case OPT_N64_CRCA:
+		case OPT_N64_CRCD:
+		case OPT_FW_CATALOG:
+		case OPT_MACHINE_PROGRESS:
+		case OPT_DAEMON:
+		case OPT_VIA_DAEMON:
+		case OPT_SOCKET:
+		case OPT_STAND_IN:
+		case OPT_STAND_INS:
+		case OPT_FLEET_UPDATE:
+		case OPT_FLEET_JOBS:
+		case OPT_FLEET_RETRIES:
+		case OPT_FLEET_AUDIT:
+		case OPT_FLEET_EXPECT:
+		case OPT_SCRIPT:
+		case OPT_SCRIPT_VAR:
+		case OPT_SCRIPT_CONTINUE:
+		case OPT_REFRESH_CAPS:
+		case OPT_NO_CAPS_CACHE:
+			return 1;
+	}
+	return 0;
+}
+
+struct script_ctx {
+	rnt_hdl_t hdl;
+	const struct cmd_settings *settings;
+};
+
+/* Run one line of a script. The settings from the command-line apply,
+ * unless the line overrides them. */
+static int runScriptStep(int argc, char **argv, void *data)
+{
+	struct script_ctx *ctx = data;
+	struct cmd_settings settings = *ctx->settings;
+	struct wusbmote_i2c_timing timing = *wusbmotelib_getDefaultI2CTiming();
+	int opt, res;
+
+	optind = 1;
+	while((opt = getopt_long(argc, argv, short_optstr, longopts, NULL)) != -1) {
+		if (parseSetting(opt, &settings))
+			continue;
+		if (opt == '?')
+			return -1;
+		if (isGlobalOption(opt)) {
+			fprintf(stderr, "Command-line only option used in a script\n");
+			return -1;
+		}
+	}
+
+	res = runCommands(ctx->hdl, argc, argv, &settings);
+
+	// A gap given on this line must not apply to the next ones (the record
+	// and stick statistics files are set again by each runCommands())
+	if (settings.i2c_gap != ctx->settings->i2c_gap) {
+		*wusbmotelib_getDefaultI2CTiming() = timing;
+	}
+
+	return res;
+}
+
+int main(int argc, char **argv)
+{
+	rnt_hdl_t hdl;
+	struct rnt_adap_list_ctx *listctx;
+	int opt, retval = 0;
+	struct rnt_adap_info inf;
+	struct rnt_adap_info *selected_device = NULL;
+	int use_first = 0, serial_specified = 0;
+	struct cmd_settings settings = { };
+	int cmd_list = 0;
+	int cmd_fw_catalog = 0;
+	int cmd_daemon = 0;
+	int cmd_perftest = 0;
+	int via_daemon = 0;
+	int stand_in = 0;
+	const char *fleet_hexfile = NULL, *fleet_expect = NULL;
+	int fleet_audit = 0;
+	int fleet_jobs = FWFLEET_DEFAULT_JOBS, fleet_retries = FWFLEET_DEFAULT_RETRIES;
+	const char *script_file = NULL;
+	struct ctlscript script;
+	const char *socket_path = NULL;
+	char default_socket_path[PATH_MAX];
+#define TARGET_SERIAL_CHARS 128
+	wchar_t target_serial[TARGET_SERIAL_CHARS];
+	int res;
+
+	ctlscript_init(&script, runScriptStep, NULL);
+	settings.perftest.warmup = -1;
+	settings.i2c_gap = -1;
+
+	while((opt = getopt_long(argc, argv, short_optstr, longopts, NULL)) != -1) {
+		if (parseSetting(opt, &settings))
+			continue;
+
+		switch(opt)
+		{
+			case 's':
+				{
+					mbstate_t ps;
+					memset(&ps, 0, sizeof(ps));
+					if (mbsrtowcs(target_serial, (const char **)&optarg, TARGET_SERIAL_CHARS, &ps) < 1) {
+						fprintf(stderr, "Invalid serial number specified\n");
+						return -1;
+					}
+					serial_specified = 1;
+				}
+				break;
+			case 'f':
+				use_first = 1;
+				break;
+			case 'h':
+				printUsage();
+				return 0;
+			case 'l':
+				cmd_list = 1;
+				break;
+			case '?':
+				fprintf(stderr, "Unrecognized argument. Try -h\n");
+				return -1;
+
+			case OPT_N64_CRCA:
+				{
+					long addr;
+					char *e;
+
+					addr = strtol(optarg, &e, 0);
+					if (e==optarg) {
+						fprintf(stderr, "Invalid address\n");
+						return 1;
+					}
+					if (addr < 0 || addr > 0xffff) {
+						fprintf(stderr, "Address out of range\n");
+						return 1;
+					}
+
+					printf("Computing pak address crc for 0x%04x\n", (uint16_t)addr);
+					printf("CRCA: 0x%04x\n", pak_address_crc(addr));
+					return 0;
+				}
+				break;
+
+			case OPT_N64_CRCD:
+				{
+					uint8_t inbuf[64];
+					int inlen;
+					int v, i;
+					uint8_t crc;
+
+					if (strlen(optarg) % 2) {
+						fprintf(stderr, "Error: An even number of nibbles must be specified, and no space between bytes. Ex: 1301 not 13 01\n");
+						return -1;
+					}
+
+					inlen = strlen(optarg)/2;
+					if (inlen > sizeof(inbuf)) {
+						fprintf(stderr, "Error: Too many bytes. Max %d\n", (int)sizeof(inbuf));
+						return -1;
+					}
+
+					for (i=0; i<inlen; i++) {
+						sscanf(optarg + (i*2), "%02x", &v);
+						inbuf[i] = v;
+					}
+
+					printf("Computing pak data CRC[%d] : ", inlen);
+					printHexBuf(inbuf, inlen);
+
+					crc = pak_data_crc(inbuf, inlen);
+
+					printf("CRCD: 0x%02x\n", crc);
+					return 0;
+				}
+				break;
+
+			case OPT_FW_CATALOG:
+				cmd_fw_catalog = 1;
+				break;
+
+			case OPT_MACHINE_PROGRESS:
+				uiio_std_setMachineReadable(1);
+				break;
+
+			case OPT_DAEMON:
+				cmd_daemon = 1;
+				break;
+
+			case OPT_VIA_DAEMON:
+				via_daemon = 1;
+				break;
+
+			case OPT_SOCKET:
+				socket_path = optarg;
+				break;
+
+			case OPT_STAND_IN:
+				stand_in = 1;
+				break;
+
+			case OPT_STAND_INS:
+				stand_in = atoi(optarg);
+				break;
+
+			case OPT_FLEET_UPDATE:
+				fleet_hexfile = optarg;
+				break;
+
+			case OPT_FLEET_AUDIT:
+				fleet_audit = 1;
+				break;
+
+			case OPT_FLEET_EXPECT:
+				fleet_expect = optarg;
+				fleet_audit = 1;
+				break;
+
+			case OPT_FLEET_JOBS:
+				fleet_jobs = atoi(optarg);
+				if (fleet_jobs < 1 || fleet_jobs > FWFLEET_MAX_JOBS) {
+					fprintf(stderr, "Invalid number of jobs (1 to %d)\n", FWFLEET_MAX_JOBS);
+					return 1;
+				}
+				break;
+
+			case OPT_FLEET_RETRIES:
+				fleet_retries = atoi(optarg);
+				if (fleet_retries < 0) {
+					fprintf(stderr, "Invalid number of retries\n");
+					return 1;
+				}
+				break;
+
+			case OPT_SCRIPT:
+				script_file = optarg;
+				break;
+
+			case OPT_SCRIPT_VAR:
+				if (ctlscript_setVarArg(&script, optarg)) {
+					return 1;
+				}
+				break;
+
+			case OPT_SCRIPT_CONTINUE:
+				script.on_error = CTLSCRIPT_CONTINUE;
+				break;
+
+			case OPT_REFRESH_CAPS:
+				rnt_setCapsCacheMode(RNT_CAPS_CACHE_REFRESH);
+				break;
+
+			case OPT_NO_CAPS_CACHE:
+				rnt_setCapsCacheMode(RNT_CAPS_CACHE_OFF);
+				break;
+
+			case OPT_PERFTEST:
+				cmd_perftest = 1;
+				break;
+		}
+	}
+
+	// Comparing result files does not need an adapter
+	if (settings.perftest.baseline && !cmd_perftest) {
+		if (!settings.infile) {
+			fprintf(stderr, "The results to compare must be specified (--infile), or use --perftest\n");
+			return 1;
+		}
+		return perftest_compareFiles(settings.perftest.baseline, settings.infile, settings.perftest.threshold);
+	}
+
+	if (cmd_fw_catalog) {
+		struct fwcatalog *cat;
+
+		cat = fwcatalog_open(NULL, NULL);
+		if (!cat) {
+			fprintf(stderr, "Firmware directory not found\n");
+			return 1;
+		}
+		fwcatalog_print(cat, NULL);
+		fwcatalog_free(cat);
+		return 0;
+	}
+
+	if (cmd_daemon && via_daemon) {
+		fprintf(stderr, "--daemon and --via_daemon cannot be used together\n");
+		return 1;
+	}
+
+	if (via_daemon) {
+		if (!socket_path) {
+			if (rntd_defaultSocketPath(default_socket_path, sizeof(default_socket_path))) {
+				fprintf(stderr, "Socket path too long\n");
+				return 1;
+			}
+			socket_path = default_socket_path;
+		}
+		if (rnt_useDaemon(socket_path)) {
+			return 1;
+		}
+	}
+
+	rnt_useStandIn(stand_in);
+	rnt_init(settings.verbose);
+
+	if (cmd_daemon) {
+		res = rntd_serve(socket_path);
+		rnt_shutdown();
+		return res ? 1 : 0;
+	}
+
+	if (fleet_hexfile || fleet_audit) {
+		struct fwfleet fleet;
+
+		if (fleet_hexfile && fleet_audit) {
+			fprintf(stderr, "--fleet_update and --fleet_audit cannot be combined\n");
+			rnt_shutdown();
+			return 1;
+		}
+		if (fleet_audit ? fwfleet_initAudit(&fleet, fleet_expect) : fwfleet_init(&fleet, fleet_hexfile)) {
+			rnt_shutdown();
+			return 1;
+		}
+		res = fwfleet_discover(&fleet);
+		if (res > 0) {
+			res = fwfleet_run(&fleet, fleet_jobs, fleet_retries);
+			fwfleet_printSummary(&fleet);
+		} else {
+			printf("No adapter to %s\n", fleet_audit ? "audit" : "update");
+			res = 1;
+		}
+		fwfleet_free(&fleet);
+		rnt_shutdown();
+		return res ? 1 : 0;
+	}
+
+	if (cmd_list) {
+		printf("Simply listing the devices...\n");
+		res = listDevices();
+		if (res > 0) {
+			printf("Found %d devices\n", res);
+			return 0;
+		} else {
+			printf("No device found\n");
+			return 1;
+		}
+	}
+
+	if (!serial_specified && !use_first) {
+		fprintf(stderr, "A serial number or -f must be used. Try -h for more information.\n");
+		return 1;
+	}
+
+	listctx = rnt_allocListCtx();
+	while ((selected_device = rnt_listDevices(&inf, listctx)))
+	{
+		if (serial_specified) {
+			if (0 == wcscmp(inf.str_serial, target_serial)) {
+				break;
+			}
+		}
+		else {
+			// use_first == 1
+			printf("Will use device '%ls' serial '%ls'\n", inf.str_prodname, inf.str_serial);
+			break;
+		}
+	}
+	rnt_freeListCtx(listctx);
+
+	if (!selected_device) {
+		if (serial_specified) {
+			fprintf(stderr, "Device not found\n");
+		} else {
+			fprintf(stderr, "No device found\n");
+		}
+		return 1;
+	}
+
+	hdl = rnt_openDevice(selected_device);
+	if (!hdl) {
+		printf("Error opening device. (Do you have permissions?)\n");
+		return 1;
+	}
+
+	retval = runCommands(hdl, argc, argv, &settings);
+
+	if (script_file && !retval) {
+		struct script_ctx ctx = { hdl, &settings };
+
+		script.ctx = &ctx;
+		retval = ctlscript_run(&script, script_file) ? 1 : 0;
 	}
 
 	rnt_closeDevice(hdl);
@@ -30,14 +30,11 @@ static int fill_pak(rnt_hdl_t hdl, unsigned char channel, uiio *u, uint8_t v)
 
 	memset(fill, v, sizeof(fill));
 
-	u->cur_progress = 0;
-	u->max_progress = 0x8000 - 32;
-	u->progressStart(u);
+	uiio_progressStart(u, 0x8000 - 32, 1);
 
 	for (block=0; block<0x8000; block+=32)
 	{
-		u->cur_progress = block;
-		u->update(u);
+		uiio_progressUpdate(u, block);
 
 		res = gcn64lib_mempak_writeBlock(hdl, channel, block, fill);
 		if (res < 0) {
@@ -45,7 +42,7 @@ static int fill_pak(rnt_hdl_t hdl, unsigned char channel, uiio *u, uint8_t v)
 		}
 	}
 
-	u->progressEnd(u, "Overwrite OK");
+	uiio_progressEnd(u, "Overwrite OK");
 	return 0;
 }
 
@@ -58,14 +55,11 @@ static int check_fill(rnt_hdl_t hdl, unsigned char channel, uiio *u, uint8_t v)
 
 	memset(expected, v, sizeof(expected));
 
-	u->cur_progress = 0;
-	u->max_progress = 0x8000 - 32;
-	u->progressStart(u);
+	uiio_progressStart(u, 0x8000 - 32, 1);
 
 	for (block=0; block<0x8000; block+=32)
 	{
-		u->cur_progress = block;
-		u->update(u);
+		uiio_progressUpdate(u, block);
 
 		res = gcn64lib_mempak_readBlock(hdl, channel, block, buf);
 		if (res < 0) {
@@ -79,7 +73,7 @@ static int check_fill(rnt_hdl_t hdl, unsigned char channel, uiio *u, uint8_t v)
 		}
 	}
 
-	u->progressEnd(u, "Verify OK");
+	uiio_progressEnd(u, "Verify OK");
 	return 0;
 }
 
@@ -41,14 +41,11 @@ static int fill_pak_pseudoRandom(rnt_hdl_t hdl, unsigned char channel, uiio *u,
 
 	lfsr = seed;
 
-	u->cur_progress = 0;
-	u->max_progress = 0x8000 - 32;
-	u->progressStart(u);
+	uiio_progressStart(u, 0x8000 - 32, 1);
 
 	for (block=0; block<0x8000; block+=32)
 	{
-		u->cur_progress = block;
-		u->update(u);
+		uiio_progressUpdate(u, block);
 
 		// Fill block with "random" data
 		for (i=0; i<32; i+= 2) {
@@ -64,7 +61,7 @@ static int fill_pak_pseudoRandom(rnt_hdl_t hdl, unsigned char channel, uiio *u,
 
 	}
 
-	u->progressEnd(u, "OK");
+	uiio_progressEnd(u, "OK");
 	return 0;
 }
 
@@ -77,14 +74,11 @@ static int verify_pak_pseudoRandom(rnt_hdl_t hdl, unsigned char channel, uiio *u
 
 	lfsr = seed;
 
-	u->cur_progress = 0;
-	u->max_progress = 0x8000 - 32;
-	u->progressStart(u);
+	uiio_progressStart(u, 0x8000 - 32, 1);
 
 	for (block=0; block<0x8000; block+=32)
 	{
-		u->cur_progress = block;
-		u->update(u);
+		uiio_progressUpdate(u, block);
 
 		// Fill block with "random" data
 		for (i=0; i<32; i+= 2) {
@@ -105,7 +99,7 @@ static int verify_pak_pseudoRandom(rnt_hdl_t hdl, unsigned char channel, uiio *u
 		}
 	}
 
-	u->progressEnd(u, "OK");
+	uiio_progressEnd(u, "OK");
 	return 0;
 }
 
@@ -117,14 +111,11 @@ static int fill_pak(rnt_hdl_t hdl, unsigned char channel, uiio *u, uint8_t v)
 
 	memset(fill, v, sizeof(fill));
 
-	u->cur_progress = 0;
-	u->max_progress = 0x8000 - 32;
-	u->progressStart(u);
+	uiio_progressStart(u, 0x8000 - 32, 1);
 
 	for (block=0; block<0x8000; block+=32)
 	{
-		u->cur_progress = block;
-		u->update(u);
+		uiio_progressUpdate(u, block);
 
 		res = gcn64lib_mempak_writeBlock(hdl, channel, block, fill);
 		if (res < 0) {
@@ -132,7 +123,7 @@ static int fill_pak(rnt_hdl_t hdl, unsigned char channel, uiio *u, uint8_t v)
 		}
 	}
 
-	u->progressEnd(u, "OK");
+	uiio_progressEnd(u, "OK");
 	return 0;
 }
 
@@ -145,14 +136,11 @@ static int check_fill(rnt_hdl_t hdl, unsigned char channel, uiio *u, uint8_t v)
 
 	memset(expected, v, sizeof(expected));
 
-	u->cur_progress = 0;
-	u->max_progress = 0x8000 - 32;
-	u->progressStart(u);
+	uiio_progressStart(u, 0x8000 - 32, 1);
 
 	for (block=0; block<0x8000; block+=32)
 	{
-		u->cur_progress = block;
-		u->update(u);
+		uiio_progressUpdate(u, block);
 
 		res = gcn64lib_mempak_readBlock(hdl, channel, block, buf);
 		if (res < 0) {
@@ -166,7 +154,7 @@ static int check_fill(rnt_hdl_t hdl, unsigned char channel, uiio *u, uint8_t v)
 		}
 	}
 
-	u->progressEnd(u, "OK");
+	uiio_progressEnd(u, "OK");
 	return 0;
 }
 
@@ -177,15 +165,12 @@ static int burstTest(rnt_hdl_t hdl, unsigned char channel, uiio *u, int n_cycles
 
 	lfsr = LFSR_SEED;
 
-	u->cur_progress = 0;
-	u->max_progress = n_cycles-1;
-	u->progressStart(u);
+	uiio_progressStart(u, n_cycles-1, 0);
 
 	for (cycle=0; cycle<n_cycles; cycle++) {
 		for (block = 0; block<n_blocks; block++)
 		{
-			u->cur_progress = cycle;
-			u->update(u);
+			uiio_progressUpdate(u, cycle);
 
 			// Fill block with "random" data
 			for (i=0; i<32; i+= 2) {
@@ -213,7 +198,7 @@ static int burstTest(rnt_hdl_t hdl, unsigned char channel, uiio *u, int n_cycles
 		}
 	}
 
-	u->progressEnd(u, "OK");
+	uiio_progressEnd(u, "OK");
 	return 0;
 }
 
@@ -233,16 +218,13 @@ int mempak_stresstest(rnt_hdl_t hdl, int channel, int first_test)
 	///////////////////////////////////////////
 	if (first_test <= 1) {
 		u->caption = "Test 1: Check for presence...\n";
-		u->cur_progress = 0;
-		u->max_progress = 1;
-		u->progressStart(u);
+		uiio_progressStart(u, 1, 0);
 		if (gcn64lib_mempak_detect(hdl, channel) < 0) {
 			u->error("No mempak detected");
 			return -1;
 		}
-		u->cur_progress = 1;
-		u->update(u);
-		u->progressEnd(u, "Mempak detected");
+		uiio_progressUpdate(u, 1);
+		uiio_progressEnd(u, "Mempak detected");
 	}
 
 	///////////////////////////////////////////
@@ -315,19 +297,16 @@ int mempak_stresstest(rnt_hdl_t hdl, int channel, int first_test)
 			u->ask(UIIO_CONTINUE_ABORT, "Please disconnect the N64 controller or remove the memory pak");
 
 			u->caption = "Test 7: Check for absence...\n";
-			u->cur_progress = 0;
-			u->max_progress = 1;
-			u->progressStart(u);
+			uiio_progressStart(u, 1, 0);
 			if (gcn64lib_mempak_detect(hdl, channel) < 0) {
 				// Found it. Good.
 			} else {
-				u->progressEnd(u, "Mempak is still present");
+				uiio_progressEnd(u, "Mempak is still present");
 				return -1;
 			}
 
-			u->cur_progress = 1;
-			u->update(u);
-			u->progressEnd(u, "Mempak not detected as expected");
+			uiio_progressUpdate(u, 1);
+			uiio_progressEnd(u, "Mempak not detected as expected");
 		}
 
 		///////////////////////////////////////////
@@ -335,16 +314,13 @@ int mempak_stresstest(rnt_hdl_t hdl, int channel, int first_test)
 			u->ask(UIIO_CONTINUE_ABORT, "Please connect the N64 controller or re-insert the memory pak");
 
 			u->caption = "Test 8: Check for presence again...\n";
-			u->cur_progress = 0;
-			u->max_progress = 1;
-			u->progressStart(u);
+			uiio_progressStart(u, 1, 0);
 			if (gcn64lib_mempak_detect(hdl, channel) < 0) {
 				u->error("No mempak detected");
 				return -1;
 			}
-			u->cur_progress = 1;
-			u->update(u);
-			u->progressEnd(u, "Mempak detected");
+			uiio_progressUpdate(u, 1);
+			uiio_progressEnd(u, "Mempak detected");
 		}
 	}
 
@@ -1,147 +1,604 @@
 #include <stdio.h>
-#include <sys/time.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "perftest.h"
 #include "gcn64_protocol.h"
 #include "gcn64lib.h"
-#include "hexdump.h"
+#include "mempak.h"
+#include "mempak_gcn64usb.h"
+#include "psxlib.h"
+#include "wusbmotelib.h"
+#include "requests.h"
+#include "timer.h"
 
-#define N_CYCLES	60
-#define N_CYCLESLONG	1200
+#define ECHO_MAX_SIZE		63
+#define CSV_HEADER			"name,status,iterations,min_us,mean_us,p50_us,p90_us,p99_us,max_us"
+// The write test rewrites this block with its own content
+#define MEMPAK_TEST_ADDR	(MEMPAK_MEM_SIZE - 0x20)
 
-static long getElaps_us(struct timeval *tv_before, struct timeval *tv_after)
+/* Runs one iteration. Returns 0 on success. */
+typedef int (*perftest_func)(rnt_hdl_t hdl, int channel, int param);
+
+struct perftest_def {
+	char name[PERFTEST_MAX_NAME];
+	perftest_func func;
+	int param;
+	int explicit_only; // Not part of the default set
+};
+
+static const char *status_names[] = { "ok", "skipped", "failed" };
+
+static int test_version(rnt_hdl_t hdl, int channel, int param)
 {
-	return (tv_after->tv_sec - tv_before->tv_sec)*1000000 + (tv_after->tv_usec - tv_before->tv_usec);
+	char version[64];
+
+	return rnt_getVersion(hdl, version, sizeof(version));
 }
 
-static void printTestResult(long total_us, int cycles)
+static int test_echo(rnt_hdl_t hdl, int channel, int size)
 {
-	printf("Total time (microseconds): %ld\n", total_us);
-	printf("Cycles: %d\n", cycles);
-	printf("Average: %ld us\n", total_us / cycles);
+	unsigned char outbuf[ECHO_MAX_SIZE], inbuf[ECHO_MAX_SIZE];
+	int i, n;
+
+	outbuf[0] = RQ_RNT_ECHO;
+	for (i=1; i<size; i++) {
+		outbuf[i] = i ^ 0xA5;
+	}
+
+	n = rnt_exchange(hdl, outbuf, size, inbuf, size);
+	if (n != size || memcmp(outbuf, inbuf, size))
+		return -1;
+
+	return 0;
 }
 
-int perftest1(rnt_hdl_t hdl, int channel)
+static int test_rawSi(rnt_hdl_t hdl, int channel, int param)
+{
+	unsigned char cmd[64] = { N64_GET_CAPABILITIES };
+
+	// Both N64 and GC controllers answer this one
+	return gcn64lib_rawSiCommand(hdl, channel, cmd, 1, cmd, sizeof(cmd)) > 0 ? 0 : -1;
+}
+
+static int test_blockIO(rnt_hdl_t hdl, int channel, int n_ops)
 {
-	int n, i, res, j;
-	unsigned char cmd[64];
-	char version[64];
-	long total_us = 0;
-	struct timeval tv_before, tv_after;
 	unsigned char cmd_getcaps[1] = { N64_GET_CAPABILITIES };
-	unsigned char cmd_getstatus[1] = { N64_GET_STATUS };
-	struct blockio_op ops[4] = {
-		{ 0, sizeof(cmd_getcaps), cmd_getcaps, 3, cmd + 0 },
-		{ 0, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 3 },
-		{ 1, sizeof(cmd_getcaps), cmd_getcaps, 3, cmd + 7 },
-		{ 1, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 10 },
-	};
-	struct blockio_op ops2[2] = {
-		{ 0, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 0 },
-		{ 1, sizeof(cmd_getstatus), cmd_getstatus, 4, cmd + 4 },
-	};
+	unsigned char rx[PERFTEST_MAX_BLOCKIO_OPS * 3];
+	struct blockio_op ops[PERFTEST_MAX_BLOCKIO_OPS];
+	int i;
+
+	for (i=0; i<n_ops; i++) {
+		ops[i].chn = channel;
+		ops[i].tx_len = sizeof(cmd_getcaps);
+		ops[i].tx_data = cmd_getcaps;
+		ops[i].rx_len = 3;
+		ops[i].rx_data = rx + i * 3;
+	}
+
+	if (gcn64lib_blockIO(hdl, ops, n_ops) < 0)
+		return -1;
+
+	for (i=0; i<n_ops; i++) {
+		if (ops[i].rx_len & (BIO_RX_LEN_TIMEDOUT | BIO_RX_LEN_PARTIAL))
+			return -1;
+	}
 
-	printf("Requesting the firmware version %d times...\n", N_CYCLES);
-	for (i=0; i<N_CYCLES; i++) {
+	return 0;
+}
+
+static int test_mempakRead(rnt_hdl_t hdl, int channel, int param)
+{
+	unsigned char block[32];
 
-		gettimeofday(&tv_before, NULL);
-		res = rnt_getVersion(hdl, version, sizeof(version));
-		gettimeofday(&tv_after, NULL);
+	return gcn64lib_mempak_readBlock(hdl, channel, MEMPAK_TEST_ADDR, block) == 0x20 ? 0 : -1;
+}
 
-		total_us += getElaps_us(&tv_before, &tv_after);
+static int test_mempakWrite(rnt_hdl_t hdl, int channel, int param)
+{
+	static unsigned char block[32];
+	static int block_channel = -1;
 
-		if (res != 0) {
-			fprintf(stderr, "error during test after %d cycles\n", i);
+	// Read once, then write the same data back each time.
+	if (block_channel != channel) {
+		if (gcn64lib_mempak_readBlock(hdl, channel, MEMPAK_TEST_ADDR, block) != 0x20)
 			return -1;
+		block_channel = channel;
+	}
+
+	return gcn64lib_mempak_writeBlock(hdl, channel, MEMPAK_TEST_ADDR, block);
+}
+
+static int test_psxRead(rnt_hdl_t hdl, int channel, int param)
+{
+	uint8_t sector[128];
+
+	return psxlib_readMemoryCardSector(hdl, channel, 0, sector);
+}
+
+static int test_i2c(rnt_hdl_t hdl, int channel, int param)
+{
+	// Read the first 6 bytes of a Wii extension controller
+	static const uint8_t reg[1] = { 0x00 };
+	uint8_t data[6];
+	struct i2c_transaction txn = {
+		.chn = channel, .addr = 0x52,
+		.wr_len = sizeof(reg), .wr_data = reg,
+		.rd_len = sizeof(data), .rd_data = data,
+	};
+
+	if (wusbmote_i2c_transaction(hdl, &txn))
+		return -1;
+
+	return txn.result ? -1 : 0;
+}
+
+static void addTest(struct perftest_def *defs, int *n, const char *name, perftest_func func, int param, int explicit_only)
+{
+	struct perftest_def *def = &defs[(*n)++];
+
+	snprintf(def->name, sizeof(def->name), "%s", name);
+	def->func = func;
+	def->param = param;
+	def->explicit_only = explicit_only;
+}
+
+static int buildTestList(struct perftest_def *defs)
+{
+	static const int echo_sizes[] = { 2, 8, 32, ECHO_MAX_SIZE };
+	char name[PERFTEST_MAX_NAME];
+	int i, n = 0;
+
+	addTest(defs, &n, "version", test_version, 0, 0);
+	for (i=0; i<sizeof(echo_sizes)/sizeof(echo_sizes[0]); i++) {
+		snprintf(name, sizeof(name), "echo_%d", echo_sizes[i]);
+		addTest(defs, &n, name, test_echo, echo_sizes[i], 0);
+	}
+	addTest(defs, &n, "raw_si", test_rawSi, 0, 0);
+	for (i=1; i<=PERFTEST_MAX_BLOCKIO_OPS; i++) {
+		snprintf(name, sizeof(name), "blockio_%d", i);
+		addTest(defs, &n, name, test_blockIO, i, 0);
+	}
+	addTest(defs, &n, "mempak_read", test_mempakRead, 0, 0);
+	addTest(defs, &n, "mempak_write", test_mempakWrite, 0, 1);
+	addTest(defs, &n, "psx_read", test_psxRead, 0, 0);
+	addTest(defs, &n, "i2c", test_i2c, 0, 0);
+
+	return n;
+}
+
+/* A test is selected by its name, or by a prefix ending at an underscore (eg: echo for echo_8) */
+static int testSelected(const struct perftest_def *def, const char *selection)
+{
+	const char *p = selection, *end;
+	int len;
+
+	if (!selection)
+		return !def->explicit_only;
+
+	while (*p) {
+		end = strchr(p, ',');
+		len = end ? end - p : strlen(p);
+
+		if (len && !strncmp(def->name, p, len) && (def->name[len] == 0 || def->name[len] == '_'))
+			return 1;
+
+		if (!end)
+			break;
+		p = end + 1;
+	}
+
+	return 0;
+}
+
+static int compareSamples(const void *a, const void *b)
+{
+	uint32_t va = *(const uint32_t*)a, vb = *(const uint32_t*)b;
+
+	return va < vb ? -1 : va > vb;
+}
+
+/* Nearest-rank percentile of sorted samples */
+static double percentile(const uint32_t *sorted, int n, int pct)
+{
+	int rank = (pct * n + 99) / 100;
+
+	if (rank < 1)
+		rank = 1;
+
+	return sorted[rank - 1];
+}
+
+static void computeStats(struct perftest_result *res, uint32_t *samples, int n)
+{
+	uint64_t total = 0;
+	int i;
+
+	res->iterations = n;
+	if (!n)
+		return;
+
+	qsort(samples, n, sizeof(uint32_t), compareSamples);
+	for (i=0; i<n; i++) {
+		total += samples[i];
+	}
+
+	res->min_us = samples[0];
+	res->max_us = samples[n-1];
+	res->mean_us = (double)total / n;
+	res->p50_us = percentile(samples, n, 50);
+	res->p90_us = percentile(samples, n, 90);
+	res->p99_us = percentile(samples, n, 99);
+}
+
+static void runTest(rnt_hdl_t hdl, int channel, const struct perftest_def *def, int warmup, int iterations,
+						uint32_t *samples, struct perftest_result *res)
+{
+	uint64_t t;
+	int i, n = 0;
+
+	memset(res, 0, sizeof(struct perftest_result));
+	strcpy(res->name, def->name);
+
+	for (i=0; i<warmup; i++) {
+		if (def->func(hdl, channel, def->param)) {
+			res->status = PERFTEST_SKIPPED;
+			return;
 		}
+	}
+
+	for (i=0; i<iterations; i++) {
+		t = getMicroseconds();
+		if (def->func(hdl, channel, def->param)) {
+			fprintf(stderr, "%s: error after %d iterations\n", def->name, i);
+			res->status = PERFTEST_FAILED;
+			break;
+		}
+		samples[n++] = getMicroseconds() - t;
+	}
+
+	computeStats(res, samples, n);
+}
+
+static int writeResults(const char *filename, const struct perftest_result *results, int n, int warmup)
+{
+	const struct perftest_result *r;
+	const char *ext = strrchr(filename, '.');
+	int csv = ext && !strcmp(ext, ".csv");
+	FILE *fptr;
+	int i;
 
-	//	printf("Version: %s\n", version);
+	fptr = fopen(filename, "w");
+	if (!fptr) {
+		perror(filename);
+		return -1;
 	}
 
-	printTestResult(total_us, N_CYCLES);
+	if (csv) {
+		fprintf(fptr, CSV_HEADER "\n");
+	} else {
+		fprintf(fptr, "{\n  \"warmup\": %d,\n  \"tests\": [\n", warmup);
+	}
 
-	total_us = 0;
-	printf("Sending the N64_GET_CAPABILITIES command %d times...\n", N_CYCLES);
-	for (i=0; i<N_CYCLES; i++) {
-		cmd[0] = N64_GET_CAPABILITIES;
-		gettimeofday(&tv_before, NULL);
-		n = gcn64lib_rawSiCommand(hdl, channel, cmd, 1, cmd, sizeof(cmd));
-		gettimeofday(&tv_after, NULL);
-		if (n >= 0) {
-			total_us += getElaps_us(&tv_before, &tv_after);
+	for (i=0; i<n; i++) {
+		r = &results[i];
+		if (csv) {
+			fprintf(fptr, "%s,%s,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", r->name, status_names[r->status],
+					r->iterations, r->min_us, r->mean_us, r->p50_us, r->p90_us, r->p99_us, r->max_us);
 		} else {
-			fprintf(stderr, "error during test after %d cycles\n", i);
-			return -1;
+			// One test per line. perftest_load() depends on it.
+			fprintf(fptr, "    { \"name\": \"%s\", \"status\": \"%s\", \"iterations\": %d, \"min_us\": %.1f, "
+						"\"mean_us\": %.1f, \"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f }%s\n",
+					r->name, status_names[r->status], r->iterations, r->min_us, r->mean_us,
+					r->p50_us, r->p90_us, r->p99_us, r->max_us, i < n-1 ? "," : "");
 		}
 	}
-	printTestResult(total_us, N_CYCLES);
 
+	if (!csv) {
+		fprintf(fptr, "  ]\n}\n");
+	}
+
+	if (fclose(fptr)) {
+		perror(filename);
+		return -1;
+	}
 
-	total_us = 0;
-	printf("Doing N64_GET_CAPS + READ_STATUS on controllers 0 and 1 through the block IO api %d times...\n", N_CYCLES);
+	return 0;
+}
 
-	for (i=0; i<N_CYCLES; i++) {
-		memset(cmd, 0xff, sizeof(cmd));
+int perftest_run(rnt_hdl_t hdl, int channel, const struct perftest_opts *opts, const char *outfile)
+{
+	struct perftest_def defs[PERFTEST_MAX_TESTS];
+	struct perftest_result results[PERFTEST_MAX_TESTS], baseline[PERFTEST_MAX_TESTS];
+	struct perftest_result *r;
+	uint32_t *samples;
+	int iterations = opts->iterations > 0 ? opts->iterations : PERFTEST_DEFAULT_ITERATIONS;
+	int warmup = opts->warmup >= 0 ? opts->warmup : PERFTEST_DEFAULT_WARMUP;
+	int i, n_defs, n = 0, n_baseline = 0, retval = 0;
 
-		gettimeofday(&tv_before, NULL);
-		res = gcn64lib_blockIO(hdl, ops, 4);
-		gettimeofday(&tv_after, NULL);
-		total_us += getElaps_us(&tv_before, &tv_after);
+	if (opts->baseline) {
+		n_baseline = perftest_load(opts->baseline, baseline, PERFTEST_MAX_TESTS);
+		if (n_baseline < 0)
+			return 1;
+	}
 
-		if (res < 0) {
-			fprintf(stderr, "Error in blockIO\n");
-			break;
+	samples = malloc(sizeof(uint32_t) * iterations);
+	if (!samples) {
+		perror("malloc");
+		return 1;
+	}
+
+	n_defs = buildTestList(defs);
+
+	printf("Running tests: %d iterations, %d warm-up, channel %d\n", iterations, warmup, channel);
+	printf("%-14s %-8s %6s %9s %9s %9s %9s %9s %9s\n", "Test", "Status", "Iter", "Min", "Mean", "P50", "P90", "P99", "Max");
+
+	// Controller polling would compete with the tests
+	rnt_suspendPolling(hdl, 1);
+
+	for (i=0; i<n_defs; i++) {
+		if (!testSelected(&defs[i], opts->tests))
+			continue;
+
+		r = &results[n++];
+		runTest(hdl, channel, &defs[i], warmup, iterations, samples, r);
+
+		printf("%-14s %-8s %6d", r->name, status_names[r->status], r->iterations);
+		if (r->iterations) {
+			printf(" %9.0f %9.1f %9.0f %9.0f %9.0f %9.0f", r->min_us, r->mean_us, r->p50_us, r->p90_us, r->p99_us, r->max_us);
+		}
+		printf("\n");
+		fflush(stdout);
+
+		if (r->status == PERFTEST_FAILED) {
+			retval = 1;
 		}
 	}
 
-	for (j=0; j<4; j++) {
-		printf("blockio[%d]: tx %d bytes, result: 0x%02x, ", j, ops[j].tx_len, ops[j].rx_len);
-		if (ops[j].rx_len & BIO_RX_LEN_TIMEDOUT) {
-			printf("Timeout\n");
-		} else if (ops[j].rx_len & BIO_RX_LEN_PARTIAL) {
-			printf("Partial read\n");
-		} else {
-			printHexBuf(ops[j].rx_data, ops[j].rx_len);
+	rnt_suspendPolling(hdl, 0);
+	free(samples);
+
+	if (!n) {
+		fprintf(stderr, "No test selected\n");
+		return 1;
+	}
+	printf("(Times in microseconds)\n");
+
+	if (outfile) {
+		if (writeResults(outfile, results, n, warmup))
+			return 1;
+		printf("Results written to %s\n", outfile);
+	}
+
+	if (opts->baseline) {
+		if (perftest_compare(baseline, n_baseline, results, n, opts->threshold)) {
+			retval = 1;
 		}
 	}
 
-	printTestResult(total_us, N_CYCLES);
+	return retval;
+}
+
+static int parseStatus(const char *s)
+{
+	int i;
+
+	for (i=0; i<sizeof(status_names)/sizeof(status_names[0]); i++) {
+		if (!strncmp(s, status_names[i], strlen(status_names[i])))
+			return i;
+	}
+
+	return -1;
+}
+
+/* Get the value of "key": in a JSON line written by writeResults */
+static const char *jsonField(const char *line, const char *key)
+{
+	char pattern[32];
+	const char *p;
+
+	snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+	p = strstr(line, pattern);
+	if (!p)
+		return NULL;
+	p += strlen(pattern);
+	if (*p == '"')
+		p++;
+
+	return p;
+}
+
+static int parseJsonLine(const char *line, struct perftest_result *r)
+{
+	const char *name, *status, *end;
+	static const char *keys[] = { "min_us", "mean_us", "p50_us", "p90_us", "p99_us", "max_us" };
+	double *values[] = { &r->min_us, &r->mean_us, &r->p50_us, &r->p90_us, &r->p99_us, &r->max_us };
+	const char *v;
+	int i;
+
+	name = jsonField(line, "name");
+	status = jsonField(line, "status");
+	v = jsonField(line, "iterations");
+	if (!name || !status || !v)
+		return -1;
+
+	end = strchr(name, '"');
+	if (!end || end - name >= PERFTEST_MAX_NAME)
+		return -1;
+	memcpy(r->name, name, end - name);
+	r->name[end - name] = 0;
+
+	r->status = parseStatus(status);
+	r->iterations = atoi(v);
+
+	for (i=0; i<6; i++) {
+		v = jsonField(line, keys[i]);
+		if (!v)
+			return -1;
+		*values[i] = atof(v);
+	}
+
+	return r->status < 0 ? -1 : 0;
+}
+
+static int parseCsvLine(char *line, struct perftest_result *r)
+{
+	char *fields[9];
+	char *p = line;
+	int i;
+
+	for (i=0; i<9; i++) {
+		fields[i] = p;
+		p = strchr(p, ',');
+		if (!p)
+			break;
+		*p++ = 0;
+	}
+	if (i != 8 || strlen(fields[0]) >= PERFTEST_MAX_NAME)
+		return -1;
+
+	strcpy(r->name, fields[0]);
+	r->status = parseStatus(fields[1]);
+	r->iterations = atoi(fields[2]);
+	r->min_us = atof(fields[3]);
+	r->mean_us = atof(fields[4]);
+	r->p50_us = atof(fields[5]);
+	r->p90_us = atof(fields[6]);
+	r->p99_us = atof(fields[7]);
+	r->max_us = atof(fields[8]);
 
-	// This test averages at 14665 us when gcn64lib_blockIO_compat() is used.
-	// On adapters supporting block IO this averages at 4466 us... More than 3 times faster.
+	return r->status < 0 ? -1 : 0;
+}
 
-	total_us = 0;
-	printf("Doing N64_GET_CAPS + READ_STATUS on controllers 0 and 1 through the block IO api %d times...\n", N_CYCLESLONG);
+int perftest_load(const char *filename, struct perftest_result *results, int max_results)
+{
+	FILE *fptr;
+	char line[512];
+	int n = 0, csv = -1, res;
 
-	for (i=0; i<N_CYCLESLONG; i++) {
-		memset(cmd, 0xff, sizeof(cmd));
+	fptr = fopen(filename, "r");
+	if (!fptr) {
+		perror(filename);
+		return -1;
+	}
 
-		gettimeofday(&tv_before, NULL);
-		res = gcn64lib_blockIO(hdl, ops2, 2);
-		gettimeofday(&tv_after, NULL);
-		total_us += getElaps_us(&tv_before, &tv_after);
+	while (fgets(line, sizeof(line), fptr)) {
+		line[strcspn(line, "\r\n")] = 0;
 
-		if (res < 0) {
-			fprintf(stderr, "Error in blockIO\n");
+		if (csv < 0) {
+			// The first line tells the format
+			csv = !strcmp(line, CSV_HEADER);
+			if (!csv && strcmp(line, "{"))
+				break;
+			continue;
+		}
+
+		if (csv) {
+			if (!*line)
+				continue;
+		} else if (!strstr(line, "\"name\"")) {
+			continue;
+		}
+
+		if (n >= max_results) {
+			fprintf(stderr, "%s: Too many results\n", filename);
 			break;
 		}
+
+		res = csv ? parseCsvLine(line, &results[n]) : parseJsonLine(line, &results[n]);
+		if (res) {
+			fprintf(stderr, "%s: Invalid result: %s\n", filename, line);
+			fclose(fptr);
+			return -1;
+		}
+		n++;
 	}
 
-	for (j=0; j<2; j++) {
-		printf("blockio[%d]: tx %d bytes, result: 0x%02x, ", j, ops[j].tx_len, ops[j].rx_len);
-		if (ops[j].rx_len & BIO_RX_LEN_TIMEDOUT) {
-			printf("Timeout\n");
-		} else if (ops[j].rx_len & BIO_RX_LEN_PARTIAL) {
-			printf("Partial read\n");
-		} else {
-			printHexBuf(ops[j].rx_data, ops[j].rx_len);
+	fclose(fptr);
+
+	if (csv < 0) {
+		fprintf(stderr, "%s: Not a perftest result file\n", filename);
+		return -1;
+	}
+
+	return n;
+}
+
+static int regressed(double base, double cur, int threshold)
+{
+	return cur - base >= PERFTEST_MIN_DELTA_US && cur > base * (100 + threshold) / 100.0;
+}
+
+static double change(double base, double cur)
+{
+	return base > 0 ? (cur - base) * 100 / base : 0;
+}
+
+int perftest_compare(const struct perftest_result *baseline, int n_baseline,
+						const struct perftest_result *current, int n_current, int threshold)
+{
+	const struct perftest_result *b, *c;
+	const char *verdict;
+	int i, j, n_regressions = 0;
+
+	if (threshold <= 0)
+		threshold = PERFTEST_DEFAULT_THRESHOLD;
+
+	printf("Comparison with the baseline (regression: p50 or p99 more than %d%% slower):\n", threshold);
+	printf("%-14s %9s %9s %8s %9s %9s %8s\n", "Test", "Base P50", "P50", "Change", "Base P99", "P99", "Change");
+
+	for (i=0; i<n_current; i++) {
+		c = &current[i];
+
+		for (b = NULL, j=0; j<n_baseline; j++) {
+			if (!strcmp(baseline[j].name, c->name)) {
+				b = &baseline[j];
+				break;
+			}
 		}
+
+		if (c->status == PERFTEST_SKIPPED) {
+			printf("%-14s %s\n", c->name, "(skipped)");
+			continue;
+		}
+		if (!b || b->status != PERFTEST_OK || !b->iterations) {
+			printf("%-14s %s\n", c->name, "(not in baseline)");
+			continue;
+		}
+		if (c->status == PERFTEST_FAILED) {
+			printf("%-14s %s\n", c->name, "FAILED");
+			n_regressions++;
+			continue;
+		}
+
+		verdict = "\n";
+		if (regressed(b->p50_us, c->p50_us, threshold) || regressed(b->p99_us, c->p99_us, threshold)) {
+			verdict = " REGRESSION\n";
+			n_regressions++;
+		}
+
+		printf("%-14s %9.0f %9.0f %+7.1f%% %9.0f %9.0f %+7.1f%%%s", c->name,
+				b->p50_us, c->p50_us, change(b->p50_us, c->p50_us),
+				b->p99_us, c->p99_us, change(b->p99_us, c->p99_us), verdict);
 	}
 
-	printTestResult(total_us, N_CYCLESLONG);
+	printf("%d regression(s)\n", n_regressions);
 
+	return n_regressions;
+}
 
+int perftest_compareFiles(const char *baseline, const char *current, int threshold)
+{
+	struct perftest_result base_results[PERFTEST_MAX_TESTS], cur_results[PERFTEST_MAX_TESTS];
+	int n_base, n_cur;
 
+	n_base = perftest_load(baseline, base_results, PERFTEST_MAX_TESTS);
+	if (n_base < 0)
+		return 1;
 
-	return 0;
+	n_cur = perftest_load(current, cur_results, PERFTEST_MAX_TESTS);
+	if (n_cur < 0)
+		return 1;
+
+	return perftest_compare(base_results, n_base, cur_results, n_cur, threshold) ? 1 : 0;
 }
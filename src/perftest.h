@@ -3,6 +3,60 @@
 
 #include "raphnetadapter.h"
 
-int perftest1(rnt_hdl_t hdl, int channel);
+#define PERFTEST_DEFAULT_ITERATIONS	200
+#define PERFTEST_DEFAULT_WARMUP		10
+#define PERFTEST_DEFAULT_THRESHOLD	10 // percent
+#define PERFTEST_MAX_BLOCKIO_OPS	8
+#define PERFTEST_MAX_TESTS			32
+#define PERFTEST_MAX_NAME			32
+// Slower by less than this is noise, whatever the percentage.
+#define PERFTEST_MIN_DELTA_US		50
+
+#define PERFTEST_OK			0
+#define PERFTEST_SKIPPED	1 // Failed during warm-up. Unsupported, or nothing connected.
+#define PERFTEST_FAILED		2 // Failed during the timed iterations
+
+struct perftest_opts {
+	int iterations; // 0 for the default
+	int warmup; // -1 for the default
+	const char *tests; // Comma separated test names or prefixes (eg: echo,blockio_1). NULL for the default set.
+	const char *baseline; // Results to compare with, or NULL
+	int threshold; // Regression threshold in percent. 0 for the default.
+};
+
+struct perftest_result {
+	char name[PERFTEST_MAX_NAME];
+	int status;
+	int iterations; // Timed iterations completed
+	double min_us, mean_us, p50_us, p90_us, p99_us, max_us;
+};
+
+/**
+ * \brief Run the benchmark suite
+ *
+ * Tests: version, echo_<bytes>, raw_si, blockio_<ops>, mempak_read,
+ * psx_read and i2c. mempak_write (rewrites the last block of the
+ * mempak with the data read from it) only runs when named.
+ *
+ * \param outfile Where to write the results (.csv for CSV, JSON otherwise). May be NULL.
+ * \return 0 on success, 1 if tests failed or regressed compared to opts->baseline
+ */
+int perftest_run(rnt_hdl_t hdl, int channel, const struct perftest_opts *opts, const char *outfile);
+
+/** \brief Load results written by perftest_run
+ * \return The number of results, or -1 on error
+ */
+int perftest_load(const char *filename, struct perftest_result *results, int max_results);
+
+/** \brief Compare results with a baseline and print the differences
+ * \return The number of regressions
+ */
+int perftest_compare(const struct perftest_result *baseline, int n_baseline,
+						const struct perftest_result *current, int n_current, int threshold);
+
+/** \brief Compare two result files
+ * \return 0 if no regressions, 1 otherwise (or on error)
+ */
+int perftest_compareFiles(const char *baseline, const char *current, int threshold);
 
 #endif // _perftest_h__
@@ -1,5 +1,8 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <math.h>
 #include "raphnetadapter.h"
 #include "gcn64lib.h"
 #include "wusbmotelib.h"
@@ -11,6 +14,11 @@
 #include "sleep.h"
 #include "delay.h"
 #include "maplelib.h"
+#include "timer.h"
+#include "sipoll.h"
+#include "inputlog.h"
+#include "sampler.h"
+#include "stickstats.h"
 
 // when defined, a roll angle is computed for the nunchuk.
 // Must also add -lm to the makefile for atan2...
@@ -20,284 +28,634 @@
 #include <math.h>
 #endif
 
-int pollraw_n64(rnt_hdl_t hdl, int chn)
+// Samples are acquired by a separate thread, as fast as possible. They are
+// read (and recorded) at this interval, and only the latest is displayed.
+#define DISPLAY_INTERVAL_US	40000
+#define WII_DISPLAY_INTERVAL_US	40000
+#define WII_MAX_READLEN			16
+// Line based displays are refreshed less often
+#define PSX_DISPLAY_INTERVAL_US	1000000
+#define DB9_DISPLAY_INTERVAL_US	1000000
+#define DC_DISPLAY_INTERVAL_US	100000
+// Number of frames read from the sampler at once
+#define READ_BATCH	64
+
+static const char *record_file;
+static const char *stickstats_file;
+static struct inputlog *record_log;
+static int record_error;
+static volatile sig_atomic_t stop_requested;
+
+void pollraw_setRecordFile(const char *filename)
+{
+	record_file = filename;
+}
+
+void pollraw_setStickStatsFile(const char *filename)
+{
+	stickstats_file = filename;
+}
+
+static void onInterrupt(int sig)
+{
+	stop_requested = 1;
+}
+
+/* Start recording if a file was set. Returns -1 on error. */
+static int recordStart(void)
+{
+	stop_requested = 0;
+	record_error = 0;
+
+	// CTRL+C ends the polling loop, so the log can be completed (and reports printed)
+	signal(SIGINT, onInterrupt);
+
+	if (!record_file)
+		return 0;
+
+	record_log = inputlog_create(record_file, getMicroseconds());
+	if (!record_log) {
+		signal(SIGINT, SIG_DFL);
+		return -1;
+	}
+
+	printf("Recording to %s\n", record_file);
+
+	return 0;
+}
+
+/* Returns the source id, or -1 when not recording. */
+static int recordSource(int type, int chn, int flags, int param)
+{
+	if (!record_log)
+		return -1;
+
+	return inputlog_addSource(record_log, type, chn, flags, param);
+}
+
+static void recordFrame(int source, uint64_t timestamp, const uint8_t *data, int len)
+{
+	if (!record_log || source < 0 || len < 1)
+		return;
+
+	if (len > INPUTLOG_MAX_FRAME)
+		len = INPUTLOG_MAX_FRAME;
+
+	if (inputlog_write(record_log, source, timestamp, data, len)) {
+		fprintf(stderr, "Error writing %s\n", record_file);
+		record_error = 1;
+		stop_requested = 1;
+	}
+}
+
+/* Returns -1 if the log could not be written completely */
+static int recordStop(void)
+{
+	uint64_t size;
+
+	signal(SIGINT, SIG_DFL);
+
+	if (!record_log)
+		return 0;
+
+	size = inputlog_size(record_log);
+	if (inputlog_close(record_log)) {
+		fprintf(stderr, "Error writing %s\n", record_file);
+		record_error = 1;
+	} else {
+		printf("\nRecorded %llu bytes to %s\n", (unsigned long long)size, record_file);
+	}
+	record_log = NULL;
+
+	return record_error ? -1 : 0;
+}
+
+
+/* Passed each frame read by drainFrames(), for recording and processing */
+typedef void (*frame_func)(const struct sampler_frame *frame, void *ctx);
+
+struct display_stats {
+	uint64_t last_report;
+	unsigned int last_samples;
+	double rate; // Frames acquired per second
+	unsigned int skipped; // Frames replaced by a newer one before they could be displayed
+};
+
+static int startSampling(struct sampler *smp, rnt_hdl_t hdl, int chn, int param, sampler_func func, void *ctx, struct display_stats *stats)
+{
+	if (sampler_start(smp, hdl, chn, param, func, ctx)) {
+		fprintf(stderr, "Could not start polling\n");
+		return -1;
+	}
+
+	memset(stats, 0, sizeof(struct display_stats));
+	stats->last_report = getMicroseconds();
+
+	return 0;
+}
+
+/* Read all the frames acquired since the last call and pass each one to on_frame.
+ * The most recent one is copied to last. When stats is given, all the others
+ * are counted as skipped (only the latest is displayed).
+ *
+ * Returns the number of frames, or -1 if acquisition stopped. */
+static int drainFrames(struct sampler *smp, frame_func on_frame, void *ctx, struct sampler_frame *last, struct display_stats *stats)
+{
+	struct sampler_frame frames[READ_BATCH];
+	int i, n, total = 0;
+
+	while ((n = sampler_read(smp, frames, READ_BATCH)) > 0) {
+		for (i=0; i<n; i++) {
+			on_frame(&frames[i], ctx);
+		}
+		*last = frames[n-1];
+		total += n;
+	}
+
+	if (stats && total > 1) {
+		stats->skipped += total - 1;
+	}
+
+	// An error is reported once the frames acquired before it are processed
+	return total ? total : n;
+}
+
+/* Update the acquisition rate. Returns 1 once per second, when updated. */
+static int updateStats(struct sampler *smp, struct display_stats *stats)
+{
+	uint64_t now = getMicroseconds();
+	unsigned int samples;
+
+	if (now - stats->last_report < 1000000)
+		return 0;
+
+	samples = sampler_samples(smp);
+	stats->rate = (samples - stats->last_samples) * 1000000.0 / (now - stats->last_report);
+	stats->last_samples = samples;
+	stats->last_report = now;
+
+	return 1;
+}
+
+static void printStats(struct sampler *smp, const struct display_stats *stats)
+{
+	printf("Rate: %.1f Hz, overruns: %u, not displayed: %u\n", stats->rate, sampler_overruns(smp), stats->skipped);
+}
+
+static void recordSingle(const struct sampler_frame *frame, void *ctx)
+{
+	recordFrame(*(int*)ctx, frame->timestamp, frame->data, frame->len);
+}
+
+/* Stick statistics are accumulated from all the frames (not only those displayed) */
+struct stick_state {
+	int source;
+	int unsigned_axes; // Gamecube axes are centered on 0x80
+	struct stickstats stats;
+};
+
+/* Statistics of previous sessions are included when the file exists */
+static int stickStart(struct stick_state *ss, int unsigned_axes, int nominal_range)
+{
+	FILE *fptr;
+
+	ss->unsigned_axes = unsigned_axes;
+	if (stickstats_init(&ss->stats, nominal_range))
+		return -1;
+
+	if (stickstats_file) {
+		fptr = fopen(stickstats_file, "rb");
+		if (fptr) {
+			fclose(fptr);
+			if (stickstats_load(&ss->stats, stickstats_file)) {
+				stickstats_free(&ss->stats);
+				return -1;
+			}
+			printf("Loaded %llu samples from %s\n", (unsigned long long)ss->stats.samples, stickstats_file);
+		}
+	}
+
+	return 0;
+}
+
+/* Print the report and update the file. Returns -1 if the file could not be written. */
+static int stickStop(struct stick_state *ss)
+{
+	struct stickstats_report rep;
+	int res = 0;
+
+	printf("\n");
+	if (!stickstats_analyze(&ss->stats, &rep)) {
+		stickstats_printReport(stdout, "Stick", &rep);
+	}
+
+	if (stickstats_file && ss->stats.samples) {
+		res = stickstats_save(&ss->stats, stickstats_file);
+		if (!res) {
+			printf("Statistics saved to %s\n", stickstats_file);
+		}
+	}
+	stickstats_free(&ss->stats);
+
+	return res;
+}
+
+/* N64 and Gamecube frames both have the main stick X and Y in bytes 2 and 3 */
+static void stickFrame(const struct sampler_frame *frame, void *ctx)
+{
+	struct stick_state *ss = ctx;
+
+	recordFrame(ss->source, frame->timestamp, frame->data, frame->len);
+
+	if (ss->unsigned_axes) {
+		stickstats_add(&ss->stats, frame->data[2] - 0x80, frame->data[3] - 0x80);
+	} else {
+		stickstats_add(&ss->stats, (int8_t)frame->data[2], (int8_t)frame->data[3]);
+	}
+}
+
+static int sampleN64(struct sampler *smp, struct sampler_frame *frame)
 {
 	uint8_t getstatus[1] = { N64_GET_STATUS };
-	uint8_t status[4];
 	int res;
-	int unique_x_seen = 0;
-	uint8_t seen_x_values[256] = { };
-	int unique_y_seen = 0;
-	uint8_t seen_y_values[256] = { };
+
+	res = gcn64lib_rawSiCommand(smp->hdl, smp->chn, getstatus, sizeof(getstatus), frame->data, 4);
+	if (res != 4) {
+		printf("Unexpected data length\n");
+		return -1;
+	}
+	frame->len = res;
+
+	return 0;
+}
+
+int pollraw_n64(rnt_hdl_t hdl, int chn)
+{
+	struct sampler smp;
+	struct sampler_frame last;
+	struct display_stats stats;
+	struct stick_state ss;
+	const uint8_t *status = last.data;
+	int n, res;
 
 	printf("Suspending polling. Please use --resume_polling later.\n");
 	rnt_suspendPolling(hdl, 1);
 
+	if (stickStart(&ss, 0, STICKSTATS_RANGE_N64))
+		return -1;
+	if (recordStart()) {
+		stickstats_free(&ss.stats);
+		return -1;
+	}
+	ss.source = recordSource(INPUTLOG_SRC_N64, chn, 0, 0);
+
+	if (startSampling(&smp, hdl, chn, 0, sampleN64, NULL, &stats)) {
+		stickstats_free(&ss.stats);
+		recordStop();
+		return -1;
+	}
+
 	printf("CTRL+C to stop\n");
-	while(1)
+	while (!stop_requested)
 	{
-		res = gcn64lib_rawSiCommand(hdl, chn, getstatus, sizeof(getstatus), status, sizeof(status));
-		if (res != 4) {
-			printf("Unexpected data length\n");
-			break;
-		}
+		_delay_us(DISPLAY_INTERVAL_US);
 
-		if (!seen_x_values[status[2]]) {
-			seen_x_values[status[2]] = 1;
-			unique_x_seen++;
-		}
-		if (!seen_y_values[status[3]]) {
-			seen_y_values[status[3]] = 1;
-			unique_y_seen++;
-		}
+		n = drainFrames(&smp, stickFrame, &ss, &last, &stats);
+		if (n < 0)
+			break;
+		updateStats(&smp, &stats);
+		if (!n)
+			continue;
 
-		printf("X: %4d (%3d), Y: %4d (%3d), Buttons=0x%02x%02x   \r",
+		printf("X: %4d (%4d..%3d), Y: %4d (%4d..%3d), Buttons=0x%02x%02x [%.0f Hz, overruns: %u, not displayed: %u]   \r",
 			(int8_t)(status[2]),
-			unique_x_seen,
+			ss.stats.min_x, ss.stats.max_x,
 			(int8_t)(status[3]),
-			unique_y_seen,
-			status[0], status[1]);
+			ss.stats.min_y, ss.stats.max_y,
+			status[0], status[1],
+			stats.rate, sampler_overruns(&smp), stats.skipped);
 		fflush(stdout);
 	}
 
-	return 0;
-}
+	sampler_stop(&smp);
 
+	res = stickStop(&ss);
+	if (recordStop())
+		return -1;
 
+	return res;
+}
 
-int pollraw_gamecube(rnt_hdl_t hdl, int chn, int mode)
+
+static int sampleGamecube(struct sampler *smp, struct sampler_frame *frame)
 {
-	uint8_t getstatus[3] = { GC_GETSTATUS1, GC_GETSTATUS2_MODE(mode), 0x00 };
-	uint8_t status[8];
+	uint8_t getstatus[3] = { GC_GETSTATUS1, GC_GETSTATUS2_MODE(smp->param), 0x00 };
 	int res;
-	int unique_x_seen = 0;
-	uint8_t seen_x_values[256] = { };
-	int unique_y_seen = 0;
-	uint8_t seen_y_values[256] = { };
 
-	uint8_t lt, rt;
-	int8_t cx, cy;
+	res = gcn64lib_rawSiCommand(smp->hdl, smp->chn, getstatus, sizeof(getstatus), frame->data, GC_GETSTATUS_REPLY_LENGTH);
+	if (res != GC_GETSTATUS_REPLY_LENGTH) {
+		printf("Not enough data received\n");
+		return -1;
+	}
+	frame->len = res;
+
+	return 0;
+}
+
+int pollraw_gamecube(rnt_hdl_t hdl, int chn, int mode)
+{
+	struct sampler smp;
+	struct sampler_frame last;
+	struct display_stats stats;
+	struct sipoll_status st = { };
+	struct stick_state ss;
+	int n, res;
 
 	printf("pollraw_gamecube, mode %d\n", mode);
 	printf("Suspending polling. Please use --resume_polling later.\n");
 	rnt_suspendPolling(hdl, 1);
 
+	if (stickStart(&ss, 1, STICKSTATS_RANGE_GC))
+		return -1;
+	if (recordStart()) {
+		stickstats_free(&ss.stats);
+		return -1;
+	}
+	ss.source = recordSource(INPUTLOG_SRC_GC, chn, 0, mode);
+
+	if (startSampling(&smp, hdl, chn, mode, sampleGamecube, NULL, &stats)) {
+		stickstats_free(&ss.stats);
+		recordStop();
+		return -1;
+	}
+
 	printf("CTRL+C to stop\n");
-	while(1)
+	while (!stop_requested)
 	{
-		res = gcn64lib_rawSiCommand(hdl, chn, getstatus, sizeof(getstatus), status, sizeof(status));
-		if (res != GC_GETSTATUS_REPLY_LENGTH) {
-			printf("Not enough data received\n");
+		_delay_us(DISPLAY_INTERVAL_US);
+
+		n = drainFrames(&smp, stickFrame, &ss, &last, &stats);
+		if (n < 0)
 			break;
-		}
+		updateStats(&smp, &stats);
+		if (!n)
+			continue;
 
-		if (!seen_x_values[status[2]]) {
-			seen_x_values[status[2]] = 1;
-			unique_x_seen++;
-		}
-		if (!seen_y_values[status[3]]) {
-			seen_y_values[status[3]] = 1;
-			unique_y_seen++;
-		}
+		memcpy(st.raw, last.data, GC_GETSTATUS_REPLY_LENGTH);
+		sipoll_decode(SIPOLL_GC, mode, &st);
+
+		printf("X: %4d (%4d..%3d), Y: %4d (%4d..%3d), CX: %4d, CY: %4d, LT: %4d, RT: %4d, Buttons: %02x %02x [%.0f Hz, overruns: %u, not displayed: %u]\r",
+			st.x,
+			ss.stats.min_x, ss.stats.max_x,
+			st.y,
+			ss.stats.min_y, ss.stats.max_y,
+			st.cx, st.cy,
+			st.lt, st.rt,
+			st.raw[0], st.raw[1],
+			stats.rate, sampler_overruns(&smp), stats.skipped);
+		fflush(stdout);
+	}
 
-		switch (mode)
-		{
-			case 3: // C-Stick 8 bit, L/R 8 bits
-				cx = (int8_t)(status[4]+0x80);
-				cy = (int8_t)(status[5]+0x80);
-				lt = status[6];
-				rt = status[7];
-				break;
-
-			default: // C-Stick 8 bit, L/R 4 bits
-			case 0:
-				cx = (int8_t)(status[4]+0x80);
-				cy = (int8_t)(status[5]+0x80);
-				lt = status[6] >> 4;
-				rt = status[6] & 0xf;
-				break;
-
-			case 1: // C-Stick 4 bits, L/R 8 bits
-				cx = (int8_t)((status[4]&0xf0)+0x80);
-				cy = (int8_t)((status[4]<<4)+0x80);
-				lt = status[5];
-				rt = status[6];
-				break;
-
-			case 2: // C-Stick 4 bits, L/R 4 bits
-				cx = (int8_t)((status[4]&0xf0)+0x80);
-				cy = (int8_t)((status[4]<<4)+0x80);
-				lt = status[5] >> 4;
-				rt = status[5] & 0xf;
-				break;
-
-			case 4: // C-Stick 8 bits, L/R 0 bits
-				cx = (int8_t)(status[4]+0x80);
-				cy = (int8_t)(status[5]+0x80);
-				lt = rt = 0;
-				break;
+	sampler_stop(&smp);
+
+	res = stickStop(&ss);
+	if (recordStop())
+		return -1;
+
+	return res;
+}
+
+struct keyboard_cmd {
+	uint8_t cmd[3];
+	int cmdlen, replylen;
+};
+
+static int sampleKeyboard(struct sampler *smp, struct sampler_frame *frame)
+{
+	struct keyboard_cmd *kc = smp->ctx;
+	int res;
+
+	res = gcn64lib_rawSiCommand(smp->hdl, smp->chn, kc->cmd, kc->cmdlen, frame->data, kc->replylen);
+	if (res != kc->replylen) {
+		printf("Not enough data received (Expected %d bytes but got %d)\n", kc->replylen, res);
+		return -1;
+	}
+	frame->len = res;
+
+	return 0;
+}
+
+struct gc_keyboard_state {
+	uint8_t prev_keys[3];
+	uint8_t active_keys[256];
+};
+
+/* Keyboards are event based: every frame is processed, not only the latest */
+static void gcKeyboardFrame(const struct sampler_frame *frame, void *ctx)
+{
+	struct gc_keyboard_state *kb = ctx;
+	const uint8_t *status = frame->data;
+	int i;
+	uint8_t lrc;
+
+	// Status
+	//       Bit
+	// Byte  7    | 6    | 5  |  4  |  3    2    1    0   |
+	//    0  ERR  | ERRL | ?  |  ?  |  Sequence counter   |
+	//    1  ????????
+	//    2  ????????
+	//    3  ????????
+	//    4  Keycode 1
+	//    5  Keycode 2
+	//    6  Keycode 3
+	//    7  LRC (XOR of bytes 0-6)
+	//
+	for (i=0, lrc=0; i<7; i++) {
+		lrc ^= status[i];
+	}
+	if (status[7] != lrc) {
+		printf("LRC error! ");
+		printHexBuf(status, frame->len);
+	}
+
+	if (status[4] == 0x02 && status[5] == 0x02 && status[6] == 0x02) {
+		printf("Too many keys down\n");
+	}
+
+	// Detect changes
+	if (memcmp(kb->prev_keys, status + 4, sizeof(kb->prev_keys))) {
+		for (i=1; i<sizeof(kb->active_keys); i++) {
+			// If a given key is reported active by the keyboard...
+			if (memchr(status+4, i, 3)) {
+				// ... and we do not already know:
+				if (!kb->active_keys[i]) {
+					printf("KEY 0x%02x down\n", i);
+					kb->active_keys[i] = 1;
+				}
+			}
+			else {
+				// If a key is not reported active by the keyboard
+				// but it was in the previous iteration
+				if (kb->active_keys[i]) {
+					printf("KEY 0x%02x up\n", i);
+					kb->active_keys[i] = 0;
+				}
+			}
 		}
+	}
+	memcpy(kb->prev_keys, status + 4, sizeof(kb->prev_keys));
+}
 
+/* Read keyboard frames until CTRL+C or an error, passing each one to on_frame */
+static int pollKeyboard(rnt_hdl_t hdl, int chn, struct keyboard_cmd *kc, frame_func on_frame, void *ctx)
+{
+	struct sampler smp;
+	struct sampler_frame last;
+	struct display_stats stats;
+
+	if (startSampling(&smp, hdl, chn, 0, sampleKeyboard, kc, &stats))
+		return -1;
 
-		printf("X: %4d (%3d), Y: %4d (%3d), CX: %4d, CY: %4d, LT: %4d, RT: %4d, Buttons: %02x %02x\r",
-			(int8_t)(status[2]+0x80),
-			unique_x_seen,
-			(int8_t)(status[3]+0x80),
-			unique_y_seen,
-			cx, cy,
-			lt, rt,
-			status[0], status[1]);
+	while (!stop_requested)
+	{
+		_delay_us(DISPLAY_INTERVAL_US);
+
+		if (drainFrames(&smp, on_frame, ctx, &last, NULL) < 0)
+			break;
 		fflush(stdout);
 	}
 
+	sampler_stop(&smp);
+
 	return 0;
 }
 
 int pollraw_gamecube_keyboard(rnt_hdl_t hdl, int chn)
 {
-	uint8_t getstatus[3] = { 0x54, 0x00, 0x00 };
-	uint8_t status[8];
-	int res;
-	int i;
-	uint8_t lrc;
-	uint8_t prev_keys[3] = { };
-	uint8_t active_keys[256] = { };
+	struct keyboard_cmd getstatus = { { 0x54, 0x00, 0x00 }, 3, 8 };
+	struct gc_keyboard_state kb = { };
 
 	printf("Suspending polling. Please use --resume_polling later.\n");
 	rnt_suspendPolling(hdl, 1);
 
 	printf("Polling gamecube keyboard.\n");
 	printf("CTRL+C to stop\n");
-	while(1)
-	{
-		res = gcn64lib_rawSiCommand(hdl, chn, getstatus, sizeof(getstatus), status, sizeof(status));
-		if (res != sizeof(status)) {
-			printf("Not enough data received\n");
-			break;
-		}
 
-		// Status
-		//       Bit
-		// Byte  7    | 6    | 5  |  4  |  3    2    1    0   |
-		//    0  ERR  | ERRL | ?  |  ?  |  Sequence counter   |
-		//    1  ????????
-		//    2  ????????
-		//    3  ????????
-		//    4  Keycode 1
-		//    5  Keycode 2
-		//    6  Keycode 3
-		//    7  LRC (XOR of bytes 0-6)
-		//
-		for (i=0, lrc=0; i<sizeof(status)-1; i++) {
-			lrc ^= status[i];
-		}
-		if (status[7] != lrc) {
-			printf("LRC error! ");
-			printHexBuf(status, res);
-		}
+	return pollKeyboard(hdl, chn, &getstatus, gcKeyboardFrame, &kb);
+}
 
-		if (status[4] == 0x02 && status[5] == 0x02 && status[6] == 0x02) {
-			printf("Too many keys down\n");
-		}
+static void randnetKeyboardFrame(const struct sampler_frame *frame, void *ctx)
+{
+	uint8_t *prev_status = ctx;
+	const uint8_t *status = frame->data;
+	int i;
 
-		// Detect changes
-		if (memcmp(prev_keys, status + 4, sizeof(prev_keys))) {
-			for (i=1; i<sizeof(active_keys); i++) {
-				// If a given key is reported active by the keyboard...
-				if (memchr(status+4, i, 3)) {
-					// ... and we do not already know:
-					if (!active_keys[i]) {
-						printf("KEY 0x%02x down\n", i);
-						active_keys[i] = 1;
-					}
-				}
-				else {
-					// If a key is not reported active by the keyboard
-					// but it was in the previous iteration
-					if (active_keys[i]) {
-						printf("KEY 0x%02x up\n", i);
-						active_keys[i] = 0;
-					}
-				}
+	// Big thanks to fraser125 for figuring this out, sharing it and testing!
+	//
+	// https://sites.google.com/site/consoleprotocols/home/nintendo-joy-bus-documentation/randnet-keyboard
+	//
+
+	// Status
+	//       Bit
+	// Byte  7  | 6 | 5 | 4    | 3 | 2 | 1 | 0        |
+	//    0  Keycode 1 MSB                            |
+	//    1  Keycode 1 LSB                            |
+	//    2  Keycode 2 MSB                            |
+	//    3  Keycode 2 LSB                            |
+	//    4  Keycode 3 MSB                            |
+	//    5  Keycode 3 LSB                            |
+	//    6  ? | ? | ? | Error | ? | ? | ? | Home key |
+	//
+	// Up to 3 keys can be pressed. When inactive, the keycodes
+	// are simply set to zero.
+	//
+
+	if (memcmp(prev_status, status, 7)) {
+		printf("---------------------\n");
+		printf("Raw: ");
+		printHexBuf(status, frame->len);
+		printf("Active keys(s): ");
+		for (i=0; i<3; i++) {
+			uint16_t keycode = status[i*2] << 8 | status[i*2+1];
+			if (keycode) {
+				printf("%04x ", keycode);
 			}
 		}
-		memcpy(prev_keys, status + 4, sizeof(prev_keys));
-	}
+		printf("\n");
+		printf("Status: %02x %s%s\n",
+					status[6],
+					status[6] & 0x10 ? "Error ":"",
+					status[6] & 0x01 ? "Home key":"");
 
-	return 0;
+	}
+	memcpy(prev_status, status, 7);
 }
 
 int pollraw_randnet_keyboard(rnt_hdl_t hdl, int chn)
 {
-	uint8_t getstatus[] = { 0x13, 0x00 };
-	uint8_t status[7];
+	struct keyboard_cmd getstatus = { { 0x13, 0x00 }, 2, 7 };
 	uint8_t prev_status[7] = { };
-	int res;
-	int i;
 
 	printf("Suspending polling. Please use --resume_polling later.\n");
 	rnt_suspendPolling(hdl, 1);
 	printf("Polling randnet keyboard...\n");
 	printf("CTRL+C to stop\n");
 
-	while(1)
-	{
-		res = gcn64lib_rawSiCommand(hdl, chn, getstatus, sizeof(getstatus), status, sizeof(status));
-		if (res != sizeof(status)) {
-			printf("Not enough data received (Expected %d bytes but got %d)\n", (int)sizeof(status), res);
-			break;
-		}
+	return pollKeyboard(hdl, chn, &getstatus, randnetKeyboardFrame, prev_status);
+}
 
-		// Big thanks to fraser125 for figuring this out, sharing it and testing!
-		//
-		// https://sites.google.com/site/consoleprotocols/home/nintendo-joy-bus-documentation/randnet-keyboard
-		//
-
-		// Status
-		//       Bit
-		// Byte  7  | 6 | 5 | 4    | 3 | 2 | 1 | 0        |
-		//    0  Keycode 1 MSB                            |
-		//    1  Keycode 1 LSB                            |
-		//    2  Keycode 2 MSB                            |
-		//    3  Keycode 2 LSB                            |
-		//    4  Keycode 3 MSB                            |
-		//    5  Keycode 3 LSB                            |
-		//    6  ? | ? | ? | Error | ? | ? | ? | Home key |
-		//
-		// Up to 3 keys can be pressed. When inactive, the keycodes
-		// are simply set to zero.
-		//
-
-		if (memcmp(prev_status, status, sizeof(status))) {
-			printf("---------------------\n");
-			printf("Raw: ");
-			printHexBuf(status, res);
-			printf("Active keys(s): ");
-			for (i=0; i<3; i++) {
-				uint16_t keycode = status[i*2] << 8 | status[i*2+1];
-				if (keycode) {
-					printf("%04x ", keycode);
-				}
-			}
-			printf("\n");
-			printf("Status: %02x %s%s\n",
-						status[6],
-						status[6] & 0x10 ? "Error ":"",
-						status[6] & 0x01 ? "Home key":"");
+/* PSX frames hold the answer of each port: ID (2 bytes), length, data */
+#define PSX_PORT_BYTES	12
+#define PSX_MAX_ANSWER	9
 
+static int samplePSX(struct sampler *smp, struct sampler_frame *frame)
+{
+	uint8_t *port_data;
+	uint16_t id;
+	int i, res;
+
+	for (i=PSXLIB_PORT_1; i<=PSXLIB_PORT_4; i++) {
+		port_data = frame->data + i * PSX_PORT_BYTES;
+		memset(port_data, 0, PSX_PORT_BYTES);
+
+		res = psxlib_pollStatus(smp->hdl, smp->chn, i, 0x00, 0x00, &id, port_data + 3, PSX_MAX_ANSWER);
+		if (res <= 0) {
+			printf("Error: psxlib_pollStatus returned %d\n", res);
+			return -1;
 		}
-		memcpy(prev_status, status, sizeof(status));
+		port_data[0] = id >> 8;
+		port_data[1] = id;
+		port_data[2] = res;
 	}
+	frame->len = (PSXLIB_PORT_4 + 1) * PSX_PORT_BYTES;
 
 	return 0;
 }
 
+static void psxFrame(const struct sampler_frame *frame, void *ctx)
+{
+	const int *sources = ctx;
+	const uint8_t *port_data;
+	int i;
+
+	for (i=PSXLIB_PORT_1; i<=PSXLIB_PORT_4; i++) {
+		port_data = frame->data + i * PSX_PORT_BYTES;
+		recordFrame(sources[i], frame->timestamp, port_data + 3, port_data[2]);
+	}
+}
+
 int pollraw_psx(rnt_hdl_t hdl, int chn)
 {
 	uint8_t answer[9];
 	uint16_t id;
-	int res;
+	int res, i, n;
 	uint8_t incfg;
+	int sources[PSXLIB_PORT_4 + 1];
+	struct sampler smp;
+	struct sampler_frame last;
+	struct display_stats stats;
+	const uint8_t *port_data;
+	uint64_t last_display = 0;
 
 	printf("Suspending polling. Please use --resume_polling later.\n");
 	rnt_suspendPolling(hdl, 1);
@@ -337,43 +695,204 @@ int pollraw_psx(rnt_hdl_t hdl, int chn)
 		psxlib_enterConfigurationMode(hdl, chn, PSXLIB_PORT_1, 0, &incfg);
 	}
 
-	while(1)
+	if (recordStart())
+		return -1;
+	for (i=PSXLIB_PORT_1; i<=PSXLIB_PORT_4; i++) {
+		sources[i] = recordSource(INPUTLOG_SRC_PSX, chn, 0, i);
+	}
+
+	if (startSampling(&smp, hdl, chn, 0, samplePSX, NULL, &stats)) {
+		recordStop();
+		return -1;
+	}
+
+	while (!stop_requested)
 	{
-		int i;
+		_delay_us(DISPLAY_INTERVAL_US);
 
-		memset(answer, 0, sizeof(answer));
+		n = drainFrames(&smp, psxFrame, sources, &last, &stats);
+		if (n < 0) {
+			sampler_stop(&smp);
+			recordStop();
+			return -1;
+		}
+		updateStats(&smp, &stats);
+
+		if (!n || last.timestamp - last_display < PSX_DISPLAY_INTERVAL_US)
+			continue;
+		last_display = last.timestamp;
 
 		for (i=PSXLIB_PORT_1; i<=PSXLIB_PORT_4; i++) {
+			port_data = last.data + i * PSX_PORT_BYTES;
+			id = port_data[0] << 8 | port_data[1];
+			printf("Port %d : ID = 0x%04x : %s : ", i+1, id, psxlib_idToString(id));
+			printHexBuf(port_data + 3, port_data[2]);
+		}
+		printStats(&smp, &stats);
+		printf("-------------------\n");
+		fflush(stdout);
+	}
 
-			res = psxlib_pollStatus(hdl, chn, i, 0x00, 0x00, &id, answer, sizeof(answer));
-			if (res <= 0) {
-				printf("Error: psxlib_pollStatus returned %d\n", res);
-				return -1;
+	sampler_stop(&smp);
+
+	return recordStop();
+}
+
+static void wii_displayStatus(uint16_t ext_id, uint8_t high_res, const uint8_t *status)
+{
+	classic_pad_data pad_data;
+	udraw_tablet_data udraw_data;
+	drawsome_tablet_data drawsome_data;
+	djhero_turntable_data turntable_data;
+	nunchuk_pad_data nunchuk_data;
+
+	switch (ext_id)
+	{
+		case ID_NUNCHUK:
+			wusbmotelib_bufferToNunchukPadData(status, &nunchuk_data);
+			printf("SX: %d, XY: %d, AX: %3d, AY: %3d, AZ: %3d\n",
+					nunchuk_data.sx, nunchuk_data.sy,
+					nunchuk_data.ax, nunchuk_data.ay, nunchuk_data.az);
+#ifdef DISPLAY_NUNCHUK_ROLL
+			// Z and X for roll
+			printf(" Roll angle: %2.1f\n", atan2(nunchuk_data.ax , (double)nunchuk_data.az) / M_PI * 2.0 * 90.0);
+#endif
+			break;
+
+		case ID_CLASSIC:
+		case ID_CLASSIC_PRO:
+			wusbmotelib_bufferToClassicPadData(status, &pad_data, ext_id, high_res);
+
+			if (high_res) {
+				printf("LX: %4d, LY: %4d, RX: %4d, RY: %4d, LT: %4d, RT: %4d\n",
+					pad_data.lx, pad_data.ly, pad_data.rx, pad_data.ry,
+					pad_data.lt, pad_data.rt);
+			}
+			else {
+				printf("LX: %4d, LY: %4d, RX: %4d, RY: %4d, LT: %4d, RT: %4d\n",
+					pad_data.lx, pad_data.ly, pad_data.rx, pad_data.ry,
+					pad_data.lt, pad_data.rt);
 			}
+			break;
 
-			printf("Port %d : ID = 0x%04x : %s : ", i+1, id, psxlib_idToString(id));
-			printHexBuf(answer, res);
+		case ID_UDRAW:
+			wusbmotelib_bufferToUdrawData(status, &udraw_data);
+			printf("X: %6d, Y: %6d, P=%3d, Buttons: 0x%02x  (%3d %3d)\n",
+					udraw_data.x,
+					udraw_data.y,
+					udraw_data.pressure,
+					udraw_data.buttons,
+					(udraw_data.x - 90 - (1440-90)/2),
+					(udraw_data.y - 90 - (1920-90)/2)
+
+					);
+			break;
+
+		case ID_DRAWSOME:
+			wusbmotelib_bufferToDrawsomeData(status, &drawsome_data);
+			printf("X: %6d, Y: %6d, P=%3d, status: 0x%02x (%s)\n",
+					drawsome_data.x,
+					drawsome_data.y,
+					drawsome_data.pressure,
+					drawsome_data.status,
+					drawsome_data.status & 0x08 ? "Pen out of range":"Pen in range"
+					);
+
+			break;
+			
+		case ID_DJHERO:
+			wusbmotelib_bufferToTurntableData(status, &turntable_data);
+			printf("X: %3d, Y: %3d, LTT=%2d, RTT=%2d, Effect=%2d, Crossfade=%2d, Buttons=%04x\n",
+				turntable_data.x,
+				turntable_data.y,
+				turntable_data.left_turntable,
+				turntable_data.right_turntable,
+				turntable_data.effect_dial,
+				turntable_data.crossfade,
+				turntable_data.buttons
+				);
+			
+			break;
+
+	}
+}
+
+/* The sampling schedule belongs to the acquisition thread */
+struct wii_sampling {
+	int readlen;
+	int period_us; // 0 for as fast as possible
+	uint64_t next;
+};
+
+static int sampleWii(struct sampler *smp, struct sampler_frame *frame)
+{
+	struct wii_sampling *ws = smp->ctx;
+	uint64_t now;
+
+	if (ws->period_us) {
+		now = getMicroseconds();
+		if (now < ws->next) {
+			_delay_us(ws->next - now);
+		} else if (now - ws->next > ws->period_us) {
+			// Too late to catch up. Restart the schedule.
+			ws->next = now;
 		}
-		printf("-------------------\n");
+		ws->next += ws->period_us;
+	}
 
-		sleep(1);
+	if (wusbmotelib_readRegs(smp->hdl, smp->chn, 0, frame->data, ws->readlen) < 0) {
+		return -1;
 	}
+	frame->timestamp = getMicroseconds();
+	frame->len = ws->readlen;
 
 	return 0;
 }
 
-int pollraw_wii(rnt_hdl_t hdl, int chn, int enable_high_res)
+/* Interval statistics, from the timestamps of all the frames (not only those displayed) */
+struct wii_state {
+	int source;
+	uint64_t last_timestamp;
+	int samples; // Since the last report
+	double sum, sumsq;
+	int min_interval, max_interval;
+};
+
+static void wiiFrame(const struct sampler_frame *frame, void *ctx)
+{
+	struct wii_state *ws = ctx;
+	int interval;
+
+	recordFrame(ws->source, frame->timestamp, frame->data, frame->len);
+
+	if (ws->samples) {
+		interval = frame->timestamp - ws->last_timestamp;
+
+		ws->sum += interval;
+		ws->sumsq += (double)interval * interval;
+		if (ws->samples == 1 || interval < ws->min_interval)
+			ws->min_interval = interval;
+		if (ws->samples == 1 || interval > ws->max_interval)
+			ws->max_interval = interval;
+	}
+	ws->last_timestamp = frame->timestamp;
+	ws->samples++;
+}
+
+/** \param rate Sampling rate in Hz (0: As fast as possible) */
+int pollraw_wii(rnt_hdl_t hdl, int chn, int enable_high_res, int rate)
 {
 	uint8_t extmem[256];
 	uint16_t ext_id;
-	uint8_t status[16], prev_status[16];
+	uint8_t prev_status[WII_MAX_READLEN];
 	uint8_t high_res = 0;
-	int res;
-	classic_pad_data pad_data;
-	udraw_tablet_data udraw_data;
-	drawsome_tablet_data drawsome_data;
-	djhero_turntable_data turntable_data;
-	nunchuk_pad_data nunchuk_data;
+	int res, n, readlen;
+	struct sampler smp;
+	struct sampler_frame last;
+	struct display_stats stats;
+	struct wii_sampling sampling = { };
+	struct wii_state state = { };
+	double mean, jitter;
 
 	printf("Polling Wii controller\n");
 	printf("CTRL+C to stop\n");
@@ -445,107 +964,90 @@ int pollraw_wii(rnt_hdl_t hdl, int chn, int enable_high_res)
 		printf("Done.\n\n");
 	}
 
-	while(1)
-	{
-		int readlen = sizeof(status);
+	readlen = sizeof(prev_status);
+	if (ext_id == ID_DRAWSOME)
+		readlen = 6;
+
+	if (rate < 0)
+		return -1;
+	sampling.readlen = readlen;
+	sampling.period_us = rate ? 1000000 / rate : 0;
 
-		if (ext_id == ID_DRAWSOME)
-			readlen = 6;
+	if (recordStart())
+		return -1;
+	state.source = recordSource(INPUTLOG_SRC_WII, chn, high_res ? INPUTLOG_FLAG_HIGH_RES : 0, ext_id);
+
+	if (startSampling(&smp, hdl, chn, 0, sampleWii, &sampling, &stats)) {
+		recordStop();
+		return -1;
+	}
+	memset(prev_status, 0, sizeof(prev_status));
 
-		_delay_us(40000);
+	// Samples are acquired by the polling thread. Here only the most
+	// recent one is decoded and displayed, at a lower rate (and only if
+	// it changed).
+	while (!stop_requested)
+	{
+		_delay_us(WII_DISPLAY_INTERVAL_US);
 
-		res = wusbmotelib_readRegs(hdl, chn, 0, status, readlen);
-		if (res < 0) {
+		n = drainFrames(&smp, wiiFrame, &state, &last, &stats);
+		if (n < 0) {
 			fprintf(stderr, "error reading registers\n");
-			return -1;
+			break;
 		}
 
-		// Only display changes
-		if (0 == memcmp(prev_status, status, readlen))
-			continue;
-		memcpy(prev_status, status, readlen);
+		if (n && memcmp(prev_status, last.data, readlen)) {
+			memcpy(prev_status, last.data, readlen);
 
-		printHexBuf(status, readlen);
+			printHexBuf(last.data, readlen);
+			wii_displayStatus(ext_id, high_res, last.data);
+		}
 
-		switch (ext_id)
-		{
-			case ID_NUNCHUK:
-				wusbmotelib_bufferToNunchukPadData(status, &nunchuk_data);
-				printf("SX: %d, XY: %d, AX: %3d, AY: %3d, AZ: %3d\n",
-						nunchuk_data.sx, nunchuk_data.sy,
-						nunchuk_data.ax, nunchuk_data.ay, nunchuk_data.az);
-#ifdef DISPLAY_NUNCHUK_ROLL
-				// Z and X for roll
-				printf(" Roll angle: %2.1f\n", atan2(nunchuk_data.ax , (double)nunchuk_data.az) / M_PI * 2.0 * 90.0);
-#endif
-				break;
+		if (updateStats(&smp, &stats)) {
+			mean = jitter = 0;
+			if (state.samples > 1) {
+				mean = state.sum / (state.samples - 1);
+				jitter = sqrt(fabs(state.sumsq / (state.samples - 1) - mean * mean));
+			}
+			printf("Rate: %.1f Hz, interval: %.0f us (min %d, max %d), jitter: %.0f us, overruns: %u, not displayed: %u\n",
+					stats.rate, mean, state.min_interval, state.max_interval, jitter,
+					sampler_overruns(&smp), stats.skipped);
+			state.samples = 0;
+			state.sum = 0;
+			state.sumsq = 0;
+		}
+	}
 
-			case ID_CLASSIC:
-			case ID_CLASSIC_PRO:
-				wusbmotelib_bufferToClassicPadData(status, &pad_data, ext_id, high_res);
+	sampler_stop(&smp);
 
-				if (high_res) {
-					printf("LX: %4d, LY: %4d, RX: %4d, RY: %4d, LT: %4d, RT: %4d\n",
-						pad_data.lx, pad_data.ly, pad_data.rx, pad_data.ry,
-						pad_data.lt, pad_data.rt);
-				}
-				else {
-					printf("LX: %4d, LY: %4d, RX: %4d, RY: %4d, LT: %4d, RT: %4d\n",
-						pad_data.lx, pad_data.ly, pad_data.rx, pad_data.ry,
-						pad_data.lt, pad_data.rt);
-				}
-				break;
-
-			case ID_UDRAW:
-				wusbmotelib_bufferToUdrawData(status, &udraw_data);
-				printf("X: %6d, Y: %6d, P=%3d, Buttons: 0x%02x  (%3d %3d)\n",
-						udraw_data.x,
-						udraw_data.y,
-						udraw_data.pressure,
-						udraw_data.buttons,
-						(udraw_data.x - 90 - (1440-90)/2),
-						(udraw_data.y - 90 - (1920-90)/2)
-
-						);
-				break;
-
-			case ID_DRAWSOME:
-				wusbmotelib_bufferToDrawsomeData(status, &drawsome_data);
-				printf("X: %6d, Y: %6d, P=%3d, status: 0x%02x (%s)\n",
-						drawsome_data.x,
-						drawsome_data.y,
-						drawsome_data.pressure,
-						drawsome_data.status,
-						drawsome_data.status & 0x08 ? "Pen out of range":"Pen in range"
-						);
-
-				break;
-				
-			case ID_DJHERO:
-				wusbmotelib_bufferToTurntableData(status, &turntable_data);
-				printf("X: %3d, Y: %3d, LTT=%2d, RTT=%2d, Effect=%2d, Crossfade=%2d, Buttons=%04x\n",
-					turntable_data.x,
-					turntable_data.y,
-					turntable_data.left_turntable,
-					turntable_data.right_turntable,
-					turntable_data.effect_dial,
-					turntable_data.crossfade,
-					turntable_data.buttons
-					);
-				
-				break;
+	// Only CTRL+C ends the loop without an error
+	if (recordStop() || !stop_requested)
+		return -1;
 
-		}
+	return 0;
+}
 
+static int sampleDB9(struct sampler *smp, struct sampler_frame *frame)
+{
+	int res;
+
+	res = db9lib_getPollData(smp->hdl, smp->chn, frame->data, 32);
+	if (res < 0) {
+		return -1;
 	}
+	frame->len = res;
 
 	return 0;
 }
 
 int pollraw_db9(rnt_hdl_t hdl, int chn)
 {
-	uint8_t buf[32];
-	int res;
+	struct sampler smp;
+	struct sampler_frame last;
+	struct display_stats stats;
+	const uint8_t *buf = last.data;
+	int res, source;
+	uint64_t last_display = 0;
 
 	printf("Polling DB9 controller\n");
 	printf("CTRL+C to stop\n");
@@ -553,19 +1055,35 @@ int pollraw_db9(rnt_hdl_t hdl, int chn)
 	printf("Suspending polling. Please use --resume_polling later.\n");
 	rnt_suspendPolling(hdl, 1);
 
-	while (1)
+	if (recordStart())
+		return -1;
+	source = recordSource(INPUTLOG_SRC_DB9, chn, 0, 0);
+
+	if (startSampling(&smp, hdl, chn, 0, sampleDB9, NULL, &stats)) {
+		recordStop();
+		return -1;
+	}
+
+	while (!stop_requested)
 	{
-		res = db9lib_getPollData(hdl, chn, buf, sizeof(buf));
-		if (res < 0) {
+		_delay_us(DISPLAY_INTERVAL_US);
+
+		res = drainFrames(&smp, recordSingle, &source, &last, &stats);
+		if (res < 0)
 			break;
-		}
+		updateStats(&smp, &stats);
+
+		if (!res || last.timestamp - last_display < DB9_DISPLAY_INTERVAL_US)
+			continue;
+		last_display = last.timestamp;
+		res = last.len;
 
 		printHexBuf(buf, res);
 
 		if (res >= 10) {
 			// Mouse mode
 			if (buf[9]) {
-				uint8_t *mouse_data = buf + 10;
+				const uint8_t *mouse_data = buf + 10;
 
 				uint8_t buttons = mouse_data[3];
 				int8_t x, y;
@@ -593,44 +1111,81 @@ int pollraw_db9(rnt_hdl_t hdl, int chn)
 			}
 		}
 
-		sleep(1);
+		printStats(&smp, &stats);
+		fflush(stdout);
 	}
 
-	return 0;
+	sampler_stop(&smp);
+
+	return recordStop();
 }
 
-int pollraw_dreamcast_controller(rnt_hdl_t hdl, int chn)
+/* smp->param is the maple function (controller or mouse) */
+static int sampleMaple(struct sampler *smp, struct sampler_frame *frame)
 {
-	uint8_t buf[64];
+	int res, flags = MAPLE_FLAG_KEEP_DATA;
 
-	int res;
-	int result, datalen;
+	if (smp->param == MAPLE_FUNC_MOUSE) {
+		flags |= MAPLE_FLAG_MOUSE_RX;
+	}
 
-	printf("Polling DC controller\n");
-	printf("CTRL+C to stop\n");
+	//res = maple_getPollData(hdl, chn, buf, sizeof(buf));
+	res = maple_sendFrame1W(smp->hdl, smp->chn,
+			MAPLE_CMD_GET_CONDITION,
+			MAPLE_ADDR_PORTB | MAPLE_ADDR_MAIN,
+			MAPLE_ADDR_PORTB | MAPLE_DC_ADDR,
+			smp->param,
+			frame->data, sizeof(frame->data), flags);
 
-	printf("Suspending polling. Please use --resume_polling later.\n");
-	rnt_suspendPolling(hdl, 1);
+	if (res < 0) {
+		return -1;
+	}
+	frame->len = res;
+
+	return 0;
+}
+
+static void dreamcastFrame(const struct sampler_frame *frame, void *ctx)
+{
+	// Error answers are not recorded
+	if (frame->data[0] != 0x86) {
+		recordFrame(*(int*)ctx, frame->timestamp, frame->data, frame->len);
+	}
+}
+
+static int pollMaple(rnt_hdl_t hdl, int chn, int function, int source)
+{
+	struct sampler smp;
+	struct sampler_frame last;
+	struct display_stats stats;
+	const uint8_t *buf = last.data;
+	int res, result, datalen;
+	uint64_t last_display = 0;
+
+	if (startSampling(&smp, hdl, chn, function, sampleMaple, NULL, &stats))
+		return -1;
 
-	while (1)
+	while (!stop_requested)
 	{
-		//res = maple_getPollData(hdl, chn, buf, sizeof(buf));
-		res = maple_sendFrame1W(hdl, chn,
-				MAPLE_CMD_GET_CONDITION,
-				MAPLE_ADDR_PORTB | MAPLE_ADDR_MAIN,
-				MAPLE_ADDR_PORTB | MAPLE_DC_ADDR,
-//				MAPLE_FUNC_MOUSE,
-				MAPLE_FUNC_CONTROLLER,
-				buf, sizeof(buf), MAPLE_FLAG_KEEP_DATA );
-
-		if (res < 0) {
+		_delay_us(DISPLAY_INTERVAL_US);
+
+		res = drainFrames(&smp, dreamcastFrame, &source, &last, &stats);
+		if (res < 0)
 			break;
+		if (updateStats(&smp, &stats)) {
+			printStats(&smp, &stats);
 		}
 
+		if (!res || last.timestamp - last_display < DC_DISPLAY_INTERVAL_US)
+			continue;
+		last_display = last.timestamp;
+		res = last.len;
+
 		if (buf[0] == 0x86)
 		{
 			if (res < 3) {
 				fprintf(stderr, "invalid data\n");
+				sampler_stop(&smp);
 				return -1;
 			}
 
@@ -648,65 +1203,256 @@ int pollraw_dreamcast_controller(rnt_hdl_t hdl, int chn)
 		else {
 			printHexBuf(buf, res);
 		}
-
-		_delay_us(100000);
+		fflush(stdout);
 	}
 
+	sampler_stop(&smp);
+
 	return 0;
 }
 
-int pollraw_dreamcast_mouse(rnt_hdl_t hdl, int chn)
+int pollraw_dreamcast_controller(rnt_hdl_t hdl, int chn)
 {
-	uint8_t buf[64];
+	int source;
 
-	int res;
-	int result, datalen;
+	printf("Polling DC controller\n");
+	printf("CTRL+C to stop\n");
+
+	printf("Suspending polling. Please use --resume_polling later.\n");
+	rnt_suspendPolling(hdl, 1);
+
+	if (recordStart())
+		return -1;
+	source = recordSource(INPUTLOG_SRC_DC, chn, 0, 0);
+
+	if (pollMaple(hdl, chn, MAPLE_FUNC_CONTROLLER, source)) {
+		recordStop();
+		return -1;
+	}
 
+	return recordStop();
+}
+
+int pollraw_dreamcast_mouse(rnt_hdl_t hdl, int chn)
+{
 	printf("Polling DC mouse\n");
 	printf("CTRL+C to stop\n");
 
 	printf("Suspending polling. Please use --resume_polling later.\n");
 	rnt_suspendPolling(hdl, 1);
 
-	while (1)
+	// Mouse frames are not recorded
+	return pollMaple(hdl, chn, MAPLE_FUNC_MOUSE, -1);
+}
+
+
+static int printPortStatus(char *dst, int dstlen, const struct sipoll_port *port, const struct sipoll_status *st)
+{
+	if (st->timed_out) {
+		return snprintf(dst, dstlen, "[%d %s: no answer] ", port->chn, sipoll_typeName(port->type));
+	}
+
+	switch (port->type)
 	{
-		//res = maple_getPollData(hdl, chn, buf, sizeof(buf));
-		res = maple_sendFrame1W(hdl, chn,
-				MAPLE_CMD_GET_CONDITION,
-				MAPLE_ADDR_PORTB | MAPLE_ADDR_MAIN,
-				MAPLE_ADDR_PORTB | MAPLE_DC_ADDR,
-				MAPLE_FUNC_MOUSE,
-				buf, sizeof(buf), MAPLE_FLAG_KEEP_DATA | MAPLE_FLAG_MOUSE_RX );
-
-		if (res < 0) {
-			break;
-		}
+		case SIPOLL_N64:
+			return snprintf(dst, dstlen, "[%d N64 X:%4d Y:%4d B:%04x] ", port->chn, st->x, st->y, st->buttons);
 
-		if (buf[0] == 0x86)
-		{
-			if (res < 3) {
-				fprintf(stderr, "invalid data\n");
-				return -1;
-			}
+		case SIPOLL_GC:
+			return snprintf(dst, dstlen, "[%d GC X:%4d Y:%4d CX:%4d CY:%4d L:%3d R:%3d B:%04x] ", port->chn,
+						st->x, st->y, st->cx, st->cy, st->lt, st->rt, st->buttons);
 
-			result = (int16_t)(buf[1] | buf[2] << 8);
-			datalen = res - 3;
+		default:
+			return snprintf(dst, dstlen, "[%d KB %04x %04x %04x%s] ", port->chn,
+						st->keys[0], st->keys[1], st->keys[2], st->error ? " ERR" : "");
+	}
+}
 
-			printf("Result %d, data[%d] = ", result, datalen);
-			if (datalen > 0) {
-				printHexBuf(buf + 3, datalen);
-			} else {
-				printf(" (no data)\n");
-			}
+/* Parse a chn:type[:mode] list, eg: 0:n64,1:gc,2:gc:3 */
+static int parsePortList(struct sipoll *sp, const char *spec)
+{
+	char buf[256], *item, *next, *type_str, *mode_str;
+	int chn, type, mode;
 
+	if (strlen(spec) >= sizeof(buf)) {
+		fprintf(stderr, "Port list too long\n");
+		return -1;
+	}
+	strcpy(buf, spec);
+
+	for (item = buf; item; item = next) {
+		next = strchr(item, ',');
+		if (next) {
+			*next++ = 0;
 		}
-		else {
-			printHexBuf(buf, res);
+
+		type_str = strchr(item, ':');
+		if (!type_str) {
+			fprintf(stderr, "Invalid port '%s' (expected channel:type)\n", item);
+			return -1;
+		}
+		*type_str++ = 0;
+
+		mode = 0;
+		mode_str = strchr(type_str, ':');
+		if (mode_str) {
+			*mode_str++ = 0;
+			mode = atoi(mode_str);
+		}
+
+		chn = atoi(item);
+		type = sipoll_parseType(type_str);
+		if (type < 0) {
+			fprintf(stderr, "Unknown controller type '%s' (n64, gc, gc_keyboard or n64_keyboard)\n", type_str);
+			return -1;
+		}
+
+		if (sipoll_addPort(sp, chn, type, mode)) {
+			return -1;
 		}
+	}
+
+	if (!sp->n_ports) {
+		fprintf(stderr, "No port to poll\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Multi frames hold, for each port: timed out flag, length, raw answer */
+#define MULTI_PORT_BYTES	(2 + SIPOLL_MAX_RX)
+
+static int sampleMulti(struct sampler *smp, struct sampler_frame *frame)
+{
+	struct sipoll *sp = smp->ctx;
+	struct sipoll_frame sf;
+	uint8_t *port_data;
+	int i;
 
-		_delay_us(100000);
+	if (sipoll_poll(sp, &sf)) {
+		fprintf(stderr, "Poll error\n");
+		return -1;
+	}
+
+	frame->timestamp = sf.timestamp;
+	for (i=0; i<sf.n_ports; i++) {
+		port_data = frame->data + i * MULTI_PORT_BYTES;
+		port_data[0] = sf.status[i].timed_out;
+		port_data[1] = sf.status[i].len;
+		memcpy(port_data + 2, sf.status[i].raw, SIPOLL_MAX_RX);
 	}
+	frame->len = sf.n_ports * MULTI_PORT_BYTES;
 
 	return 0;
 }
 
+/* Port timeouts are counted here (the sipoll counters belong to the sampling thread) */
+struct multi_state {
+	int n_ports;
+	int sources[SIPOLL_MAX_PORTS];
+	int timeouts[SIPOLL_MAX_PORTS];
+};
+
+static void multiFrame(const struct sampler_frame *frame, void *ctx)
+{
+	struct multi_state *ms = ctx;
+	const uint8_t *port_data;
+	int i;
+
+	for (i=0; i<ms->n_ports; i++) {
+		port_data = frame->data + i * MULTI_PORT_BYTES;
+		if (port_data[0]) {
+			ms->timeouts[i]++;
+		} else {
+			recordFrame(ms->sources[i], frame->timestamp, port_data + 2, port_data[1]);
+		}
+	}
+}
+
+int pollraw_multi(rnt_hdl_t hdl, const char *spec)
+{
+	struct sipoll sp;
+	struct sipoll_status st;
+	struct sampler smp;
+	struct sampler_frame last;
+	struct display_stats stats;
+	struct multi_state ms = { };
+	const uint8_t *port_data;
+	char line[512], prev_line[512] = "";
+	int i, p, n;
+
+	sipoll_init(&sp, hdl);
+	if (parsePortList(&sp, spec))
+		return -1;
+
+	printf("Suspending polling. Please use --resume_polling later.\n");
+	rnt_suspendPolling(hdl, 1);
+
+	if (recordStart())
+		return -1;
+	ms.n_ports = sp.n_ports;
+	for (i=0; i<sp.n_ports; i++) {
+		switch (sp.ports[i].type)
+		{
+			case SIPOLL_N64: ms.sources[i] = recordSource(INPUTLOG_SRC_N64, sp.ports[i].chn, 0, 0); break;
+			case SIPOLL_GC: ms.sources[i] = recordSource(INPUTLOG_SRC_GC, sp.ports[i].chn, 0, sp.ports[i].gc_mode); break;
+			default: ms.sources[i] = -1; break; // Keyboards are not recorded
+		}
+	}
+
+	printf("Polling %d port(s) with one request per frame\n", sp.n_ports);
+	printf("CTRL+C to stop\n");
+
+	if (startSampling(&smp, hdl, 0, 0, sampleMulti, &sp, &stats)) {
+		recordStop();
+		return -1;
+	}
+
+	while (!stop_requested)
+	{
+		_delay_us(DISPLAY_INTERVAL_US);
+
+		n = drainFrames(&smp, multiFrame, &ms, &last, &stats);
+		if (n < 0) {
+			sampler_stop(&smp);
+			recordStop();
+			return -1;
+		}
+
+		// Only the latest frame is displayed (and only if something changed)
+		if (n) {
+			for (i=0, p=0; i<sp.n_ports && p < sizeof(line); i++) {
+				port_data = last.data + i * MULTI_PORT_BYTES;
+				memset(&st, 0, sizeof(st));
+				st.timed_out = port_data[0];
+				st.len = port_data[1];
+				memcpy(st.raw, port_data + 2, SIPOLL_MAX_RX);
+				if (!st.timed_out) {
+					sipoll_decode(sp.ports[i].type, sp.ports[i].gc_mode, &st);
+				}
+				p += printPortStatus(line + p, sizeof(line) - p, &sp.ports[i], &st);
+			}
+			if (p > 0 && p <= sizeof(line)) {
+				line[p-1] = 0; // Trailing space
+			}
+			if (strcmp(line, prev_line)) {
+				printf("%s\n", line);
+				strcpy(prev_line, line);
+			}
+		}
+
+		if (updateStats(&smp, &stats)) {
+			printf("Rate: %.1f frames/s (%.1f samples/s), overruns: %u, not displayed: %u. Timeouts:",
+						stats.rate, stats.rate * sp.n_ports, sampler_overruns(&smp), stats.skipped);
+			for (i=0; i<sp.n_ports; i++) {
+				printf(" chn%d: %d", sp.ports[i].chn, ms.timeouts[i]);
+			}
+			printf("\n");
+			fflush(stdout);
+		}
+	}
+
+	sampler_stop(&smp);
+
+	return recordStop();
+}
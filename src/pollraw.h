@@ -6,9 +6,33 @@ int pollraw_gamecube_keyboard(rnt_hdl_t hdl, int chn);
 int pollraw_gamecube(rnt_hdl_t hdl, int chn, int mode);
 int pollraw_randnet_keyboard(rnt_hdl_t hdl, int chn);
 int pollraw_psx(rnt_hdl_t hdl, int chn);
-int pollraw_wii(rnt_hdl_t hdl, int chn, int enable_high_res);
+int pollraw_wii(rnt_hdl_t hdl, int chn, int enable_high_res, int rate);
 int pollraw_db9(rnt_hdl_t hdl, int chn);
 int pollraw_dreamcast_mouse(rnt_hdl_t hdl, int chn);
 int pollraw_dreamcast_controller(rnt_hdl_t hdl, int chn);
 
+/** \brief Poll several N64/GC controllers or keyboards, one block IO request per frame
+ * \param spec Ports as channel:type[:mode], comma separated. Ex: 0:n64,1:gc,2:gc:3,3:gc_keyboard
+ */
+int pollraw_multi(rnt_hdl_t hdl, const char *spec);
+
+/** \brief Record the samples of the next pollraw command to a file (see inputlog.h)
+ *
+ * Supported by the N64, Gamecube, PSX, Wii, DB9, Dreamcast controller and
+ * multi port commands. CTRL+C stops polling and completes the file.
+ *
+ * \param filename The file to write, or NULL to stop recording
+ */
+void pollraw_setRecordFile(const char *filename);
+
+/** \brief Accumulate the stick statistics of the next N64 or Gamecube pollraw command in a file
+ *
+ * Statistics already in the file (from previous sessions with the same
+ * controller) are included. A grade report is printed when polling stops
+ * (see stickstats.h). Without a file, the report covers the session only.
+ *
+ * \param filename The file to update, or NULL
+ */
+void pollraw_setStickStatsFile(const char *filename);
+
 #endif // _pollraw_h__
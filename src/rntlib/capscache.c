@@ -0,0 +1,295 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "capscache.h"
+#include "userdirs.h"
+
+#define CACHE_MAGIC		"capscache 1"
+#define MAX_KEY			128
+// 4 lists of up to 256 bytes in hex, plus the key
+#define MAX_LINE		(4 * 512 + 4 * MAX_KEY)
+#define N_FIELDS		8
+
+struct cache_entry {
+	char serial[MAX_KEY];
+	char usb_id[MAX_KEY];
+	char fw_version[MAX_KEY];
+	struct rnt_dyn_features feats;
+};
+
+static void stripEol(char *s)
+{
+	int len = strlen(s);
+
+	while (len && (s[len-1] == '\n' || s[len-1] == '\r'))
+		s[--len] = 0;
+}
+
+static int splitFields(char *line, char **fields, int max_fields)
+{
+	int n = 0;
+
+	while (n < max_fields) {
+		fields[n++] = line;
+		line = strchr(line, '\t');
+		if (!line)
+			break;
+		*line = 0;
+		line++;
+	}
+
+	return n;
+}
+
+static int validKeyString(const char *s)
+{
+	return strlen(s) < MAX_KEY && !strpbrk(s, "\t\r\n");
+}
+
+/* Build the key of an adapter. Returns -1 if it cannot be cached. */
+static int makeKey(const struct rnt_adap_info *info, const char *fw_version, struct cache_entry *key)
+{
+	int n;
+
+	if (!info->str_serial[0] || !validKeyString(fw_version))
+		return -1;
+
+	// Fails if the serial cannot be represented in the current locale
+	n = snprintf(key->serial, sizeof(key->serial), "%ls", info->str_serial);
+	if (n < 0 || n >= sizeof(key->serial) || !validKeyString(key->serial))
+		return -1;
+
+	snprintf(key->usb_id, sizeof(key->usb_id), "%04x:%04x:%d.%d", info->usb_vid, info->usb_pid,
+				info->version_major, info->version_minor);
+	strcpy(key->fw_version, fw_version);
+
+	return 0;
+}
+
+static int sameKey(const struct cache_entry *a, const struct cache_entry *b)
+{
+	return !strcmp(a->serial, b->serial) && !strcmp(a->usb_id, b->usb_id) && !strcmp(a->fw_version, b->fw_version);
+}
+
+static void writeHex(FILE *fptr, const uint8_t *data, int len)
+{
+	int i;
+
+	for (i=0; i<len; i++) {
+		fprintf(fptr, "%02x", data[i]);
+	}
+}
+
+static int parseHex(const char *s, uint8_t *dst, int *len, int maxlen)
+{
+	unsigned int v;
+	int n = strlen(s);
+
+	if (n % 2 || n / 2 > maxlen)
+		return -1;
+
+	for (*len = 0; *s; s += 2) {
+		if (1 != sscanf(s, "%2x", &v))
+			return -1;
+		dst[(*len)++] = v;
+	}
+
+	return 0;
+}
+
+static int parseEntry(char *line, struct cache_entry *e)
+{
+	char *fields[N_FIELDS];
+	struct rnt_dyn_features *f = &e->feats;
+
+	if (N_FIELDS != splitFields(line, fields, N_FIELDS) || strcmp(fields[0], "C"))
+		return -1;
+
+	if (!validKeyString(fields[1]) || !validKeyString(fields[2]) || !validKeyString(fields[3]))
+		return -1;
+
+	strcpy(e->serial, fields[1]);
+	strcpy(e->usb_id, fields[2]);
+	strcpy(e->fw_version, fields[3]);
+
+	if (parseHex(fields[4], f->supported_requests, &f->n_supported_requests, sizeof(f->supported_requests)) ||
+		parseHex(fields[5], f->supported_modes, &f->n_supported_modes, sizeof(f->supported_modes)) ||
+		parseHex(fields[6], f->supported_cfg_params, &f->n_supported_cfg_params, sizeof(f->supported_cfg_params)) ||
+		parseHex(fields[7], f->supported_mappings, &f->n_supported_mappings, sizeof(f->supported_mappings)))
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Load the cache. Returns the number of entries (0 if the file is missing or invalid). */
+static int loadCache(const char *filename, struct cache_entry *entries, int max_entries)
+{
+	FILE *fptr;
+	char *line;
+	int n = 0;
+
+	fptr = fopen(filename, "r");
+	if (!fptr)
+		return 0;
+
+	line = malloc(MAX_LINE);
+	if (!line) {
+		fclose(fptr);
+		return 0;
+	}
+
+	if (!fgets(line, MAX_LINE, fptr))
+		goto done;
+	stripEol(line);
+	if (strcmp(line, CACHE_MAGIC))
+		goto done;
+
+	while (n < max_entries && fgets(line, MAX_LINE, fptr)) {
+		stripEol(line);
+		if (parseEntry(line, &entries[n])) {
+			// Ignore the rest of a damaged file
+			break;
+		}
+		n++;
+	}
+
+done:
+	free(line);
+	fclose(fptr);
+
+	return n;
+}
+
+static int saveCache(const char *filename, const struct cache_entry *entries, int n_entries)
+{
+	char tmpname[PATH_MAX + 8];
+	const struct rnt_dyn_features *f;
+	FILE *fptr;
+	int i;
+
+	// Write to a temporary file first, so an interrupted write does not leave a corrupted cache.
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+	fptr = fopen(tmpname, "w");
+	if (!fptr) {
+		return -1;
+	}
+
+	fprintf(fptr, CACHE_MAGIC "\n");
+	for (i=0; i<n_entries; i++) {
+		f = &entries[i].feats;
+		fprintf(fptr, "C\t%s\t%s\t%s\t", entries[i].serial, entries[i].usb_id, entries[i].fw_version);
+		writeHex(fptr, f->supported_requests, f->n_supported_requests);
+		fputc('\t', fptr);
+		writeHex(fptr, f->supported_modes, f->n_supported_modes);
+		fputc('\t', fptr);
+		writeHex(fptr, f->supported_cfg_params, f->n_supported_cfg_params);
+		fputc('\t', fptr);
+		writeHex(fptr, f->supported_mappings, f->n_supported_mappings);
+		fputc('\n', fptr);
+	}
+
+	if (fclose(fptr)) {
+		remove(tmpname);
+		return -1;
+	}
+
+#ifdef WINDOWS
+	remove(filename); // rename does not replace existing files on Windows
+#endif
+	if (rename(tmpname, filename)) {
+		remove(tmpname);
+		return -1;
+	}
+
+	return 0;
+}
+
+int capscache_lookup(const struct rnt_adap_info *info, const char *fw_version, struct rnt_dyn_features *feats)
+{
+	char filename[PATH_MAX];
+	struct cache_entry key, *entries;
+	int i, n, res = -1;
+
+	if (makeKey(info, fw_version, &key))
+		return -1;
+
+	if (rnt_getCacheFilename(CAPSCACHE_FILE_NAME, filename, sizeof(filename)))
+		return -1;
+
+	entries = malloc(sizeof(struct cache_entry) * CAPSCACHE_MAX_ENTRIES);
+	if (!entries)
+		return -1;
+
+	n = loadCache(filename, entries, CAPSCACHE_MAX_ENTRIES);
+	for (i=0; i<n; i++) {
+		if (sameKey(&entries[i], &key)) {
+			memcpy(feats, &entries[i].feats, sizeof(struct rnt_dyn_features));
+			res = 0;
+			break;
+		}
+	}
+
+	free(entries);
+
+	return res;
+}
+
+int capscache_store(const struct rnt_adap_info *info, const char *fw_version, const struct rnt_dyn_features *feats)
+{
+	char filename[PATH_MAX];
+	struct cache_entry *entries;
+	int i, n, res;
+
+	if (rnt_getCacheFilename(CAPSCACHE_FILE_NAME, filename, sizeof(filename)))
+		return -1;
+
+	entries = malloc(sizeof(struct cache_entry) * (CAPSCACHE_MAX_ENTRIES + 1));
+	if (!entries)
+		return -1;
+
+	// The new entry goes first. The oldest ones fall off the end.
+	if (makeKey(info, fw_version, &entries[0])) {
+		free(entries);
+		return -1;
+	}
+	memcpy(&entries[0].feats, feats, sizeof(struct rnt_dyn_features));
+
+	n = loadCache(filename, entries + 1, CAPSCACHE_MAX_ENTRIES);
+	for (i=1; i<=n; ) {
+		// Also drops the entries for other firmware versions of the same adapter
+		if (!strcmp(entries[i].serial, entries[0].serial) && !strcmp(entries[i].usb_id, entries[0].usb_id)) {
+			memmove(&entries[i], &entries[i+1], sizeof(struct cache_entry) * (n - i));
+			n--;
+			continue;
+		}
+		i++;
+	}
+	n++;
+	if (n > CAPSCACHE_MAX_ENTRIES) {
+		n = CAPSCACHE_MAX_ENTRIES;
+	}
+
+	res = saveCache(filename, entries, n);
+	free(entries);
+
+	return res;
+}
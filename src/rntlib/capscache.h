@@ -0,0 +1,28 @@
+#ifndef _capscache_h__
+#define _capscache_h__
+
+#include "raphnetadapter.h"
+
+#define CAPSCACHE_FILE_NAME		"capscache"
+#define CAPSCACHE_MAX_ENTRIES	64
+
+/**
+ * \brief Adapter capability cache
+ *
+ * The supported requests, modes, configuration parameters and mappings
+ * of adapters are stored in the user cache directory. Entries are keyed
+ * by serial number, USB VID/PID, USB device version and firmware version,
+ * so updating the firmware invalidates them.
+ */
+
+/** \brief Get the cached features of an adapter
+ * \param info The adapter, as listed
+ * \param fw_version The version string returned by the adapter
+ * \return 0 if found, -1 otherwise
+ */
+int capscache_lookup(const struct rnt_adap_info *info, const char *fw_version, struct rnt_dyn_features *feats);
+
+/** \brief Add or replace the entry for an adapter. The least recently stored entries are dropped when full. */
+int capscache_store(const struct rnt_adap_info *info, const char *fw_version, const struct rnt_dyn_features *feats);
+
+#endif // _capscache_h__
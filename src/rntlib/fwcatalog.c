@@ -0,0 +1,919 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE // for memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+#include "fwcatalog.h"
+#include "ihex.h"
+#include "ihex_signature.h"
+#include "userdirs.h"
+
+#ifdef WINDOWS
+#include "memmem.h"
+#define PATH_SEP	"\\"
+#else
+#define PATH_SEP	"/"
+#endif
+
+#define INDEX_MAGIC			"fwcatalog 1"
+#define LIST_FILE			"firmwares.list"
+#define IMAGE_SIZE			0x20000
+#define MAX_LINE			8192
+#define MAX_FIELDS			12
+
+/* The index as loaded from disk, before validation */
+struct index_data {
+	int64_t base_mtime;
+	int n_dirs;
+	struct fwcatalog_dir *dirs;
+	int n_entries;
+	struct fwcatalog_entry **entries;
+};
+
+static unsigned int hashString(const char *s)
+{
+	unsigned int h = 2166136261u;
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+
+	return h % FWCATALOG_HASH_BUCKETS;
+}
+
+static char *canonicalPath(const char *path)
+{
+#ifdef WINDOWS
+	return _fullpath(NULL, path, 0);
+#else
+	return realpath(path, NULL);
+#endif
+}
+
+static int statFile(const char *path, int64_t *mtime, int64_t *size)
+{
+	struct stat st;
+
+	if (stat(path, &st)) {
+		return -1;
+	}
+	if (mtime)
+		*mtime = st.st_mtime;
+	if (size)
+		*size = st.st_size;
+
+	return 0;
+}
+
+static int isHexFile(const char *name)
+{
+	int len = strlen(name);
+
+	return len > 4 && !strcasecmp(name + len - 4, ".hex");
+}
+
+static const char *baseName(const char *path)
+{
+	const char *p = strrchr(path, PATH_SEP[0]);
+
+	return p ? p + 1 : path;
+}
+
+static void freeEntry(struct fwcatalog_entry *e)
+{
+	if (e) {
+		free(e->path);
+		free(e->notes);
+		free(e);
+	}
+}
+
+static struct fwcatalog_entry *newEntry(const char *path)
+{
+	struct fwcatalog_entry *e;
+
+	e = calloc(1, sizeof(struct fwcatalog_entry));
+	if (!e)
+		return NULL;
+
+	e->path = strdup(path);
+	if (!e->path) {
+		free(e);
+		return NULL;
+	}
+	e->filename = baseName(e->path);
+
+	return e;
+}
+
+static int appendEntry(struct fwcatalog_entry ***entries, int *n, struct fwcatalog_entry *e)
+{
+	struct fwcatalog_entry **tmp;
+
+	tmp = realloc(*entries, sizeof(struct fwcatalog_entry *) * (*n + 1));
+	if (!tmp)
+		return -1;
+
+	tmp[*n] = e;
+	(*n)++;
+	*entries = tmp;
+
+	return 0;
+}
+
+static int appendDir(struct fwcatalog_dir **dirs, int *n, const struct fwcatalog_dir *d)
+{
+	struct fwcatalog_dir *tmp;
+
+	tmp = realloc(*dirs, sizeof(struct fwcatalog_dir) * (*n + 1));
+	if (!tmp)
+		return -1;
+
+	tmp[*n] = *d;
+	(*n)++;
+	*dirs = tmp;
+
+	return 0;
+}
+
+/** \brief Parse a hex file and fill the content related fields */
+static int parseFirmware(struct fwcatalog_entry *e)
+{
+	unsigned char *image;
+	struct ihex_info info;
+	int i, max_address;
+
+	image = malloc(IMAGE_SIZE);
+	if (!image) {
+		perror("malloc");
+		return -1;
+	}
+	memset(image, 0xff, IMAGE_SIZE);
+
+	max_address = load_ihex_ex(e->path, image, IMAGE_SIZE, &info);
+	if (max_address < 0) {
+		free(image);
+		return -1;
+	}
+
+	e->data_bytes = info.data_bytes;
+	e->n_ranges = info.n_ranges;
+	memcpy(e->ranges, info.ranges, sizeof(e->ranges));
+
+	e->crc = crc32(0, NULL, 0);
+	for (i=0; i<info.n_ranges; i++) {
+		e->crc = crc32(e->crc, image + info.ranges[i].start, info.ranges[i].end - info.ranges[i].start);
+	}
+
+	e->signature_ok = e->signature[0] &&
+		memmem(image, max_address + 1, e->signature, strlen(e->signature)) != NULL;
+
+	free(image);
+
+	return 0;
+}
+
+/* Undo GKeyFile style escapes (\n, \t, \r, \s and \\) */
+static void unescape(char *s)
+{
+	char *d = s;
+
+	for (; *s; s++) {
+		if (*s == '\\' && s[1]) {
+			s++;
+			switch (*s) {
+				case 'n': *d++ = '\n'; break;
+				case 't': *d++ = '\t'; break;
+				case 'r': *d++ = '\r'; break;
+				case 's': *d++ = ' '; break;
+				default: *d++ = *s; break;
+			}
+		} else {
+			*d++ = *s;
+		}
+	}
+	*d = 0;
+}
+
+static void stripEol(char *s)
+{
+	int len = strlen(s);
+
+	while (len && (s[len-1] == '\n' || s[len-1] == '\r'))
+		s[--len] = 0;
+}
+
+/** \brief Apply the information from firmwares.list to the entries of a directory */
+static void loadListFile(const char *dirpath, struct fwcatalog_entry **entries, int n_entries)
+{
+	char listfile[PATH_MAX];
+	char line[MAX_LINE];
+	char section[256] = "";
+	FILE *fptr;
+	int i;
+
+	snprintf(listfile, sizeof(listfile), "%s" PATH_SEP LIST_FILE, dirpath);
+
+	// Start from scratch (the file may have changed)
+	for (i=0; i<n_entries; i++) {
+		entries[i]->version[0] = 0;
+		entries[i]->date[0] = 0;
+		free(entries[i]->notes);
+		entries[i]->notes = NULL;
+	}
+
+	fptr = fopen(listfile, "r");
+	if (!fptr)
+		return;
+
+	while (fgets(line, sizeof(line), fptr)) {
+		char *value;
+
+		stripEol(line);
+
+		if (line[0] == '[') {
+			char *end = strchr(line, ']');
+			if (end) {
+				*end = 0;
+				snprintf(section, sizeof(section), "%.255s", line + 1);
+			}
+			continue;
+		}
+
+		value = strchr(line, '=');
+		if (!value || !section[0])
+			continue;
+		*value = 0;
+		value++;
+		unescape(value);
+
+		// Sections are the lowercase file names
+		for (i=0; i<n_entries; i++) {
+			if (strcasecmp(entries[i]->filename, section))
+				continue;
+
+			if (!strcmp(line, "version")) {
+				snprintf(entries[i]->version, sizeof(entries[i]->version), "%s", value);
+			} else if (!strcmp(line, "date")) {
+				snprintf(entries[i]->date, sizeof(entries[i]->date), "%s", value);
+			} else if (!strcmp(line, "notes")) {
+				free(entries[i]->notes);
+				entries[i]->notes = strdup(value);
+			}
+		}
+	}
+
+	fclose(fptr);
+}
+
+/*** Index file ***/
+
+static void writeEscaped(FILE *fptr, const char *s)
+{
+	for (; s && *s; s++) {
+		switch (*s) {
+			case '\\': fputs("\\\\", fptr); break;
+			case '\n': fputs("\\n", fptr); break;
+			case '\t': fputs("\\t", fptr); break;
+			case '\r': fputs("\\r", fptr); break;
+			default: fputc(*s, fptr); break;
+		}
+	}
+}
+
+/* Split a line on tabs. Empty fields are kept. */
+static int splitFields(char *line, char **fields, int max_fields)
+{
+	int n = 0;
+
+	while (n < max_fields) {
+		fields[n++] = line;
+		line = strchr(line, '\t');
+		if (!line)
+			break;
+		*line = 0;
+		line++;
+	}
+
+	return n;
+}
+
+static int parseRanges(const char *s, struct fwcatalog_entry *e)
+{
+	unsigned int start, end;
+	int consumed;
+
+	e->n_ranges = 0;
+	while (*s && e->n_ranges < IHEX_MAX_RANGES) {
+		if (2 != sscanf(s, "%x-%x%n", &start, &end, &consumed))
+			return -1;
+		e->ranges[e->n_ranges].start = start;
+		e->ranges[e->n_ranges].end = end;
+		e->n_ranges++;
+		s += consumed;
+		if (*s == ',')
+			s++;
+	}
+
+	return 0;
+}
+
+static void freeIndex(struct index_data *idx)
+{
+	int i;
+
+	for (i=0; i<idx->n_dirs; i++) {
+		free(idx->dirs[i].path);
+	}
+	free(idx->dirs);
+	for (i=0; i<idx->n_entries; i++) {
+		freeEntry(idx->entries[i]);
+	}
+	free(idx->entries);
+	memset(idx, 0, sizeof(struct index_data));
+}
+
+static int loadIndex(const char *index_file, const char *basedir, struct index_data *idx)
+{
+	FILE *fptr;
+	char *line;
+	char *fields[MAX_FIELDS];
+	int n, ok = 0;
+
+	memset(idx, 0, sizeof(struct index_data));
+
+	fptr = fopen(index_file, "r");
+	if (!fptr)
+		return -1;
+
+	line = malloc(MAX_LINE);
+	if (!line) {
+		fclose(fptr);
+		return -1;
+	}
+
+	if (!fgets(line, MAX_LINE, fptr))
+		goto done;
+	stripEol(line);
+	if (strcmp(line, INDEX_MAGIC))
+		goto done;
+
+	while (fgets(line, MAX_LINE, fptr)) {
+		stripEol(line);
+		n = splitFields(line, fields, MAX_FIELDS);
+
+		if (!strcmp(fields[0], "B") && n == 3) {
+			// The index is for another firmwares directory
+			if (strcmp(fields[1], basedir))
+				goto done;
+			idx->base_mtime = strtoll(fields[2], NULL, 0);
+			ok = 1;
+		}
+		else if (!strcmp(fields[0], "D") && n == 6) {
+			struct fwcatalog_dir d = { };
+
+			d.path = strdup(fields[1]);
+			snprintf(d.signature, sizeof(d.signature), "%s", fields[2]);
+			d.mtime = strtoll(fields[3], NULL, 0);
+			d.list_mtime = strtoll(fields[4], NULL, 0);
+			d.list_size = strtoll(fields[5], NULL, 0);
+			if (!d.path || appendDir(&idx->dirs, &idx->n_dirs, &d)) {
+				free(d.path);
+				ok = 0;
+				goto done;
+			}
+		}
+		else if (!strcmp(fields[0], "F") && n == 12) {
+			struct fwcatalog_entry *e;
+
+			e = newEntry(fields[1]);
+			if (!e) {
+				ok = 0;
+				goto done;
+			}
+			e->mtime = strtoll(fields[2], NULL, 0);
+			e->size = strtoll(fields[3], NULL, 0);
+			snprintf(e->signature, sizeof(e->signature), "%s", fields[4]);
+			e->signature_ok = atoi(fields[5]);
+			e->crc = strtoul(fields[6], NULL, 16);
+			e->data_bytes = atoi(fields[7]);
+			snprintf(e->version, sizeof(e->version), "%s", fields[8]);
+			snprintf(e->date, sizeof(e->date), "%s", fields[9]);
+			if (parseRanges(fields[10], e)) {
+				freeEntry(e);
+				ok = 0;
+				goto done;
+			}
+			unescape(fields[11]);
+			if (fields[11][0]) {
+				e->notes = strdup(fields[11]);
+			}
+
+			if (appendEntry(&idx->entries, &idx->n_entries, e)) {
+				freeEntry(e);
+				ok = 0;
+				goto done;
+			}
+		}
+		else {
+			ok = 0;
+			goto done;
+		}
+	}
+
+done:
+	free(line);
+	fclose(fptr);
+
+	if (!ok) {
+		freeIndex(idx);
+		return -1;
+	}
+
+	return 0;
+}
+
+int fwcatalog_save(struct fwcatalog *cat, const char *index_file)
+{
+	char default_index[PATH_MAX];
+	char tmpname[PATH_MAX + 8];
+	int64_t base_mtime = 0;
+	FILE *fptr;
+	int i, j;
+
+	if (!index_file) {
+		if (rnt_getCacheFilename(FWCATALOG_INDEX_NAME, default_index, sizeof(default_index))) {
+			return -1;
+		}
+		index_file = default_index;
+	}
+
+	statFile(cat->basedir, &base_mtime, NULL);
+
+	// Write to a temporary file first, so an interrupted write does not leave a corrupted index.
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", index_file);
+	fptr = fopen(tmpname, "w");
+	if (!fptr) {
+		return -1;
+	}
+
+	fprintf(fptr, INDEX_MAGIC "\n");
+	fprintf(fptr, "B\t%s\t%lld\n", cat->basedir, (long long)base_mtime);
+
+	for (i=0; i<cat->n_dirs; i++) {
+		struct fwcatalog_dir *d = &cat->dirs[i];
+		fprintf(fptr, "D\t%s\t%s\t%lld\t%lld\t%lld\n", d->path, d->signature,
+				(long long)d->mtime, (long long)d->list_mtime, (long long)d->list_size);
+	}
+
+	for (i=0; i<cat->n_entries; i++) {
+		struct fwcatalog_entry *e = cat->entries[i];
+
+		fprintf(fptr, "F\t%s\t%lld\t%lld\t%s\t%d\t%08x\t%d\t%s\t%s\t",
+				e->path, (long long)e->mtime, (long long)e->size,
+				e->signature, e->signature_ok, e->crc, e->data_bytes,
+				e->version, e->date);
+		for (j=0; j<e->n_ranges; j++) {
+			fprintf(fptr, "%s%x-%x", j ? ",":"", e->ranges[j].start, e->ranges[j].end);
+		}
+		fputc('\t', fptr);
+		writeEscaped(fptr, e->notes);
+		fputc('\n', fptr);
+	}
+
+	if (fclose(fptr)) {
+		remove(tmpname);
+		return -1;
+	}
+
+#ifdef WINDOWS
+	remove(index_file); // rename does not replace existing files on Windows
+#endif
+	if (rename(tmpname, index_file)) {
+		remove(tmpname);
+		return -1;
+	}
+
+	cat->dirty = 0;
+
+	return 0;
+}
+
+/*** Catalog ***/
+
+static struct fwcatalog_entry *takeIndexedEntry(struct index_data *idx, const char *path)
+{
+	struct fwcatalog_entry *e;
+	int i;
+
+	for (i=0; i<idx->n_entries; i++) {
+		e = idx->entries[i];
+		if (e && !strcmp(e->path, path)) {
+			idx->entries[i] = NULL;
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+static struct fwcatalog_dir *findIndexedDir(struct index_data *idx, const char *path)
+{
+	int i;
+
+	for (i=0; i<idx->n_dirs; i++) {
+		if (!strcmp(idx->dirs[i].path, path))
+			return &idx->dirs[i];
+	}
+
+	return NULL;
+}
+
+/** \brief Add a file to the catalog, reusing the indexed entry when it is still valid */
+static int addFile(struct fwcatalog *cat, struct index_data *idx, const char *path, const char *signature)
+{
+	struct fwcatalog_entry *e;
+	int64_t mtime, size;
+
+	if (statFile(path, &mtime, &size)) {
+		return 0; // Deleted since listed/indexed
+	}
+
+	e = takeIndexedEntry(idx, path);
+	if (e && e->mtime == mtime && e->size == size && !strcmp(e->signature, signature)) {
+		cat->reused++;
+	} else {
+		freeEntry(e);
+		e = newEntry(path);
+		if (!e)
+			return -1;
+
+		e->mtime = mtime;
+		e->size = size;
+		snprintf(e->signature, sizeof(e->signature), "%s", signature);
+		if (parseFirmware(e)) {
+			// Keep invalid files out of the catalog
+			freeEntry(e);
+			return 0;
+		}
+		cat->parsed++;
+		cat->dirty = 1;
+	}
+
+	if (appendEntry(&cat->entries, &cat->n_entries, e)) {
+		freeEntry(e);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int addDirectory(struct fwcatalog *cat, struct index_data *idx, const char *path, const char *signature)
+{
+	struct fwcatalog_dir d = { }, *old;
+	char listfile[PATH_MAX];
+	int first_entry = cat->n_entries, parsed = cat->parsed, relisted = 0, i, list_changed;
+
+	if (statFile(path, &d.mtime, NULL)) {
+		return 0;
+	}
+	snprintf(d.signature, sizeof(d.signature), "%s", signature);
+	snprintf(listfile, sizeof(listfile), "%s" PATH_SEP LIST_FILE, path);
+	if (statFile(listfile, &d.list_mtime, &d.list_size)) {
+		d.list_mtime = d.list_size = -1;
+	}
+
+	old = findIndexedDir(idx, path);
+	if (old && old->mtime == d.mtime) {
+		// No files added or removed. Only check the indexed files.
+		for (i=0; i<idx->n_entries; i++) {
+			struct fwcatalog_entry *e = idx->entries[i];
+			char filepath[PATH_MAX];
+
+			if (!e || strlen(e->path) <= strlen(path) || strncmp(e->path, path, strlen(path)) ||
+					strchr(e->path + strlen(path) + 1, PATH_SEP[0]))
+				continue;
+
+			snprintf(filepath, sizeof(filepath), "%s", e->path);
+			if (addFile(cat, idx, filepath, signature))
+				return -1;
+		}
+	} else {
+		DIR *dir;
+		struct dirent *de;
+
+		dir = opendir(path);
+		if (!dir)
+			return 0;
+
+		while ((de = readdir(dir))) {
+			char filepath[PATH_MAX];
+
+			if (!isHexFile(de->d_name))
+				continue;
+
+			snprintf(filepath, sizeof(filepath), "%s" PATH_SEP "%s", path, de->d_name);
+			if (addFile(cat, idx, filepath, signature)) {
+				closedir(dir);
+				return -1;
+			}
+		}
+		closedir(dir);
+		relisted = 1;
+		cat->dirty = 1;
+	}
+
+	// Release notes: Only re-read when firmwares.list changed or for new entries
+	list_changed = !old || old->list_mtime != d.list_mtime || old->list_size != d.list_size;
+	if (list_changed || relisted || cat->parsed != parsed) {
+		loadListFile(path, cat->entries + first_entry, cat->n_entries - first_entry);
+		cat->dirty = 1;
+	}
+
+	d.path = strdup(path);
+	if (!d.path || appendDir(&cat->dirs, &cat->n_dirs, &d)) {
+		free(d.path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int compareEntries(const void *a, const void *b)
+{
+	const struct fwcatalog_entry *ea = *(const struct fwcatalog_entry **)a;
+	const struct fwcatalog_entry *eb = *(const struct fwcatalog_entry **)b;
+
+	return strcmp(ea->path, eb->path);
+}
+
+static void buildHashTables(struct fwcatalog *cat)
+{
+	struct fwcatalog_entry **tail_sig[FWCATALOG_HASH_BUCKETS];
+	int i;
+
+	memset(cat->by_sig, 0, sizeof(cat->by_sig));
+	memset(cat->by_path, 0, sizeof(cat->by_path));
+	for (i=0; i<FWCATALOG_HASH_BUCKETS; i++) {
+		tail_sig[i] = &cat->by_sig[i];
+	}
+
+	// Keep catalog order within a signature (appending)
+	for (i=0; i<cat->n_entries; i++) {
+		struct fwcatalog_entry *e = cat->entries[i];
+		unsigned int h;
+
+		h = hashString(e->signature);
+		e->next_same_sig = NULL;
+		*tail_sig[h] = e;
+		tail_sig[h] = &e->next_same_sig;
+
+		h = hashString(e->path);
+		e->next_same_path = cat->by_path[h];
+		cat->by_path[h] = e;
+	}
+}
+
+const char *fwcatalog_findFirmwareDir(void)
+{
+	const char *locations[] = {
+		"firmwares", // For windows installations
+		"../firmwares", // For linux compiled and run-in-place build
+		NULL
+	};
+	struct stat st;
+	int i;
+
+	for (i=0; locations[i]; i++) {
+		if (0 == stat(locations[i], &st) && S_ISDIR(st.st_mode)) {
+			return locations[i];
+		}
+	}
+
+	return NULL;
+}
+
+struct fwcatalog *fwcatalog_open(const char *basedir, const char *index_file)
+{
+	struct fwcatalog *cat;
+	struct index_data idx;
+	char default_index[PATH_MAX];
+	int64_t base_mtime;
+	int i, have_index;
+
+	if (!basedir) {
+		basedir = fwcatalog_findFirmwareDir();
+		if (!basedir)
+			return NULL;
+	}
+
+	if (!index_file) {
+		if (0 == rnt_getCacheFilename(FWCATALOG_INDEX_NAME, default_index, sizeof(default_index))) {
+			index_file = default_index;
+		}
+	}
+
+	cat = calloc(1, sizeof(struct fwcatalog));
+	if (!cat)
+		return NULL;
+
+	cat->basedir = canonicalPath(basedir);
+	if (!cat->basedir || statFile(cat->basedir, &base_mtime, NULL)) {
+		fwcatalog_free(cat);
+		return NULL;
+	}
+
+	have_index = index_file && 0 == loadIndex(index_file, cat->basedir, &idx);
+	if (!have_index) {
+		memset(&idx, 0, sizeof(idx));
+	}
+
+	if (have_index && idx.base_mtime == base_mtime) {
+		// No signature directories added or removed
+		for (i=0; i<idx.n_dirs; i++) {
+			char *path = strdup(idx.dirs[i].path);
+			char sig[FWCATALOG_SIGNATURE_MAXLEN];
+
+			snprintf(sig, sizeof(sig), "%s", idx.dirs[i].signature);
+			if (!path || addDirectory(cat, &idx, path, sig)) {
+				free(path);
+				goto err;
+			}
+			free(path);
+		}
+	} else {
+		DIR *dir;
+		struct dirent *de;
+
+		dir = opendir(cat->basedir);
+		if (!dir)
+			goto err;
+
+		while ((de = readdir(dir))) {
+			char path[PATH_MAX];
+			struct stat st;
+
+			if (de->d_name[0] == '.' || strlen(de->d_name) >= FWCATALOG_SIGNATURE_MAXLEN)
+				continue;
+
+			snprintf(path, sizeof(path), "%s" PATH_SEP "%s", cat->basedir, de->d_name);
+			if (stat(path, &st) || !S_ISDIR(st.st_mode))
+				continue;
+
+			if (addDirectory(cat, &idx, path, de->d_name)) {
+				closedir(dir);
+				goto err;
+			}
+		}
+		closedir(dir);
+		cat->dirty = 1;
+	}
+
+	// Indexed files which were not seen anymore mean a change too
+	for (i=0; i<idx.n_entries; i++) {
+		if (idx.entries[i]) {
+			cat->dirty = 1;
+		}
+	}
+	freeIndex(&idx);
+
+	qsort(cat->entries, cat->n_entries, sizeof(struct fwcatalog_entry *), compareEntries);
+	buildHashTables(cat);
+
+	if (cat->dirty && index_file) {
+		if (fwcatalog_save(cat, index_file)) {
+			fprintf(stderr, "Warning: Could not save firmware index %s\n", index_file);
+		}
+	}
+
+	return cat;
+
+err:
+	freeIndex(&idx);
+	fwcatalog_free(cat);
+	return NULL;
+}
+
+void fwcatalog_free(struct fwcatalog *cat)
+{
+	int i;
+
+	if (!cat)
+		return;
+
+	for (i=0; i<cat->n_dirs; i++) {
+		free(cat->dirs[i].path);
+	}
+	free(cat->dirs);
+	for (i=0; i<cat->n_entries; i++) {
+		freeEntry(cat->entries[i]);
+	}
+	free(cat->entries);
+	free(cat->basedir);
+	free(cat);
+}
+
+const struct fwcatalog_entry *fwcatalog_findBySignature(const struct fwcatalog *cat, const char *signature)
+{
+	const struct fwcatalog_entry *e;
+
+	if (!cat || !signature)
+		return NULL;
+
+	for (e = cat->by_sig[hashString(signature)]; e; e = e->next_same_sig) {
+		if (!strcmp(e->signature, signature))
+			return e;
+	}
+
+	return NULL;
+}
+
+const struct fwcatalog_entry *fwcatalog_findByPath(const struct fwcatalog *cat, const char *path)
+{
+	const struct fwcatalog_entry *e;
+	char *canonical;
+	int64_t mtime, size;
+
+	if (!cat || !path)
+		return NULL;
+
+	canonical = canonicalPath(path);
+	if (!canonical)
+		return NULL;
+
+	for (e = cat->by_path[hashString(canonical)]; e; e = e->next_same_path) {
+		if (!strcmp(e->path, canonical))
+			break;
+	}
+	free(canonical);
+
+	// Modified since it was indexed?
+	if (e && (statFile(e->path, &mtime, &size) || mtime != e->mtime || size != e->size)) {
+		return NULL;
+	}
+
+	return e;
+}
+
+int fwcatalog_checkSignature(const struct fwcatalog *cat, const char *path, const char *signature)
+{
+	const struct fwcatalog_entry *e;
+
+	if (!signature)
+		return 0;
+
+	e = fwcatalog_findByPath(cat, path);
+	if (e && !strcmp(e->signature, signature)) {
+		return e->signature_ok;
+	}
+
+	return check_ihex_for_signature(path, signature);
+}
+
+void fwcatalog_print(const struct fwcatalog *cat, const char *signature)
+{
+	int i, j;
+
+	printf("Firmware directory: %s\n", cat->basedir);
+	printf("%d firmware(s), %d parsed, %d from index\n", cat->n_entries, cat->parsed, cat->reused);
+
+	for (i=0; i<cat->n_entries; i++) {
+		const struct fwcatalog_entry *e = cat->entries[i];
+
+		if (signature && strcmp(signature, e->signature))
+			continue;
+
+		printf("%s/%s: version %s (%s), %d bytes, crc32 %08x%s, ranges:",
+				e->signature, e->filename,
+				e->version[0] ? e->version : "?",
+				e->date[0] ? e->date : "?",
+				e->data_bytes, e->crc,
+				e->signature_ok ? "" : ", SIGNATURE NOT FOUND");
+		for (j=0; j<e->n_ranges; j++) {
+			printf(" 0x%04x-0x%04x", e->ranges[j].start, e->ranges[j].end - 1);
+		}
+		printf("\n");
+	}
+}
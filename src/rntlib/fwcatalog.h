@@ -0,0 +1,100 @@
+#ifndef _fwcatalog_h__
+#define _fwcatalog_h__
+
+#include <stdint.h>
+#include <time.h>
+#include "ihex.h"
+
+#define FWCATALOG_INDEX_NAME		"fwcatalog.idx"
+#define FWCATALOG_SIGNATURE_MAXLEN	64
+#define FWCATALOG_MAX_FIELD			32
+#define FWCATALOG_HASH_BUCKETS		64
+
+/**
+ * \brief One firmware file of the firmwares/ tree
+ *
+ * Files are stored in a directory named after the signature of the
+ * adapters they are for. The version, date and notes come from the
+ * firmwares.list file in the same directory.
+ */
+struct fwcatalog_entry {
+	char *path;
+	const char *filename; // Points inside path
+
+	/* Used to know if the cached information is still valid */
+	int64_t mtime;
+	int64_t size;
+
+	char signature[FWCATALOG_SIGNATURE_MAXLEN]; // From the directory name
+	int signature_ok; // Signature found in the image
+	uint32_t crc; // CRC32 of the populated bytes, in address order
+	int data_bytes;
+	int n_ranges;
+	struct ihex_range ranges[IHEX_MAX_RANGES];
+
+	char version[FWCATALOG_MAX_FIELD];
+	char date[FWCATALOG_MAX_FIELD];
+	char *notes;
+
+	/* Next entry for the same signature / in the same path hash bucket */
+	struct fwcatalog_entry *next_same_sig;
+	struct fwcatalog_entry *next_same_path;
+};
+
+struct fwcatalog_dir {
+	char *path;
+	char signature[FWCATALOG_SIGNATURE_MAXLEN];
+	int64_t mtime;
+	int64_t list_mtime, list_size; // firmwares.list (-1 if absent)
+};
+
+struct fwcatalog {
+	char *basedir;
+	int n_dirs;
+	struct fwcatalog_dir *dirs;
+	int n_entries;
+	struct fwcatalog_entry **entries;
+
+	struct fwcatalog_entry *by_sig[FWCATALOG_HASH_BUCKETS];
+	struct fwcatalog_entry *by_path[FWCATALOG_HASH_BUCKETS];
+
+	/* Statistics from the last fwcatalog_open() */
+	int parsed; // Hex files parsed because the index was missing or outdated
+	int reused; // Entries taken from the index
+	int dirty; // Index must be saved
+};
+
+/** \brief Return the firmwares directory, if found ("firmwares" or "../firmwares"). */
+const char *fwcatalog_findFirmwareDir(void);
+
+/** \brief Load the catalog for a firmwares directory
+ *
+ * The index file is used for entries whose file size and modification time
+ * did not change. Only new or modified files are parsed, and directories are
+ * only listed when their modification time changed. The index is rewritten
+ * if anything changed.
+ *
+ * \param basedir The firmwares directory. NULL to use fwcatalog_findFirmwareDir().
+ * \param index_file The index. NULL for the default location in the user cache directory.
+ * \return The catalog, or NULL if basedir does not exist.
+ */
+struct fwcatalog *fwcatalog_open(const char *basedir, const char *index_file);
+void fwcatalog_free(struct fwcatalog *cat);
+int fwcatalog_save(struct fwcatalog *cat, const char *index_file);
+
+/** \brief Get the firmwares for an adapter signature. Follow next_same_sig for the others. */
+const struct fwcatalog_entry *fwcatalog_findBySignature(const struct fwcatalog *cat, const char *signature);
+
+/** \brief Get a catalog entry by path, if the file did not change since it was indexed. */
+const struct fwcatalog_entry *fwcatalog_findByPath(const struct fwcatalog *cat, const char *path);
+
+/** \brief Check if a hex file contains a signature, using the catalog when possible
+ *
+ * Falls back to check_ihex_for_signature() for files not in the catalog.
+ * cat may be NULL.
+ */
+int fwcatalog_checkSignature(const struct fwcatalog *cat, const char *path, const char *signature);
+
+void fwcatalog_print(const struct fwcatalog *cat, const char *signature);
+
+#endif // _fwcatalog_h__
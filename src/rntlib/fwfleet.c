@@ -0,0 +1,795 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#define _GNU_SOURCE // for memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <zlib.h>
+#include "fwfleet.h"
+#include "ihex.h"
+#include "delay.h"
+#include "timer.h"
+
+#ifdef WINDOWS
+#include "memmem.h"
+#endif
+
+#define PROGRESS_INTERVAL_US	1000000
+#define BOOT_TIMEOUT_MS			3000
+#define BOOT_POLL_INTERVAL_US	100000
+
+const char *fwfleet_stateName(int state)
+{
+	switch (state)
+	{
+		case FWFLEET_QUEUED: return "queued";
+		case FWFLEET_ENTER_BOOTLOADER: return "enter bootloader";
+		case FWFLEET_ERASE: return "erase";
+		case FWFLEET_PROGRAM: return "program";
+		case FWFLEET_VERIFY: return "verify";
+		case FWFLEET_READ: return "read";
+		case FWFLEET_BOOT: return "boot";
+		case FWFLEET_DONE: return "done";
+		case FWFLEET_FAILED: return "failed";
+	}
+	return "?";
+}
+
+static int loadImage(struct fwfleet *fl, const char *hexfile)
+{
+	int max_addr;
+
+	fl->image = malloc(X2GCN64_MAX_FIRMWARE_SIZE);
+	if (!fl->image) {
+		perror("malloc");
+		return -1;
+	}
+	memset(fl->image, 0xff, X2GCN64_MAX_FIRMWARE_SIZE);
+
+	max_addr = load_ihex(hexfile, fl->image, X2GCN64_MAX_FIRMWARE_SIZE);
+	if (max_addr < 0) {
+		fprintf(stderr, "Could not load hex file\n");
+		free(fl->image);
+		fl->image = NULL;
+		return -1;
+	}
+	fl->image_size = max_addr + 1;
+
+	return 0;
+}
+
+int fwfleet_init(struct fwfleet *fl, const char *hexfile)
+{
+	memset(fl, 0, sizeof(struct fwfleet));
+
+	if (loadImage(fl, hexfile))
+		return -1;
+
+	pthread_mutex_init(&fl->lock, NULL);
+
+	return 0;
+}
+
+int fwfleet_initAudit(struct fwfleet *fl, const char *expected_hexfile)
+{
+	memset(fl, 0, sizeof(struct fwfleet));
+	fl->audit = 1;
+
+	if (expected_hexfile && loadImage(fl, expected_hexfile))
+		return -1;
+
+	// Optional: Without it, the firmwares are only identified by CRC
+	fl->catalog = fwcatalog_open(NULL, NULL);
+
+	pthread_mutex_init(&fl->lock, NULL);
+
+	return 0;
+}
+
+void fwfleet_free(struct fwfleet *fl)
+{
+	int i;
+
+	for (i=0; i<fl->n_hdls; i++) {
+		rnt_closeDevice(fl->hdls[i]);
+	}
+	free(fl->hdls);
+	free(fl->devices);
+	free(fl->image);
+	if (fl->catalog) {
+		fwcatalog_free(fl->catalog);
+	}
+	pthread_mutex_destroy(&fl->lock);
+	memset(fl, 0, sizeof(struct fwfleet));
+}
+
+static int imageHasSignature(struct fwfleet *fl, const char *signature)
+{
+	return memmem(fl->image, fl->image_size, signature, strlen(signature)) != NULL;
+}
+
+/* \return 1 if a device to update was added */
+static int probeChannel(struct fwfleet *fl, rnt_hdl_t hdl, const wchar_t *serial, int channel)
+{
+	struct x2gcn64_adapter_info inf;
+	struct fwfleet_device *dev, *devices;
+	const char *signature;
+	char name[48];
+
+	// The echo test is silent when nothing answers
+	if (x2gcn64_adapter_echotest(hdl, channel, 0))
+		return 0;
+	if (x2gcn64_adapter_getInfo(hdl, channel, &inf))
+		return 0;
+
+	snprintf(name, sizeof(name), "%.32ls:%d", serial, channel);
+
+	if (inf.in_bootloader) {
+		if (!fl->audit) {
+			printf("  %s: Adapter in bootloader (unknown type), skipped. Use --x2gcn64_update.\n", name);
+			return 0;
+		}
+		inf.adapter_type = -1;
+		strcpy(inf.app.version, "-");
+	}
+	else if (!fl->audit) {
+		signature = x2gcn64_getAdapterSignature(inf.adapter_type);
+		if (!signature || !imageHasSignature(fl, signature)) {
+			printf("  %s: %s version %s, skipped (the firmware is for other adapters)\n",
+						name, x2gcn64_adapter_type_name(inf.adapter_type), inf.app.version);
+			return 0;
+		}
+	}
+
+	if (!inf.in_bootloader && !inf.app.upgradeable) {
+		printf("  %s: %s version %s, skipped (not upgradeable)\n",
+					name, x2gcn64_adapter_type_name(inf.adapter_type), inf.app.version);
+		return 0;
+	}
+
+	devices = realloc(fl->devices, (fl->n_devices + 1) * sizeof(struct fwfleet_device));
+	if (!devices) {
+		perror("realloc");
+		return 0;
+	}
+	fl->devices = devices;
+	dev = &fl->devices[fl->n_devices++];
+
+	memset(dev, 0, sizeof(struct fwfleet_device));
+	dev->hdl = hdl;
+	dev->channel = channel;
+	strcpy(dev->name, name);
+	dev->adapter_type = inf.adapter_type;
+	snprintf(dev->old_version, sizeof(dev->old_version), "%s", inf.app.version);
+	dev->started_in_bootloader = inf.in_bootloader;
+	dev->differ = -1;
+	dev->state = FWFLEET_QUEUED;
+
+	if (inf.in_bootloader) {
+		printf("  %s: Adapter in bootloader, will be read\n", name);
+	} else {
+		printf("  %s: %s version %s, will be %s\n", name, x2gcn64_adapter_type_name(inf.adapter_type),
+					inf.app.version, fl->audit ? "read" : "updated");
+	}
+
+	return 1;
+}
+
+int fwfleet_discover(struct fwfleet *fl)
+{
+	struct rnt_adap_list_ctx *listctx;
+	struct rnt_adap_info inf, caps_inf;
+	rnt_hdl_t hdl, *hdls;
+	char signature[64];
+	int chn, used;
+
+	printf("Looking for adapters...\n");
+
+	listctx = rnt_allocListCtx();
+	if (!listctx)
+		return -1;
+
+	while (rnt_listDevices(&inf, listctx))
+	{
+		hdl = rnt_openDevice(&inf);
+		if (!hdl) {
+			printf("%ls: Could not be opened, skipped\n", inf.str_serial);
+			continue;
+		}
+
+		printf("%ls (%ls)\n", inf.str_serial, inf.str_prodname);
+
+		if (!rnt_getSignature(hdl, signature, sizeof(signature)) && signature[0] && imageHasSignature(fl, signature)) {
+			printf("  This firmware is for the USB adapter itself. Use dfu-programmer (one adapter at a time).\n");
+		}
+
+		used = 0;
+		rnt_getInfo(hdl, &caps_inf);
+		for (chn=0; chn<caps_inf.caps.n_raw_channels; chn++) {
+			used |= probeChannel(fl, hdl, inf.str_serial, chn);
+		}
+
+		if (!used) {
+			rnt_closeDevice(hdl);
+			continue;
+		}
+
+		hdls = realloc(fl->hdls, (fl->n_hdls + 1) * sizeof(rnt_hdl_t));
+		if (!hdls) {
+			perror("realloc");
+			while (fl->n_devices && fl->devices[fl->n_devices-1].hdl == hdl) {
+				fl->n_devices--;
+			}
+			rnt_closeDevice(hdl);
+			break;
+		}
+		fl->hdls = hdls;
+		fl->hdls[fl->n_hdls++] = hdl;
+	}
+
+	rnt_freeListCtx(listctx);
+
+	return fl->n_devices;
+}
+
+static void setState(struct fwfleet *fl, struct fwfleet_device *dev, int state)
+{
+	pthread_mutex_lock(&fl->lock);
+	dev->state = state;
+	dev->blocks_done = 0;
+	dev->blocks_total = 0;
+	pthread_mutex_unlock(&fl->lock);
+}
+
+static void setProgress(struct fwfleet *fl, struct fwfleet_device *dev, int done, int total)
+{
+	pthread_mutex_lock(&fl->lock);
+	dev->blocks_done = done;
+	dev->blocks_total = total;
+	pthread_mutex_unlock(&fl->lock);
+}
+
+/* Record why the current step failed. \return FWFLEET_FAILED */
+static int fail(struct fwfleet *fl, struct fwfleet_device *dev, int fatal, const char *fmt, ...)
+{
+	va_list ap;
+
+	pthread_mutex_lock(&fl->lock);
+	va_start(ap, fmt);
+	vsnprintf(dev->error, sizeof(dev->error), fmt, ap);
+	va_end(ap);
+	dev->failed_state = dev->state;
+	dev->fatal = fatal;
+	pthread_mutex_unlock(&fl->lock);
+
+	return FWFLEET_FAILED;
+}
+
+/* inf receives the bootloader information */
+static int stepEnterBootloader(struct fwfleet *fl, struct fwfleet_device *dev, struct x2gcn64_adapter_info *inf, struct x2gcn64_program_plan *plan)
+{
+	if (x2gcn64_adapter_getInfo(dev->hdl, dev->channel, inf))
+		return fail(fl, dev, 0, "No answer");
+
+	// Already in the bootloader when retrying
+	if (!inf->in_bootloader) {
+		if (x2gcn64_adapter_enterBootloader(dev->hdl, dev->channel))
+			return fail(fl, dev, 0, "Bootloader did not start");
+		if (x2gcn64_adapter_getInfo(dev->hdl, dev->channel, inf) || !inf->in_bootloader)
+			return fail(fl, dev, 0, "Bootloader info not available");
+	}
+
+	if (fl->audit)
+		return FWFLEET_READ;
+
+	// Everything up to the bootloader is covered, see x2gcn64_adapter_updateFirmware()
+	if (fl->image_size > inf->bootldr.bootloader_start_address)
+		return fail(fl, dev, 1, "Firmware overlaps the bootloader");
+	if (x2gcn64_adapter_makeProgramPlan(fl->image, inf->bootldr.bootloader_start_address, inf->bootldr.mcu_page_size, plan))
+		return fail(fl, dev, 1, "Invalid bootloader start address");
+
+	return FWFLEET_ERASE;
+}
+
+static int stepErase(struct fwfleet *fl, struct fwfleet_device *dev)
+{
+	if (x2gcn64_adapter_boot_eraseAll(dev->hdl, dev->channel))
+		return fail(fl, dev, 0, "Erase request failed");
+	if (x2gcn64_adapter_waitNotBusy(dev->hdl, dev->channel, X2GCN64_OP_ERASE, 0))
+		return fail(fl, dev, 0, "Erase timeout");
+
+	return FWFLEET_PROGRAM;
+}
+
+/* A failed block exchange is repeated in place. The whole update is only
+ * started over when a block keeps failing or the bootloader stops answering. */
+#define BLOCK_ATTEMPTS	3
+
+static int writeBlock(struct fwfleet *fl, struct fwfleet_device *dev, int block)
+{
+	int attempt;
+
+	for (attempt = 0; attempt < BLOCK_ATTEMPTS; attempt++) {
+		if (attempt) {
+			// The block may have been received and its page be in progress
+			if (x2gcn64_adapter_waitNotBusy(dev->hdl, dev->channel, X2GCN64_OP_WRITE, 0))
+				return -1;
+		}
+		if (!x2gcn64_adapter_boot_writeBlock(dev->hdl, dev->channel, block, fl->image + block * X2GCN64_BLOCK_SIZE, 0))
+			return 0;
+	}
+
+	return -1;
+}
+
+static int readBlock(struct fwfleet_device *dev, int block, unsigned char buf[X2GCN64_BLOCK_SIZE])
+{
+	int attempt;
+
+	// Reading has no side effect, so failed reads are simply repeated
+	for (attempt = 0; attempt < BLOCK_ATTEMPTS; attempt++) {
+		if (!x2gcn64_adapter_boot_readBlock(dev->hdl, dev->channel, block, buf))
+			return 0;
+	}
+
+	return -1;
+}
+
+static int stepProgram(struct fwfleet *fl, struct fwfleet_device *dev, const struct x2gcn64_program_plan *plan)
+{
+	int i, done = 0;
+
+	for (i=0; i<plan->n_blocks; i++) {
+		if (!X2GCN64_PLAN_HAS_BLOCK(plan, i))
+			continue;
+
+		if (writeBlock(fl, dev, i))
+			return fail(fl, dev, 0, "Write failed at 0x%04x", i * X2GCN64_BLOCK_SIZE);
+
+		setProgress(fl, dev, ++done, plan->n_program);
+	}
+
+	return FWFLEET_VERIFY;
+}
+
+static int stepVerify(struct fwfleet *fl, struct fwfleet_device *dev, const struct x2gcn64_program_plan *plan)
+{
+	unsigned char buf[X2GCN64_BLOCK_SIZE];
+	int i, done = 0;
+
+	for (i=0; i<plan->n_blocks; i++) {
+		if (!X2GCN64_PLAN_HAS_BLOCK(plan, i))
+			continue;
+
+		if (readBlock(dev, i, buf))
+			return fail(fl, dev, 0, "Read failed at 0x%04x", i * X2GCN64_BLOCK_SIZE);
+		if (memcmp(buf, fl->image + i * X2GCN64_BLOCK_SIZE, X2GCN64_BLOCK_SIZE))
+			return fail(fl, dev, 0, "Mismatch at 0x%04x", i * X2GCN64_BLOCK_SIZE);
+
+		setProgress(fl, dev, ++done, plan->n_program);
+	}
+
+	return FWFLEET_BOOT;
+}
+
+/* Compare the flash with the part of a catalog firmware it covers (the
+ * bootloader is not read back) */
+static int flashMatchesEntry(const struct fwcatalog_entry *e, const struct x2gcn64_flash *flash, unsigned char *image)
+{
+	uLong crc;
+	int i, start, end;
+
+	for (i=0; i<e->n_ranges; i++) {
+		if (e->ranges[i].end > flash->size)
+			break;
+	}
+
+	// Entirely readable: the CRC from the catalog is enough
+	if (i == e->n_ranges) {
+		crc = crc32(0, NULL, 0);
+		for (i=0; i<e->n_ranges; i++) {
+			crc = crc32(crc, flash->data + e->ranges[i].start, e->ranges[i].end - e->ranges[i].start);
+		}
+		return crc == e->crc;
+	}
+
+	memset(image, 0xff, X2GCN64_MAX_FIRMWARE_SIZE);
+	if (load_ihex(e->path, image, X2GCN64_MAX_FIRMWARE_SIZE) < 0)
+		return 0;
+
+	for (i=0; i<e->n_ranges; i++) {
+		start = e->ranges[i].start;
+		end = e->ranges[i].end;
+		if (start >= flash->size)
+			break;
+		if (end > flash->size)
+			end = flash->size;
+		if (memcmp(flash->data + start, image + start, end - start))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Find the catalog firmware the flash content comes from */
+static const struct fwcatalog_entry *identifyFirmware(const struct fwcatalog *cat, int adapter_type, const struct x2gcn64_flash *flash)
+{
+	const struct fwcatalog_entry *e, *found = NULL;
+	const char *signature;
+	unsigned char *image;
+	int type;
+
+	if (!cat)
+		return NULL;
+
+	image = malloc(X2GCN64_MAX_FIRMWARE_SIZE);
+	if (!image)
+		return NULL;
+
+	// The type of adapters found in the bootloader is unknown: try them all
+	for (type = 0; type <= ADAPTER_TYPE_CLASSIC_TO_GC && !found; type++) {
+		if (adapter_type >= 0 && type != adapter_type)
+			continue;
+
+		signature = x2gcn64_getAdapterSignature(type);
+		for (e = fwcatalog_findBySignature(cat, signature); e && !found; e = e->next_same_sig) {
+			if (strcmp(e->signature, signature))
+				continue;
+			if (flashMatchesEntry(e, flash, image))
+				found = e;
+		}
+	}
+
+	free(image);
+
+	return found;
+}
+
+struct read_ctx {
+	struct fwfleet *fl;
+	struct fwfleet_device *dev;
+};
+
+static void readProgress(void *ctx, int done, int total)
+{
+	struct read_ctx *rc = ctx;
+
+	setProgress(rc->fl, rc->dev, done, total);
+}
+
+static int stepRead(struct fwfleet *fl, struct fwfleet_device *dev, const struct x2gcn64_adapter_info *inf)
+{
+	struct x2gcn64_flash *flash, *expected;
+	const struct fwcatalog_entry *e;
+	struct read_ctx rc = { fl, dev };
+	int differ = -1;
+
+	flash = malloc(sizeof(struct x2gcn64_flash));
+	expected = malloc(sizeof(struct x2gcn64_flash));
+	if (!flash || !expected) {
+		free(flash);
+		free(expected);
+		return fail(fl, dev, 1, "Out of memory");
+	}
+
+	if (x2gcn64_adapter_boot_readFlash(dev->hdl, dev->channel, inf, flash, readProgress, &rc)) {
+		free(flash);
+		free(expected);
+		return fail(fl, dev, 0, "Read failed");
+	}
+
+	e = identifyFirmware(fl->catalog, dev->adapter_type, flash);
+
+	// Pages not populated by the hex file are expected to be erased
+	if (fl->image && !x2gcn64_flash_init(expected, fl->image, flash->size, flash->page_size)) {
+		differ = x2gcn64_flash_compare(flash, expected, dev->mismatch_map);
+	}
+
+	pthread_mutex_lock(&fl->lock);
+	dev->crc = flash->crc;
+	dev->n_pages = flash->n_pages;
+	dev->page_size = flash->page_size;
+	dev->differ = differ;
+	if (e) {
+		snprintf(dev->firmware, sizeof(dev->firmware), "%.40s (%.16s)", e->filename, e->version);
+	}
+	pthread_mutex_unlock(&fl->lock);
+
+	free(flash);
+	free(expected);
+
+	// Adapters found in the bootloader are left there
+	return dev->started_in_bootloader ? FWFLEET_DONE : FWFLEET_BOOT;
+}
+
+static int stepBoot(struct fwfleet *fl, struct fwfleet_device *dev)
+{
+	struct x2gcn64_adapter_info inf;
+	uint64_t t_start;
+
+	if (x2gcn64_adapter_bootApplication(dev->hdl, dev->channel))
+		return fail(fl, dev, 0, "Boot request failed");
+
+	t_start = getMilliseconds();
+	do {
+		_delay_us(BOOT_POLL_INTERVAL_US);
+		if (!x2gcn64_adapter_getInfo(dev->hdl, dev->channel, &inf) && !inf.in_bootloader) {
+			pthread_mutex_lock(&fl->lock);
+			snprintf(dev->new_version, sizeof(dev->new_version), "%s", inf.app.version);
+			pthread_mutex_unlock(&fl->lock);
+			return FWFLEET_DONE;
+		}
+	} while (getMilliseconds() - t_start < BOOT_TIMEOUT_MS);
+
+	return fail(fl, dev, 0, "Application did not start");
+}
+
+static void updateDevice(struct fwfleet *fl, struct fwfleet_device *dev)
+{
+	struct x2gcn64_program_plan plan;
+	struct x2gcn64_adapter_info inf;
+	int state = FWFLEET_ENTER_BOOTLOADER, next;
+
+	pthread_mutex_lock(&fl->lock);
+	dev->t_start = getMilliseconds();
+	dev->attempts = 1;
+	pthread_mutex_unlock(&fl->lock);
+	setState(fl, dev, state);
+
+	while (state != FWFLEET_DONE && state != FWFLEET_FAILED)
+	{
+		switch (state)
+		{
+			case FWFLEET_ENTER_BOOTLOADER: next = stepEnterBootloader(fl, dev, &inf, &plan); break;
+			case FWFLEET_ERASE: next = stepErase(fl, dev); break;
+			case FWFLEET_PROGRAM: next = stepProgram(fl, dev, &plan); break;
+			case FWFLEET_VERIFY: next = stepVerify(fl, dev, &plan); break;
+			case FWFLEET_READ: next = stepRead(fl, dev, &inf); break;
+			case FWFLEET_BOOT: next = stepBoot(fl, dev); break;
+			default: next = FWFLEET_FAILED; break;
+		}
+
+		// Only booting can be retried alone. Otherwise, block exchanges were
+		// already retried in place, so the flash content is unknown and the
+		// bootloader may have been left: start over.
+		if (next == FWFLEET_FAILED && !dev->fatal && dev->attempts <= fl->retries) {
+			pthread_mutex_lock(&fl->lock);
+			dev->attempts++;
+			pthread_mutex_unlock(&fl->lock);
+			next = state == FWFLEET_BOOT ? FWFLEET_BOOT : FWFLEET_ENTER_BOOTLOADER;
+		}
+
+		setState(fl, dev, next);
+		state = next;
+	}
+
+	pthread_mutex_lock(&fl->lock);
+	dev->t_end = getMilliseconds();
+	pthread_mutex_unlock(&fl->lock);
+}
+
+static void *fleetWorker(void *arg)
+{
+	struct fwfleet *fl = arg;
+	struct fwfleet_device *dev;
+
+	while (1)
+	{
+		pthread_mutex_lock(&fl->lock);
+		dev = fl->next_device < fl->n_devices ? &fl->devices[fl->next_device++] : NULL;
+		pthread_mutex_unlock(&fl->lock);
+
+		if (!dev)
+			break;
+
+		updateDevice(fl, dev);
+	}
+
+	return NULL;
+}
+
+/* One line: counts per state, then the devices being updated. Called with the lock held. */
+static int printProgress(struct fwfleet *fl, uint64_t t_start)
+{
+	struct fwfleet_device *dev;
+	int i, done = 0, failed = 0, queued = 0;
+
+	for (i=0; i<fl->n_devices; i++) {
+		switch (fl->devices[i].state)
+		{
+			case FWFLEET_DONE: done++; break;
+			case FWFLEET_FAILED: failed++; break;
+			case FWFLEET_QUEUED: queued++; break;
+		}
+	}
+
+	printf("[%4d s] done: %d, failed: %d, queued: %d |", (int)((getMilliseconds() - t_start) / 1000), done, failed, queued);
+	for (i=0; i<fl->n_devices; i++) {
+		dev = &fl->devices[i];
+		if (dev->state == FWFLEET_QUEUED || dev->state == FWFLEET_DONE || dev->state == FWFLEET_FAILED)
+			continue;
+
+		printf(" %s %s", dev->name, fwfleet_stateName(dev->state));
+		if (dev->blocks_total) {
+			printf(" %d%%", dev->blocks_done * 100 / dev->blocks_total);
+		}
+		if (dev->attempts > 1) {
+			printf(" (try %d)", dev->attempts);
+		}
+		printf(";");
+	}
+	printf("\n");
+	fflush(stdout);
+
+	return done + failed;
+}
+
+int fwfleet_run(struct fwfleet *fl, int jobs, int retries)
+{
+	pthread_t threads[FWFLEET_MAX_JOBS];
+	uint64_t t_start;
+	int i, finished, failed = 0;
+
+	if (jobs < 1)
+		jobs = 1;
+	if (jobs > FWFLEET_MAX_JOBS)
+		jobs = FWFLEET_MAX_JOBS;
+	if (jobs > fl->n_devices)
+		jobs = fl->n_devices;
+
+	fl->retries = retries < 0 ? 0 : retries;
+	fl->next_device = 0;
+
+	if (fl->audit) {
+		printf("Reading %d adapter(s), %d at a time\n", fl->n_devices, jobs);
+	} else {
+		printf("Updating %d adapter(s), %d at a time, firmware size %d bytes\n", fl->n_devices, jobs, fl->image_size);
+	}
+	t_start = getMilliseconds();
+	x2gcn64_adapter_getWaitStats(fl->waits);
+
+	for (i=0; i<jobs; i++) {
+		if (pthread_create(&threads[i], NULL, fleetWorker, fl)) {
+			perror("pthread_create");
+			break;
+		}
+	}
+	jobs = i;
+
+	// Without any worker, nothing will happen
+	if (!jobs) {
+		return fl->n_devices;
+	}
+
+	do {
+		_delay_us(PROGRESS_INTERVAL_US);
+		pthread_mutex_lock(&fl->lock);
+		finished = printProgress(fl, t_start);
+		pthread_mutex_unlock(&fl->lock);
+	} while (finished < fl->n_devices);
+
+	for (i=0; i<jobs; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	for (i=0; i<fl->n_devices; i++) {
+		if (fl->devices[i].state != FWFLEET_DONE || fl->devices[i].differ > 0) {
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+static void printAuditSummary(struct fwfleet *fl)
+{
+	struct fwfleet_device *dev;
+	const char *expected;
+	int i, j, count, done = 0, differ = 0;
+
+	printf("%-20s %-20s %-8s %-8s  %-36s %-9s %8s  %s\n", "Adapter", "Type", "Version", "crc32", "Firmware", "Expected", "Time", "Result");
+	for (i=0; i<fl->n_devices; i++) {
+		dev = &fl->devices[i];
+
+		if (dev->state != FWFLEET_DONE) {
+			printf("%-20s %-20s %-8s %-8s  %-36s %-9s %6.1f s  Failed at %s: %s\n", dev->name,
+						x2gcn64_adapter_type_name(dev->adapter_type), dev->old_version, "-", "-", "-",
+						(dev->t_end - dev->t_start) / 1000.0, fwfleet_stateName(dev->failed_state), dev->error);
+			continue;
+		}
+
+		done++;
+		if (dev->differ < 0) {
+			expected = "-";
+		} else if (dev->differ == 0) {
+			expected = "Same";
+		} else {
+			expected = "Differs";
+			differ++;
+		}
+		printf("%-20s %-20s %-8s %08x  %-36s %-9s %6.1f s  Ok\n", dev->name,
+					x2gcn64_adapter_type_name(dev->adapter_type), dev->old_version, dev->crc,
+					dev->firmware[0] ? dev->firmware : "Unknown", expected,
+					(dev->t_end - dev->t_start) / 1000.0);
+	}
+	printf("%d of %d adapter(s) read", done, fl->n_devices);
+	if (fl->image) {
+		printf(", %d differ from the expected firmware", differ);
+	}
+	printf("\n");
+
+	// Group the adapters by flash content
+	printf("\nFirmware in use:\n");
+	for (i=0; i<fl->n_devices; i++) {
+		dev = &fl->devices[i];
+		if (dev->state != FWFLEET_DONE)
+			continue;
+
+		// Already counted with an earlier adapter?
+		for (j=0; j<i; j++) {
+			if (fl->devices[j].state == FWFLEET_DONE && fl->devices[j].crc == dev->crc)
+				break;
+		}
+		if (j < i)
+			continue;
+
+		for (j=i, count=0; j<fl->n_devices; j++) {
+			if (fl->devices[j].state == FWFLEET_DONE && fl->devices[j].crc == dev->crc)
+				count++;
+		}
+		printf("  %08x  %3d adapter(s)  %s\n", dev->crc, count, dev->firmware[0] ? dev->firmware : "Unknown");
+	}
+
+	for (i=0; i<fl->n_devices; i++) {
+		dev = &fl->devices[i];
+		if (dev->state != FWFLEET_DONE || dev->differ <= 0)
+			continue;
+
+		printf("\n%s: %d of %d pages differ\n", dev->name, dev->differ, dev->n_pages);
+		x2gcn64_flash_printMismatchMap(dev->n_pages, dev->page_size, dev->mismatch_map);
+	}
+}
+
+void fwfleet_printSummary(struct fwfleet *fl)
+{
+	struct fwfleet_device *dev;
+	int i, done = 0;
+
+	if (fl->audit) {
+		printAuditSummary(fl);
+		return;
+	}
+
+	printf("%-20s %-20s %-8s %-8s %-6s %8s  %s\n", "Adapter", "Type", "Before", "After", "Tries", "Time", "Result");
+	for (i=0; i<fl->n_devices; i++) {
+		dev = &fl->devices[i];
+
+		printf("%-20s %-20s %-8s %-8s %-6d %6.1f s  ", dev->name, x2gcn64_adapter_type_name(dev->adapter_type),
+					dev->old_version, dev->new_version[0] ? dev->new_version : "-",
+					dev->attempts, (dev->t_end - dev->t_start) / 1000.0);
+
+		if (dev->state == FWFLEET_DONE) {
+			printf("Ok\n");
+			done++;
+		} else {
+			printf("Failed at %s: %s\n", fwfleet_stateName(dev->failed_state), dev->error);
+		}
+	}
+	printf("%d of %d adapter(s) updated\n", done, fl->n_devices);
+	x2gcn64_adapter_printWaitStats(fl->waits);
+}
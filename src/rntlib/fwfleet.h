@@ -0,0 +1,121 @@
+#ifndef _fwfleet_h__
+#define _fwfleet_h__
+
+#include <stdint.h>
+#include <pthread.h>
+#include "raphnetadapter.h"
+#include "x2gcn64_adapters.h"
+#include "fwcatalog.h"
+
+#define FWFLEET_DEFAULT_JOBS		4
+#define FWFLEET_MAX_JOBS			64
+#define FWFLEET_DEFAULT_RETRIES		2
+
+/* Per-device update steps, in order */
+enum fwfleet_state {
+	FWFLEET_QUEUED,
+	FWFLEET_ENTER_BOOTLOADER,
+	FWFLEET_ERASE,
+	FWFLEET_PROGRAM,
+	FWFLEET_VERIFY,
+	FWFLEET_READ, // Audits only (instead of erase, program and verify)
+	FWFLEET_BOOT,
+	FWFLEET_DONE,
+	FWFLEET_FAILED,
+};
+
+struct fwfleet_device {
+	rnt_hdl_t hdl; // Shared with the other devices on the same USB adapter
+	int channel;
+	char name[48]; // USB adapter serial and channel, eg: 00001A:0
+	int adapter_type;
+	char old_version[16];
+	char new_version[16];
+
+	/* Updated by the worker, under fwfleet.lock */
+	int state;
+	int failed_state; // State where the last error occurred
+	int fatal; // The last error cannot be fixed by retrying
+	int attempts;
+	int blocks_done, blocks_total; // Of the current step (program or verify)
+	uint64_t t_start, t_end; // ms
+	char error[64]; // Last error
+
+	/* Audits */
+	int started_in_bootloader; // Left in the bootloader after the read
+	uint32_t crc; // Of the application area
+	int page_size, n_pages;
+	int differ; // Pages which differ from the expected firmware, -1 if not compared
+	unsigned char mismatch_map[X2GCN64_MAX_PAGES / 8];
+	char firmware[64]; // Matching catalog firmware, empty if unknown
+};
+
+/**
+ * \brief Update the firmware of many x2gcn64 adapters at once
+ *
+ * All the x2gcn64 adapters (GC to N64, SNES to N64...) connected to the
+ * listed USB adapters are probed. Those the firmware file is for (its
+ * signature is found in the image) are updated concurrently, each by a
+ * worker running the update steps (enter bootloader, erase, program,
+ * verify, boot) and retrying failed steps. As the bootloader is slow to
+ * answer, even a single USB adapter with several channels gains from
+ * parallel updates.
+ *
+ * Firmware files for the USB adapters themselves are recognized (their
+ * signature, from rnt_getSignature()) but not supported: those adapters
+ * are updated with dfu-programmer.
+ *
+ * In audit mode, the flash of each adapter is read back instead. Its CRC
+ * identifies the firmware in the catalog, and when an expected firmware
+ * is given the pages which differ from it are reported.
+ */
+struct fwfleet {
+	unsigned char *image; // X2GCN64_MAX_FIRMWARE_SIZE, unused bytes set to 0xFF. Optional for audits.
+	int image_size;
+
+	int audit;
+	struct fwcatalog *catalog; // Audits only, may be NULL
+
+	int n_devices;
+	struct fwfleet_device *devices;
+	int n_hdls;
+	rnt_hdl_t *hdls;
+
+	int retries;
+	pthread_mutex_t lock;
+	int next_device; // Next device for a worker to update
+	struct x2gcn64_wait_stats waits[X2GCN64_NUM_OPS]; // When the update started
+};
+
+/**
+ * \brief Load the firmware to install
+ * \return 0 on success, -1 on error
+ */
+int fwfleet_init(struct fwfleet *fl, const char *hexfile);
+/**
+ * \brief Prepare a fleet audit
+ * \param expected_hexfile Firmware the adapters should have, or NULL to only identify their firmware
+ * \return 0 on success, -1 on error
+ */
+int fwfleet_initAudit(struct fwfleet *fl, const char *expected_hexfile);
+void fwfleet_free(struct fwfleet *fl);
+
+/**
+ * \brief Find the adapters to update. The other adapters found are listed with the reason they are skipped.
+ * \return The number of adapters to update, or -1 on error
+ */
+int fwfleet_discover(struct fwfleet *fl);
+
+/**
+ * \brief Update (or audit) all the adapters found, printing the overall progress every second
+ * \param jobs Maximum number of adapters updated at the same time
+ * \param retries How many times a failed step may be retried, per adapter
+ * \return The number of adapters which could not be updated (audits: not read, or differing
+ *         from the expected firmware)
+ */
+int fwfleet_run(struct fwfleet *fl, int jobs, int retries);
+
+void fwfleet_printSummary(struct fwfleet *fl);
+const char *fwfleet_stateName(int state);
+
+#endif // _fwfleet_h__
@@ -46,8 +46,17 @@ int gcn64lib_rawSiCommand(rnt_hdl_t hdl, unsigned char channel, unsigned char *t
 	n = rnt_exchange(hdl, cmd, cmdlen, rep, sizeof(rep));
 	if (n<0)
 		return n;
+	if (n < 3)
+		return -1;
 
+	// Never trust the length more than what was received and what fits in rx
 	rx_len = rep[2];
+	if (rx_len > n - 3) {
+		rx_len = n - 3;
+	}
+	if (rx_len > max_rx) {
+		rx_len = max_rx;
+	}
 	if (rx) {
 		memcpy(rx, rep + 3, rx_len);
 	}
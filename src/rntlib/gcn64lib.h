@@ -3,6 +3,11 @@
 
 #include "raphnetadapter.h"
 
+/**
+ * \brief Send a raw SI command and receive the answer
+ * \param rx Receives the answer, up to max_rx bytes (may be NULL)
+ * \return The number of bytes received (never more than max_rx), or -1 on error
+ */
 int gcn64lib_rawSiCommand(rnt_hdl_t hdl, unsigned char channel, unsigned char *tx, unsigned char tx_len, unsigned char *rx, unsigned char max_rx);
 int gcn64lib_n64_expansionWrite(rnt_hdl_t hdl, unsigned char channel, unsigned short addr, const unsigned char *data, int len);
 int gcn64lib_n64_expansionRead(rnt_hdl_t hdl, unsigned char channel, unsigned short addr, unsigned char *dst, int max_len);
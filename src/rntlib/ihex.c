@@ -15,8 +15,46 @@
 	along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include "hexdump.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ihex.h"
+
+#ifndef WINDOWS
+#include <sys/mman.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY	0
+#endif
+
+/* Value of each hexadecimal digit, plus one. Zero for other characters. */
+static const unsigned char hexdigits[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+/* \return Number of bytes decoded. Stops at the first invalid digit pair. */
+static int decodeHex(const unsigned char *src, int max_bytes, unsigned char *dst)
+{
+	int i;
+	unsigned char hi, lo;
+
+	for (i=0; i<max_bytes; i++) {
+		hi = hexdigits[src[i*2]];
+		lo = hexdigits[src[i*2+1]];
+		if (!hi || !lo)
+			break;
+		dst[i] = (hi-1) << 4 | (lo-1);
+	}
+
+	return i;
+}
 
 static unsigned char chk(unsigned char *buf, int len)
 {
@@ -29,131 +67,487 @@ static unsigned char chk(unsigned char *buf, int len)
 	return r;
 }
 
+struct ihex_file {
+	const unsigned char *data;
+	size_t size;
+	int mapped;
+};
+
+static int openFile(const char *file, struct ihex_file *f)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(file, O_RDONLY | O_BINARY);
+	if (fd < 0) {
+		perror("open");
+		return -1;
+	}
+
+	if (fstat(fd, &st)) {
+		perror("fstat");
+		close(fd);
+		return -1;
+	}
+
+	f->size = st.st_size;
+	f->mapped = 0;
+
+	if (f->size == 0) {
+		f->data = NULL;
+		close(fd);
+		return 0;
+	}
+
+#ifndef WINDOWS
+	f->data = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (f->data != MAP_FAILED) {
+		f->mapped = 1;
+		close(fd);
+		return 0;
+	}
+#endif
+
+	// Fallback: Read the whole file
+	{
+		unsigned char *buf;
+		size_t done = 0;
+		ssize_t n;
+
+		buf = malloc(f->size);
+		if (!buf) {
+			perror("malloc");
+			close(fd);
+			return -1;
+		}
+
+		while (done < f->size) {
+			n = read(fd, buf + done, f->size - done);
+			if (n <= 0) {
+				perror("read");
+				free(buf);
+				close(fd);
+				return -1;
+			}
+			done += n;
+		}
+		f->data = buf;
+	}
+
+	close(fd);
+	return 0;
+}
+
+static void closeFile(struct ihex_file *f)
+{
+#ifndef WINDOWS
+	if (f->mapped) {
+		munmap((void*)f->data, f->size);
+		return;
+	}
+#endif
+	free((void*)f->data);
+}
+
+/* \return 0 on success, negative on errors (same codes as load_ihex). */
+int ihex_parse_file(const char *file, ihex_data_callback cb, void *ctx)
+{
+	struct ihex_file f;
+	const unsigned char *p, *end, *eol;
+	unsigned char databuf[1+2+1+255+1];
+	unsigned int data_count, address, offset = 0;
+	int line = 0, eof_seen = 0, ret = 0, n;
+
+	if (openFile(file, &f)) {
+		return -1;
+	}
+
+	p = f.data;
+	end = f.data + f.size;
+
+	for (; p < end; p = eol + 1) {
+		eol = memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+
+		line++;
+
+		if (p[0] != ':') {
+			// Blank lines (or trailing CR) are not worth a warning
+			if (eol - p > 1 || (eol - p == 1 && p[0] != '\r'))
+				fprintf(stderr, "Ignored invalid line %d\n", line);
+			continue;
+		}
+
+		if (eof_seen) {
+			fprintf(stderr, "extra data after EOF record in hex file\n");
+			ret = -7;
+			goto done;
+		}
+
+		// :10 0000 00 92C064C7ABC0AAC0A9C0A8C0A7C0A6C0 00
+		//  ^  ^    ^  ^                                ^-- Checksum
+		//  |  |    |  +----- Data [data_count]
+		//  |  |    +---- Record type
+		//  |  +------ Address
+		//  +----- data_count
+		//
+
+		if ((eol - p - 1) / 2 < 1 || decodeHex(p + 1, 1, databuf) != 1) {
+			fprintf(stderr, "Invalid record (less data than expected) at line %d\n", line);
+			ret = -5;
+			goto done;
+		}
+		data_count = databuf[0];
+
+		// Data length sanity check. Only line endings may follow the record.
+		n = (eol - p - 1) / 2;
+		if (n > 1+2+1+data_count+1)
+			n = 1+2+1+data_count+1;
+		n = decodeHex(p + 1, n, databuf);
+		if (n != 1+2+1+data_count+1 ||
+			(p + 1 + n*2 < eol && p[1 + n*2] != '\r'))
+		{
+			fprintf(stderr, "Invalid record (less data than expected) at line %d\n", line);
+			ret = -5;
+			goto done;
+		}
+
+		// Validate the record checksum
+		if (chk(databuf, n)) {
+			fprintf(stderr, "Bad checksum at line %d\n", line);
+			ret = -4;
+			goto done;
+		}
+
+		address = databuf[1]<<8 | databuf[2];
+
+		switch(databuf[3])
+		{
+			case 0x00: // Data
+				ret = cb(ctx, address + offset, databuf + 4, data_count);
+				if (ret) {
+					goto done;
+				}
+				break;
+
+			case 0x01: // EOF
+				eof_seen = 1;
+				break;
+
+			case 0x02: // Extended segment address
+				if (data_count != 2) {
+					fprintf(stderr, "ihex parser: Malformatted 0x02 record at line %d\n", line);
+					ret = -8;
+					goto done;
+				}
+				offset = ((databuf[4] << 8) | databuf[5]) << 4;
+				break;
+
+			case 0x04: // Extended linear address
+				if (data_count != 2) {
+					fprintf(stderr, "ihex parser: Malformatted 0x04 record at line %d\n", line);
+					ret = -8;
+					goto done;
+				}
+				offset = (databuf[4] << 24) | (databuf[5] << 16);
+				break;
+
+			case 0x03: // Start segment address
+			case 0x05: // Start linear address
+				// Ignored
+				break;
+
+			default:
+				fprintf(stderr, "ihex parser: Unimplemented record type 0x%02x at line %d\n", databuf[3], line);
+				ret = -2;
+				goto done;
+		}
+	}
+
+done:
+	closeFile(&f);
+	return ret;
+}
+
+struct load_ctx {
+	unsigned char *dstbuf;
+	int bufsize;
+	unsigned int max_address;
+	struct ihex_info *info;
+};
+
+static void addRange(struct ihex_info *info, unsigned int address, unsigned int count)
+{
+	struct ihex_range *r;
+	int i;
+
+	// Most records simply extend the last range
+	if (info->n_ranges) {
+		r = &info->ranges[info->n_ranges - 1];
+		if (r->end == address) {
+			r->end += count;
+			return;
+		}
+	}
+
+	// Merge with an adjacent or overlapping range
+	for (i=0; i<info->n_ranges; i++) {
+		r = &info->ranges[i];
+		if (address <= r->end && address + count >= r->start) {
+			if (address < r->start)
+				r->start = address;
+			if (address + count > r->end)
+				r->end = address + count;
+			return;
+		}
+	}
+
+	if (info->n_ranges >= IHEX_MAX_RANGES) {
+		// Out of ranges. Extend the last one to cover this record.
+		r = &info->ranges[info->n_ranges - 1];
+		if (address < r->start)
+			r->start = address;
+		if (address + count > r->end)
+			r->end = address + count;
+		info->ranges_truncated = 1;
+		return;
+	}
+
+	r = &info->ranges[info->n_ranges++];
+	r->start = address;
+	r->end = address + count;
+}
+
+static int loadRecord(void *ctx, unsigned int address, const unsigned char *data, int count)
+{
+	struct load_ctx *lc = ctx;
+
+	if (address + count > lc->bufsize) {
+		fprintf(stderr, "hex file too large\n");
+		return -6;
+	}
+	if (address + count > lc->max_address) {
+		lc->max_address = address + count;
+	}
+	memcpy(lc->dstbuf + address, data, count);
+
+	if (lc->info) {
+		addRange(lc->info, address, count);
+		lc->info->data_bytes += count;
+	}
+
+	return 0;
+}
+
 /* \return The highest address written to, or negative on errors.
  */
+int load_ihex_ex(const char *file, unsigned char *dstbuf, int bufsize, struct ihex_info *info)
+{
+	struct load_ctx lc = {
+		.dstbuf = dstbuf,
+		.bufsize = bufsize,
+		.info = info,
+	};
+	int ret;
+
+	if (info) {
+		memset(info, 0, sizeof(struct ihex_info));
+	}
+
+	ret = ihex_parse_file(file, loadRecord, &lc);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return lc.max_address;
+}
+
 int load_ihex(const char *file, unsigned char *dstbuf, int bufsize)
+{
+	return load_ihex_ex(file, dstbuf, bufsize, NULL);
+}
+
+static int writeRecord(FILE *fptr, int type, unsigned int address, const unsigned char *data, int count)
+{
+	unsigned char rec[4 + 255];
+	int i;
+
+	rec[0] = count;
+	rec[1] = address >> 8;
+	rec[2] = address;
+	rec[3] = type;
+	if (count) {
+		memcpy(rec + 4, data, count);
+	}
+
+	fputc(':', fptr);
+	for (i=0; i<4 + count; i++) {
+		fprintf(fptr, "%02X", rec[i]);
+	}
+	return fprintf(fptr, "%02X\n", (unsigned char)-chk(rec, 4 + count)) < 0 ? -1 : 0;
+}
+
+#define SAVE_RECORD_SIZE	16
+
+/** \brief Write an image to a hex file
+ *
+ * Records only containing 0xFF bytes (erased flash) are left out.
+ *
+ * \return 0 on success, -1 on error
+ */
+int save_ihex(const char *file, const unsigned char *data, int len)
 {
 	FILE *fptr;
-	char linebuf[550];
-	unsigned char databuf[2+1+255+1];
-	int ret = 0;
-	int line = 0;
-	int eof_seen = 0;
-	unsigned int max_address = 0;
-	unsigned int offset = 0;
-
-	fptr = fopen(file, "r");
+	unsigned char ext[2];
+	unsigned int address, segment = 0;
+	int i, count, res = 0;
+
+	fptr = fopen(file, "w");
 	if (!fptr) {
-		perror("fopen");
+		perror(file);
 		return -1;
 	}
 
-	do {
-		if (fgets(linebuf, sizeof(linebuf), fptr)) {
-			unsigned int data_count;
-			unsigned int address;
-			int input_nibbles, input_bytes;
-			int i;
+	for (address = 0; address < len && !res; address += SAVE_RECORD_SIZE) {
+		count = len - address < SAVE_RECORD_SIZE ? len - address : SAVE_RECORD_SIZE;
 
-			line++;
+		for (i=0; i<count; i++) {
+			if (data[address + i] != 0xff)
+				break;
+		}
+		if (i == count)
+			continue;
 
-			if (linebuf[0] != ':') {
-				fprintf(stderr, "Ignored invalid line %d\n", line);
-				continue;
-			}
+		// Extended linear address record beyond 64K
+		if (address >> 16 != segment) {
+			segment = address >> 16;
+			ext[0] = segment >> 8;
+			ext[1] = segment;
+			res = writeRecord(fptr, 4, 0, ext, 2);
+		}
 
-			if (eof_seen) {
-				fprintf(stderr, "extra data after EOF record in hex file\n");
-				ret = -7;
-				goto err;
-			}
+		res |= writeRecord(fptr, 0, address & 0xffff, data + address, count);
+	}
 
-			// :10 0000 00 92C064C7ABC0AAC0A9C0A8C0A7C0A6C0 00
-			//  ^  ^    ^  ^                                ^-- Checksum
-			//  |  |    |  +----- Data [data_count]
-			//  |  |    +---- Record type
-			//  |  +------ Address
-			//  +----- data_count
-			//
+	res |= writeRecord(fptr, 1, 0, NULL, 0);
 
-			input_nibbles = strlen(linebuf) - 1;
+	if (fclose(fptr) || res) {
+		perror(file);
+		return -1;
+	}
 
-			for (input_bytes=0,i=0; i<input_nibbles; i+=2) {
-				unsigned int byte;
-				if (1 != sscanf(linebuf + 1 + i, "%02x", &byte)) {
-					break;
-				}
-				databuf[input_bytes] = byte;
-				input_bytes++;
-			}
+	return 0;
+}
 
-			//printf("Input bytes: %d\n", input_bytes);
-			//printHexBuf(databuf, input_bytes);
+struct search_ctx {
+	const char *signature;
+	int siglen;
+	unsigned int next_address;
+	int tail_len;
+	// Last bytes of the contiguous data seen so far, followed by the current record
+	unsigned char window[IHEX_MAX_STREAM_SIGNATURE + 255];
+	int found;
+};
 
-			// Validate the record checksum
-			if (chk(databuf, input_bytes)) {
-				fprintf(stderr, "Bad checksum at line %d\n", line);
-				ret = -4;
-				goto err;
-			}
+static int searchRecord(void *ctx, unsigned int address, const unsigned char *data, int count)
+{
+	struct search_ctx *sc = ctx;
+	const unsigned char *p, *end;
+	int keep;
 
-			// Data length sanity check
-			data_count = databuf[0];
-			if (input_bytes != 1+2+1+data_count+1) {
-				fprintf(stderr, "Invalid record (less data than expected) at line %d\n", line);
-				ret = -5;
-				goto err;
-			}
+	if (address != sc->next_address) {
+		sc->tail_len = 0;
+	}
+	sc->next_address = address + count;
+
+	memcpy(sc->window + sc->tail_len, data, count);
+
+	// Only look where the first character of the signature appears
+	p = sc->window;
+	end = sc->window + sc->tail_len + count;
+	while (end - p >= sc->siglen && (p = memchr(p, sc->signature[0], end - p - sc->siglen + 1))) {
+		if (!memcmp(p, sc->signature, sc->siglen)) {
+			sc->found = 1;
+			return 1; // Stop parsing
+		}
+		p++;
+	}
+
+	// A signature crossing records needs at most siglen-1 bytes from before
+	keep = sc->siglen - 1;
+	if (keep > sc->tail_len + count)
+		keep = sc->tail_len + count;
+	memmove(sc->window, sc->window + sc->tail_len + count - keep, keep);
+	sc->tail_len = keep;
 
-			address = databuf[1]<<8 | databuf[2];
-
-			switch(databuf[3])
-			{
-				case 0x00: // Data
-					if (address + offset + data_count > bufsize) {
-						fprintf(stderr, "hex file too large\n");
-						ret = -6;
-						goto err;
-					}
-					if (address + offset + data_count > max_address) {
-						max_address = address + offset + data_count;
-					}
-					memcpy(dstbuf + address + offset, databuf + 4, data_count);
-					break;
-
-				case 0x01: // EOF
-					eof_seen = 1;
-					break;
-
-				case 0x04: // Extended linear address
-					if (data_count != 2) {
-						fprintf(stderr, "ihex parser: Malformatted 0x04 record at line %d\n", line);
-						ret = -8;
-						goto err;
-					}
-					offset = (databuf[4] << 24) | (databuf[5] << 16);
-					//printf("OFfset: 0x%08x\n", offset);
-					break;
-
-				case 0x03: // Start segment address
-				case 0x05: // Start linear address
-					// Ignored
-					break;
-
-				default:
-				case 0x02: // Extended segment address
-					fprintf(stderr, "ihex parser: Unimplemented record type 0x%02x at line %d\n", databuf[3], line);
-					ret = -2;
-					goto err;
+	return 0;
+}
+
+/** \brief Look for a string in the data of a hex file without loading the image
+ *
+ * Records are expected in ascending address order, as produced by common
+ * toolchains. A signature split across non-contiguous records is not found.
+ *
+ * \return 1 if found, 0 if not found, negative on errors
+ */
+int ihex_find_signature(const char *file, const char *signature)
+{
+	struct search_ctx sc = { };
+	int ret;
+
+	sc.signature = signature;
+	sc.siglen = strlen(signature);
+	if (sc.siglen < 1 || sc.siglen > IHEX_MAX_STREAM_SIGNATURE) {
+		return -1;
+	}
+
+	ret = ihex_parse_file(file, searchRecord, &sc);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return sc.found;
+}
+
+#ifdef IHEX_BENCHMARK
+#include <dirent.h>
+#include "timer.h"
+
+// gcc -DIHEX_BENCHMARK -I. ihex.c timer.c -o ihex_bench -Wall -O2
+// ./ihex_bench ../../firmwares/*/*.hex
+int main(int argc, char **argv)
+{
+	static unsigned char buf[0x20000];
+	struct ihex_info info;
+	uint64_t start, t_load = 0, t_search = 0;
+	int i, r, iterations = 20, size = 0;
+
+	for (i=1; i<argc; i++) {
+		start = getMicroseconds();
+		for (r=0; r<iterations; r++) {
+			if (load_ihex_ex(argv[i], buf, sizeof(buf), &info) < 0) {
+				printf("%s: load failed\n", argv[i]);
+				return 1;
 			}
+		}
+		t_load += getMicroseconds() - start;
+		size += info.data_bytes;
 
+		start = getMicroseconds();
+		for (r=0; r<iterations; r++) {
+			// Not present: Worst case, the whole file is parsed
+			ihex_find_signature(argv[i], "00000000-0000-0000-0000-000000000000");
 		}
-	} while (!feof(fptr));
+		t_search += getMicroseconds() - start;
+
+		printf("%s: %d bytes in %d range(s)\n", argv[i], info.data_bytes, info.n_ranges);
+	}
 
-	fclose(fptr);
-	return max_address;
+	printf("%d files, %d bytes of data, %d iterations\n", argc-1, size, iterations);
+	printf("Load: %.1f us per file\n", (double)t_load / iterations / (argc-1));
+	printf("Signature search: %.1f us per file\n", (double)t_search / iterations / (argc-1));
 
-err:
-	fclose(fptr);
-	return ret;
+	return 0;
 }
+#endif
@@ -1,8 +1,35 @@
 #ifndef _ihex_h__
 #define _ihex_h__
 
+#define IHEX_MAX_RANGES				16
+#define IHEX_MAX_STREAM_SIGNATURE	128
+
+/* Address range populated by data records. End is exclusive. */
+struct ihex_range {
+	unsigned int start, end;
+};
+
+struct ihex_info {
+	int data_bytes;
+	int n_ranges;
+	struct ihex_range ranges[IHEX_MAX_RANGES];
+	/* Set when there were more than IHEX_MAX_RANGES ranges (the last one then covers the rest) */
+	int ranges_truncated;
+};
+
+/* Called for each data record, with the absolute address. A non-zero
+ * return value stops parsing (negative values are returned as errors). */
+typedef int (*ihex_data_callback)(void *ctx, unsigned int address, const unsigned char *data, int count);
+
+int ihex_parse_file(const char *file, ihex_data_callback cb, void *ctx);
+
 /* \return File size, or negative value on error.*/
 int load_ihex(const char *file, unsigned char *dstbuf, int bufsize);
+int load_ihex_ex(const char *file, unsigned char *dstbuf, int bufsize, struct ihex_info *info);
+/* Records only containing 0xFF bytes are left out. \return 0 on success, -1 on error */
+int save_ihex(const char *file, const unsigned char *data, int len);
 
-#endif // _ihex_h__
+/* \return 1 if found, 0 if not, negative on errors */
+int ihex_find_signature(const char *file, const char *signature);
 
+#endif // _ihex_h__
@@ -14,6 +14,7 @@ char check_ihex_for_signature(const char *filename, const char *signature)
 {
 	unsigned char *buf;
 	int max_address;
+	char found = 0;
 
 	if (!filename) {
 		return 0;
@@ -22,6 +23,11 @@ char check_ihex_for_signature(const char *filename, const char *signature)
 		return 0;
 	}
 
+	// Stream through the records when possible
+	if (strlen(signature) <= IHEX_MAX_STREAM_SIGNATURE) {
+		return ihex_find_signature(filename, signature) == 1;
+	}
+
 	buf = malloc(IHEX_MAX_FILE_SIZE);
 	if (!buf) {
 		perror("malloc");
@@ -31,13 +37,12 @@ char check_ihex_for_signature(const char *filename, const char *signature)
 	max_address= load_ihex(filename, buf, IHEX_MAX_FILE_SIZE);
 
 	if (max_address > 0) {
-		if (!memmem(buf, max_address + 1, signature, strlen(signature))) {
-			return 0;
+		if (memmem(buf, max_address + 1, signature, strlen(signature))) {
+			found = 1;
 		}
-		return 1;
 	}
 
-	return 0;
-}
-
+	free(buf);
 
+	return found;
+}
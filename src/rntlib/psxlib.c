@@ -1,5 +1,7 @@
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
 #include "rnt_priv.h"
 #include "psxlib.h"
 #include "requests.h"
@@ -11,13 +13,14 @@
 int psxlib_exchange(rnt_hdl_t hdl, unsigned char channel, unsigned char *tx, unsigned char tx_len, unsigned char *rx, unsigned char max_rx)
 {
 	unsigned char cmd[4 + tx_len];
-	unsigned char rep[2 + 64];
 	int cmdlen = 0, rx_len, n;
 
 	if (!hdl) {
 		return -1;
 	}
 
+	unsigned char rep[2 + hdl->report_size];
+
 	if (!tx && tx_len > 0) {
 		return -1;
 	}
@@ -58,6 +61,9 @@ int psxlib_exchange(rnt_hdl_t hdl, unsigned char channel, unsigned char *tx, uns
 	return rx_len;
 }
 
+static int readSector(rnt_hdl_t hdl, uint8_t chn, const struct psxlib_chunk_plan *plan, uint16_t sector, uint8_t dst[128]);
+static int writeSector(rnt_hdl_t hdl, uint8_t chn, const struct psxlib_chunk_plan *plan, uint16_t sector, const uint8_t data[128]);
+
 static uint8_t xorbuf(const uint8_t *buf, int len)
 {
 	uint8_t r = 0;
@@ -67,81 +73,428 @@ static uint8_t xorbuf(const uint8_t *buf, int len)
 	return r;
 }
 
-int psxlib_readMemoryCard(rnt_hdl_t hdl, uint8_t chn, struct psx_memorycard *dst, uiio *u)
+static const uint8_t *dirFrame(const struct psx_memorycard *mc, int block)
+{
+	return mc->contents + (PSXLIB_MC_DIR_FIRST_SECTOR + block - 1) * PSXLIB_MC_SECTOR_SIZE;
+}
+
+static int isFormatted(const struct psx_memorycard *mc)
+{
+	return mc->contents[0] == 'M' && mc->contents[1] == 'C';
+}
+
+/** \brief Find which data blocks are in use according to the directory frames
+ *
+ * Only sector 0 and the directory frames (sectors 1 to 15) need to be valid
+ * in mc. Blocks whose directory frame has a bad checksum are considered
+ * in use. Block 0 is never included.
+ *
+ * \param mc The memory card data
+ * \param used_mask Bit n is set when block n is in use
+ * \return 0 on success, PSXLIB_ERR_INVALID_DATA if the card is not formatted.
+ */
+int psxlib_getUsedBlocks(const struct psx_memorycard *mc, uint16_t *used_mask)
+{
+	const uint8_t *frame;
+	uint16_t mask = 0;
+	int block;
+
+	if (!mc || !used_mask)
+		return PSXLIB_ERR_BAD_PARAM;
+
+	if (!isFormatted(mc))
+		return PSXLIB_ERR_INVALID_DATA;
+
+	for (block = 1; block <= PSXLIB_MC_N_DIR_FRAMES; block++) {
+		frame = dirFrame(mc, block);
+
+		if (xorbuf(frame, PSXLIB_MC_SECTOR_SIZE) != 0) {
+			// Cannot trust this frame. Better read the block than lose data.
+			mask |= 1 << block;
+			continue;
+		}
+
+		switch (frame[0])
+		{
+			case PSXLIB_MC_BLOCK_FIRST:
+			case PSXLIB_MC_BLOCK_MIDDLE:
+			case PSXLIB_MC_BLOCK_LAST:
+				mask |= 1 << block;
+				break;
+		}
+	}
+
+	*used_mask = mask;
+
+	return 0;
+}
+
+/** \brief Follow the chain of blocks belonging to a save
+ *
+ * \param mc The memory card data (only the directory frames need to be valid)
+ * \param first_block The first block of the save (1-15)
+ * \param save_mask Bit n is set when block n belongs to the save
+ * \return 0 on success, PSXLIB_ERR_INVALID_DATA if first_block does not start a
+ *         save or if the chain is broken.
+ */
+int psxlib_getSaveBlocks(const struct psx_memorycard *mc, int first_block, uint16_t *save_mask)
+{
+	const uint8_t *frame;
+	uint16_t mask = 0, next;
+	int block = first_block;
+
+	if (!mc || !save_mask)
+		return PSXLIB_ERR_BAD_PARAM;
+
+	if (block < 1 || block > PSXLIB_MC_N_DIR_FRAMES)
+		return PSXLIB_ERR_BAD_PARAM;
+
+	if (!isFormatted(mc))
+		return PSXLIB_ERR_INVALID_DATA;
+
+	frame = dirFrame(mc, block);
+	if (frame[0] != PSXLIB_MC_BLOCK_FIRST)
+		return PSXLIB_ERR_INVALID_DATA;
+
+	while (1) {
+		if (xorbuf(frame, PSXLIB_MC_SECTOR_SIZE) != 0)
+			return PSXLIB_ERR_INVALID_DATA;
+
+		// Guard against loops
+		if (mask & (1 << block))
+			return PSXLIB_ERR_INVALID_DATA;
+		mask |= 1 << block;
+
+		next = frame[8] | frame[9] << 8;
+		if (next == PSXLIB_MC_NO_NEXT_BLOCK || frame[0] == PSXLIB_MC_BLOCK_LAST)
+			break;
+
+		// Next block pointers are 0-based (0 is block 1)
+		block = next + 1;
+		if (block > PSXLIB_MC_N_DIR_FRAMES)
+			return PSXLIB_ERR_INVALID_DATA;
+
+		frame = dirFrame(mc, block);
+		if (frame[0] != PSXLIB_MC_BLOCK_MIDDLE && frame[0] != PSXLIB_MC_BLOCK_LAST)
+			return PSXLIB_ERR_INVALID_DATA;
+	}
+
+	*save_mask = mask;
+
+	return 0;
+}
+
+/* dst receives the sector first. Progress is counted in sectors (when u is not NULL). */
+static int readSectors(rnt_hdl_t hdl, uint8_t chn, uint8_t *dst, uint16_t first, uint16_t count, uiio *u)
 {
+	struct psxlib_chunk_plan plan;
 	uint16_t sector;
 	int res;
 
+	res = psxlib_getChunkPlan(hdl, &plan);
+	if (res) {
+		return res;
+	}
+
+	for (sector = first; sector < first + count; sector++) {
+		res = readSector(hdl, chn, &plan, sector, dst + (sector - first) * PSXLIB_MC_SECTOR_SIZE);
+		if (res) {
+			return res;
+		}
+
+		if (u && uiio_progressUpdate(u, u->cur_progress + 1)) {
+			return PSXLIB_ERR_USER_CANCELLED;
+		}
+	}
+
+	return 0;
+}
+
+int psxlib_readMemoryCard(rnt_hdl_t hdl, uint8_t chn, struct psx_memorycard *dst, uiio *u)
+{
+	return psxlib_readMemoryCardEx(hdl, chn, dst, PSXLIB_READ_ALL, 0, u);
+}
+
+/** \brief Read a memory card, optionally skipping unused blocks
+ *
+ * In PSXLIB_READ_USED and PSXLIB_READ_SAVE modes, the directory frames are read
+ * first to decide which blocks need to be read. Block 0 is always read in full.
+ * Blocks which are not read are zero-filled and flagged in dst->skipped_blocks.
+ *
+ * If the card is not formatted, PSXLIB_READ_USED falls back to reading everything.
+ *
+ * \param mode PSXLIB_READ_ALL, PSXLIB_READ_USED or PSXLIB_READ_SAVE
+ * \param first_block First block of the save to read (PSXLIB_READ_SAVE only)
+ */
+int psxlib_readMemoryCardEx(rnt_hdl_t hdl, uint8_t chn, struct psx_memorycard *dst, int mode, int first_block, uiio *u)
+{
+	uint16_t blocks = 0xFFFF;
+	uint16_t done = 0;
+	int block, n_blocks, res;
+
+	if (!dst)
+		return PSXLIB_ERR_BAD_PARAM;
+
+	if (mode == PSXLIB_READ_SAVE && (first_block < 1 || first_block > PSXLIB_MC_N_DIR_FRAMES))
+		return PSXLIB_ERR_BAD_PARAM;
+
 	u = getUIIO(u);
 
-	u->cur_progress = 0;
-	u->max_progress = PSXLIB_MC_N_SECTORS;
+	dst->skipped_blocks = 0;
+
 	u->progress_type = PROGRESS_TYPE_ADDRESS;
 	u->caption = "Reading memory card...";
-	u->progressStart(u);
+	uiio_progressStart(u, PSXLIB_MC_N_SECTORS, PSXLIB_MC_SECTOR_SIZE);
 
-	for (sector = 0; sector < PSXLIB_MC_N_SECTORS; sector++) {
-		res = psxlib_readMemoryCardSector(hdl, chn, sector, dst->contents + sector * PSXLIB_MC_SECTOR_SIZE);
+	if (mode != PSXLIB_READ_ALL) {
+		// Header and directory frames
+		done = PSXLIB_MC_DIR_FIRST_SECTOR + PSXLIB_MC_N_DIR_FRAMES;
+		res = readSectors(hdl, chn, dst->contents, 0, done, u);
 		if (res) {
-			u->progressEnd(u, "Error");
-			return res;
+			goto error;
 		}
 
-		u->cur_progress = sector;
-		if (u->update(u)) {
-			u->progressEnd(u, "Aborted");
-			return PSXLIB_ERR_USER_CANCELLED;
+		if (mode == PSXLIB_READ_SAVE) {
+			res = psxlib_getSaveBlocks(dst, first_block, &blocks);
+		} else {
+			res = psxlib_getUsedBlocks(dst, &blocks);
+			if (res == PSXLIB_ERR_INVALID_DATA) {
+				u->printf("\nMemory card not formatted. Reading all blocks.\n");
+				blocks = 0xFFFF;
+				res = 0;
+			}
+		}
+		if (res) {
+			goto error;
 		}
+
+		blocks |= 1; // Block 0 is always read
+
+		for (n_blocks = 0, block = 0; block < PSXLIB_MC_N_BLOCKS; block++) {
+			if (blocks & (1 << block))
+				n_blocks++;
+		}
+		u->max_progress = n_blocks * PSXLIB_MC_SECTORS_PER_BLOCK;
 	}
 
-	u->progressEnd(u, "Done");
+	for (block = 0; block < PSXLIB_MC_N_BLOCKS; block++) {
+		uint16_t first = block * PSXLIB_MC_SECTORS_PER_BLOCK;
+		uint16_t count = PSXLIB_MC_SECTORS_PER_BLOCK;
+
+		if (!(blocks & (1 << block))) {
+			memset(dst->contents + block * PSXLIB_MC_BLOCK_SIZE, 0, PSXLIB_MC_BLOCK_SIZE);
+			dst->skipped_blocks |= 1 << block;
+			continue;
+		}
+
+		// Skip what was already read during the directory pass
+		if (done > first) {
+			count -= done - first;
+			first = done;
+		}
+
+		res = readSectors(hdl, chn, dst->contents + first * PSXLIB_MC_SECTOR_SIZE, first, count, u);
+		if (res) {
+			goto error;
+		}
+	}
+
+	uiio_progressEnd(u, "Done");
 
 	return 0;
+
+error:
+	uiio_progressEnd(u, res == PSXLIB_ERR_USER_CANCELLED ? "Aborted" : "Error");
+	return res;
 }
 
-int psxlib_writeMemoryCard(rnt_hdl_t hdl, uint8_t chn, const struct psx_memorycard *dst, uiio *u)
+int psxlib_writeMemoryCard(rnt_hdl_t hdl, uint8_t chn, const struct psx_memorycard *src, uiio *u)
 {
+	return psxlib_writeMemoryCardEx(hdl, chn, src, NULL, PSXLIB_WRITE_ALL, NULL, u);
+}
+
+/** \brief Write a memory card, skipping sectors which already hold the right data
+ *
+ * Sectors are only written when their contents differ from what is on the card. What
+ * is on the card is either known in advance (known != NULL), or read back before
+ * each write (PSXLIB_WRITE_COMPARE). Sectors of blocks flagged in known->skipped_blocks
+ * are treated as unknown. Blocks flagged in src->skipped_blocks are never written.
+ * Images of sparse dumps loaded with psxlib_loadMemoryCardFromFile() keep their
+ * skipped_blocks, so their zero-filled blocks are never mistaken for the card contents.
+ *
+ * \param src The new memory card contents
+ * \param known The current card contents (may be NULL)
+ * \param mode PSXLIB_WRITE_ALL or PSXLIB_WRITE_COMPARE
+ * \param stats Receives the number of sectors written and skipped (may be NULL)
+ */
+int psxlib_writeMemoryCardEx(rnt_hdl_t hdl, uint8_t chn, const struct psx_memorycard *src, const struct psx_memorycard *known, int mode, struct psxlib_write_stats *stats, uiio *u)
+{
+	struct psxlib_write_stats st = { };
+	struct psxlib_chunk_plan plan;
+	uint8_t current[PSXLIB_MC_SECTOR_SIZE];
+	const uint8_t *data;
+	char caption[96];
 	uint16_t sector;
-	int res;
+	uint16_t bit;
+	int res = 0;
+
+	if (!src)
+		return PSXLIB_ERR_BAD_PARAM;
 
 	u = getUIIO(u);
 
-	u->cur_progress = 0;
-	u->max_progress = PSXLIB_MC_N_SECTORS;
+	res = psxlib_getChunkPlan(hdl, &plan);
+	if (res)
+		return res;
+
 	u->progress_type = PROGRESS_TYPE_ADDRESS;
 	u->caption = "Writing to memory card...";
-	u->progressStart(u);
+	uiio_progressStart(u, PSXLIB_MC_N_SECTORS, PSXLIB_MC_SECTOR_SIZE);
 
 	for (sector = 0; sector < PSXLIB_MC_N_SECTORS; sector++) {
-		res = psxlib_writeMemoryCardSector(hdl, chn, sector, dst->contents + sector * PSXLIB_MC_SECTOR_SIZE);
+		data = src->contents + sector * PSXLIB_MC_SECTOR_SIZE;
+		bit = 1 << (sector / PSXLIB_MC_SECTORS_PER_BLOCK);
+
+		if (src->skipped_blocks & bit) {
+			st.skipped++;
+			goto next;
+		}
+
+		if (known && !(known->skipped_blocks & bit)) {
+			if (0 == memcmp(known->contents + sector * PSXLIB_MC_SECTOR_SIZE, data, PSXLIB_MC_SECTOR_SIZE)) {
+				st.skipped++;
+				goto next;
+			}
+		} else if (mode == PSXLIB_WRITE_COMPARE) {
+			res = readSector(hdl, chn, &plan, sector, current);
+			if (res) {
+				break;
+			}
+			if (0 == memcmp(current, data, PSXLIB_MC_SECTOR_SIZE)) {
+				st.skipped++;
+				goto next;
+			}
+		}
+
+		res = writeSector(hdl, chn, &plan, sector, data);
 		if (res) {
-			u->progressEnd(u, "Error");
-			return res;
+			break;
+		}
+		st.written++;
+
+next:
+		if (mode != PSXLIB_WRITE_ALL || known) {
+			snprintf(caption, sizeof(caption), "Writing to memory card (%d written, %d unchanged)", st.written, st.skipped);
+			u->caption = caption;
 		}
 
-		u->cur_progress = sector;
-		if (u->update(u)) {
+		if (uiio_progressUpdate(u, sector + 1)) {
 			res = u->ask(UIIO_NOYES, "If you interrupt the transfer, some or all saves on your memory card will be corrupted.\n\nReally stop?");
 			if (res == UIIO_YES) {
-				u->progressEnd(u, "Aborted");
-				return PSXLIB_ERR_USER_CANCELLED;
+				res = PSXLIB_ERR_USER_CANCELLED;
+				break;
 			}
+			res = 0;
 		}
 	}
 
-	u->progressEnd(u, "Done");
+	// caption points to a local buffer
+	u->caption = "Writing to memory card...";
+
+	if (stats) {
+		*stats = st;
+	}
+
+	if (res) {
+		uiio_progressEnd(u, res == PSXLIB_ERR_USER_CANCELLED ? "Aborted" : "Error");
+		return res;
+	}
+
+	uiio_progressEnd(u, "Done");
 
 	return 0;
 }
 
-int psxlib_writeMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, const uint8_t data[128])
+/** \brief Compute how sector transactions are split in exchanges
+ *
+ * Each RQ_PSX_RAW exchange must fit in one report, including the protocol overhead.
+ * With the usual 63 byte reports, this gives the historical 60 + 60 + 20 bytes for
+ * reads and 50 + 50 + 38 bytes for writes. Adapters with larger reports need fewer
+ * exchanges per sector.
+ *
+ * When the report is too small for a transaction to fit in PSXLIB_MAX_CHUNKS exchanges,
+ * the number of chunks is set to 0 (readSector() and writeSector() then refuse the plan).
+ *
+ * \return 0 on success, PSXLIB_ERR_BAD_PARAM if the report size is too small
+ */
+int psxlib_getChunkPlan(rnt_hdl_t hdl, struct psxlib_chunk_plan *plan)
+{
+	int todo, i;
+
+	memset(plan, 0, sizeof(struct psxlib_chunk_plan));
+
+	plan->report_size = hdl->report_size;
+	plan->max_rx = hdl->report_size - PSXLIB_RX_OVERHEAD;
+	plan->max_tx = hdl->report_size - PSXLIB_TX_OVERHEAD;
+	if (plan->max_rx > 255)
+		plan->max_rx = 255;
+	if (plan->max_tx > 255)
+		plan->max_tx = 255;
+
+	if (plan->max_rx <= 0 || plan->max_tx <= 0)
+		return PSXLIB_ERR_BAD_PARAM;
+
+	for (todo = PSXLIB_READ_TRANSACTION_SIZE, i = 0; todo > 0 && i < PSXLIB_MAX_CHUNKS; i++) {
+		plan->read_chunks[i] = todo > plan->max_rx ? plan->max_rx : todo;
+		todo -= plan->read_chunks[i];
+	}
+	// Only usable if the whole transaction fits
+	plan->n_read_chunks = todo ? 0 : i;
+
+	// Writes receive as many bytes as they send
+	for (todo = PSXLIB_WRITE_TRANSACTION_SIZE, i = 0; todo > 0 && i < PSXLIB_MAX_CHUNKS; i++) {
+		plan->write_chunks[i] = todo > plan->max_tx ? plan->max_tx : todo;
+		todo -= plan->write_chunks[i];
+	}
+	plan->n_write_chunks = todo ? 0 : i;
+
+	if (!plan->n_read_chunks || !plan->n_write_chunks)
+		return PSXLIB_ERR_BAD_PARAM;
+
+	return 0;
+}
+
+void psxlib_printChunkPlan(const struct psxlib_chunk_plan *plan)
+{
+	int i;
+
+	if (!plan->n_read_chunks || !plan->n_write_chunks) {
+		printf("PSX chunk plan: report size %d is too small for memory card access\n", plan->report_size);
+		return;
+	}
+
+	printf("PSX chunk plan: report size %d, read %d exchange(s) [", plan->report_size, plan->n_read_chunks);
+	for (i=0; i<plan->n_read_chunks; i++) {
+		printf("%s%d", i ? " + ":"", plan->read_chunks[i]);
+	}
+	printf("], write %d exchange(s) [", plan->n_write_chunks);
+	for (i=0; i<plan->n_write_chunks; i++) {
+		printf("%s%d", i ? " + ":"", plan->write_chunks[i]);
+	}
+	printf("]\n");
+}
+
+static int writeSector(rnt_hdl_t hdl, uint8_t chn, const struct psxlib_chunk_plan *plan, uint16_t sector, const uint8_t data[128])
 {
-	uint8_t request[128+10] = {
+	uint8_t request[PSXLIB_WRITE_TRANSACTION_SIZE] = {
 		0x81, 'W', 0x00, 0x00, sector >> 8, sector & 0xff
 	};
-	uint8_t inbuf[128+10];
+	uint8_t inbuf[PSXLIB_WRITE_TRANSACTION_SIZE];
 	uint8_t flgchn;
-	int res;
+	int res, i, done = 0;
+
+	if (plan->n_write_chunks < 1 || plan->n_write_chunks > PSXLIB_MAX_CHUNKS)
+		return PSXLIB_ERR_BAD_PARAM;
 
 	memcpy(request + 6, data, 128);
 
@@ -150,36 +503,24 @@ int psxlib_writeMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, co
 
 	//printf("Out: "); printHexBuf(request, sizeof(request));
 
-	flgchn = chn | (FLG_NO_DESELECT << 4);
-	res = psxlib_exchange(hdl, flgchn, request + 0, 50, inbuf + 0, 50);
-	if (res < 0) {
-		return PSXLIB_ERR_IO_ERROR;
-	}
-	if (res != 50) {
-		printf("Incorrect length. Expected %d, received %d\n", 50, res);
-		return PSXLIB_ERR_IO_ERROR;
-	}
-
-	res = psxlib_exchange(hdl, flgchn, request + 50, 50, inbuf + 60, 50);
-	if (res < 0) {
-		return PSXLIB_ERR_IO_ERROR;
-	}
-	if (res != 50) {
-		printf("Incorrect length. Expected %d, received %d\n", 50, res);
-		return PSXLIB_ERR_IO_ERROR;
-	}
+	for (i=0; i<plan->n_write_chunks; i++) {
+		if (i == plan->n_write_chunks - 1) {
+			flgchn = chn | (FLG_POST_DELAY << 4);
+		} else {
+			flgchn = chn | (FLG_NO_DESELECT << 4);
+		}
 
-	flgchn = chn | (FLG_POST_DELAY << 4);
-	res = psxlib_exchange(hdl, flgchn, request + 50 + 50, 38, inbuf + 50 + 50, 38);
-	if (res < 0) {
-		return PSXLIB_ERR_IO_ERROR;
-	}
-	if (res != 38) {
-		printf("Incorrect length. Expected %d, received %d\n", 38, res);
-		return PSXLIB_ERR_IO_ERROR;
+		res = psxlib_exchange(hdl, flgchn, request + done, plan->write_chunks[i], inbuf + done, plan->write_chunks[i]);
+		if (res < 0) {
+			return PSXLIB_ERR_IO_ERROR;
+		}
+		if (res != plan->write_chunks[i]) {
+			printf("Incorrect length. Expected %d, received %d\n", plan->write_chunks[i], res);
+			return PSXLIB_ERR_IO_ERROR;
+		}
+		done += res;
 	}
 
-
 	//printf("In: "); printHexBuf(inbuf, sizeof(inbuf));
 
 	// Now check if it worked.
@@ -216,17 +557,52 @@ int psxlib_writeMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, co
 	return 0;
 }
 
+int psxlib_writeMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, const uint8_t data[128])
+{
+	struct psxlib_chunk_plan plan;
+
+	psxlib_getChunkPlan(hdl, &plan);
+
+	return writeSector(hdl, chn, &plan, sector, data);
+}
+
 int psxlib_readMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, uint8_t dst[128])
+{
+	struct psxlib_chunk_plan plan;
+
+	psxlib_getChunkPlan(hdl, &plan);
+
+	return readSector(hdl, chn, &plan, sector, dst);
+}
+
+/** \brief Read consecutive sectors
+ *
+ * The chunk plan is computed once and the sectors are read back to back.
+ * When u is not NULL, its progress is advanced by one per sector read (the
+ * caller starts and ends it), and PSXLIB_ERR_USER_CANCELLED is returned
+ * if the user cancels.
+ *
+ * \param dst Receives count * PSXLIB_MC_SECTOR_SIZE bytes
+ */
+int psxlib_readMemoryCardSectors(rnt_hdl_t hdl, uint8_t chn, uint16_t first, uint16_t count, uint8_t *dst, uiio *u)
+{
+	if (!dst || first + count > PSXLIB_MC_N_SECTORS)
+		return PSXLIB_ERR_BAD_PARAM;
+
+	return readSectors(hdl, chn, dst, first, count, u);
+}
+
+static int readSector(rnt_hdl_t hdl, uint8_t chn, const struct psxlib_chunk_plan *plan, uint16_t sector, uint8_t dst[128])
 {
 	uint8_t request[6] = {
 		0x81, 0x52, 0x00, 0x00,
 		sector >> 8, sector & 0xff
 	};
-	uint8_t inbuf[140];
-	int res, done;
+	uint8_t inbuf[PSXLIB_READ_TRANSACTION_SIZE];
+	int res, done, i;
 	uint16_t confirmed_sector;
 	uint8_t chk;
-	int todo, chunksize;
+	int chunksize;
 	uint8_t flgchn;
 	int txlen;
 
@@ -238,29 +614,18 @@ int psxlib_readMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, uin
 	//
 
 	// Hardware limitations (maximum USB endpoint size in micro-controller)
-	// makes it impossible to read 128 bytes in one go.
+	// makes it impossible to read 128 bytes in one go on most adapters.
 	//
-	// And due to the adapter protocol overhead, the maximum is 60. Three exchanges
-	// are therefore required.
-
+	// A total of 140 bytes must be exchanged, split according to the
+	// chunk plan. (e.g. 60 + 60 + 20 with 63 byte reports)
 
-	// A total of 140 bytes should be sent.
-	//
-	// First send 7 bytes. (the pause after this helps for the extra delay after 5C is sent.
-	// Then 60
-	// Then 60
-	// Then 13
-	//
-	//
+	if (plan->n_read_chunks < 1 || plan->n_read_chunks > PSXLIB_MAX_CHUNKS)
+		return PSXLIB_ERR_BAD_PARAM;
 
-	todo = 140;
 	done = 0;
-	do
+	for (i=0; i<plan->n_read_chunks; i++)
 	{
-		chunksize = todo;
-		if (chunksize > 60) {
-			chunksize = 60;
-		}
+		chunksize = plan->read_chunks[i];
 
 		flgchn = chn;
 
@@ -276,7 +641,7 @@ int psxlib_readMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, uin
 		}
 
 		// Last exchange?
-		if (chunksize < todo) {
+		if (i < plan->n_read_chunks - 1) {
 			// Make sure the cart stays selected until the end
 			flgchn |= FLG_NO_DESELECT<<4;
 		}
@@ -291,9 +656,7 @@ int psxlib_readMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, uin
 		}
 
 		done += chunksize;
-		todo -= chunksize;
 	}
-	while (todo > 0);
 
 	/* Now a few checks */
 
@@ -335,6 +698,76 @@ int psxlib_readMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, uin
 	return 0;
 }
 
+/* The raw format has no room for the blocks skipped by sparse reads. They
+ * are listed in a small text file next to the image (filename.skipped). */
+static void skipFilename(const char *filename, char *dst, int dstlen)
+{
+	snprintf(dst, dstlen, "%s%s", filename, PSXLIB_SKIP_FILE_SUFFIX);
+}
+
+static int writeSkipFile(const char *filename, uint16_t skipped_blocks)
+{
+	char path[1024];
+	FILE *fptr;
+
+	skipFilename(filename, path, sizeof(path));
+
+	// A full image: remove the list left by an earlier sparse dump, if any
+	if (!skipped_blocks) {
+		if (unlink(path) && errno != ENOENT) {
+			perror(path);
+			return -1;
+		}
+		return 0;
+	}
+
+	fptr = fopen(path, "w");
+	if (!fptr) {
+		perror(path);
+		return -1;
+	}
+
+	fprintf(fptr, "# Blocks not read from the card (zero-filled in the image)\n");
+	fprintf(fptr, "skipped_blocks 0x%04x\n", skipped_blocks);
+
+	if (fclose(fptr)) {
+		perror(path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int readSkipFile(const char *filename, uint16_t *skipped_blocks)
+{
+	char path[1024], line[128];
+	unsigned int mask;
+	FILE *fptr;
+	int found = 0;
+
+	*skipped_blocks = 0;
+
+	skipFilename(filename, path, sizeof(path));
+	fptr = fopen(path, "r");
+	if (!fptr) {
+		// No list: Nothing was skipped
+		return errno == ENOENT ? 0 : PSXLIB_ERR_FILE_READ_ERROR;
+	}
+
+	while (fgets(line, sizeof(line), fptr)) {
+		if (line[0] == '#')
+			continue;
+		if (1 == sscanf(line, "skipped_blocks %x", &mask) && mask <= 0xffff) {
+			*skipped_blocks = mask;
+			found = 1;
+		}
+	}
+
+	fclose(fptr);
+
+	return found ? 0 : PSXLIB_ERR_FILE_READ_ERROR;
+}
+
 int psxlib_writeMemoryCardToFile(const struct psx_memorycard *mc_data, const char *filename, int format)
 {
 	FILE *fptr;
@@ -359,6 +792,10 @@ int psxlib_writeMemoryCardToFile(const struct psx_memorycard *mc_data, const cha
 
 	fclose(fptr);
 
+	if (writeSkipFile(filename, mc_data->skipped_blocks)) {
+		return -2;
+	}
+
 	return 0;
 }
 
@@ -392,7 +829,7 @@ int psxlib_loadMemoryCardFromFile(const char *filename, int format, struct psx_m
 
 	fclose(fptr);
 
-	return 0;
+	return readSkipFile(filename, &dst_mc_data->skipped_blocks);
 }
 
 const char *psxlib_idToString(uint16_t id)
@@ -427,6 +864,13 @@ const char *psxlib_getErrorString(int code)
 		case PSXLIB_ERR_BUFFER_TOO_SMALL: return "Buffer too small";
 		case PSXLIB_ERR_FILE_FORMAT_NOT_SUPPORTED: return "File format not supported";
 		case PSXLIB_ERR_USER_CANCELLED: return "Cancelled";
+		case PSXLIB_ERR_NOT_FORMATTED: return "Memory card not formatted";
+		case PSXLIB_ERR_CARD_FULL: return "Not enough free blocks";
+		case PSXLIB_ERR_NOT_LOADED: return "Required data not read from card";
+		case PSXLIB_ERR_NO_SUCH_SAVE: return "No save starts at this block";
+		case PSXLIB_ERR_SAVE_EXISTS: return "A save with the same name already exists";
+		case PSXLIB_ERR_FILE_WRITE_ERROR: return "Error writing file";
+		case PSXLIB_ERR_FILE_READ_ERROR: return "Error reading file";
 	}
 
 	return "(unknown - internal error)";
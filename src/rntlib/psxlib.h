@@ -15,6 +15,12 @@
 #define PSXLIB_ERR_FILE_FORMAT_NOT_SUPPORTED	-9
 #define PSXLIB_ERR_FILE_READ_ERROR	-10
 #define PSXLIB_ERR_USER_CANCELLED	-11
+#define PSXLIB_ERR_NOT_FORMATTED	-12
+#define PSXLIB_ERR_CARD_FULL		-13
+#define PSXLIB_ERR_NOT_LOADED		-14
+#define PSXLIB_ERR_NO_SUCH_SAVE		-15
+#define PSXLIB_ERR_SAVE_EXISTS		-16
+#define PSXLIB_ERR_FILE_WRITE_ERROR	-17
 
 #define PSXLIB_ERR_BUFFER_TOO_SMALL	-100
 #define PSXLIB_ERR_BAD_PARAM		-101
@@ -24,13 +30,55 @@
 #define PSXLIB_MC_SECTOR_SIZE	0x80
 #define PSXLIB_MC_N_BLOCKS		(PSXLIB_MC_TOTAL_SIZE / PSXLIB_MC_BLOCK_SIZE)
 #define PSXLIB_MC_N_SECTORS		(PSXLIB_MC_TOTAL_SIZE / PSXLIB_MC_SECTOR_SIZE)
+#define PSXLIB_MC_SECTORS_PER_BLOCK	(PSXLIB_MC_BLOCK_SIZE / PSXLIB_MC_SECTOR_SIZE)
 
 struct psx_memorycard {
 	uint8_t contents[PSXLIB_MC_TOTAL_SIZE];
+	// Bit n set when block n was not read from the card (sparse reads). The
+	// contents of skipped blocks are zero-filled.
+	uint16_t skipped_blocks;
 };
 
+/* Directory frames (sectors 1 to 15 of block 0) */
+#define PSXLIB_MC_DIR_FIRST_SECTOR	1
+#define PSXLIB_MC_N_DIR_FRAMES		15
+
+#define PSXLIB_MC_BLOCK_FREE		0xA0
+#define PSXLIB_MC_BLOCK_FIRST		0x51
+#define PSXLIB_MC_BLOCK_MIDDLE		0x52
+#define PSXLIB_MC_BLOCK_LAST		0x53
+#define PSXLIB_MC_BLOCK_DEL_FIRST	0xA1
+#define PSXLIB_MC_BLOCK_DEL_MIDDLE	0xA2
+#define PSXLIB_MC_BLOCK_DEL_LAST	0xA3
+
+#define PSXLIB_MC_NO_NEXT_BLOCK		0xFFFF
+
 int psxlib_exchange(rnt_hdl_t hdl, unsigned char channel, unsigned char *tx, unsigned char tx_len, unsigned char *rx, unsigned char max_rx);
 
+/* Bytes exchanged with the card for a sector read or write */
+#define PSXLIB_READ_TRANSACTION_SIZE	140
+#define PSXLIB_WRITE_TRANSACTION_SIZE	138
+
+/* Report bytes not usable for card data in RQ_PSX_RAW exchanges. Values
+ * include the margin used since the first versions (60 and 50 bytes per
+ * exchange with 63 byte reports) */
+#define PSXLIB_RX_OVERHEAD	3
+#define PSXLIB_TX_OVERHEAD	13
+
+#define PSXLIB_MAX_CHUNKS	16
+
+struct psxlib_chunk_plan {
+	int report_size;
+	int max_rx, max_tx;
+	int n_read_chunks;
+	int read_chunks[PSXLIB_MAX_CHUNKS];
+	int n_write_chunks;
+	int write_chunks[PSXLIB_MAX_CHUNKS];
+};
+
+int psxlib_getChunkPlan(rnt_hdl_t hdl, struct psxlib_chunk_plan *plan);
+void psxlib_printChunkPlan(const struct psxlib_chunk_plan *plan);
+
 #define PSXLIB_PORT_1 0
 #define PSXLIB_PORT_2 1
 #define PSXLIB_PORT_3 2
@@ -42,12 +90,32 @@ int psxlib_unlockRumble(rnt_hdl_t hdl, uint8_t chn, uint8_t port);
 int psxlib_enableAnalog(rnt_hdl_t hdl, uint8_t chn, uint8_t port, uint8_t enable);
 
 int psxlib_readMemoryCard(rnt_hdl_t hdl, uint8_t chn, struct psx_memorycard *dst, uiio *u);
+
+#define PSXLIB_READ_ALL		0 // All 1024 sectors
+#define PSXLIB_READ_USED	1 // Block 0 and blocks in use by a save
+#define PSXLIB_READ_SAVE	2 // Block 0 and the blocks of the save starting at first_block
+int psxlib_readMemoryCardEx(rnt_hdl_t hdl, uint8_t chn, struct psx_memorycard *dst, int mode, int first_block, uiio *u);
+int psxlib_getUsedBlocks(const struct psx_memorycard *mc, uint16_t *used_mask);
+int psxlib_getSaveBlocks(const struct psx_memorycard *mc, int first_block, uint16_t *save_mask);
 int psxlib_readMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, uint8_t dst[128]);
+int psxlib_readMemoryCardSectors(rnt_hdl_t hdl, uint8_t chn, uint16_t first, uint16_t count, uint8_t *dst, uiio *u);
 int psxlib_writeMemoryCard(rnt_hdl_t hdl, uint8_t chn, const struct psx_memorycard *src, uiio *u);
+
+#define PSXLIB_WRITE_ALL		0 // Write all sectors
+#define PSXLIB_WRITE_COMPARE	1 // Read each sector first, write only if different
+
+struct psxlib_write_stats {
+	int written;
+	int skipped;
+};
+
+int psxlib_writeMemoryCardEx(rnt_hdl_t hdl, uint8_t chn, const struct psx_memorycard *src, const struct psx_memorycard *known, int mode, struct psxlib_write_stats *stats, uiio *u);
 int psxlib_writeMemoryCardSector(rnt_hdl_t hdl, uint8_t chn, uint16_t sector, const uint8_t data[128]);
 
 #define PSXLIB_FILE_FORMAT_AUTO	-1
 #define PSXLIB_FILE_FORMAT_RAW	0 // 128kB headerless image
+// Sparse images (skipped_blocks != 0) come with a list of the skipped blocks, in filename + this suffix
+#define PSXLIB_SKIP_FILE_SUFFIX	".skipped"
 int psxlib_loadMemoryCardFromFile(const char *filename, int format, struct psx_memorycard *dst_mc_data);
 int psxlib_writeMemoryCardToFile(const struct psx_memorycard *mc_data, const char *filename, int format);
 
@@ -0,0 +1,847 @@
+/*	gc_n64_usb : Gamecube or N64 controller to USB adapter firmware
+	Copyright (C) 2007-2024  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "psxmc_fs.h"
+
+/* PSX memory card filesystem
+ *
+ * Block 0 holds the header (sector 0) and one directory frame per data block
+ * (sectors 1 to 15). Saves occupy one or more data blocks, chained by the
+ * 'next block' field of the directory frames. The first sector of a save is
+ * the title frame ("SC" magic, Shift-JIS title, icon palette), followed by
+ * one to three icon frames.
+ *
+ * Directory frame layout:
+ *   0x00     Block state (PSXLIB_MC_BLOCK_*)
+ *   0x04-07  Save size in bytes (little endian, first block only)
+ *   0x08-09  Next block, 0-based (little endian, 0xFFFF for none)
+ *   0x0A-1E  Filename (ASCII, zero terminated)
+ *   0x7F     XOR of bytes 0x00-0x7E
+ */
+
+#define SECTOR_BIT(map, s)		((map)[(s) >> 3] & (1 << ((s) & 7)))
+#define SET_SECTOR_BIT(map, s)	((map)[(s) >> 3] |= (1 << ((s) & 7)))
+#define CLR_SECTOR_BIT(map, s)	((map)[(s) >> 3] &= ~(1 << ((s) & 7)))
+
+#define FIRST_SECTOR_OF(block)	((block) * PSXLIB_MC_SECTORS_PER_BLOCK)
+#define DIR_SECTOR_OF(block)	(PSXLIB_MC_DIR_FIRST_SECTOR + (block) - 1)
+#define N_DIR_SECTORS			(PSXLIB_MC_DIR_FIRST_SECTOR + PSXLIB_MC_N_DIR_FRAMES)
+
+#define FRAME_OFS_STATE		0x00
+#define FRAME_OFS_SIZE		0x04
+#define FRAME_OFS_NEXT		0x08
+#define FRAME_OFS_FILENAME	0x0A
+#define FRAME_OFS_CHECKSUM	0x7F
+
+#define TITLE_OFS_ICONFLAG	0x02
+#define TITLE_OFS_TITLE		0x04
+#define TITLE_OFS_PALETTE	0x60
+
+static uint8_t *sectorPtr(struct psxmc_fs *fs, int sector)
+{
+	return fs->card.contents + sector * PSXLIB_MC_SECTOR_SIZE;
+}
+
+static const uint8_t *sectorPtrConst(const struct psxmc_fs *fs, int sector)
+{
+	return fs->card.contents + sector * PSXLIB_MC_SECTOR_SIZE;
+}
+
+static const uint8_t *dirFrame(const struct psxmc_fs *fs, int block)
+{
+	return sectorPtrConst(fs, DIR_SECTOR_OF(block));
+}
+
+static uint8_t frameChecksum(const uint8_t *frame)
+{
+	uint8_t r = 0;
+	int i;
+
+	for (i=0; i<FRAME_OFS_CHECKSUM; i++) {
+		r ^= frame[i];
+	}
+
+	return r;
+}
+
+static int frameValid(const uint8_t *frame)
+{
+	return frameChecksum(frame) == frame[FRAME_OFS_CHECKSUM];
+}
+
+static int frameIsFree(const uint8_t *frame)
+{
+	if (!frameValid(frame))
+		return 0;
+
+	switch (frame[FRAME_OFS_STATE])
+	{
+		case PSXLIB_MC_BLOCK_FREE:
+		case PSXLIB_MC_BLOCK_DEL_FIRST:
+		case PSXLIB_MC_BLOCK_DEL_MIDDLE:
+		case PSXLIB_MC_BLOCK_DEL_LAST:
+			return 1;
+	}
+
+	return 0;
+}
+
+static void frameSetNext(uint8_t *frame, int next_block)
+{
+	uint16_t next = next_block ? next_block - 1 : PSXLIB_MC_NO_NEXT_BLOCK;
+
+	frame[FRAME_OFS_NEXT] = next;
+	frame[FRAME_OFS_NEXT + 1] = next >> 8;
+}
+
+static void makeFrame(uint8_t *frame, uint8_t state, int next_block)
+{
+	memset(frame, 0, PSXLIB_MC_SECTOR_SIZE);
+	frame[FRAME_OFS_STATE] = state;
+	frameSetNext(frame, next_block);
+}
+
+static int allLoaded(const struct psxmc_fs *fs, int first_sector, int count)
+{
+	int s;
+
+	for (s = first_sector; s < first_sector + count; s++) {
+		if (!SECTOR_BIT(fs->loaded, s))
+			return 0;
+	}
+
+	return 1;
+}
+
+static int checkDirectory(const struct psxmc_fs *fs)
+{
+	if (!allLoaded(fs, 0, N_DIR_SECTORS))
+		return PSXLIB_ERR_NOT_LOADED;
+
+	if (fs->card.contents[0] != 'M' || fs->card.contents[1] != 'C')
+		return PSXLIB_ERR_NOT_FORMATTED;
+
+	return 0;
+}
+
+/* Replace a sector in the image, marking it dirty if it changed
+ * (or if its previous contents are unknown) */
+static void putSector(struct psxmc_fs *fs, int sector, const uint8_t *data)
+{
+	uint8_t *dst = sectorPtr(fs, sector);
+
+	if (SECTOR_BIT(fs->loaded, sector)) {
+		if (0 == memcmp(dst, data, PSXLIB_MC_SECTOR_SIZE))
+			return;
+	}
+
+	memmove(dst, data, PSXLIB_MC_SECTOR_SIZE);
+	SET_SECTOR_BIT(fs->loaded, sector);
+	SET_SECTOR_BIT(fs->dirty, sector);
+}
+
+static void putFrame(struct psxmc_fs *fs, int block, uint8_t *frame)
+{
+	frame[FRAME_OFS_CHECKSUM] = frameChecksum(frame);
+	putSector(fs, DIR_SECTOR_OF(block), frame);
+}
+
+/** \brief Initialize an empty image (nothing loaded) */
+void psxmc_init(struct psxmc_fs *fs)
+{
+	memset(fs, 0, sizeof(struct psxmc_fs));
+}
+
+/** \brief Initialize from a complete memory card image
+ *
+ * Blocks flagged in mc->skipped_blocks are not considered loaded.
+ */
+void psxmc_initFromImage(struct psxmc_fs *fs, const struct psx_memorycard *mc)
+{
+	int s;
+
+	psxmc_init(fs);
+	memcpy(&fs->card, mc, sizeof(struct psx_memorycard));
+
+	for (s = 0; s < PSXLIB_MC_N_SECTORS; s++) {
+		if (!(mc->skipped_blocks & (1 << (s / PSXLIB_MC_SECTORS_PER_BLOCK)))) {
+			SET_SECTOR_BIT(fs->loaded, s);
+		}
+	}
+}
+
+/* Consecutive sectors are read in runs, with one chunk plan per run */
+static int loadSectors(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, const uint8_t *wanted, const char *caption, uiio *u)
+{
+	int s, first, res, count = 0;
+
+	for (s = 0; s < PSXLIB_MC_N_SECTORS; s++) {
+		if (SECTOR_BIT(wanted, s) && !SECTOR_BIT(fs->loaded, s))
+			count++;
+	}
+
+	if (!count)
+		return 0;
+
+	u = getUIIO(u);
+
+	u->progress_type = PROGRESS_TYPE_ADDRESS;
+	u->caption = caption;
+	uiio_progressStart(u, count, PSXLIB_MC_SECTOR_SIZE);
+
+	for (s = 0; s < PSXLIB_MC_N_SECTORS; s++) {
+		if (!SECTOR_BIT(wanted, s) || SECTOR_BIT(fs->loaded, s))
+			continue;
+
+		first = s;
+		while (s + 1 < PSXLIB_MC_N_SECTORS && SECTOR_BIT(wanted, s + 1) && !SECTOR_BIT(fs->loaded, s + 1))
+			s++;
+
+		res = psxlib_readMemoryCardSectors(hdl, chn, first, s - first + 1, sectorPtr(fs, first), u);
+		if (res) {
+			uiio_progressEnd(u, res == PSXLIB_ERR_USER_CANCELLED ? "Aborted" : "Error");
+			return res;
+		}
+		for (; first <= s; first++) {
+			SET_SECTOR_BIT(fs->loaded, first);
+		}
+	}
+
+	uiio_progressEnd(u, "Done");
+
+	return 0;
+}
+
+/** \brief Read the header and directory frames from the card (16 sectors) */
+int psxmc_loadDirectory(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uiio *u)
+{
+	uint8_t wanted[PSXLIB_MC_N_SECTORS / 8] = { };
+	int s;
+
+	for (s = 0; s < N_DIR_SECTORS; s++) {
+		SET_SECTOR_BIT(wanted, s);
+	}
+
+	return loadSectors(hdl, chn, fs, wanted, "Reading memory card directory...", u);
+}
+
+/** \brief Read the title and icon frames of every save (4 sectors per save) */
+int psxmc_loadTitles(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uiio *u)
+{
+	uint8_t wanted[PSXLIB_MC_N_SECTORS / 8] = { };
+	const uint8_t *frame;
+	int block, s, res;
+
+	res = psxmc_loadDirectory(hdl, chn, fs, u);
+	if (res)
+		return res;
+
+	res = checkDirectory(fs);
+	if (res)
+		return res;
+
+	for (block = 1; block <= PSXLIB_MC_N_DIR_FRAMES; block++) {
+		frame = dirFrame(fs, block);
+		if (frameValid(frame) && frame[FRAME_OFS_STATE] == PSXLIB_MC_BLOCK_FIRST) {
+			for (s = 0; s < 1 + PSXMC_MAX_ICON_FRAMES; s++) {
+				SET_SECTOR_BIT(wanted, FIRST_SECTOR_OF(block) + s);
+			}
+		}
+	}
+
+	return loadSectors(hdl, chn, fs, wanted, "Reading save titles...", u);
+}
+
+/** \brief Read all sectors of the blocks in block_mask */
+int psxmc_loadBlocks(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uint16_t block_mask, uiio *u)
+{
+	uint8_t wanted[PSXLIB_MC_N_SECTORS / 8] = { };
+	int s;
+
+	for (s = 0; s < PSXLIB_MC_N_SECTORS; s++) {
+		if (block_mask & (1 << (s / PSXLIB_MC_SECTORS_PER_BLOCK))) {
+			SET_SECTOR_BIT(wanted, s);
+		}
+	}
+
+	return loadSectors(hdl, chn, fs, wanted, "Reading memory card blocks...", u);
+}
+
+/** \brief Read the directory and all blocks in use */
+int psxmc_loadUsedBlocks(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uiio *u)
+{
+	uint16_t used;
+	int res;
+
+	res = psxmc_loadDirectory(hdl, chn, fs, u);
+	if (res)
+		return res;
+
+	res = checkDirectory(fs);
+	if (res)
+		return res;
+
+	res = psxlib_getUsedBlocks(&fs->card, &used);
+	if (res)
+		return res;
+
+	return psxmc_loadBlocks(hdl, chn, fs, used, u);
+}
+
+int psxmc_countDirty(const struct psxmc_fs *fs)
+{
+	int s, count = 0;
+
+	for (s = 0; s < PSXLIB_MC_N_SECTORS; s++) {
+		if (SECTOR_BIT(fs->dirty, s))
+			count++;
+	}
+
+	return count;
+}
+
+/** \brief Write modified sectors to the card
+ *
+ * Data blocks are written before block 0, so if the operation is interrupted
+ * the directory still describes the previous state of the card.
+ */
+int psxmc_commit(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uiio *u)
+{
+	int pass, s, res, n_dirty;
+
+	u = getUIIO(u);
+
+	n_dirty = psxmc_countDirty(fs);
+	if (!n_dirty)
+		return 0;
+	u->progress_type = PROGRESS_TYPE_ADDRESS;
+	u->caption = "Writing to memory card...";
+	uiio_progressStart(u, n_dirty, PSXLIB_MC_SECTOR_SIZE);
+
+	for (pass = 0; pass < 2; pass++) {
+		for (s = 0; s < PSXLIB_MC_N_SECTORS; s++) {
+			// Pass 0: data blocks, pass 1: block 0
+			if ((s < PSXLIB_MC_SECTORS_PER_BLOCK) != pass)
+				continue;
+			if (!SECTOR_BIT(fs->dirty, s))
+				continue;
+
+			res = psxlib_writeMemoryCardSector(hdl, chn, s, sectorPtr(fs, s));
+			if (res) {
+				uiio_progressEnd(u, "Error");
+				return res;
+			}
+			CLR_SECTOR_BIT(fs->dirty, s);
+
+			if (uiio_progressUpdate(u, u->cur_progress + 1)) {
+				res = u->ask(UIIO_NOYES, "If you interrupt the transfer, the save being modified may be corrupted.\n\nReally stop?");
+				if (res == UIIO_YES) {
+					uiio_progressEnd(u, "Aborted");
+					return PSXLIB_ERR_USER_CANCELLED;
+				}
+			}
+		}
+	}
+
+	uiio_progressEnd(u, "Done");
+
+	return 0;
+}
+
+/* Convert a Shift-JIS title to ASCII. Characters without an ASCII
+ * equivalent are replaced by '?'. */
+static void sjisToAscii(const uint8_t *src, int len, char *dst)
+{
+	static const struct { uint16_t sjis; char c; } punct[] = {
+		{ 0x8140, ' ' }, { 0x8143, ',' }, { 0x8144, '.' }, { 0x8146, ':' },
+		{ 0x8147, ';' }, { 0x8148, '?' }, { 0x8149, '!' }, { 0x8151, '_' },
+		{ 0x815B, '-' }, { 0x815E, '/' }, { 0x8166, '\'' }, { 0x8168, '"' },
+		{ 0x8169, '(' }, { 0x816A, ')' }, { 0x816D, '[' }, { 0x816E, ']' },
+		{ 0x817B, '+' }, { 0x817C, '-' }, { 0x8181, '=' }, { 0x8183, '<' },
+		{ 0x8184, '>' }, { 0x8193, '%' }, { 0x8194, '#' }, { 0x8195, '&' },
+		{ 0x8196, '*' }, { 0x8197, '@' },
+		{ }
+	};
+	int i = 0, j;
+	uint16_t c;
+
+	while (i < len && src[i]) {
+		if (src[i] < 0x80) {
+			*dst++ = src[i++];
+			continue;
+		}
+
+		// Single byte half-width katakana
+		if (src[i] >= 0xA1 && src[i] <= 0xDF) {
+			*dst++ = '?';
+			i++;
+			continue;
+		}
+
+		if (i + 1 >= len)
+			break;
+
+		c = src[i] << 8 | src[i+1];
+		i += 2;
+
+		if (c >= 0x824F && c <= 0x8258) {
+			*dst++ = '0' + c - 0x824F;
+		} else if (c >= 0x8260 && c <= 0x8279) {
+			*dst++ = 'A' + c - 0x8260;
+		} else if (c >= 0x8281 && c <= 0x829A) {
+			*dst++ = 'a' + c - 0x8281;
+		} else {
+			for (j=0; punct[j].sjis; j++) {
+				if (punct[j].sjis == c)
+					break;
+			}
+			*dst++ = punct[j].sjis ? punct[j].c : '?';
+		}
+	}
+
+	*dst = 0;
+}
+
+/** \brief Get information about the save starting at first_block
+ *
+ * \return 0 on success, PSXLIB_ERR_NO_SUCH_SAVE if no save starts at this block.
+ */
+int psxmc_getSave(const struct psxmc_fs *fs, int first_block, struct psxmc_save *save)
+{
+	const uint8_t *frame, *title;
+	uint16_t mask;
+	int block, res;
+
+	res = checkDirectory(fs);
+	if (res)
+		return res;
+
+	if (first_block < 1 || first_block > PSXLIB_MC_N_DIR_FRAMES)
+		return PSXLIB_ERR_BAD_PARAM;
+
+	// Validates the chain
+	res = psxlib_getSaveBlocks(&fs->card, first_block, &mask);
+	if (res == PSXLIB_ERR_INVALID_DATA) {
+		return PSXLIB_ERR_NO_SUCH_SAVE;
+	}
+	if (res)
+		return res;
+
+	memset(save, 0, sizeof(struct psxmc_save));
+	save->first_block = first_block;
+
+	frame = dirFrame(fs, first_block);
+	save->size = frame[FRAME_OFS_SIZE] | frame[FRAME_OFS_SIZE+1] << 8 |
+				frame[FRAME_OFS_SIZE+2] << 16 | frame[FRAME_OFS_SIZE+3] << 24;
+	memcpy(save->filename, frame + FRAME_OFS_FILENAME, PSXMC_FILENAME_MAXCHARS);
+	save->filename[PSXMC_FILENAME_MAXCHARS] = 0;
+
+	block = first_block;
+	while (1) {
+		uint16_t next;
+
+		save->blocks[save->n_blocks++] = block;
+
+		frame = dirFrame(fs, block);
+		next = frame[FRAME_OFS_NEXT] | frame[FRAME_OFS_NEXT+1] << 8;
+		if (next == PSXLIB_MC_NO_NEXT_BLOCK || frame[FRAME_OFS_STATE] == PSXLIB_MC_BLOCK_LAST)
+			break;
+		block = next + 1;
+	}
+
+	if (SECTOR_BIT(fs->loaded, FIRST_SECTOR_OF(first_block))) {
+		title = sectorPtrConst(fs, FIRST_SECTOR_OF(first_block));
+		if (title[0] == 'S' && title[1] == 'C') {
+			save->has_title = 1;
+			sjisToAscii(title + TITLE_OFS_TITLE, PSXMC_TITLE_MAXCHARS * 2, save->title);
+			switch (title[TITLE_OFS_ICONFLAG])
+			{
+				case 0x11: save->icon_frames = 1; break;
+				case 0x12: save->icon_frames = 2; break;
+				case 0x13: save->icon_frames = 3; break;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/** \brief List the saves on the card (in directory order)
+ *
+ * \return The number of saves, or a negative error code
+ */
+int psxmc_listSaves(const struct psxmc_fs *fs, struct psxmc_save *saves, int max_saves)
+{
+	const uint8_t *frame;
+	int block, res, n = 0;
+
+	res = checkDirectory(fs);
+	if (res)
+		return res;
+
+	for (block = 1; block <= PSXLIB_MC_N_DIR_FRAMES && n < max_saves; block++) {
+		frame = dirFrame(fs, block);
+		if (!frameValid(frame) || frame[FRAME_OFS_STATE] != PSXLIB_MC_BLOCK_FIRST)
+			continue;
+
+		res = psxmc_getSave(fs, block, &saves[n]);
+		if (res == PSXLIB_ERR_NO_SUCH_SAVE)
+			continue; // Broken chain
+		if (res)
+			return res;
+		n++;
+	}
+
+	return n;
+}
+
+int psxmc_getFreeBlocks(const struct psxmc_fs *fs)
+{
+	int block, res, n = 0;
+
+	res = checkDirectory(fs);
+	if (res)
+		return res;
+
+	for (block = 1; block <= PSXLIB_MC_N_DIR_FRAMES; block++) {
+		if (frameIsFree(dirFrame(fs, block)))
+			n++;
+	}
+
+	return n;
+}
+
+/** \brief Decode one of the icon frames of a save to RGBA (0xRRGGBBAA) pixels */
+int psxmc_getIcon(const struct psxmc_fs *fs, const struct psxmc_save *save, int frame, uint32_t rgba[PSXMC_ICON_WIDTH * PSXMC_ICON_HEIGHT])
+{
+	const uint8_t *title, *icon;
+	uint32_t palette[16];
+	int first, i;
+
+	if (frame < 0 || frame >= save->icon_frames)
+		return PSXLIB_ERR_BAD_PARAM;
+
+	first = FIRST_SECTOR_OF(save->first_block);
+	if (!allLoaded(fs, first, 1 + save->icon_frames))
+		return PSXLIB_ERR_NOT_LOADED;
+
+	title = sectorPtrConst(fs, first);
+	icon = sectorPtrConst(fs, first + 1 + frame);
+
+	for (i=0; i<16; i++) {
+		uint16_t c = title[TITLE_OFS_PALETTE + i*2] | title[TITLE_OFS_PALETTE + i*2 + 1] << 8;
+		uint8_t r = c & 0x1f, g = (c >> 5) & 0x1f, b = (c >> 10) & 0x1f;
+
+		palette[i] = ((r << 3 | r >> 2) << 24) | ((g << 3 | g >> 2) << 16) | ((b << 3 | b >> 2) << 8);
+		// Black (0x0000) is transparent
+		if (c) {
+			palette[i] |= 0xff;
+		}
+	}
+
+	// 4 bits per pixel, left pixel in the low nibble
+	for (i=0; i<PSXMC_ICON_WIDTH * PSXMC_ICON_HEIGHT / 2; i++) {
+		rgba[i*2] = palette[icon[i] & 0x0f];
+		rgba[i*2+1] = palette[icon[i] >> 4];
+	}
+
+	return 0;
+}
+
+/** \brief Export a save to a single-save file (.mcs format)
+ *
+ * The file contains a copy of the directory frame followed by the data blocks.
+ */
+int psxmc_exportSave(const struct psxmc_fs *fs, int first_block, const char *filename)
+{
+	struct psxmc_save save;
+	FILE *fptr;
+	int i, res;
+
+	res = psxmc_getSave(fs, first_block, &save);
+	if (res)
+		return res;
+
+	for (i=0; i<save.n_blocks; i++) {
+		if (!allLoaded(fs, FIRST_SECTOR_OF(save.blocks[i]), PSXLIB_MC_SECTORS_PER_BLOCK))
+			return PSXLIB_ERR_NOT_LOADED;
+	}
+
+	fptr = fopen(filename, "wb");
+	if (!fptr) {
+		return PSXLIB_ERR_FILE_NOT_FOUND;
+	}
+
+	if (1 != fwrite(dirFrame(fs, first_block), PSXMC_MCS_HEADER_SIZE, 1, fptr)) {
+		fclose(fptr);
+		return PSXLIB_ERR_FILE_WRITE_ERROR;
+	}
+
+	for (i=0; i<save.n_blocks; i++) {
+		if (1 != fwrite(sectorPtrConst(fs, FIRST_SECTOR_OF(save.blocks[i])), PSXLIB_MC_BLOCK_SIZE, 1, fptr)) {
+			fclose(fptr);
+			return PSXLIB_ERR_FILE_WRITE_ERROR;
+		}
+	}
+
+	fclose(fptr);
+
+	return 0;
+}
+
+/** \brief Import a single-save file (.mcs format) into free blocks
+ *
+ * Only the directory frames and data sectors of the new save become dirty.
+ *
+ * \param first_block Receives the first block of the new save (may be NULL)
+ */
+int psxmc_importSave(struct psxmc_fs *fs, const char *filename, int *first_block)
+{
+	struct psxmc_save saves[PSXLIB_MC_N_DIR_FRAMES];
+	uint8_t free_blocks[PSXLIB_MC_N_DIR_FRAMES];
+	uint8_t frame[PSXLIB_MC_SECTOR_SIZE];
+	uint8_t *data = NULL;
+	FILE *fptr;
+	long filesize;
+	int n_blocks, n_free = 0, n_saves;
+	int block, i, s, res;
+
+	res = checkDirectory(fs);
+	if (res)
+		return res;
+
+	fptr = fopen(filename, "rb");
+	if (!fptr) {
+		return PSXLIB_ERR_FILE_NOT_FOUND;
+	}
+
+	fseek(fptr, 0, SEEK_END);
+	filesize = ftell(fptr);
+	fseek(fptr, 0, SEEK_SET);
+
+	n_blocks = (filesize - PSXMC_MCS_HEADER_SIZE) / PSXLIB_MC_BLOCK_SIZE;
+	if (filesize != PSXMC_MCS_HEADER_SIZE + n_blocks * PSXLIB_MC_BLOCK_SIZE ||
+		n_blocks < 1 || n_blocks > PSXLIB_MC_N_DIR_FRAMES)
+	{
+		fclose(fptr);
+		return PSXLIB_ERR_FILE_FORMAT_NOT_SUPPORTED;
+	}
+
+	data = malloc(filesize);
+	if (!data) {
+		fclose(fptr);
+		return PSXLIB_ERR_UNKNOWN;
+	}
+
+	if (1 != fread(data, filesize, 1, fptr)) {
+		res = PSXLIB_ERR_FILE_READ_ERROR;
+		goto done;
+	}
+
+	if (data[FRAME_OFS_STATE] != PSXLIB_MC_BLOCK_FIRST) {
+		res = PSXLIB_ERR_FILE_FORMAT_NOT_SUPPORTED;
+		goto done;
+	}
+
+	// The BIOS does not allow two saves with the same filename
+	n_saves = psxmc_listSaves(fs, saves, PSXLIB_MC_N_DIR_FRAMES);
+	for (i=0; i<n_saves; i++) {
+		if (0 == strncmp(saves[i].filename, (char*)data + FRAME_OFS_FILENAME, PSXMC_FILENAME_MAXCHARS)) {
+			res = PSXLIB_ERR_SAVE_EXISTS;
+			goto done;
+		}
+	}
+
+	for (block = 1; block <= PSXLIB_MC_N_DIR_FRAMES && n_free < n_blocks; block++) {
+		if (frameIsFree(dirFrame(fs, block))) {
+			free_blocks[n_free++] = block;
+		}
+	}
+	if (n_free < n_blocks) {
+		res = PSXLIB_ERR_CARD_FULL;
+		goto done;
+	}
+
+	for (i=0; i<n_blocks; i++) {
+		block = free_blocks[i];
+
+		for (s = 0; s < PSXLIB_MC_SECTORS_PER_BLOCK; s++) {
+			putSector(fs, FIRST_SECTOR_OF(block) + s,
+					data + PSXMC_MCS_HEADER_SIZE + i * PSXLIB_MC_BLOCK_SIZE + s * PSXLIB_MC_SECTOR_SIZE);
+		}
+
+		if (i == 0) {
+			memcpy(frame, data, PSXLIB_MC_SECTOR_SIZE);
+			if (!(frame[FRAME_OFS_SIZE] | frame[FRAME_OFS_SIZE+1] | frame[FRAME_OFS_SIZE+2] | frame[FRAME_OFS_SIZE+3])) {
+				uint32_t size = n_blocks * PSXLIB_MC_BLOCK_SIZE;
+				frame[FRAME_OFS_SIZE] = size;
+				frame[FRAME_OFS_SIZE+1] = size >> 8;
+				frame[FRAME_OFS_SIZE+2] = size >> 16;
+				frame[FRAME_OFS_SIZE+3] = size >> 24;
+			}
+			frameSetNext(frame, i + 1 < n_blocks ? free_blocks[i+1] : 0);
+		} else {
+			makeFrame(frame, i + 1 < n_blocks ? PSXLIB_MC_BLOCK_MIDDLE : PSXLIB_MC_BLOCK_LAST,
+					i + 1 < n_blocks ? free_blocks[i+1] : 0);
+		}
+		putFrame(fs, block, frame);
+	}
+
+	if (first_block) {
+		*first_block = free_blocks[0];
+	}
+
+	res = 0;
+
+done:
+	fclose(fptr);
+	free(data);
+
+	return res;
+}
+
+/** \brief Delete a save
+ *
+ * Like the PSX BIOS, this only marks the directory frames as deleted.
+ */
+int psxmc_deleteSave(struct psxmc_fs *fs, int first_block)
+{
+	struct psxmc_save save;
+	uint8_t frame[PSXLIB_MC_SECTOR_SIZE];
+	int i, res;
+
+	res = psxmc_getSave(fs, first_block, &save);
+	if (res)
+		return res;
+
+	for (i=0; i<save.n_blocks; i++) {
+		memcpy(frame, dirFrame(fs, save.blocks[i]), PSXLIB_MC_SECTOR_SIZE);
+		// 0x51-0x53 become 0xA1-0xA3
+		frame[FRAME_OFS_STATE] = frame[FRAME_OFS_STATE] - PSXLIB_MC_BLOCK_FIRST + PSXLIB_MC_BLOCK_DEL_FIRST;
+		putFrame(fs, save.blocks[i], frame);
+	}
+
+	return 0;
+}
+
+/* First block of the lowest run of n consecutive free blocks, or 0 if there is none */
+static int findFreeRun(const struct psxmc_fs *fs, int n)
+{
+	int block, len = 0;
+
+	for (block = 1; block <= PSXLIB_MC_N_DIR_FRAMES; block++) {
+		len = frameIsFree(dirFrame(fs, block)) ? len + 1 : 0;
+		if (len == n)
+			return block - n + 1;
+	}
+
+	return 0;
+}
+
+/* Copy a save to the blocks starting at dst_block. The new directory frames
+ * are ascending, so the new chain only becomes valid once its last frame is
+ * written. */
+static void copySave(struct psxmc_fs *fs, const struct psxmc_save *save, int dst_block)
+{
+	uint8_t frame[PSXLIB_MC_SECTOR_SIZE];
+	int b, s;
+
+	for (b=0; b<save->n_blocks; b++) {
+		for (s = 0; s < PSXLIB_MC_SECTORS_PER_BLOCK; s++) {
+			putSector(fs, FIRST_SECTOR_OF(dst_block + b) + s, sectorPtrConst(fs, FIRST_SECTOR_OF(save->blocks[b]) + s));
+		}
+	}
+
+	for (b=0; b<save->n_blocks; b++) {
+		memcpy(frame, dirFrame(fs, save->blocks[b]), PSXLIB_MC_SECTOR_SIZE);
+		frameSetNext(frame, b + 1 < save->n_blocks ? dst_block + b + 1 : 0);
+		putFrame(fs, dst_block + b, frame);
+	}
+}
+
+/** \brief Move saves to contiguous blocks, as low as possible
+ *
+ * Loads the directory and the blocks in use, then writes to the card as it
+ * goes. Saves are only moved to blocks which are free on the card, and each
+ * move takes two commits: the copy (data, then its directory frames), then
+ * the release of the old blocks. If interrupted, every save is still on the
+ * card, but the one being moved may be there twice.
+ *
+ * Frames which are neither free nor part of a valid save (broken chains,
+ * bad checksums) are left untouched. Deleted saves are not recoverable once
+ * their blocks are reused. As a save cannot be moved over its own blocks,
+ * some free blocks may remain between saves.
+ *
+ * \return The number of saves moved, or a negative error code
+ */
+int psxmc_defragment(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uiio *u)
+{
+	struct psxmc_save saves[PSXLIB_MC_N_DIR_FRAMES];
+	uint8_t frame[PSXLIB_MC_SECTOR_SIZE];
+	int n_saves, i, b, dst, contiguous, res, moved = 0;
+
+	res = psxmc_loadUsedBlocks(hdl, chn, fs, u);
+	if (res)
+		return res;
+
+	// Pending changes first, so the card matches the image
+	res = psxmc_commit(hdl, chn, fs, u);
+	if (res)
+		return res;
+
+	while (1)
+	{
+		n_saves = psxmc_listSaves(fs, saves, PSXLIB_MC_N_DIR_FRAMES);
+		if (n_saves < 0)
+			return n_saves;
+
+		// A fragmented save moves to any free run. A contiguous one only moves lower.
+		for (i=0; i<n_saves; i++) {
+			contiguous = 1;
+			for (b=1; b<saves[i].n_blocks; b++) {
+				if (saves[i].blocks[b] != saves[i].first_block + b)
+					contiguous = 0;
+			}
+
+			dst = findFreeRun(fs, saves[i].n_blocks);
+			if (dst && (!contiguous || dst < saves[i].first_block))
+				break;
+		}
+
+		if (i == n_saves)
+			break;
+
+		copySave(fs, &saves[i], dst);
+		res = psxmc_commit(hdl, chn, fs, u);
+		if (res)
+			return res;
+
+		for (b=0; b<saves[i].n_blocks; b++) {
+			makeFrame(frame, PSXLIB_MC_BLOCK_FREE, 0);
+			putFrame(fs, saves[i].blocks[b], frame);
+		}
+		res = psxmc_commit(hdl, chn, fs, u);
+		if (res)
+			return res;
+
+		moved++;
+	}
+
+	return moved;
+}
@@ -0,0 +1,63 @@
+#ifndef _psxmc_fs_h__
+#define _psxmc_fs_h__
+
+#include <stdint.h>
+#include "psxlib.h"
+
+#define PSXMC_FILENAME_MAXCHARS		20
+#define PSXMC_TITLE_MAXCHARS		32
+#define PSXMC_ICON_WIDTH			16
+#define PSXMC_ICON_HEIGHT			16
+#define PSXMC_MAX_ICON_FRAMES		3
+
+/* Size of the header in .mcs single-save files (a copy of the directory frame) */
+#define PSXMC_MCS_HEADER_SIZE		PSXLIB_MC_SECTOR_SIZE
+
+/**
+ * \brief A memory card image which may be only partially read from the card
+ *
+ * loaded[] tells which sectors hold valid data, dirty[] which sectors were
+ * modified and must be written back by psxmc_commit().
+ */
+struct psxmc_fs {
+	struct psx_memorycard card;
+	uint8_t loaded[PSXLIB_MC_N_SECTORS / 8];
+	uint8_t dirty[PSXLIB_MC_N_SECTORS / 8];
+};
+
+struct psxmc_save {
+	int first_block; // 1-15
+	int n_blocks;
+	uint8_t blocks[PSXLIB_MC_N_DIR_FRAMES]; // Block numbers, in chain order
+	uint32_t size; // In bytes, from the directory frame
+	char filename[PSXMC_FILENAME_MAXCHARS + 1];
+
+	// From the title frame (only when the first sector of the save is loaded)
+	int has_title;
+	char title[PSXMC_TITLE_MAXCHARS * 2 + 1]; // Shift-JIS converted to ASCII
+	int icon_frames;
+};
+
+/* Setup */
+void psxmc_init(struct psxmc_fs *fs);
+void psxmc_initFromImage(struct psxmc_fs *fs, const struct psx_memorycard *mc);
+
+/* Card I/O (only reads sectors which are not loaded yet, only writes dirty sectors) */
+int psxmc_loadDirectory(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uiio *u);
+int psxmc_loadTitles(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uiio *u);
+int psxmc_loadBlocks(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uint16_t block_mask, uiio *u);
+int psxmc_loadUsedBlocks(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uiio *u);
+int psxmc_commit(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uiio *u);
+int psxmc_countDirty(const struct psxmc_fs *fs);
+int psxmc_defragment(rnt_hdl_t hdl, uint8_t chn, struct psxmc_fs *fs, uiio *u);
+
+/* Filesystem operations (on the image only) */
+int psxmc_listSaves(const struct psxmc_fs *fs, struct psxmc_save *saves, int max_saves);
+int psxmc_getSave(const struct psxmc_fs *fs, int first_block, struct psxmc_save *save);
+int psxmc_getFreeBlocks(const struct psxmc_fs *fs);
+int psxmc_getIcon(const struct psxmc_fs *fs, const struct psxmc_save *save, int frame, uint32_t rgba[PSXMC_ICON_WIDTH * PSXMC_ICON_HEIGHT]);
+int psxmc_exportSave(const struct psxmc_fs *fs, int first_block, const char *filename);
+int psxmc_importSave(struct psxmc_fs *fs, const char *filename, int *first_block);
+int psxmc_deleteSave(struct psxmc_fs *fs, int first_block);
+
+#endif // _psxmc_fs_h__
@@ -24,10 +24,17 @@
 #include "requests.h"
 #include "hexdump.h"
 #include "timer.h"
+#include "rnt_sim.h"
+#include "rntd.h"
+#include "capscache.h"
+#include "x2gcn64_adapters.h"
 
 #include "hidapi.h"
 
 static int dusbr_verbose = 0;
+static int use_stand_in = 0;
+static char *daemon_socket = NULL;
+static int caps_cache_mode = RNT_CAPS_CACHE_ON;
 
 static int rnt_readSupportedFeatures(rnt_hdl_t hdl, struct rnt_dyn_features *dst_dynfeat);
 
@@ -250,6 +257,34 @@ void rnt_shutdown(void)
 	hid_exit();
 }
 
+void rnt_setCapsCacheMode(int mode)
+{
+	caps_cache_mode = mode;
+}
+
+void rnt_useStandIn(int count)
+{
+	if (count > RNT_SIM_MAX)
+		count = RNT_SIM_MAX;
+	use_stand_in = count;
+}
+
+int rnt_useDaemon(const char *socket_path)
+{
+	free(daemon_socket);
+	daemon_socket = NULL;
+
+	if (socket_path) {
+		daemon_socket = strdup(socket_path);
+		if (!daemon_socket) {
+			perror("strdup");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 #define PID_NOT_HANDLED		0
 #define PID_HANDLED			1
 #define PID_HANDLED_LEGACY	2
@@ -286,6 +321,7 @@ void rnt_freeListCtx(struct rnt_adap_list_ctx *ctx)
 		if (ctx->devs) {
 			hid_free_enumeration(ctx->devs);
 		}
+		free(ctx->remote);
 		free(ctx);
 	}
 }
@@ -305,24 +341,11 @@ int rnt_countDevices(void)
 	return count;
 }
 
-/**
- * \brief List instances of our rgbleds device on the USB busses.
- * \param info Pointer to rnt_adap_info structure to store data
- * \param dst Destination buffer for device serial number/id.
- * \param dstbuf_size Destination buffer size.
- */
-struct rnt_adap_info *rnt_listDevices(struct rnt_adap_info *info, struct rnt_adap_list_ctx *ctx)
+static struct rnt_adap_info *listHidDevices(struct rnt_adap_info *info, struct rnt_adap_list_ctx *ctx)
 {
 	struct rnt_adap_caps caps;
 	int handled;
 
-	memset(info, 0, sizeof(struct rnt_adap_info));
-
-	if (!ctx) {
-		fprintf(stderr, "rnt_listDevices: Passed null context\n");
-		return NULL;
-	}
-
 	if (ctx->devs)
 		goto jumpin;
 
@@ -373,6 +396,62 @@ struct rnt_adap_info *rnt_listDevices(struct rnt_adap_info *info, struct rnt_ada
 	return NULL;
 }
 
+static struct rnt_adap_info *listRemoteDevices(struct rnt_adap_info *info, struct rnt_adap_list_ctx *ctx)
+{
+	int n;
+
+	if (!ctx->remote) {
+		n = rntd_clientList(daemon_socket, &ctx->remote);
+		if (n < 0) {
+			return NULL;
+		}
+		ctx->n_remote = n;
+	}
+
+	if (ctx->cur_remote >= ctx->n_remote)
+		return NULL;
+
+	memcpy(info, &ctx->remote[ctx->cur_remote], sizeof(struct rnt_adap_info));
+	ctx->cur_remote++;
+
+	return info;
+}
+
+/**
+ * \brief List instances of our rgbleds device on the USB busses.
+ * \param info Pointer to rnt_adap_info structure to store data
+ * \param dst Destination buffer for device serial number/id.
+ * \param dstbuf_size Destination buffer size.
+ */
+struct rnt_adap_info *rnt_listDevices(struct rnt_adap_info *info, struct rnt_adap_list_ctx *ctx)
+{
+	memset(info, 0, sizeof(struct rnt_adap_info));
+
+	if (!ctx) {
+		fprintf(stderr, "rnt_listDevices: Passed null context\n");
+		return NULL;
+	}
+
+	if (daemon_socket) {
+		return listRemoteDevices(info, ctx);
+	}
+
+	if (!ctx->hid_done) {
+		if (listHidDevices(info, ctx)) {
+			return info;
+		}
+		ctx->hid_done = 1;
+	}
+
+	if (ctx->stand_in_listed < use_stand_in) {
+		rnt_sim_getInfo(info, ctx->stand_in_listed);
+		ctx->stand_in_listed++;
+		return info;
+	}
+
+	return NULL;
+}
+
 static int rnt_featToCaps(const struct rnt_dyn_features *dyn, struct rnt_adap_caps *caps);
 
 rnt_hdl_t rnt_openDevice(const struct rnt_adap_info *dev)
@@ -380,6 +459,7 @@ rnt_hdl_t rnt_openDevice(const struct rnt_adap_info *dev)
 	hid_device *hdev = NULL;
 	rnt_hdl_t hdl;
 	char version[64];
+	int have_version;
 
 	if (!dev)
 		return NULL;
@@ -390,20 +470,39 @@ rnt_hdl_t rnt_openDevice(const struct rnt_adap_info *dev)
 		return NULL;
 	}
 
+	pthread_mutex_init(&hdl->io_lock, NULL);
 	memcpy(&hdl->info, dev, sizeof(struct rnt_adap_info));
 
+	// The daemon already knows the capabilities of the adapter
+	if (daemon_socket) {
+		if (rntd_clientOpen(hdl, daemon_socket) < 0) {
+			pthread_mutex_destroy(&hdl->io_lock);
+			free(hdl);
+			return NULL;
+		}
+		return hdl;
+	}
+
+	if (rnt_sim_isStandIn(dev)) {
+		if (rnt_sim_attach(hdl) < 0) {
+			pthread_mutex_destroy(&hdl->io_lock);
+			free(hdl);
+			return NULL;
+		}
+	}
 	// Legacy devices (raphnet products based on V-USB) do not have
 	// an hid data interface. Those adapters cannot be managed/configures.
 	//
 	// But we can still "open" them, but only to display their USB VID/PID
 	// and name.
-	if (!dev->legacy_adapter) {
+	else if (!dev->legacy_adapter) {
 		if (IS_VERBOSE()) {
 			printf("Opening device path: '%s'\n", dev->str_path);
 		}
 
 		hdev = hid_open_path(dev->str_path);
 		if (!hdev) {
+			pthread_mutex_destroy(&hdl->io_lock);
 			free(hdl);
 			return NULL;
 		}
@@ -422,16 +521,23 @@ rnt_hdl_t rnt_openDevice(const struct rnt_adap_info *dev)
 		}
 	}
 
+	// Also validates the cached capabilities, which are for a specific firmware version.
+	have_version = (0 == rnt_getVersion(hdl, version, sizeof(version)));
+
 	if (dev->caps.features & RNTF_DYNAMIC_FEATURES) {
 		struct rnt_dyn_features feats;
 
-		if (rnt_readSupportedFeatures(hdl, &feats) < 0) {
-			fprintf(stderr, "Failed to query features\n");
-			if (hdev) {
-				hid_close(hdev);
+		if (!have_version || caps_cache_mode != RNT_CAPS_CACHE_ON || capscache_lookup(dev, version, &feats)) {
+			if (rnt_readSupportedFeatures(hdl, &feats) < 0) {
+				fprintf(stderr, "Failed to query features\n");
+				rnt_closeDevice(hdl);
+				return NULL;
 			}
-			free(hdl);
-			return NULL;
+			if (have_version && caps_cache_mode != RNT_CAPS_CACHE_OFF) {
+				capscache_store(dev, version, &feats);
+			}
+		} else if (IS_VERBOSE()) {
+			printf("Using cached capabilities\n");
 		}
 #if 0
 		printf("Supported requests: ");
@@ -446,7 +552,7 @@ rnt_hdl_t rnt_openDevice(const struct rnt_adap_info *dev)
 	}
 
 	// Fixme: This will eventually match something else (i.e not gcn64-usb) by mistake..
-	if (0 == rnt_getVersion(hdl, version, sizeof(version))) {
+	if (have_version) {
 		int a,b,c;
 
 		if (3 == sscanf(version, "%d.%d.%d", &a, &b, &c)) {
@@ -515,7 +621,14 @@ void rnt_closeDevice(rnt_hdl_t hdl)
 	if (hdev) {
 		hid_close(hdev);
 	}
+	if (hdl->ops && hdl->ops->close) {
+		hdl->ops->close(hdl);
+	}
+
+	// The cache is keyed on the handle, which a later rnt_openDevice() may reuse
+	x2gcn64_adapter_invalidateCache(hdl, -1);
 
+	pthread_mutex_destroy(&hdl->io_lock);
 	free(hdl);
 }
 
@@ -596,11 +709,15 @@ int rnt_poll_result(rnt_hdl_t hdl, unsigned char *cmd, int cmd_maxlen)
 	return res_len;
 }
 
-int rnt_exchange(rnt_hdl_t hdl, unsigned char *outcmd, int outlen, unsigned char *result, int result_max)
+static int exchange(rnt_hdl_t hdl, unsigned char *outcmd, int outlen, unsigned char *result, int result_max)
 {
 	int n;
 	uint64_t time_start, time_now;
 
+	if (hdl->ops) {
+		return hdl->ops->exchange(hdl, outcmd, outlen, result, result_max);
+	}
+
 	if (IS_VERY_VERBOSE()) {
 		printf("Sending command."); fflush(stdout);
 	}
@@ -644,6 +761,19 @@ int rnt_exchange(rnt_hdl_t hdl, unsigned char *outcmd, int outlen, unsigned char
 	return n;
 }
 
+/* The command and the poll for its answer must not be interleaved with
+ * those of another thread using the same handle. */
+int rnt_exchange(rnt_hdl_t hdl, unsigned char *outcmd, int outlen, unsigned char *result, int result_max)
+{
+	int n;
+
+	pthread_mutex_lock(&hdl->io_lock);
+	n = exchange(hdl, outcmd, outlen, result, result_max);
+	pthread_mutex_unlock(&hdl->io_lock);
+
+	return n;
+}
+
 int rnt_suspendPolling(rnt_hdl_t hdl, unsigned char suspend)
 {
 	unsigned char cmd[2];
@@ -766,7 +896,7 @@ int rnt_getVersion(rnt_hdl_t hdl, char *dst, int dstmax)
 		return -1;
 
 	/* legacy device. Version must be built from */
-	if (!hdl->hdev) {
+	if (hdl->info.legacy_adapter) {
 		snprintf(dst, dstmax, "%d.%d(.x)", hdl->version_major, hdl->version_minor);
 		return 0;
 	}
@@ -109,6 +109,28 @@ typedef struct _rnt_hdl_t *rnt_hdl_t;
 int rnt_init(int verbose);
 void rnt_shutdown(void);
 
+#define RNT_CAPS_CACHE_OFF		0 // Always query the adapter capabilities
+#define RNT_CAPS_CACHE_ON		1 // Use the capabilities cached by a previous open (default)
+#define RNT_CAPS_CACHE_REFRESH	2 // Query the capabilities and update the cache
+
+/** \brief Select how rnt_openDevice() uses the capability cache (see capscache.h)
+ *
+ * Cached capabilities are only used when the serial number, USB device
+ * version and firmware version (read from the adapter when opening it)
+ * all match.
+ */
+void rnt_setCapsCacheMode(int mode);
+
+/** \brief Also list stand-in adapters (see rnt_sim.h). Call before listing.
+ * \param count Number of stand-in adapters (0 for none)
+ */
+void rnt_useStandIn(int count);
+
+/** \brief List and open the adapters through the daemon (see rntd.h)
+ * \param socket_path The daemon socket. NULL to go back to using the adapters directly.
+ */
+int rnt_useDaemon(const char *socket_path);
+
 struct rnt_adap_list_ctx *rnt_allocListCtx(void);
 void rnt_freeListCtx(struct rnt_adap_list_ctx *ctx);
 struct rnt_adap_info *rnt_listDevices(struct rnt_adap_info *info, struct rnt_adap_list_ctx *ctx);
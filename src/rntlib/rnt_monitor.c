@@ -0,0 +1,400 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "rnt_monitor.h"
+#include "timer.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#define UEVENT_BUFFER_SIZE	4096
+#endif
+
+struct rnt_monitor {
+	rnt_monitor_func func;
+	void *ctx;
+
+	struct rnt_adap_info *devices;
+	int n_devices;
+
+	int fd; // Hotplug events, or -1
+	uint64_t next_rescan; // 0 when none is scheduled
+	int uses_hidraw; // Adapters are listed as /dev/hidrawN, so hidraw events are enough
+};
+
+static int findIndex(struct rnt_monitor *mon, const char *path)
+{
+	int i;
+
+	for (i=0; i<mon->n_devices; i++) {
+		if (!strcmp(mon->devices[i].str_path, path)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static void removeIndex(struct rnt_monitor *mon, int index)
+{
+	struct rnt_adap_info removed;
+
+	// Keep a copy for the callback, the table entry is overwritten.
+	memcpy(&removed, &mon->devices[index], sizeof(struct rnt_adap_info));
+	memmove(&mon->devices[index], &mon->devices[index+1], sizeof(struct rnt_adap_info) * (mon->n_devices - index - 1));
+	mon->n_devices--;
+
+	if (mon->func) {
+		mon->func(RNT_MONITOR_REMOVED, &removed, mon->ctx);
+	}
+}
+
+static int addDevice(struct rnt_monitor *mon, const struct rnt_adap_info *info)
+{
+	if (mon->n_devices >= RNT_MONITOR_MAX_DEVICES) {
+		fprintf(stderr, "rnt_monitor: Too many adapters\n");
+		return -1;
+	}
+
+	memcpy(&mon->devices[mon->n_devices++], info, sizeof(struct rnt_adap_info));
+	if (!strncmp(info->str_path, "/dev/hidraw", 11)) {
+		mon->uses_hidraw = 1;
+	}
+
+	if (mon->func) {
+		mon->func(RNT_MONITOR_ADDED, info, mon->ctx);
+	}
+
+	return 0;
+}
+
+/* Hotplug events come in bursts (usb device, interfaces, hidraw...). Each
+ * one pushes the listing back, so it is done once when they stop. */
+static void scheduleRescan(struct rnt_monitor *mon, int delay_ms)
+{
+	mon->next_rescan = getMilliseconds() + delay_ms;
+	if (!mon->next_rescan) {
+		mon->next_rescan = 1;
+	}
+}
+
+#ifdef __linux__
+static int openHotplug(void)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1; // Kernel events
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Kernel uevents are "action@devpath" followed by KEY=VALUE strings, all nul terminated */
+static int handleUevent(struct rnt_monitor *mon, const char *buf, int len)
+{
+	const char *p, *action = NULL, *subsystem = NULL, *devname = NULL, *devtype = NULL;
+	char path[PATH_MAXCHARS];
+	int i;
+
+	for (p = buf; p < buf + len; p += strlen(p) + 1) {
+		if (!strncmp(p, "ACTION=", 7)) {
+			action = p + 7;
+		} else if (!strncmp(p, "SUBSYSTEM=", 10)) {
+			subsystem = p + 10;
+		} else if (!strncmp(p, "DEVNAME=", 8)) {
+			devname = p + 8;
+		} else if (!strncmp(p, "DEVTYPE=", 8)) {
+			devtype = p + 8;
+		}
+	}
+
+	if (!action || !subsystem) {
+		return 0;
+	}
+	if (strcmp(action, "add") && strcmp(action, "remove")) {
+		return 0;
+	}
+
+	if (!strcmp(subsystem, "hidraw")) {
+		if (!strcmp(action, "remove")) {
+			// The path of a removed device is known, no need to list the others.
+			if (devname) {
+				snprintf(path, sizeof(path), "/dev/%s", devname);
+				i = findIndex(mon, path);
+				if (i >= 0) {
+					removeIndex(mon, i);
+					return 1;
+				}
+			}
+			return 0;
+		}
+		scheduleRescan(mon, RNT_MONITOR_SETTLE_MS);
+		return 0;
+	}
+
+	// With an other hidapi backend, USB devices are all there is to go by.
+	if (!mon->uses_hidraw && !strcmp(subsystem, "usb") && devtype && !strcmp(devtype, "usb_device")) {
+		scheduleRescan(mon, RNT_MONITOR_SETTLE_MS);
+	}
+
+	return 0;
+}
+
+static int readHotplug(struct rnt_monitor *mon)
+{
+	char buf[UEVENT_BUFFER_SIZE];
+	struct sockaddr_nl from;
+	socklen_t fromlen;
+	int n, changes = 0;
+
+	while (1) {
+		fromlen = sizeof(from);
+		n = recvfrom(mon->fd, buf, sizeof(buf) - 1, MSG_DONTWAIT, (struct sockaddr*)&from, &fromlen);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				// Events were lost. The table may be out of date.
+				scheduleRescan(mon, 0);
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				perror("rnt_monitor");
+				return -1;
+			}
+			break;
+		}
+
+		// Only trust the kernel
+		if (fromlen != sizeof(from) || from.nl_pid != 0)
+			continue;
+
+		buf[n] = 0;
+		changes += handleUevent(mon, buf, n);
+	}
+
+	return changes;
+}
+#endif
+
+struct rnt_monitor *rnt_monitor_new(rnt_monitor_func func, void *ctx, int flags)
+{
+	struct rnt_monitor *mon;
+
+	mon = calloc(1, sizeof(struct rnt_monitor));
+	if (!mon) {
+		perror("calloc");
+		return NULL;
+	}
+
+	mon->devices = calloc(RNT_MONITOR_MAX_DEVICES, sizeof(struct rnt_adap_info));
+	if (!mon->devices) {
+		perror("calloc");
+		free(mon);
+		return NULL;
+	}
+
+	mon->func = func;
+	mon->ctx = ctx;
+	mon->fd = -1;
+
+#ifdef __linux__
+	if (!(flags & RNT_MONITOR_NO_HOTPLUG)) {
+		mon->fd = openHotplug();
+	}
+#endif
+
+	// The first rnt_monitor_process() call lists the adapters
+	scheduleRescan(mon, 0);
+
+	return mon;
+}
+
+void rnt_monitor_free(struct rnt_monitor *mon)
+{
+	if (!mon)
+		return;
+
+#ifdef __linux__
+	if (mon->fd >= 0) {
+		close(mon->fd);
+	}
+#endif
+	free(mon->devices);
+	free(mon);
+}
+
+int rnt_monitor_getFd(struct rnt_monitor *mon)
+{
+	return mon->fd;
+}
+
+int rnt_monitor_getTimeout(struct rnt_monitor *mon)
+{
+	uint64_t now;
+
+	if (!mon->next_rescan)
+		return -1;
+
+	now = getMilliseconds();
+	if (now >= mon->next_rescan)
+		return 0;
+
+	return mon->next_rescan - now;
+}
+
+int rnt_monitor_rescan(struct rnt_monitor *mon)
+{
+	struct rnt_adap_list_ctx *listctx;
+	struct rnt_adap_info *found;
+	char *seen;
+	int i, n_found = 0, changes = 0;
+
+	if (mon->fd < 0) {
+		scheduleRescan(mon, RNT_MONITOR_RESCAN_MS);
+	} else {
+		mon->next_rescan = 0;
+	}
+
+	found = calloc(RNT_MONITOR_MAX_DEVICES, sizeof(struct rnt_adap_info));
+	seen = calloc(RNT_MONITOR_MAX_DEVICES, 1);
+	listctx = rnt_allocListCtx();
+	if (!found || !seen || !listctx) {
+		free(found);
+		free(seen);
+		rnt_freeListCtx(listctx);
+		return -1;
+	}
+
+	while (n_found < RNT_MONITOR_MAX_DEVICES && rnt_listDevices(&found[n_found], listctx)) {
+		n_found++;
+	}
+	rnt_freeListCtx(listctx);
+
+	// Removals first, so the table has room for the additions.
+	for (i=0; i<n_found; i++) {
+		int idx = findIndex(mon, found[i].str_path);
+		if (idx >= 0) {
+			seen[idx] = 1;
+		}
+	}
+	for (i=mon->n_devices-1; i>=0; i--) {
+		if (!seen[i]) {
+			removeIndex(mon, i);
+			changes++;
+		}
+	}
+
+	for (i=0; i<n_found; i++) {
+		if (findIndex(mon, found[i].str_path) < 0) {
+			if (addDevice(mon, &found[i]))
+				break;
+			changes++;
+		}
+	}
+
+	free(found);
+	free(seen);
+
+	return changes;
+}
+
+int rnt_monitor_process(struct rnt_monitor *mon)
+{
+	int res, changes = 0;
+
+#ifdef __linux__
+	if (mon->fd >= 0) {
+		res = readHotplug(mon);
+		if (res < 0) {
+			// Fall back to periodic listing
+			close(mon->fd);
+			mon->fd = -1;
+			scheduleRescan(mon, 0);
+		} else {
+			changes += res;
+		}
+	}
+#endif
+
+	if (mon->next_rescan && getMilliseconds() >= mon->next_rescan) {
+		res = rnt_monitor_rescan(mon);
+		if (res < 0)
+			return -1;
+		changes += res;
+	}
+
+	return changes;
+}
+
+int rnt_monitor_count(struct rnt_monitor *mon)
+{
+	return mon->n_devices;
+}
+
+const struct rnt_adap_info *rnt_monitor_get(struct rnt_monitor *mon, int index)
+{
+	if (index < 0 || index >= mon->n_devices)
+		return NULL;
+
+	return &mon->devices[index];
+}
+
+const struct rnt_adap_info *rnt_monitor_findByPath(struct rnt_monitor *mon, const char *path)
+{
+	int i = findIndex(mon, path);
+
+	return i < 0 ? NULL : &mon->devices[i];
+}
+
+int rnt_monitor_inject(struct rnt_monitor *mon, int event, const struct rnt_adap_info *info)
+{
+	int i = findIndex(mon, info->str_path);
+
+	switch (event)
+	{
+		case RNT_MONITOR_ADDED:
+			if (i >= 0)
+				return 0;
+			return addDevice(mon, info) ? -1 : 1;
+
+		case RNT_MONITOR_REMOVED:
+			if (i < 0)
+				return 0;
+			removeIndex(mon, i);
+			return 1;
+	}
+
+	return -1;
+}
@@ -0,0 +1,70 @@
+#ifndef _rnt_monitor_h__
+#define _rnt_monitor_h__
+
+#include "raphnetadapter.h"
+
+#define RNT_MONITOR_ADDED		1
+#define RNT_MONITOR_REMOVED		2
+
+#define RNT_MONITOR_MAX_DEVICES	128
+// Without hotplug events, the adapters are listed this often
+#define RNT_MONITOR_RESCAN_MS	2000
+// Hotplug events come in bursts. List the adapters once they stop.
+#define RNT_MONITOR_SETTLE_MS	250
+
+// Flags for rnt_monitor_new()
+#define RNT_MONITOR_NO_HOTPLUG	1 // Only use periodic listing
+
+struct rnt_monitor;
+
+/** \brief Called when an adapter is added or removed. info is only valid during the call. */
+typedef void (*rnt_monitor_func)(int event, const struct rnt_adap_info *info, void *ctx);
+
+/**
+ * \brief Keep a table of the connected adapters up to date
+ *
+ * On Linux, the kernel hotplug events (netlink) tell when to update the
+ * table. Removed hidraw devices are dropped without listing the adapters
+ * again. Otherwise, or when hotplug events are not available, the adapters
+ * are listed and the result compared to the table.
+ *
+ * The table starts empty. The first rnt_monitor_process() call lists the
+ * adapters and reports them all as added.
+ *
+ * \param func Called for each change (may be NULL)
+ */
+struct rnt_monitor *rnt_monitor_new(rnt_monitor_func func, void *ctx, int flags);
+void rnt_monitor_free(struct rnt_monitor *mon);
+
+/** \brief Get the file descriptor to watch for events (readable), or -1 if there is none */
+int rnt_monitor_getFd(struct rnt_monitor *mon);
+
+/** \brief Get the delay (ms) before rnt_monitor_process() must be called, even if the fd is not readable. */
+int rnt_monitor_getTimeout(struct rnt_monitor *mon);
+
+/** \brief Handle the pending events and list the adapters if needed
+ * \return The number of changes, or -1 on error
+ */
+int rnt_monitor_process(struct rnt_monitor *mon);
+
+/** \brief List the adapters now and report the differences
+ * \return The number of changes, or -1 on error
+ */
+int rnt_monitor_rescan(struct rnt_monitor *mon);
+
+int rnt_monitor_count(struct rnt_monitor *mon);
+/** \brief Get an adapter from the table (0 to rnt_monitor_count()-1) */
+const struct rnt_adap_info *rnt_monitor_get(struct rnt_monitor *mon, int index);
+const struct rnt_adap_info *rnt_monitor_findByPath(struct rnt_monitor *mon, const char *path);
+
+/** \brief Apply a synthetic event (for testing) as if it came from the system
+ *
+ * RNT_MONITOR_ADDED adds info to the table and RNT_MONITOR_REMOVED
+ * removes the adapter with the same path. The callback is called if the
+ * table changed.
+ *
+ * \return 1 if the table changed, 0 otherwise, -1 on error
+ */
+int rnt_monitor_inject(struct rnt_monitor *mon, int event, const struct rnt_adap_info *info);
+
+#endif // _rnt_monitor_h__
@@ -1,19 +1,36 @@
 #ifndef _rnt_priv_h__
 #define _rnt_priv_h__
 
+#include <pthread.h>
 #include "hidapi.h"
 #include "raphnetadapter.h"
 
 struct rnt_adap_list_ctx {
 	struct hid_device_info *devs, *cur_dev;
+	int hid_done;
+	int stand_in_listed; // Stand-in adapters listed so far
+	// Adapters listed by the daemon (see rnt_useDaemon())
+	struct rnt_adap_info *remote;
+	int n_remote, cur_remote;
+};
+
+/* For handles which do not talk to a local HID device (the stand-in
+ * adapter, adapters shared by the daemon). */
+struct rnt_hdl_ops {
+	int (*exchange)(struct _rnt_hdl_t *hdl, unsigned char *outcmd, int outlen, unsigned char *result, int result_max);
+	void (*close)(struct _rnt_hdl_t *hdl);
 };
 
 typedef struct _rnt_hdl_t {
 	hid_device *hdev;
+	pthread_mutex_t io_lock; // Held during rnt_exchange()
 	int report_size;
 	struct rnt_adap_info info;
 	// Version info for legacy devices
 	uint8_t version_major, version_minor;
+	// NULL for HID devices
+	const struct rnt_hdl_ops *ops;
+	void *priv;
 } *rnt_hdl_t;
 
 #endif
@@ -0,0 +1,91 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rnt_ring.h"
+
+int rnt_ring_init(struct rnt_ring *ring, unsigned int size, unsigned int elem_size)
+{
+	unsigned int n = 1;
+
+	memset(ring, 0, sizeof(struct rnt_ring));
+
+	while (n < size) {
+		n <<= 1;
+	}
+
+	ring->buf = malloc((size_t)n * elem_size);
+	if (!ring->buf) {
+		perror("malloc");
+		return -1;
+	}
+	ring->size = n;
+	ring->elem_size = elem_size;
+
+	return 0;
+}
+
+void rnt_ring_free(struct rnt_ring *ring)
+{
+	free(ring->buf);
+	ring->buf = NULL;
+}
+
+int rnt_ring_push(struct rnt_ring *ring, const void *elem)
+{
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= ring->size) {
+		__atomic_store_n(&ring->overruns, ring->overruns + 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	memcpy(ring->buf + (size_t)(head & (ring->size - 1)) * ring->elem_size, elem, ring->elem_size);
+
+	// The element must be complete before the consumer sees it
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int rnt_ring_pop(struct rnt_ring *ring, void *elem)
+{
+	unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return 0;
+
+	memcpy(elem, ring->buf + (size_t)(tail & (ring->size - 1)) * ring->elem_size, ring->elem_size);
+
+	// The slot may be reused once the copy is done
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+unsigned int rnt_ring_count(struct rnt_ring *ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+unsigned int rnt_ring_overruns(struct rnt_ring *ring)
+{
+	return __atomic_load_n(&ring->overruns, __ATOMIC_RELAXED);
+}
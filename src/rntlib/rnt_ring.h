@@ -0,0 +1,51 @@
+#ifndef _rnt_ring_h__
+#define _rnt_ring_h__
+
+#include <stdint.h>
+
+#define RNT_RING_CACHE_LINE	64
+
+/**
+ * \brief Single producer, single consumer lock-free ring buffer
+ *
+ * One thread pushes, another pops, without locking: each index is only
+ * written by its own side and published with release/acquire ordering.
+ * When the ring is full, new elements are discarded and counted as
+ * overruns (the producer cannot drop the oldest one, it belongs to the
+ * consumer).
+ */
+struct rnt_ring {
+	uint8_t *buf;
+	unsigned int size; // Number of elements, a power of two
+	unsigned int elem_size;
+
+	// On separate cache lines so the two threads do not contend
+	unsigned int head __attribute__((aligned(RNT_RING_CACHE_LINE))); // Written by the producer
+	unsigned int overruns; // Written by the producer
+	unsigned int tail __attribute__((aligned(RNT_RING_CACHE_LINE))); // Written by the consumer
+};
+
+/** \brief Allocate the buffer
+ * \param size Number of elements (rounded up to a power of two)
+ * \return 0 on success, -1 on error
+ */
+int rnt_ring_init(struct rnt_ring *ring, unsigned int size, unsigned int elem_size);
+void rnt_ring_free(struct rnt_ring *ring);
+
+/** \brief Add an element (producer only)
+ * \return 0 on success, -1 if the ring is full (the element is discarded)
+ */
+int rnt_ring_push(struct rnt_ring *ring, const void *elem);
+
+/** \brief Remove the oldest element (consumer only)
+ * \return 1 if an element was copied to elem, 0 if the ring is empty
+ */
+int rnt_ring_pop(struct rnt_ring *ring, void *elem);
+
+/** \brief Number of elements waiting (exact for the consumer, a lower bound for others) */
+unsigned int rnt_ring_count(struct rnt_ring *ring);
+
+/** \brief Number of elements discarded because the ring was full */
+unsigned int rnt_ring_overruns(struct rnt_ring *ring);
+
+#endif // _rnt_ring_h__
@@ -0,0 +1,454 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rnt_priv.h"
+#include "rnt_sim.h"
+#include "requests.h"
+#include "delay.h"
+#include "timer.h"
+
+#define SIM_REPORT_SIZE		63
+#define SIM_CFG_MAXLEN		32
+
+/* The emulated GC to N64 adapter: Atmega168, 2K bootloader */
+#define SIM_X2_FLASH_SIZE		0x4000
+#define SIM_X2_PAGE_SIZE		128
+#define SIM_X2_BOOTLOADER		0x3800
+#define SIM_X2_VERSION			"2.3"
+#define SIM_X2_BOOT_VERSION		"1.2"
+#define SIM_X2_ERASE_US			200000
+#define SIM_X2_PAGE_WRITE_US	4500
+#define SIM_X2_SI_DELAY_US		1000 // Round trip time of a real adapter
+
+struct sim_x2gcn64 {
+	uint8_t in_bootloader;
+	uint64_t busy_until; // us
+	uint8_t flash[SIM_X2_FLASH_SIZE];
+};
+
+struct rnt_sim {
+	uint8_t cfg[256][SIM_CFG_MAXLEN];
+	uint8_t cfg_len[256];
+	uint8_t mapping;
+	uint8_t polling_suspended;
+	uint8_t vibration[RNT_SIM_CHANNELS];
+
+	struct sim_x2gcn64 x2;
+	unsigned int si_errors; // One SI command out of si_errors gets no answer (0: never)
+	uint32_t si_random; // Random generator state for the SI errors
+};
+
+static const uint8_t sim_requests[] = {
+	RQ_RNT_ECHO,
+	RQ_RNT_SET_CONFIG_PARAM,
+	RQ_RNT_GET_CONFIG_PARAM,
+	RQ_RNT_SUSPEND_POLLING,
+	RQ_RNT_GET_VERSION,
+	RQ_RNT_GET_SIGNATURE,
+	RQ_RNT_GET_CONTROLLER_TYPE,
+	RQ_RNT_SET_VIBRATION,
+	RQ_RNT_SET_MAPPING,
+	RQ_RNT_GET_MAPPING,
+	RQ_RNT_GET_SUPPORTED_REQUESTS,
+	RQ_RNT_GET_SUPPORTED_MODES,
+	RQ_RNT_GET_SUPPORTED_CFG_PARAMS,
+	RQ_RNT_GET_SUPPORTED_MAPPINGS,
+	RQ_RNT_RESET_FIRMWARE,
+	RQ_GCN64_RAW_SI_COMMAND,
+};
+
+static const uint8_t sim_modes[] = {
+	CFG_MODE_2P_STANDARD,
+	CFG_MODE_2P_N64_ONLY,
+	CFG_MODE_2P_GC_ONLY,
+};
+
+static const uint8_t sim_cfg_params[] = {
+	CFG_PARAM_MODE,
+	CFG_PARAM_SERIAL,
+	CFG_PARAM_POLL_INTERVAL0,
+	CFG_PARAM_POLL_INTERVAL1,
+	CFG_PARAM_BUTTON_HOLDOFF,
+	CFG_PARAM_FULL_SLIDERS,
+	CFG_PARAM_INVERT_TRIG,
+};
+
+static const uint8_t sim_mappings[] = { 0, 1, 2 };
+
+static void setCfg(struct rnt_sim *sim, uint8_t param, const void *data, int len)
+{
+	if (len > SIM_CFG_MAXLEN)
+		len = SIM_CFG_MAXLEN;
+	memcpy(sim->cfg[param], data, len);
+	sim->cfg_len[param] = len;
+}
+
+static int isSupportedCfgParam(uint8_t param)
+{
+	return memchr(sim_cfg_params, param, sizeof(sim_cfg_params)) != NULL;
+}
+
+/* Answer an x2gcn64 command (see x2gcn64_adapters.c) as the adapter would.
+ * Returns the answer length, 0 when the adapter does not answer. */
+static int simX2gcn64(struct sim_x2gcn64 *x2, const uint8_t *si, int len, uint8_t *reply)
+{
+	int i, addr, busy;
+
+	if (len < 2 || si[0] != 'R')
+		return 0;
+
+	_delay_us(SIM_X2_SI_DELAY_US);
+	busy = getMicroseconds() < x2->busy_until;
+
+	switch (si[1])
+	{
+		case 0x00: // Echo
+			memcpy(reply, si, len);
+			return len;
+
+		case 0x01: // Get device info
+			memset(reply, 0, 32);
+			reply[0] = x2->in_bootloader;
+			if (x2->in_bootloader) {
+				reply[1] = SIM_X2_PAGE_SIZE;
+				reply[2] = SIM_X2_BOOTLOADER >> 8;
+				reply[3] = SIM_X2_BOOTLOADER & 0xff;
+				strcpy((char*)reply + 10, SIM_X2_BOOT_VERSION);
+			} else {
+				reply[9] = 1; // Upgradeable
+				strcpy((char*)reply + 10, SIM_X2_VERSION);
+			}
+			return 32;
+
+		case 0xff: // Enter bootloader
+			if (!x2->in_bootloader) {
+				// The application restarts in the bootloader without answering
+				x2->in_bootloader = 1;
+				return 0;
+			}
+			reply[0] = 0x00;
+			return 1;
+	}
+
+	if (!x2->in_bootloader)
+		return 0;
+
+	switch (si[1])
+	{
+		case 0xf9: // Is busy
+			reply[0] = busy;
+			return 1;
+
+		case 0xf0: // Erase all
+			memset(x2->flash, 0xff, SIM_X2_BOOTLOADER);
+			x2->busy_until = getMicroseconds() + SIM_X2_ERASE_US;
+			reply[0] = 0x00;
+			return 1;
+
+		case 0xf1: // Read block
+			if (len < 4)
+				return 0;
+			addr = (si[2] << 8 | si[3]) * 32;
+			if (addr + 32 > SIM_X2_FLASH_SIZE)
+				return 0;
+			memcpy(reply, x2->flash + addr, 32);
+			return 32;
+
+		case 0xf2: // Write block
+			if (len < 4 + 32)
+				return 0;
+			addr = (si[2] << 8 | si[3]) * 32;
+			memcpy(reply, (uint8_t[]){ 0x00, 0x00, si[2], si[3] }, 4);
+			if (busy || addr + 32 > SIM_X2_BOOTLOADER) {
+				reply[0] = 0x01; // NACK
+				return 4;
+			}
+			// Programming can only clear bits, as with real flash
+			for (i=0; i<32; i++) {
+				x2->flash[addr + i] &= si[4 + i];
+			}
+			// A page is written once its last block is received
+			if ((addr + 32) % SIM_X2_PAGE_SIZE == 0) {
+				reply[1] = 1;
+				x2->busy_until = getMicroseconds() + SIM_X2_PAGE_WRITE_US;
+			}
+			return 4;
+
+		case 0xfe: // Boot application
+			reply[0] = 0x00;
+			if (x2->flash[0] != 0xff) {
+				x2->in_bootloader = 0;
+			}
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Xorshift. Seeded per stand-in, so a given run is repeatable but a retried
+ * command does not always hit an error again. */
+static int simSiError(struct rnt_sim *sim)
+{
+	uint32_t x = sim->si_random;
+
+	if (!sim->si_errors)
+		return 0;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	sim->si_random = x;
+
+	return x % sim->si_errors == 0;
+}
+
+static int simRawSiCommand(struct rnt_sim *sim, const uint8_t *cmd, int cmdlen, uint8_t *answer)
+{
+	int n = 0;
+
+	if (cmdlen < 3 || cmdlen < 3 + cmd[2])
+		return 1;
+
+	answer[1] = cmd[1];
+	if (cmd[1] == RNT_SIM_X2GCN64_CHANNEL) {
+		if (!simSiError(sim)) {
+			n = simX2gcn64(&sim->x2, cmd + 3, cmd[2], answer + 3);
+		}
+	}
+	answer[2] = n;
+
+	return 3 + n;
+}
+
+/* Build the answer to a command, as the firmware would. Returns the answer length. */
+static int simRequest(struct rnt_sim *sim, const uint8_t *cmd, int cmdlen, uint8_t *answer)
+{
+	const void *list = NULL;
+	int len = 0;
+
+	answer[0] = cmd[0];
+
+	switch (cmd[0])
+	{
+		case RQ_RNT_ECHO:
+			memcpy(answer, cmd, cmdlen);
+			return cmdlen;
+
+		case RQ_RNT_SET_CONFIG_PARAM:
+			if (cmdlen < 2)
+				return 1;
+			if (isSupportedCfgParam(cmd[1])) {
+				setCfg(sim, cmd[1], cmd + 2, cmdlen - 2);
+			}
+			answer[1] = cmd[1];
+			return 2;
+
+		case RQ_RNT_GET_CONFIG_PARAM:
+			if (cmdlen < 2)
+				return 1;
+			answer[1] = cmd[1];
+			memcpy(answer + 2, sim->cfg[cmd[1]], sim->cfg_len[cmd[1]]);
+			return 2 + sim->cfg_len[cmd[1]];
+
+		case RQ_RNT_SUSPEND_POLLING:
+			if (cmdlen >= 2) {
+				sim->polling_suspended = cmd[1];
+			}
+			return 1;
+
+		case RQ_RNT_GET_VERSION:
+			strcpy((char*)answer + 1, RNT_SIM_VERSION);
+			return 1 + strlen(RNT_SIM_VERSION) + 1;
+
+		case RQ_RNT_GET_SIGNATURE:
+			strcpy((char*)answer + 1, RNT_SIM_SIGNATURE);
+			return 1 + strlen(RNT_SIM_SIGNATURE) + 1;
+
+		case RQ_RNT_GET_CONTROLLER_TYPE:
+			if (cmdlen < 2)
+				return 1;
+			answer[1] = cmd[1];
+			// A N64 controller on the first channel, a Gamecube controller on the second.
+			switch (cmd[1])
+			{
+				case 0: answer[2] = CTL_TYPE_N64; break;
+				case 1: answer[2] = CTL_TYPE_GC; break;
+				default: answer[2] = CTL_TYPE_NONE; break;
+			}
+			return 3;
+
+		case RQ_RNT_SET_VIBRATION:
+			if (cmdlen >= 3 && cmd[1] < RNT_SIM_CHANNELS) {
+				sim->vibration[cmd[1]] = cmd[2];
+			}
+			return 1;
+
+		case RQ_RNT_SET_MAPPING:
+			if (cmdlen >= 2) {
+				sim->mapping = cmd[1];
+			}
+			return 1;
+
+		case RQ_RNT_GET_MAPPING:
+			answer[1] = sim->mapping;
+			return 2;
+
+		case RQ_RNT_GET_SUPPORTED_REQUESTS:
+			list = sim_requests;
+			len = sizeof(sim_requests);
+			break;
+
+		case RQ_RNT_GET_SUPPORTED_MODES:
+			list = sim_modes;
+			len = sizeof(sim_modes);
+			break;
+
+		case RQ_RNT_GET_SUPPORTED_CFG_PARAMS:
+			list = sim_cfg_params;
+			len = sizeof(sim_cfg_params);
+			break;
+
+		case RQ_RNT_GET_SUPPORTED_MAPPINGS:
+			list = sim_mappings;
+			len = sizeof(sim_mappings);
+			break;
+
+		case RQ_RNT_RESET_FIRMWARE:
+			sim->polling_suspended = 0;
+			memset(sim->vibration, 0, sizeof(sim->vibration));
+			return 1;
+
+		case RQ_GCN64_RAW_SI_COMMAND:
+			return simRawSiCommand(sim, cmd, cmdlen, answer);
+
+		default:
+			// Unknown requests are echoed back without data
+			return 1;
+	}
+
+	memcpy(answer + 1, list, len);
+	return 1 + len;
+}
+
+static int simExchange(rnt_hdl_t hdl, unsigned char *outcmd, int outlen, unsigned char *result, int result_max)
+{
+	uint8_t answer[SIM_REPORT_SIZE + 1 + SIM_CFG_MAXLEN];
+	int n;
+
+	if (outlen < 1 || outlen > SIM_REPORT_SIZE) {
+		return -1;
+	}
+
+	n = simRequest(hdl->priv, outcmd, outlen, answer);
+	if (n > SIM_REPORT_SIZE) {
+		n = SIM_REPORT_SIZE;
+	}
+
+	if (result) {
+		memcpy(result, answer, n < result_max ? n : result_max);
+	}
+
+	return n;
+}
+
+static void simClose(rnt_hdl_t hdl)
+{
+	free(hdl->priv);
+	hdl->priv = NULL;
+}
+
+static const struct rnt_hdl_ops sim_ops = {
+	.exchange = simExchange,
+	.close = simClose,
+};
+
+void rnt_sim_getInfo(struct rnt_adap_info *info, int index)
+{
+	char serial[16];
+
+	memset(info, 0, sizeof(struct rnt_adap_info));
+
+	snprintf(serial, sizeof(serial), RNT_SIM_SERIAL, index + 1);
+	wcsncpy(info->str_prodname, RNT_SIM_PRODNAME, PRODNAME_MAXCHARS-1);
+	swprintf(info->str_serial, SERIAL_MAXCHARS, L"%s", serial);
+	if (index) {
+		snprintf(info->str_path, PATH_MAXCHARS, RNT_SIM_PATH ":%d", index + 1);
+	} else {
+		strncpy(info->str_path, RNT_SIM_PATH, PATH_MAXCHARS-1);
+	}
+	info->usb_vid = OUR_VENDOR_ID;
+	info->usb_pid = 0x0060;
+	info->access = 1;
+	info->caps.rpsize = SIM_REPORT_SIZE;
+	info->caps.n_channels = RNT_SIM_CHANNELS;
+	info->caps.n_raw_channels = RNT_SIM_CHANNELS;
+	info->caps.features = RNTF_DYNAMIC_FEATURES;
+	info->version_major = 3;
+	info->version_minor = 6;
+}
+
+int rnt_sim_isStandIn(const struct rnt_adap_info *info)
+{
+	int len = strlen(RNT_SIM_PATH);
+
+	if (strncmp(info->str_path, RNT_SIM_PATH, len))
+		return 0;
+
+	return info->str_path[len] == 0 || info->str_path[len] == ':';
+}
+
+int rnt_sim_attach(rnt_hdl_t hdl)
+{
+	struct rnt_sim *sim;
+	const char *errors;
+	char serial[16];
+	int number = 1;
+
+	sim = calloc(1, sizeof(struct rnt_sim));
+	if (!sim) {
+		perror("calloc");
+		return -1;
+	}
+
+	sscanf(hdl->info.str_path, RNT_SIM_PATH ":%d", &number);
+	snprintf(serial, sizeof(serial), RNT_SIM_SERIAL, number);
+
+	setCfg(sim, CFG_PARAM_SERIAL, serial, strlen(serial));
+	setCfg(sim, CFG_PARAM_MODE, (uint8_t[]){ CFG_MODE_2P_STANDARD }, 1);
+	setCfg(sim, CFG_PARAM_POLL_INTERVAL0, (uint8_t[]){ 1 }, 1);
+	setCfg(sim, CFG_PARAM_POLL_INTERVAL1, (uint8_t[]){ 1 }, 1);
+	setCfg(sim, CFG_PARAM_BUTTON_HOLDOFF, (uint8_t[]){ 0 }, 1);
+	setCfg(sim, CFG_PARAM_FULL_SLIDERS, (uint8_t[]){ 0 }, 1);
+	setCfg(sim, CFG_PARAM_INVERT_TRIG, (uint8_t[]){ 0 }, 1);
+
+	// The GC to N64 adapter starts with a valid application
+	memset(sim->x2.flash, 0xff, SIM_X2_FLASH_SIZE);
+	memset(sim->x2.flash, 0x00, SIM_X2_PAGE_SIZE);
+
+	errors = getenv(RNT_SIM_SI_ERRORS_ENV);
+	if (errors) {
+		sim->si_errors = atoi(errors);
+		sim->si_random = 0x9e3779b9 * number;
+	}
+
+	hdl->ops = &sim_ops;
+	hdl->priv = sim;
+
+	return 0;
+}
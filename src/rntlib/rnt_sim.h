@@ -0,0 +1,41 @@
+#ifndef _rnt_sim_h__
+#define _rnt_sim_h__
+
+#include "raphnetadapter.h"
+
+#define RNT_SIM_PATH		"stand-in" // Followed by :2, :3... for the next ones
+#define RNT_SIM_SERIAL		"SIM%03d"
+#define RNT_SIM_MAX			99
+#define RNT_SIM_PRODNAME	L"Stand-in adapter"
+#define RNT_SIM_VERSION		"3.6.0"
+#define RNT_SIM_SIGNATURE	"rnt-stand-in-adapter"
+#define RNT_SIM_CHANNELS	2
+
+/* A GC to N64 adapter (x2gcn64_adapters.h) is emulated on this channel */
+#define RNT_SIM_X2GCN64_CHANNEL	0
+
+/* When set to n, one raw SI command out of n (on average, at random) to the
+ * emulated GC to N64 adapter gets no answer (for testing error recovery). */
+#define RNT_SIM_SI_ERRORS_ENV	"GCN64CTL_STAND_IN_SI_ERRORS"
+
+/** \brief Fill an adapter information structure for a stand-in adapter
+ *
+ * The stand-in adapter is a simulated GC/N64 adapter which answers the
+ * common management requests (version, signature, configuration, controller
+ * type, vibration, mappings and feature queries) without any hardware. It
+ * is meant for testing the tools. It can be opened like any other adapter.
+ *
+ * Raw SI commands reach an emulated GC to N64 adapter on the first channel,
+ * with its bootloader and flash memory, so firmware updates can be tested.
+ *
+ * \param index 0 for the first stand-in adapter (serial SIM001), 1 for the second...
+ */
+void rnt_sim_getInfo(struct rnt_adap_info *info, int index);
+
+/** \brief Check if an adapter information structure is the stand-in adapter */
+int rnt_sim_isStandIn(const struct rnt_adap_info *info);
+
+/** \brief Make a new handle talk to a simulated adapter. For raphnetadapter.c */
+int rnt_sim_attach(rnt_hdl_t hdl);
+
+#endif // _rnt_sim_h__
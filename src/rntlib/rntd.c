@@ -0,0 +1,868 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rnt_priv.h"
+#include "rntd.h"
+
+#ifdef WINDOWS
+
+int rntd_defaultSocketPath(char *dst, int dstlen)
+{
+	return -1;
+}
+
+int rntd_serve(const char *socket_path)
+{
+	fprintf(stderr, "The daemon is not supported on this platform\n");
+	return -1;
+}
+
+int rntd_clientList(const char *socket_path, struct rnt_adap_info **list)
+{
+	fprintf(stderr, "The daemon is not supported on this platform\n");
+	return RNTD_ERR_CONNECT;
+}
+
+int rntd_clientOpen(rnt_hdl_t hdl, const char *socket_path)
+{
+	return RNTD_ERR_CONNECT;
+}
+
+#else
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "rnt_monitor.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* Sent instead of the OPEN reply while another client owns the adapter */
+#define RNTD_BUSY	1
+
+/* A client that stops sending in the middle of a message is dropped after this */
+#define RNTD_RECV_TIMEOUT_S	1
+
+static int writeAll(int fd, const void *buf, int len)
+{
+	const uint8_t *p = buf;
+	int n;
+
+	while (len > 0) {
+		n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int readAll(int fd, void *buf, int len)
+{
+	uint8_t *p = buf;
+	int n;
+
+	while (len > 0) {
+		n = recv(fd, p, len, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0) {
+			return -1; // Connection closed
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int sendMsg(int fd, int type, int status, const void *payload, int len)
+{
+	struct rntd_msg_hdr hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.type = type;
+	hdr.status = status;
+	hdr.len = len;
+
+	if (writeAll(fd, &hdr, sizeof(hdr)))
+		return -1;
+	if (len && writeAll(fd, payload, len))
+		return -1;
+
+	return 0;
+}
+
+static int recvMsg(int fd, struct rntd_msg_hdr *hdr, void *payload, int payload_max)
+{
+	if (readAll(fd, hdr, sizeof(struct rntd_msg_hdr)))
+		return -1;
+	if (hdr->len > payload_max)
+		return -1;
+	if (hdr->len && readAll(fd, payload, hdr->len))
+		return -1;
+
+	return 0;
+}
+
+static int makeAddr(const char *socket_path, struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", socket_path);
+		return -1;
+	}
+	strcpy(addr->sun_path, socket_path);
+
+	return 0;
+}
+
+int rntd_defaultSocketPath(char *dst, int dstlen)
+{
+	const char *env;
+	int n;
+
+	env = getenv(RNTD_SOCKET_ENV);
+	if (env && *env) {
+		n = snprintf(dst, dstlen, "%s", env);
+	} else {
+		env = getenv("XDG_RUNTIME_DIR");
+		if (env && *env) {
+			n = snprintf(dst, dstlen, "%s/%s", env, RNTD_SOCKET_NAME);
+		} else {
+			n = snprintf(dst, dstlen, "/tmp/gcn64ctl-%d.sock", (int)getuid());
+		}
+	}
+
+	if (n < 0 || n >= dstlen)
+		return -1;
+
+	return 0;
+}
+
+/*** Client ***/
+
+struct rntd_conn {
+	int fd;
+};
+
+static int clientConnect(const char *socket_path)
+{
+	struct sockaddr_un addr;
+	struct rntd_hello hello;
+	struct rntd_msg_hdr hdr;
+	int fd;
+
+	if (makeAddr(socket_path, &addr))
+		return -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "Could not connect to the daemon at %s (%s)\n", socket_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	hello.version = RNTD_PROTOCOL_VERSION;
+	hello.info_size = sizeof(struct rnt_adap_info);
+	if (sendMsg(fd, RNTD_MSG_HELLO, 0, &hello, sizeof(hello)) || recvMsg(fd, &hdr, NULL, 0)) {
+		fprintf(stderr, "Daemon connection error\n");
+		close(fd);
+		return -1;
+	}
+
+	if (hdr.status != RNTD_OK) {
+		fprintf(stderr, "The daemon is from a different gcn64ctl version\n");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int rntd_clientList(const char *socket_path, struct rnt_adap_info **list)
+{
+	struct rntd_msg_hdr hdr;
+	int fd, res = RNTD_ERR_UNKNOWN;
+
+	*list = NULL;
+
+	fd = clientConnect(socket_path);
+	if (fd < 0)
+		return RNTD_ERR_CONNECT;
+
+	if (sendMsg(fd, RNTD_MSG_LIST, 0, NULL, 0) || readAll(fd, &hdr, sizeof(hdr))) {
+		fprintf(stderr, "Daemon connection error\n");
+		goto done;
+	}
+
+	if (hdr.status < 0) {
+		res = hdr.status;
+		goto done;
+	}
+
+	if (hdr.status > RNTD_MAX_ADAPTERS || hdr.len != hdr.status * sizeof(struct rnt_adap_info)) {
+		fprintf(stderr, "Invalid reply from daemon\n");
+		goto done;
+	}
+
+	*list = malloc(hdr.len + 1);
+	if (!*list) {
+		perror("malloc");
+		goto done;
+	}
+
+	if (readAll(fd, *list, hdr.len)) {
+		fprintf(stderr, "Daemon connection error\n");
+		free(*list);
+		*list = NULL;
+		goto done;
+	}
+
+	res = hdr.status;
+
+done:
+	close(fd);
+	return res;
+}
+
+static int clientExchange(rnt_hdl_t hdl, unsigned char *outcmd, int outlen, unsigned char *result, int result_max)
+{
+	struct rntd_conn *conn = hdl->priv;
+	uint8_t msg[sizeof(struct rntd_exchange) + RNTD_MAX_REQUEST];
+	struct rntd_exchange ex;
+	struct rntd_msg_hdr hdr;
+
+	if (outlen < 0 || outlen > RNTD_MAX_REQUEST) {
+		return -1;
+	}
+
+	if (!result || result_max < 0) {
+		result_max = 0;
+	}
+	if (result_max > RNTD_MAX_REQUEST) {
+		result_max = RNTD_MAX_REQUEST;
+	}
+
+	ex.result_max = result_max;
+	ex.outlen = outlen;
+	memcpy(msg, &ex, sizeof(ex));
+	memcpy(msg + sizeof(ex), outcmd, outlen);
+
+	if (sendMsg(conn->fd, RNTD_MSG_EXCHANGE, 0, msg, sizeof(ex) + outlen) ||
+			recvMsg(conn->fd, &hdr, result, result_max))
+	{
+		fprintf(stderr, "Daemon connection error\n");
+		return -1;
+	}
+
+	return hdr.status;
+}
+
+static void clientClose(rnt_hdl_t hdl)
+{
+	struct rntd_conn *conn = hdl->priv;
+
+	sendMsg(conn->fd, RNTD_MSG_CLOSE, 0, NULL, 0);
+	close(conn->fd);
+	free(conn);
+	hdl->priv = NULL;
+}
+
+static const struct rnt_hdl_ops client_ops = {
+	.exchange = clientExchange,
+	.close = clientClose,
+};
+
+int rntd_clientOpen(rnt_hdl_t hdl, const char *socket_path)
+{
+	struct rntd_open_reply reply;
+	struct rntd_msg_hdr hdr;
+	struct rntd_conn *conn;
+	int fd;
+
+	conn = malloc(sizeof(struct rntd_conn));
+	if (!conn) {
+		perror("malloc");
+		return RNTD_ERR_UNKNOWN;
+	}
+
+	fd = clientConnect(socket_path);
+	if (fd < 0) {
+		free(conn);
+		return RNTD_ERR_CONNECT;
+	}
+
+	if (sendMsg(fd, RNTD_MSG_OPEN, 0, hdl->info.str_path, strlen(hdl->info.str_path) + 1)) {
+		goto conn_error;
+	}
+
+	while (1) {
+		if (recvMsg(fd, &hdr, &reply, sizeof(reply))) {
+			goto conn_error;
+		}
+		if (hdr.status != RNTD_BUSY)
+			break;
+		printf("Adapter in use by another client. Waiting...\n");
+	}
+
+	if (hdr.status != RNTD_OK || hdr.len != sizeof(reply)) {
+		fprintf(stderr, "The daemon could not open the adapter (%d)\n", hdr.status);
+		close(fd);
+		free(conn);
+		return hdr.status < 0 ? hdr.status : RNTD_ERR_UNKNOWN;
+	}
+
+	memcpy(&hdl->info, &reply.info, sizeof(struct rnt_adap_info));
+	hdl->report_size = reply.report_size;
+	hdl->version_major = reply.info.version_major;
+	hdl->version_minor = reply.info.version_minor;
+
+	conn->fd = fd;
+	hdl->ops = &client_ops;
+	hdl->priv = conn;
+
+	return RNTD_OK;
+
+conn_error:
+	fprintf(stderr, "Daemon connection error\n");
+	close(fd);
+	free(conn);
+	return RNTD_ERR_CONNECT;
+}
+
+/*** Daemon ***/
+
+struct rntd_adapter {
+	int used;
+	struct rnt_adap_info info;
+	rnt_hdl_t hdl; // Kept open once opened, so the capabilities are only read once
+	int owner; // Client index, or -1
+	int present; // Still connected
+	int failed; // An I/O error occured. Reopen once released.
+};
+
+struct rntd_client {
+	int fd; // -1 for a free slot
+	int hello_done;
+	int adapter; // Owned adapter, or -1
+	int waiting; // Adapter waited for, or -1
+};
+
+struct rntd {
+	struct rntd_adapter adapters[RNTD_MAX_ADAPTERS];
+	struct rntd_client clients[RNTD_MAX_CLIENTS];
+	struct rnt_monitor *mon;
+};
+
+static volatile sig_atomic_t rntd_quit;
+
+static void rntd_signal(int sig)
+{
+	rntd_quit = 1;
+}
+
+static int findAdapter(struct rntd *d, const char *path)
+{
+	int i;
+
+	for (i=0; i<RNTD_MAX_ADAPTERS; i++) {
+		if (d->adapters[i].used && !strcmp(d->adapters[i].info.str_path, path)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static void adapterEvent(int event, const struct rnt_adap_info *info, void *ctx)
+{
+	struct rntd *d = ctx;
+	struct rntd_adapter *a;
+	int i;
+
+	i = findAdapter(d, info->str_path);
+
+	if (event == RNT_MONITOR_ADDED) {
+		if (i < 0) {
+			for (i=0; i<RNTD_MAX_ADAPTERS && d->adapters[i].used; i++);
+			if (i == RNTD_MAX_ADAPTERS) {
+				fprintf(stderr, "Too many adapters\n");
+				return;
+			}
+			a = &d->adapters[i];
+			memset(a, 0, sizeof(struct rntd_adapter));
+			a->used = 1;
+			a->owner = -1;
+		}
+		a = &d->adapters[i];
+		a->present = 1;
+		if (!a->hdl) {
+			memcpy(&a->info, info, sizeof(struct rnt_adap_info));
+		}
+		printf("Adapter found: '%ls' serial '%ls'\n", info->str_prodname, info->str_serial);
+		return;
+	}
+
+	if (i < 0)
+		return;
+
+	a = &d->adapters[i];
+	printf("Adapter gone: '%ls' serial '%ls'\n", a->info.str_prodname, a->info.str_serial);
+	a->present = 0;
+
+	// Forget the adapter, unless a client is using it. Then it is forgotten once released.
+	if (a->owner >= 0) {
+		a->failed = 1;
+		return;
+	}
+	if (a->hdl) {
+		rnt_closeDevice(a->hdl);
+	}
+	a->used = 0;
+}
+
+static int sendList(struct rntd *d, int fd)
+{
+	struct rnt_adap_info list[RNTD_MAX_ADAPTERS];
+	struct rntd_adapter *a;
+	int i, n = 0;
+
+	for (i=0; i<RNTD_MAX_ADAPTERS; i++) {
+		a = &d->adapters[i];
+		if (!a->used || !a->present)
+			continue;
+		// Once opened, the capabilities read from the adapter are known.
+		if (a->hdl) {
+			rnt_getInfo(a->hdl, &list[n]);
+		} else {
+			memcpy(&list[n], &a->info, sizeof(struct rnt_adap_info));
+		}
+		n++;
+	}
+
+	return sendMsg(fd, RNTD_MSG_LIST, n, list, n * sizeof(struct rnt_adap_info));
+}
+
+/* Give an adapter to a client and send the OPEN reply. */
+static int grantAdapter(struct rntd *d, int ci, int ai)
+{
+	struct rntd_client *c = &d->clients[ci];
+	struct rntd_adapter *a = &d->adapters[ai];
+	struct rntd_open_reply reply;
+
+	c->waiting = -1;
+
+	if (!a->hdl) {
+		a->hdl = rnt_openDevice(&a->info);
+		a->failed = 0;
+		if (!a->hdl) {
+			fprintf(stderr, "Could not open '%ls' serial '%ls'\n", a->info.str_prodname, a->info.str_serial);
+			return sendMsg(c->fd, RNTD_MSG_OPEN, RNTD_ERR_OPEN_FAILED, NULL, 0);
+		}
+	}
+
+	a->owner = ci;
+	c->adapter = ai;
+
+	memset(&reply, 0, sizeof(reply));
+	reply.report_size = a->hdl->report_size;
+	rnt_getInfo(a->hdl, &reply.info);
+
+	return sendMsg(c->fd, RNTD_MSG_OPEN, RNTD_OK, &reply, sizeof(reply));
+}
+
+static void dropClient(struct rntd *d, int ci);
+
+/* Release the adapter owned by a client and give it to the next one waiting for it */
+static void releaseAdapter(struct rntd *d, int ci)
+{
+	struct rntd_client *c = &d->clients[ci];
+	struct rntd_adapter *a;
+	int ai = c->adapter, i, next;
+
+	if (ai < 0)
+		return;
+
+	a = &d->adapters[ai];
+	a->owner = -1;
+	c->adapter = -1;
+
+	if (a->failed || !a->present) {
+		if (a->hdl) {
+			rnt_closeDevice(a->hdl);
+			a->hdl = NULL;
+		}
+		if (!a->present) {
+			a->used = 0;
+		}
+	}
+
+	// Serve the waiting clients in turn, starting after the one releasing the adapter.
+	for (i=1; i<=RNTD_MAX_CLIENTS; i++) {
+		next = (ci + i) % RNTD_MAX_CLIENTS;
+		c = &d->clients[next];
+		if (c->fd < 0 || c->waiting != ai)
+			continue;
+
+		if (!a->used) {
+			c->waiting = -1;
+			if (sendMsg(c->fd, RNTD_MSG_OPEN, RNTD_ERR_NOT_FOUND, NULL, 0)) {
+				dropClient(d, next);
+			}
+			continue;
+		}
+
+		if (grantAdapter(d, next, ai)) {
+			dropClient(d, next);
+			continue;
+		}
+
+		if (a->owner >= 0)
+			break;
+	}
+}
+
+static void dropClient(struct rntd *d, int ci)
+{
+	struct rntd_client *c = &d->clients[ci];
+
+	if (c->fd < 0)
+		return;
+
+	close(c->fd);
+	c->fd = -1;
+	c->waiting = -1;
+	releaseAdapter(d, ci);
+}
+
+static int handleOpen(struct rntd *d, int ci, char *path, int len)
+{
+	struct rntd_client *c = &d->clients[ci];
+	int ai;
+
+	if (c->adapter >= 0 || c->waiting >= 0 || len < 1) {
+		return sendMsg(c->fd, RNTD_MSG_OPEN, RNTD_ERR_BAD_REQUEST, NULL, 0);
+	}
+	path[len-1] = 0;
+
+	ai = findAdapter(d, path);
+	if (ai < 0) {
+		// Maybe just connected, and the hotplug events not handled yet
+		rnt_monitor_rescan(d->mon);
+		ai = findAdapter(d, path);
+	}
+	if (ai < 0 || !d->adapters[ai].present) {
+		return sendMsg(c->fd, RNTD_MSG_OPEN, RNTD_ERR_NOT_FOUND, NULL, 0);
+	}
+
+	if (d->adapters[ai].owner >= 0) {
+		c->waiting = ai;
+		return sendMsg(c->fd, RNTD_MSG_OPEN, RNTD_BUSY, NULL, 0);
+	}
+
+	return grantAdapter(d, ci, ai);
+}
+
+static int handleExchange(struct rntd *d, int ci, uint8_t *payload, int len)
+{
+	struct rntd_client *c = &d->clients[ci];
+	uint8_t result[RNTD_MAX_REQUEST];
+	struct rntd_adapter *a;
+	struct rntd_exchange ex;
+	int n;
+
+	if (c->adapter < 0) {
+		return sendMsg(c->fd, RNTD_MSG_EXCHANGE, RNTD_ERR_NOT_OWNER, NULL, 0);
+	}
+	a = &d->adapters[c->adapter];
+
+	if (len < sizeof(ex)) {
+		return sendMsg(c->fd, RNTD_MSG_EXCHANGE, RNTD_ERR_BAD_REQUEST, NULL, 0);
+	}
+	memcpy(&ex, payload, sizeof(ex));
+	if (ex.outlen != len - sizeof(ex) || ex.result_max > sizeof(result)) {
+		return sendMsg(c->fd, RNTD_MSG_EXCHANGE, RNTD_ERR_BAD_REQUEST, NULL, 0);
+	}
+
+	n = rnt_exchange(a->hdl, payload + sizeof(ex), ex.outlen, result, ex.result_max);
+	if (n < 0) {
+		a->failed = 1;
+	}
+
+	return sendMsg(c->fd, RNTD_MSG_EXCHANGE, n, result, n > 0 ? (n < ex.result_max ? n : ex.result_max) : 0);
+}
+
+/* Returns non-zero if the client must be dropped */
+static int handleMessage(struct rntd *d, int ci)
+{
+	struct rntd_client *c = &d->clients[ci];
+	uint8_t payload[sizeof(struct rntd_exchange) + RNTD_MAX_REQUEST];
+	struct rntd_msg_hdr hdr;
+
+	if (recvMsg(c->fd, &hdr, payload, sizeof(payload)))
+		return -1;
+
+	if (!c->hello_done) {
+		struct rntd_hello hello;
+
+		if (hdr.type != RNTD_MSG_HELLO || hdr.len != sizeof(hello))
+			return -1;
+
+		memcpy(&hello, payload, sizeof(hello));
+		if (hello.version != RNTD_PROTOCOL_VERSION || hello.info_size != sizeof(struct rnt_adap_info)) {
+			sendMsg(c->fd, RNTD_MSG_HELLO, RNTD_ERR_VERSION, NULL, 0);
+			return -1;
+		}
+
+		c->hello_done = 1;
+		return sendMsg(c->fd, RNTD_MSG_HELLO, RNTD_OK, NULL, 0);
+	}
+
+	switch (hdr.type)
+	{
+		case RNTD_MSG_LIST:
+			return sendList(d, c->fd);
+
+		case RNTD_MSG_OPEN:
+			return handleOpen(d, ci, (char*)payload, hdr.len);
+
+		case RNTD_MSG_EXCHANGE:
+			return handleExchange(d, ci, payload, hdr.len);
+
+		case RNTD_MSG_CLOSE:
+			c->waiting = -1;
+			releaseAdapter(d, ci);
+			return 0;
+	}
+
+	return -1;
+}
+
+static void acceptClient(struct rntd *d, int listen_fd)
+{
+	struct timeval tv = { .tv_sec = RNTD_RECV_TIMEOUT_S };
+	struct rntd_client *c;
+	int fd, i;
+
+	fd = accept(listen_fd, NULL, NULL);
+	if (fd < 0) {
+		if (errno != EINTR)
+			perror("accept");
+		return;
+	}
+
+	for (i=0; i<RNTD_MAX_CLIENTS && d->clients[i].fd >= 0; i++);
+	if (i == RNTD_MAX_CLIENTS) {
+		fprintf(stderr, "Too many clients\n");
+		close(fd);
+		return;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	c = &d->clients[i];
+	c->fd = fd;
+	c->hello_done = 0;
+	c->adapter = -1;
+	c->waiting = -1;
+}
+
+static int openSocket(const char *socket_path)
+{
+	struct sockaddr_un addr;
+	mode_t old_umask;
+	int fd, res;
+
+	if (makeAddr(socket_path, &addr))
+		return -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	// Do not steal the socket of a running daemon, but replace a stale one.
+	if (0 == connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+		fprintf(stderr, "A daemon is already listening on %s\n", socket_path);
+		close(fd);
+		return -1;
+	}
+	unlink(socket_path);
+
+	// Only the current user may use the adapters through the daemon.
+	old_umask = umask(0077);
+	res = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+	umask(old_umask);
+
+	if (res < 0 || listen(fd, 8) < 0) {
+		fprintf(stderr, "Could not listen on %s (%s)\n", socket_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int rntd_serve(const char *socket_path)
+{
+	char default_path[PATH_MAX];
+	struct pollfd pfds[RNTD_MAX_CLIENTS + 2];
+	int pfd_client[RNTD_MAX_CLIENTS + 2];
+	struct sigaction sa;
+	struct rntd *d;
+	int listen_fd, i, n, first_client;
+
+	if (!socket_path) {
+		if (rntd_defaultSocketPath(default_path, sizeof(default_path))) {
+			fprintf(stderr, "Socket path too long\n");
+			return -1;
+		}
+		socket_path = default_path;
+	}
+
+	d = calloc(1, sizeof(struct rntd));
+	if (!d) {
+		perror("calloc");
+		return -1;
+	}
+	for (i=0; i<RNTD_MAX_CLIENTS; i++) {
+		d->clients[i].fd = -1;
+	}
+
+	listen_fd = openSocket(socket_path);
+	if (listen_fd < 0) {
+		free(d);
+		return -1;
+	}
+
+	d->mon = rnt_monitor_new(adapterEvent, d, 0);
+	if (!d->mon) {
+		close(listen_fd);
+		unlink(socket_path);
+		free(d);
+		return -1;
+	}
+
+	// No SA_RESTART: poll() must return when asked to quit
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = rntd_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	rnt_monitor_process(d->mon);
+	if (rnt_monitor_getFd(d->mon) < 0) {
+		printf("No hotplug events, listing adapters every %d ms\n", RNT_MONITOR_RESCAN_MS);
+	}
+	printf("Listening on %s\n", socket_path);
+	fflush(stdout);
+
+	while (!rntd_quit) {
+		pfds[0].fd = listen_fd;
+		pfds[0].events = POLLIN;
+		n = 1;
+		if (rnt_monitor_getFd(d->mon) >= 0) {
+			pfds[n].fd = rnt_monitor_getFd(d->mon);
+			pfds[n].events = POLLIN;
+			n++;
+		}
+		first_client = n;
+		for (i=0; i<RNTD_MAX_CLIENTS; i++) {
+			if (d->clients[i].fd < 0)
+				continue;
+			pfds[n].fd = d->clients[i].fd;
+			pfds[n].events = POLLIN;
+			pfd_client[n] = i;
+			n++;
+		}
+
+		if (poll(pfds, n, rnt_monitor_getTimeout(d->mon)) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+
+		// Before serving the clients, so they do not get a removed adapter.
+		rnt_monitor_process(d->mon);
+
+		for (i=first_client; i<n; i++) {
+			if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+				// The client may have been dropped while serving an other one
+				if (d->clients[pfd_client[i]].fd != pfds[i].fd)
+					continue;
+				if (handleMessage(d, pfd_client[i])) {
+					dropClient(d, pfd_client[i]);
+				}
+			}
+		}
+
+		if (pfds[0].revents & POLLIN) {
+			acceptClient(d, listen_fd);
+		}
+
+		fflush(stdout);
+	}
+
+	printf("Exiting\n");
+
+	for (i=0; i<RNTD_MAX_CLIENTS; i++) {
+		if (d->clients[i].fd >= 0) {
+			close(d->clients[i].fd);
+		}
+	}
+	for (i=0; i<RNTD_MAX_ADAPTERS; i++) {
+		if (d->adapters[i].used && d->adapters[i].hdl) {
+			rnt_closeDevice(d->adapters[i].hdl);
+		}
+	}
+
+	rnt_monitor_free(d->mon);
+	close(listen_fd);
+	unlink(socket_path);
+	free(d);
+
+	return 0;
+}
+
+#endif // WINDOWS
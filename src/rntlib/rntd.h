@@ -0,0 +1,79 @@
+#ifndef _rntd_h__
+#define _rntd_h__
+
+#include <stdint.h>
+#include "raphnetadapter.h"
+
+/* Adapter daemon
+ *
+ * The daemon keeps the adapters open (so their capabilities are only read
+ * once) and serves them to gcn64ctl instances over a UNIX domain socket.
+ * A client owns an adapter from OPEN until CLOSE or until it disconnects.
+ * Other clients opening the same adapter wait for their turn. Requests are
+ * forwarded as is, so every rnt_* function works through the daemon.
+ */
+
+#define RNTD_PROTOCOL_VERSION	1
+#define RNTD_SOCKET_ENV			"GCN64CTL_SOCKET"
+#define RNTD_SOCKET_NAME		"gcn64ctl.sock"
+#define RNTD_MAX_ADAPTERS		32
+#define RNTD_MAX_CLIENTS		32
+#define RNTD_MAX_REQUEST		1024
+
+/* Message types */
+#define RNTD_MSG_HELLO		1	// payload: struct rntd_hello
+#define RNTD_MSG_LIST		2	// reply payload: struct rnt_adap_info[status]
+#define RNTD_MSG_OPEN		3	// payload: str_path. reply payload: struct rntd_open_reply
+#define RNTD_MSG_EXCHANGE	4	// payload: struct rntd_exchange + command. reply payload: result
+#define RNTD_MSG_CLOSE		5
+
+/* Status */
+#define RNTD_OK					0
+#define RNTD_ERR_UNKNOWN		-1
+#define RNTD_ERR_VERSION		-2
+#define RNTD_ERR_NOT_FOUND		-3
+#define RNTD_ERR_OPEN_FAILED	-4
+#define RNTD_ERR_NOT_OWNER		-5
+#define RNTD_ERR_BAD_REQUEST	-6
+#define RNTD_ERR_CONNECT		-7
+
+struct rntd_msg_hdr {
+	uint16_t type;
+	int32_t status; // Replies: RNTD_OK/RNTD_ERR_*, or the result of rnt_exchange()
+	uint32_t len; // Payload bytes that follow
+};
+
+struct rntd_hello {
+	uint32_t version;
+	uint32_t info_size; // sizeof(struct rnt_adap_info)
+};
+
+struct rntd_open_reply {
+	int32_t report_size;
+	struct rnt_adap_info info;
+};
+
+struct rntd_exchange {
+	uint16_t result_max;
+	uint16_t outlen;
+};
+
+/** \brief Get the socket path: $GCN64CTL_SOCKET, $XDG_RUNTIME_DIR/gcn64ctl.sock or /tmp/gcn64ctl-<uid>.sock */
+int rntd_defaultSocketPath(char *dst, int dstlen);
+
+/** \brief Run the daemon until SIGINT or SIGTERM
+ * \param socket_path The socket to listen on. NULL for the default.
+ * \return 0 on normal exit, -1 on error
+ */
+int rntd_serve(const char *socket_path);
+
+/** \brief Get the adapters from the daemon. For raphnetadapter.c
+ * \param list Receives the list (to free())
+ * \return The number of adapters, or RNTD_ERR_*
+ */
+int rntd_clientList(const char *socket_path, struct rnt_adap_info **list);
+
+/** \brief Open hdl->info through the daemon, waiting for other clients to release it. For raphnetadapter.c */
+int rntd_clientOpen(rnt_hdl_t hdl, const char *socket_path);
+
+#endif // _rntd_h__
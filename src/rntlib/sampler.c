@@ -0,0 +1,99 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "sampler.h"
+#include "timer.h"
+
+static void *acquisitionThread(void *arg)
+{
+	struct sampler *smp = arg;
+	struct sampler_frame frame;
+
+	while (__atomic_load_n(&smp->running, __ATOMIC_RELAXED)) {
+		frame.timestamp = getMicroseconds();
+		frame.len = 0;
+
+		if (smp->func(smp, &frame)) {
+			// Seen by the consumer after the frames already pushed
+			__atomic_store_n(&smp->error, 1, __ATOMIC_RELEASE);
+			break;
+		}
+
+		rnt_ring_push(&smp->ring, &frame);
+		__atomic_store_n(&smp->samples, smp->samples + 1, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+int sampler_start(struct sampler *smp, rnt_hdl_t hdl, int chn, int param, sampler_func func, void *ctx)
+{
+	memset(smp, 0, sizeof(struct sampler));
+	smp->hdl = hdl;
+	smp->chn = chn;
+	smp->param = param;
+	smp->ctx = ctx;
+	smp->func = func;
+	smp->running = 1;
+
+	if (rnt_ring_init(&smp->ring, SAMPLER_RING_SIZE, sizeof(struct sampler_frame)))
+		return -1;
+
+	if (pthread_create(&smp->thread, NULL, acquisitionThread, smp)) {
+		perror("pthread_create");
+		rnt_ring_free(&smp->ring);
+		return -1;
+	}
+
+	return 0;
+}
+
+void sampler_stop(struct sampler *smp)
+{
+	__atomic_store_n(&smp->running, 0, __ATOMIC_RELAXED);
+	pthread_join(smp->thread, NULL);
+	rnt_ring_free(&smp->ring);
+}
+
+int sampler_read(struct sampler *smp, struct sampler_frame *dst, int max_frames)
+{
+	int error, n = 0;
+
+	// Checked first: frames pushed before the error are then all visible below
+	error = __atomic_load_n(&smp->error, __ATOMIC_ACQUIRE);
+
+	while (n < max_frames && rnt_ring_pop(&smp->ring, &dst[n])) {
+		n++;
+	}
+
+	if (!n && error) {
+		return -1;
+	}
+
+	return n;
+}
+
+unsigned int sampler_samples(struct sampler *smp)
+{
+	return __atomic_load_n(&smp->samples, __ATOMIC_RELAXED);
+}
+
+unsigned int sampler_overruns(struct sampler *smp)
+{
+	return rnt_ring_overruns(&smp->ring);
+}
@@ -0,0 +1,63 @@
+#ifndef _sampler_h__
+#define _sampler_h__
+
+#include <stdint.h>
+#include <pthread.h>
+#include "raphnetadapter.h"
+#include "rnt_ring.h"
+
+#define SAMPLER_RING_SIZE	4096
+#define SAMPLER_MAX_DATA	64
+
+struct sampler_frame {
+	/** Acquisition time (monotonic, microseconds) */
+	uint64_t timestamp;
+	int len;
+	uint8_t data[SAMPLER_MAX_DATA];
+};
+
+struct sampler;
+
+/** \brief Acquire one frame (called by the acquisition thread)
+ *
+ * The timestamp is set before the call, but may be replaced.
+ *
+ * \return 0 on success, -1 to stop sampling
+ */
+typedef int (*sampler_func)(struct sampler *smp, struct sampler_frame *frame);
+
+/**
+ * \brief Acquisition thread pushing raw frames into a lock-free ring
+ *
+ * Frames are acquired as fast as the adapter answers, independently of
+ * how fast the consumer (display, recorder) reads them. Only the
+ * acquisition thread talks to the adapter while sampling is active.
+ */
+struct sampler {
+	rnt_hdl_t hdl;
+	int chn;
+	int param; // For use by the sampling function
+	void *ctx; // For use by the sampling function
+	sampler_func func;
+
+	pthread_t thread;
+	int running;
+	int error;
+	unsigned int samples;
+
+	struct rnt_ring ring;
+};
+
+int sampler_start(struct sampler *smp, rnt_hdl_t hdl, int chn, int param, sampler_func func, void *ctx);
+void sampler_stop(struct sampler *smp);
+
+/** \return Number of frames copied to dst (oldest first), or -1 if acquisition stopped and all frames were read. */
+int sampler_read(struct sampler *smp, struct sampler_frame *dst, int max_frames);
+
+/** \brief Number of frames acquired so far */
+unsigned int sampler_samples(struct sampler *smp);
+
+/** \brief Number of frames discarded because the consumer did not keep up */
+unsigned int sampler_overruns(struct sampler *smp);
+
+#endif // _sampler_h__
@@ -0,0 +1,251 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "sipoll.h"
+#include "gcn64_protocol.h"
+#include "timer.h"
+
+static const struct {
+	const char *name;
+	int type;
+} type_names[] = {
+	{ "n64", SIPOLL_N64 },
+	{ "gc", SIPOLL_GC },
+	{ "gc_keyboard", SIPOLL_GC_KEYBOARD },
+	{ "n64_keyboard", SIPOLL_N64_KEYBOARD },
+};
+
+void sipoll_init(struct sipoll *sp, rnt_hdl_t hdl)
+{
+	memset(sp, 0, sizeof(struct sipoll));
+	sp->hdl = hdl;
+}
+
+int sipoll_addPort(struct sipoll *sp, uint8_t chn, int type, int gc_mode)
+{
+	struct sipoll_port *port;
+
+	if (sp->n_ports >= SIPOLL_MAX_PORTS) {
+		fprintf(stderr, "sipoll: Too many ports\n");
+		return -1;
+	}
+
+	port = &sp->ports[sp->n_ports];
+	memset(port, 0, sizeof(struct sipoll_port));
+	port->chn = chn;
+	port->type = type;
+	port->gc_mode = gc_mode;
+
+	switch (type)
+	{
+		case SIPOLL_N64:
+			port->tx[0] = N64_GET_STATUS;
+			port->tx_len = 1;
+			port->rx_len = N64_GET_STATUS_REPLY_LENGTH;
+			break;
+
+		case SIPOLL_GC:
+			port->tx[0] = GC_GETSTATUS1;
+			port->tx[1] = GC_GETSTATUS2_MODE(gc_mode);
+			port->tx[2] = GC_GETSTATUS3(0);
+			port->tx_len = 3;
+			port->rx_len = GC_GETSTATUS_REPLY_LENGTH;
+			break;
+
+		case SIPOLL_GC_KEYBOARD:
+			port->tx[0] = 0x54;
+			port->tx_len = 3;
+			port->rx_len = 8;
+			break;
+
+		case SIPOLL_N64_KEYBOARD:
+			port->tx[0] = 0x13;
+			port->tx_len = 2;
+			port->rx_len = 7;
+			break;
+
+		default:
+			fprintf(stderr, "sipoll: Invalid controller type %d\n", type);
+			return -1;
+	}
+
+	sp->n_ports++;
+
+	return 0;
+}
+
+static void decodeGamecube(int mode, struct sipoll_status *st)
+{
+	const uint8_t *status = st->raw;
+
+	st->buttons = status[0] << 8 | status[1];
+	st->x = (int8_t)(status[2]+0x80);
+	st->y = (int8_t)(status[3]+0x80);
+
+	switch (mode)
+	{
+		case 3: // C-Stick 8 bit, L/R 8 bits
+			st->cx = (int8_t)(status[4]+0x80);
+			st->cy = (int8_t)(status[5]+0x80);
+			st->lt = status[6];
+			st->rt = status[7];
+			break;
+
+		default: // C-Stick 8 bit, L/R 4 bits
+		case 0:
+			st->cx = (int8_t)(status[4]+0x80);
+			st->cy = (int8_t)(status[5]+0x80);
+			st->lt = status[6] >> 4;
+			st->rt = status[6] & 0xf;
+			break;
+
+		case 1: // C-Stick 4 bits, L/R 8 bits
+			st->cx = (int8_t)((status[4]&0xf0)+0x80);
+			st->cy = (int8_t)((status[4]<<4)+0x80);
+			st->lt = status[5];
+			st->rt = status[6];
+			break;
+
+		case 2: // C-Stick 4 bits, L/R 4 bits
+			st->cx = (int8_t)((status[4]&0xf0)+0x80);
+			st->cy = (int8_t)((status[4]<<4)+0x80);
+			st->lt = status[5] >> 4;
+			st->rt = status[5] & 0xf;
+			break;
+
+		case 4: // C-Stick 8 bits, L/R 0 bits
+			st->cx = (int8_t)(status[4]+0x80);
+			st->cy = (int8_t)(status[5]+0x80);
+			st->lt = st->rt = 0;
+			break;
+	}
+}
+
+void sipoll_decode(int type, int gc_mode, struct sipoll_status *st)
+{
+	uint8_t lrc;
+	int i;
+
+	st->buttons = 0;
+	st->x = st->y = st->cx = st->cy = 0;
+	st->lt = st->rt = 0;
+	memset(st->keys, 0, sizeof(st->keys));
+	st->error = 0;
+
+	if (st->timed_out)
+		return;
+
+	switch (type)
+	{
+		case SIPOLL_N64:
+			st->buttons = st->raw[0] << 8 | st->raw[1];
+			st->x = (int8_t)st->raw[2];
+			st->y = (int8_t)st->raw[3];
+			break;
+
+		case SIPOLL_GC:
+			decodeGamecube(gc_mode, st);
+			break;
+
+		case SIPOLL_GC_KEYBOARD:
+			// See pollraw_gamecube_keyboard() for the format
+			for (i=0, lrc=0; i<7; i++) {
+				lrc ^= st->raw[i];
+			}
+			st->error = (st->raw[7] != lrc) || (st->raw[0] & 0x80);
+			for (i=0; i<3; i++) {
+				st->keys[i] = st->raw[4+i];
+			}
+			break;
+
+		case SIPOLL_N64_KEYBOARD:
+			// See pollraw_randnet_keyboard() for the format
+			for (i=0; i<3; i++) {
+				st->keys[i] = st->raw[i*2] << 8 | st->raw[i*2+1];
+			}
+			st->error = st->raw[6] & 0x10;
+			st->buttons = st->raw[6] & 0x01; // Home key
+			break;
+	}
+}
+
+int sipoll_poll(struct sipoll *sp, struct sipoll_frame *frame)
+{
+	struct blockio_op ops[SIPOLL_MAX_PORTS];
+	struct sipoll_port *port;
+	struct sipoll_status *st;
+	int i;
+
+	// rx_len is overwritten by the result, so the ops are rebuilt each time.
+	for (i=0; i<sp->n_ports; i++) {
+		port = &sp->ports[i];
+		st = &frame->status[i];
+
+		memset(st->raw, 0, sizeof(st->raw));
+		ops[i].chn = port->chn;
+		ops[i].tx_len = port->tx_len;
+		ops[i].tx_data = port->tx;
+		ops[i].rx_len = port->rx_len;
+		ops[i].rx_data = st->raw;
+	}
+
+	frame->timestamp = getMicroseconds();
+	if (gcn64lib_blockIO(sp->hdl, ops, sp->n_ports) < 0) {
+		return -1;
+	}
+
+	frame->n_ports = sp->n_ports;
+	for (i=0; i<sp->n_ports; i++) {
+		port = &sp->ports[i];
+		st = &frame->status[i];
+
+		st->len = ops[i].rx_len & BIO_RXTX_MASK;
+		st->timed_out = (ops[i].rx_len & (BIO_RX_LEN_TIMEDOUT | BIO_RX_LEN_PARTIAL)) || st->len != port->rx_len;
+		if (st->timed_out) {
+			port->timeouts++;
+		}
+		sipoll_decode(port->type, port->gc_mode, st);
+	}
+	sp->frames++;
+
+	return 0;
+}
+
+const char *sipoll_typeName(int type)
+{
+	int i;
+
+	for (i=0; i<sizeof(type_names)/sizeof(type_names[0]); i++) {
+		if (type_names[i].type == type)
+			return type_names[i].name;
+	}
+
+	return "unknown";
+}
+
+int sipoll_parseType(const char *name)
+{
+	int i;
+
+	for (i=0; i<sizeof(type_names)/sizeof(type_names[0]); i++) {
+		if (!strcmp(type_names[i].name, name))
+			return type_names[i].type;
+	}
+
+	return -1;
+}
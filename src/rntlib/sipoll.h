@@ -0,0 +1,92 @@
+#ifndef _sipoll_h__
+#define _sipoll_h__
+
+#include <stdint.h>
+#include "raphnetadapter.h"
+#include "gcn64lib.h"
+
+#define SIPOLL_MAX_PORTS	4
+#define SIPOLL_MAX_TX		3
+#define SIPOLL_MAX_RX		8
+
+/* Controller types */
+#define SIPOLL_N64			1
+#define SIPOLL_GC			2
+#define SIPOLL_GC_KEYBOARD	3
+#define SIPOLL_N64_KEYBOARD	4 // Randnet
+
+/** \brief Decoded status of one controller */
+struct sipoll_status {
+	/** Set when the controller did not answer (or the answer was incomplete) */
+	int timed_out;
+	uint8_t len;
+	uint8_t raw[SIPOLL_MAX_RX];
+
+	/* Controllers (N64 has no C-stick axes or triggers) */
+	uint16_t buttons;
+	int8_t x, y, cx, cy;
+	uint8_t lt, rt;
+
+	/* Keyboards: Up to 3 keys down, 0 when unused */
+	uint16_t keys[3];
+	int error; // Keyboard reported an error (or bad LRC)
+};
+
+/** \brief The status of all ports, read in the same exchange */
+struct sipoll_frame {
+	/** Acquisition time (monotonic, microseconds) */
+	uint64_t timestamp;
+	int n_ports;
+	struct sipoll_status status[SIPOLL_MAX_PORTS];
+};
+
+struct sipoll_port {
+	uint8_t chn;
+	int type;
+	int gc_mode; // For SIPOLL_GC
+	uint8_t tx[SIPOLL_MAX_TX];
+	uint8_t tx_len, rx_len;
+	int timeouts;
+};
+
+/**
+ * \brief Poll several controllers with one block IO request
+ *
+ * The status command of each port goes in the same RQ_GCN64_BLOCK_IO
+ * request, so each frame costs a single exchange with the adapter,
+ * whatever the number of ports. Adapters without block IO support get
+ * one raw command per port instead.
+ *
+ * The caller must suspend the adapter polling first.
+ */
+struct sipoll {
+	rnt_hdl_t hdl;
+	int n_ports;
+	struct sipoll_port ports[SIPOLL_MAX_PORTS];
+	int frames;
+};
+
+void sipoll_init(struct sipoll *sp, rnt_hdl_t hdl);
+
+/** \brief Add a port to poll
+ * \param gc_mode Gamecube status mode (0-7), for SIPOLL_GC
+ * \return 0 on success, -1 if there is no room or the type is invalid
+ */
+int sipoll_addPort(struct sipoll *sp, uint8_t chn, int type, int gc_mode);
+
+/** \brief Poll all ports once
+ * \return 0 on success (even if some ports timed out), -1 on error
+ */
+int sipoll_poll(struct sipoll *sp, struct sipoll_frame *frame);
+
+/** \brief Decode a raw status answer (sets the fields of st from st->raw) */
+void sipoll_decode(int type, int gc_mode, struct sipoll_status *st);
+
+const char *sipoll_typeName(int type);
+
+/** \brief Get a type from its name (n64, gc, gc_keyboard, n64_keyboard)
+ * \return The type, or -1 if unknown
+ */
+int sipoll_parseType(const char *name);
+
+#endif // _sipoll_h__
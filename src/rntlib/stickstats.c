@@ -0,0 +1,390 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stickstats.h"
+
+#define STICKSTATS_MAGIC	"RNTSTCK"
+#define STICKSTATS_VERSION	1
+
+// Positions this close to the most frequent one are considered at rest
+#define REST_RADIUS		8
+// Positions seen less than this fraction of the rest position are only passing through
+#define REST_MIN_FRACTION	100
+// With an octagonal gate, the reach in the gate directions exceeds the reach between them by this factor
+#define OCTAGON_FACTOR	1.02
+
+static const double range_limits[4] = { 95, 90, 80, 70 }; // % of nominal, minimum for A, B, C, D
+static const double drift_limits[4] = { 2, 4, 6, 10 }; // maximum for A, B, C, D
+static const double deadzone_limits[4] = { 1, 2, 4, 8 }; // maximum for A, B, C, D
+
+int stickstats_init(struct stickstats *st, int nominal_range)
+{
+	memset(st, 0, sizeof(struct stickstats));
+
+	st->grid = calloc(256 * 256, sizeof(uint32_t));
+	if (!st->grid) {
+		perror("calloc");
+		return -1;
+	}
+	st->nominal_range = nominal_range;
+	stickstats_reset(st);
+
+	return 0;
+}
+
+void stickstats_free(struct stickstats *st)
+{
+	free(st->grid);
+	st->grid = NULL;
+}
+
+void stickstats_reset(struct stickstats *st)
+{
+	st->samples = 0;
+	st->min_x = st->min_y = 127;
+	st->max_x = st->max_y = -128;
+	memset(st->grid, 0, 256 * 256 * sizeof(uint32_t));
+}
+
+static int clampAxis(int v)
+{
+	return v < -128 ? -128 : v > 127 ? 127 : v;
+}
+
+void stickstats_add(struct stickstats *st, int x, int y)
+{
+	x = clampAxis(x);
+	y = clampAxis(y);
+
+	if (x < st->min_x) st->min_x = x;
+	if (x > st->max_x) st->max_x = x;
+	if (y < st->min_y) st->min_y = y;
+	if (y > st->max_y) st->max_y = y;
+
+	st->grid[(x + 128) * 256 + y + 128]++;
+	st->samples++;
+}
+
+void stickstats_merge(struct stickstats *dst, const struct stickstats *src)
+{
+	int i;
+
+	if (!src->samples)
+		return;
+
+	if (src->min_x < dst->min_x) dst->min_x = src->min_x;
+	if (src->max_x > dst->max_x) dst->max_x = src->max_x;
+	if (src->min_y < dst->min_y) dst->min_y = src->min_y;
+	if (src->max_y > dst->max_y) dst->max_y = src->max_y;
+
+	for (i=0; i<256 * 256; i++) {
+		dst->grid[i] += src->grid[i];
+	}
+	dst->samples += src->samples;
+}
+
+static void putLE(uint8_t *dst, uint64_t value, int len)
+{
+	int i;
+
+	for (i=0; i<len; i++) {
+		dst[i] = value >> (i * 8);
+	}
+}
+
+static uint64_t getLE(const uint8_t *src, int len)
+{
+	uint64_t value = 0;
+	int i;
+
+	for (i=0; i<len; i++) {
+		value |= (uint64_t)src[i] << (i * 8);
+	}
+
+	return value;
+}
+
+/* File format: magic and version, samples (64 bit), then the count
+ * (32 bit) of each grid position seen, as X, Y (signed bytes), count.
+ * All little endian. Ranges are recomputed from the grid. */
+int stickstats_save(const struct stickstats *st, const char *filename)
+{
+	FILE *fptr;
+	uint8_t buf[8];
+	int i;
+
+	fptr = fopen(filename, "wb");
+	if (!fptr) {
+		perror(filename);
+		return -1;
+	}
+
+	fwrite(STICKSTATS_MAGIC, 7, 1, fptr);
+	fputc(STICKSTATS_VERSION, fptr);
+	putLE(buf, st->samples, 8);
+	fwrite(buf, 8, 1, fptr);
+
+	for (i=0; i<256 * 256; i++) {
+		if (!st->grid[i])
+			continue;
+		buf[0] = (i >> 8) - 128;
+		buf[1] = (i & 0xff) - 128;
+		putLE(buf + 2, st->grid[i], 4);
+		fwrite(buf, 6, 1, fptr);
+	}
+
+	if (fclose(fptr)) {
+		perror(filename);
+		return -1;
+	}
+
+	return 0;
+}
+
+int stickstats_load(struct stickstats *st, const char *filename)
+{
+	FILE *fptr;
+	uint8_t buf[8];
+	uint64_t samples, total = 0;
+	uint32_t count;
+	int x, y;
+
+	fptr = fopen(filename, "rb");
+	if (!fptr) {
+		perror(filename);
+		return -1;
+	}
+
+	if (fread(buf, 8, 1, fptr) != 1 || memcmp(buf, STICKSTATS_MAGIC, 7) || buf[7] != STICKSTATS_VERSION) {
+		fprintf(stderr, "%s: Not a stick statistics file\n", filename);
+		goto error;
+	}
+	if (fread(buf, 8, 1, fptr) != 1) {
+		goto truncated;
+	}
+	samples = getLE(buf, 8);
+
+	while (fread(buf, 6, 1, fptr) == 1) {
+		x = (int8_t)buf[0];
+		y = (int8_t)buf[1];
+		count = getLE(buf + 2, 4);
+
+		if (x < st->min_x) st->min_x = x;
+		if (x > st->max_x) st->max_x = x;
+		if (y < st->min_y) st->min_y = y;
+		if (y > st->max_y) st->max_y = y;
+		st->grid[(x + 128) * 256 + y + 128] += count;
+		total += count;
+	}
+
+	if (total != samples) {
+		goto truncated;
+	}
+	st->samples += samples;
+
+	fclose(fptr);
+	return 0;
+
+truncated:
+	fprintf(stderr, "%s: File truncated\n", filename);
+error:
+	fclose(fptr);
+	return -1;
+}
+
+static char gradeAtLeast(double value, const double limits[4])
+{
+	int i;
+
+	for (i=0; i<4; i++) {
+		if (value >= limits[i])
+			return 'A' + i;
+	}
+	return 'F';
+}
+
+static char gradeAtMost(double value, const double limits[4])
+{
+	int i;
+
+	for (i=0; i<4; i++) {
+		if (value <= limits[i])
+			return 'A' + i;
+	}
+	return 'F';
+}
+
+int stickstats_analyze(const struct stickstats *st, struct stickstats_report *rep)
+{
+	int x, y, px = 0, py = 0, sector, k, reached = 0;
+	uint32_t count, peak = 0;
+	double dx, dy, r, weight = 0, sum_x = 0, sum_y = 0, sumsq_x = 0, sumsq_y = 0;
+	double min_r = 0, max_r = 0, cardinal = 0, angle, reach_min;
+	char worst;
+
+	memset(rep, 0, sizeof(struct stickstats_report));
+	if (!st->samples)
+		return -1;
+
+	rep->samples = st->samples;
+	rep->min_x = st->min_x;
+	rep->max_x = st->max_x;
+	rep->min_y = st->min_y;
+	rep->max_y = st->max_y;
+
+	// The rest position is around the most frequent one
+	for (x=st->min_x; x<=st->max_x; x++) {
+		for (y=st->min_y; y<=st->max_y; y++) {
+			count = st->grid[(x + 128) * 256 + y + 128];
+			if (count > peak) {
+				peak = count;
+				px = x;
+				py = y;
+			}
+		}
+	}
+
+	for (x=px-REST_RADIUS; x<=px+REST_RADIUS; x++) {
+		for (y=py-REST_RADIUS; y<=py+REST_RADIUS; y++) {
+			if (x < -128 || x > 127 || y < -128 || y > 127)
+				continue;
+			count = st->grid[(x + 128) * 256 + y + 128];
+			if (!count || count < peak / REST_MIN_FRACTION)
+				continue;
+			weight += count;
+			sum_x += (double)count * x;
+			sum_y += (double)count * y;
+			sumsq_x += (double)count * x * x;
+			sumsq_y += (double)count * y * y;
+		}
+	}
+	rep->rest_x = sum_x / weight;
+	rep->rest_y = sum_y / weight;
+	rep->noise_var_x = fabs(sumsq_x / weight - rep->rest_x * rep->rest_x);
+	rep->noise_var_y = fabs(sumsq_y / weight - rep->rest_y * rep->rest_y);
+	rep->drift = sqrt(rep->rest_x * rep->rest_x + rep->rest_y * rep->rest_y);
+
+	for (x=st->min_x; x<=st->max_x; x++) {
+		for (y=st->min_y; y<=st->max_y; y++) {
+			count = st->grid[(x + 128) * 256 + y + 128];
+			if (!count)
+				continue;
+
+			dx = x - rep->rest_x;
+			dy = y - rep->rest_y;
+			r = sqrt(dx * dx + dy * dy);
+
+			if (abs(x - px) <= REST_RADIUS && abs(y - py) <= REST_RADIUS && count >= peak / REST_MIN_FRACTION) {
+				if (r > rep->deadzone)
+					rep->deadzone = r;
+			}
+
+			// Sectors are centered on their direction (sector 0 on +X)
+			angle = atan2(dy, dx);
+			if (angle < 0)
+				angle += 2 * M_PI;
+			sector = (int)floor(angle / (2 * M_PI) * STICKSTATS_SECTORS + 0.5) % STICKSTATS_SECTORS;
+			if (r > rep->sector_r[sector])
+				rep->sector_r[sector] = r;
+		}
+	}
+
+	// A direction is reached half-way to the nominal range (or clearly outside the rest area)
+	reach_min = st->nominal_range ? st->nominal_range / 2.0 : rep->deadzone + REST_RADIUS;
+
+	rep->octagon = 1;
+	for (k=0; k<8; k++) {
+		rep->gate_r[k] = rep->sector_r[k * STICKSTATS_SECTORS / 8];
+		if (rep->gate_r[k] >= reach_min)
+			rep->directions++;
+
+		// Compare with the reach half-way to the previous and next gate directions
+		if (rep->gate_r[k] < rep->sector_r[(k * 2 + 1) * STICKSTATS_SECTORS / 16] * OCTAGON_FACTOR ||
+			rep->gate_r[k] < rep->sector_r[((k * 2 + 15) % 16) * STICKSTATS_SECTORS / 16] * OCTAGON_FACTOR)
+			rep->octagon = 0;
+
+		if (!(k & 1))
+			cardinal += rep->gate_r[k] / 4;
+	}
+	if (rep->directions < 8)
+		rep->octagon = 0;
+
+	for (sector=0; sector<STICKSTATS_SECTORS; sector++) {
+		r = rep->sector_r[sector];
+		if (r <= rep->deadzone)
+			continue;
+		if (!reached || r < min_r)
+			min_r = r;
+		if (r > max_r)
+			max_r = r;
+		reached++;
+	}
+	if (max_r > 0)
+		rep->circularity = min_r * 100 / max_r;
+
+	rep->range_pct = st->nominal_range ? cardinal * 100 / st->nominal_range : 0;
+
+	if (!st->nominal_range) {
+		rep->grade_range = '-';
+	} else if (rep->directions < 8) {
+		rep->grade_range = '?';
+	} else {
+		rep->grade_range = gradeAtLeast(rep->range_pct, range_limits);
+	}
+	rep->grade_drift = gradeAtMost(rep->drift, drift_limits);
+	rep->grade_deadzone = gradeAtMost(rep->deadzone, deadzone_limits);
+
+	// The overall grade is the worst one
+	worst = rep->grade_drift > rep->grade_deadzone ? rep->grade_drift : rep->grade_deadzone;
+	if (rep->directions < 8) {
+		rep->grade = '?';
+	} else if (rep->grade_range == '-') {
+		rep->grade = worst;
+	} else {
+		rep->grade = rep->grade_range > worst ? rep->grade_range : worst;
+	}
+
+	return 0;
+}
+
+void stickstats_printReport(FILE *fptr, const char *name, const struct stickstats_report *rep)
+{
+	int k;
+
+	fprintf(fptr, "%s: %llu samples, grade %c\n", name, (unsigned long long)rep->samples, rep->grade);
+	fprintf(fptr, "  Range: X %d..%d, Y %d..%d", rep->min_x, rep->max_x, rep->min_y, rep->max_y);
+	if (rep->grade_range != '-') {
+		fprintf(fptr, ", cardinal reach %.0f%% of nominal (%c)", rep->range_pct, rep->grade_range);
+	}
+	fprintf(fptr, "\n");
+	fprintf(fptr, "  Rest position: (%.1f, %.1f), center drift %.1f (%c)\n",
+			rep->rest_x, rep->rest_y, rep->drift, rep->grade_drift);
+	fprintf(fptr, "  Noise at rest: stddev X %.2f, Y %.2f, deadzone radius %.1f (%c)\n",
+			sqrt(rep->noise_var_x), sqrt(rep->noise_var_y), rep->deadzone, rep->grade_deadzone);
+	fprintf(fptr, "  Gate: %s, reach (+X, +X+Y, +Y, ...):", rep->octagon ? "octagonal" : "round or irregular");
+	for (k=0; k<8; k++) {
+		fprintf(fptr, " %.0f", rep->gate_r[k]);
+	}
+	fprintf(fptr, "\n");
+	fprintf(fptr, "  Circularity %.0f%%, gate directions reached %d/8\n", rep->circularity, rep->directions);
+	if (rep->directions < 8) {
+		fprintf(fptr, "  Move the stick all around the gate to grade it\n");
+	}
+}
@@ -0,0 +1,87 @@
+#ifndef _stickstats_h__
+#define _stickstats_h__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Nominal reach of a good stick in the cardinal directions */
+#define STICKSTATS_RANGE_N64	80
+#define STICKSTATS_RANGE_GC		100
+
+// The reach is evaluated in this many directions (a multiple of 8)
+#define STICKSTATS_SECTORS	64
+
+/**
+ * \brief Analog stick statistics, accumulated sample by sample
+ *
+ * Adding a sample only updates counters and the occupancy grid, so it
+ * is cheap enough to be done for every sample at the full poll rate.
+ * Everything else (rest position, noise, gate shape, grade) is derived
+ * from the grid by stickstats_analyze(). Statistics of several sessions
+ * with the same controller can be merged, or saved and loaded.
+ *
+ * Axis values are signed, 0 at the center. They are clamped to -128..127.
+ */
+struct stickstats {
+	int nominal_range;
+	uint64_t samples;
+	int min_x, max_x, min_y, max_y;
+	uint32_t *grid; // 256x256 sample counts, by X and Y (offset by 128)
+};
+
+struct stickstats_report {
+	uint64_t samples;
+	int min_x, max_x, min_y, max_y;
+
+	/** Mean position while at rest, and its distance from 0,0 */
+	double rest_x, rest_y, drift;
+	/** Variance of each axis while at rest */
+	double noise_var_x, noise_var_y;
+	/** Radius of the positions seen at rest (deadzone needed to hide the noise) */
+	double deadzone;
+
+	/** Reach in each direction, from the rest position. Sector 0 is +X, sector
+	 * STICKSTATS_SECTORS/4 is +Y. */
+	double sector_r[STICKSTATS_SECTORS];
+	/** Reach in the 8 gate directions (+X, +X+Y, +Y, ...) */
+	double gate_r[8];
+	/** Gate directions reached */
+	int directions;
+	/** The reach peaks in the gate directions, as with an octagonal gate */
+	int octagon;
+	/** Smallest reach over the largest, in %, for the directions reached */
+	double circularity;
+	/** Mean reach in the cardinal directions, in % of the nominal range */
+	double range_pct;
+
+	/** A (best) to F, or '?' if not all the gate directions were reached. The
+	 * range is not graded ('-') when the nominal range is unknown (0). */
+	char grade_range, grade_drift, grade_deadzone, grade;
+};
+
+/**
+ * \param nominal_range Reach of a good stick in the cardinal directions (STICKSTATS_RANGE_*), 0 if unknown
+ * \return 0 on success, -1 on error
+ */
+int stickstats_init(struct stickstats *st, int nominal_range);
+void stickstats_free(struct stickstats *st);
+void stickstats_reset(struct stickstats *st);
+
+void stickstats_add(struct stickstats *st, int x, int y);
+
+/** \brief Add the samples of src to dst */
+void stickstats_merge(struct stickstats *dst, const struct stickstats *src);
+
+/** \brief Load statistics saved by stickstats_save() (into an initialized struct)
+ * \return 0 on success, -1 on error
+ */
+int stickstats_load(struct stickstats *st, const char *filename);
+/** \return 0 on success, -1 on error */
+int stickstats_save(const struct stickstats *st, const char *filename);
+
+/** \return 0 on success, -1 if there are no samples */
+int stickstats_analyze(const struct stickstats *st, struct stickstats_report *rep);
+
+void stickstats_printReport(FILE *fptr, const char *name, const struct stickstats_report *rep);
+
+#endif // _stickstats_h__
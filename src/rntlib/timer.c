@@ -17,6 +17,19 @@ uint64_t getMilliseconds()
 #endif
 }
 
+uint64_t getMicroseconds()
+{
+#ifndef WINDOWS
+	struct timespec time_now;
+	clock_gettime(CLOCK_MONOTONIC, &time_now);
+	return (uint64_t)time_now.tv_sec * 1000000 + time_now.tv_nsec / 1000;
+#else
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return count.QuadPart / freq.QuadPart * 1000000 + (count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#endif
+}
 
 #ifdef TEST_TIMER
 #include <stdio.h>
@@ -4,5 +4,6 @@
 #include <stdint.h>
 
 uint64_t getMilliseconds();
+uint64_t getMicroseconds();
 
 #endif // _timer_h__
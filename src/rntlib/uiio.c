@@ -3,6 +3,10 @@
 #include <string.h>
 
 #include "uiio.h"
+#include "timer.h"
+
+// No rate estimate before this much time has elapsed
+#define RATE_MIN_ELAPSED_US	200000
 
 static int uiio_std_ask(int type, const char *fmt, ...)
 {
@@ -97,10 +101,13 @@ static int uiio_std_update(uiio *u)
 {
 	int i;
 	float progress_pc;
+	char rate[64];
 
 	if (u->progress_status < UIIO_PROGRESS_STARTED)
 		return 0;
 
+	uiio_formatRate(u, rate, sizeof(rate));
+
 	progress_pc = u->cur_progress / (float)u->max_progress * 100.0;
 
 	if (u->progress_type == PROGRESS_TYPE_ADDRESS) {
@@ -114,15 +121,17 @@ static int uiio_std_update(uiio *u)
 			}
 		}
 
-		printf("] 0x%04x / 0x%04x (%.1f%%)",
+		printf("] 0x%04x / 0x%04x (%.1f%%) %-32s",
 			u->cur_progress,
 			u->max_progress,
-			progress_pc	);
+			progress_pc,
+			rate);
 	} else {
 		// percent
-		printf("%s : %.2f%%\r",
+		printf("%s : %.2f%% %-32s\r",
 			u->caption,
-			u->cur_progress / (float)u->max_progress * 100.0);
+			u->cur_progress / (float)u->max_progress * 100.0,
+			rate);
 
 	}
 
@@ -131,6 +140,35 @@ static int uiio_std_update(uiio *u)
 	return 0;
 }
 
+static void uiio_machine_update_start(uiio *u)
+{
+	printf("progress_start\t%s\t%u\t%d\n", u->caption ? u->caption : "", u->max_progress, u->unit_bytes);
+	fflush(stdout);
+	u->progress_status = UIIO_PROGRESS_STARTED;
+}
+
+static void uiio_machine_update_end(uiio *u, const char *msg)
+{
+	if (u->progress_status < UIIO_PROGRESS_STARTED)
+		return;
+
+	printf("progress_end\t%s\n", msg);
+	fflush(stdout);
+	u->progress_status = UIIO_PROGRESS_STOPPED;
+}
+
+static int uiio_machine_update(uiio *u)
+{
+	if (u->progress_status < UIIO_PROGRESS_STARTED)
+		return 0;
+
+	printf("progress\t%u\t%u\t%.0f\t%d\n", u->cur_progress, u->max_progress,
+			u->rate * u->unit_bytes, u->eta);
+	fflush(stdout);
+
+	return 0;
+}
+
 static uiio uiio_std = {
 	.ask = uiio_std_ask,
 	.error = uiio_std_error,
@@ -142,6 +180,19 @@ static uiio uiio_std = {
 };
 
 
+void uiio_std_setMachineReadable(int enable)
+{
+	if (enable) {
+		uiio_std.progressStart = uiio_machine_update_start;
+		uiio_std.update = uiio_machine_update;
+		uiio_std.progressEnd = uiio_machine_update_end;
+	} else {
+		uiio_std.progressStart = uiio_std_update_start;
+		uiio_std.update = uiio_std_update;
+		uiio_std.progressEnd = uiio_std_update_end;
+	}
+}
+
 void uiio_init_std(uiio *u)
 {
 	if (u)
@@ -154,3 +205,100 @@ uiio *getUIIO(uiio *u)
 		return u;
 	return &uiio_std;
 }
+
+static void computeRate(uiio *u, uint64_t now)
+{
+	uint64_t elapsed = now - u->start_us;
+
+	if (elapsed < RATE_MIN_ELAPSED_US || !u->cur_progress) {
+		u->rate = 0;
+		u->eta = -1;
+		return;
+	}
+
+	u->rate = u->cur_progress * 1000000.0 / elapsed;
+	if (u->cur_progress >= u->max_progress) {
+		u->eta = 0;
+	} else {
+		u->eta = (u->max_progress - u->cur_progress) / u->rate + 0.5;
+	}
+}
+
+void uiio_progressStart(uiio *u, uint32_t max, int unit_bytes)
+{
+	u->cur_progress = 0;
+	u->max_progress = max;
+	u->unit_bytes = unit_bytes;
+	u->start_us = getMicroseconds();
+	u->last_update_us = u->start_us;
+	u->last_progress = 0;
+	u->rate = 0;
+	u->eta = -1;
+
+	u->progressStart(u);
+}
+
+int uiio_progressUpdate(uiio *u, uint32_t cur)
+{
+	uint64_t now;
+	int hz = u->max_update_hz > 0 ? u->max_update_hz : UIIO_DEFAULT_UPDATE_HZ;
+
+	u->cur_progress = cur;
+
+	// Let the implementation see the cancellation right away
+	if (u->progress_status == UIIO_PROGRESS_CANCELLED)
+		return u->update(u);
+
+	now = getMicroseconds();
+	if (now - u->last_update_us < 1000000 / hz)
+		return 0;
+
+	u->last_update_us = now;
+	u->last_progress = cur;
+	computeRate(u, now);
+
+	return u->update(u);
+}
+
+void uiio_progressEnd(uiio *u, const char *msg)
+{
+	// Make sure the final value is displayed
+	if (u->progress_status >= UIIO_PROGRESS_STARTED && u->last_progress != u->cur_progress) {
+		computeRate(u, getMicroseconds());
+		u->last_progress = u->cur_progress;
+		u->update(u);
+	}
+
+	u->progressEnd(u, msg);
+}
+
+int uiio_formatRate(const uiio *u, char *dst, int dstlen)
+{
+	char rate[32];
+	double bps;
+
+	if (u->rate <= 0) {
+		if (dstlen > 0)
+			dst[0] = 0;
+		return 0;
+	}
+
+	if (u->unit_bytes) {
+		bps = u->rate * u->unit_bytes;
+		if (bps >= 1024 * 1024) {
+			snprintf(rate, sizeof(rate), "%.1f MiB/s", bps / (1024 * 1024));
+		} else if (bps >= 1024) {
+			snprintf(rate, sizeof(rate), "%.1f KiB/s", bps / 1024);
+		} else {
+			snprintf(rate, sizeof(rate), "%.0f B/s", bps);
+		}
+	} else {
+		snprintf(rate, sizeof(rate), "%.1f/s", u->rate);
+	}
+
+	if (u->eta >= 0) {
+		return snprintf(dst, dstlen, "%s, %d:%02d left", rate, u->eta / 60, u->eta % 60);
+	}
+
+	return snprintf(dst, dstlen, "%s", rate);
+}
@@ -21,6 +21,9 @@
 #define UIIO_PROGRESS_STARTED		1
 #define UIIO_PROGRESS_CANCELLED		2
 
+/* Default for max_update_hz */
+#define UIIO_DEFAULT_UPDATE_HZ		10
+
 typedef struct _uiio {
 	/**
 	 * \brief Used to ask the user to confirm something before proceeding.
@@ -56,6 +59,14 @@ typedef struct _uiio {
 	int progress_type;
 	uint32_t cur_progress;
 	uint32_t max_progress;
+	int unit_bytes; // Bytes per progress unit, 0 if progress is not a byte count
+
+	/* Maintained by uiio_progressStart/Update/End */
+	int max_update_hz; // 0 for UIIO_DEFAULT_UPDATE_HZ
+	uint64_t start_us, last_update_us;
+	uint32_t last_progress;
+	float rate; // Progress units per second
+	int eta; // Seconds left, -1 if unknown
 
 	// Indicates the progress will restart for another operation. Used to prevent
 	// waiting for the user to close the progress window. (i.e. Write then verify)
@@ -77,6 +88,39 @@ typedef struct _uiio {
 /** \brief Initizlize a uiio object with default (stdio) implementations */
 void uiio_init_std(uiio *u);
 
+/** \brief Make the stdio progress output machine-readable
+ *
+ * Instead of a progress bar, one tab-separated line is printed per update:
+ *
+ *   progress_start <caption> <max> <unit_bytes>
+ *   progress <cur> <max> <bytes per second> <eta seconds>
+ *   progress_end <message>
+ *
+ * Bytes per second is 0 when progress is not a byte count, eta is -1 when unknown.
+ */
+void uiio_std_setMachineReadable(int enable);
+
+/** \brief Start reporting progress
+ *
+ * Transfer code should use these instead of calling progressStart, update and
+ * progressEnd directly. Updates are coalesced to at most max_update_hz per
+ * second, and the rate and ETA are computed.
+ *
+ * \param max The value of cur_progress when done
+ * \param unit_bytes Bytes per progress unit (0 if not counting bytes)
+ */
+void uiio_progressStart(uiio *u, uint32_t max, int unit_bytes);
+
+/** \brief Set the current progress. Cheap enough to call for every block.
+ * \return Non-zero if the operation was cancelled */
+int uiio_progressUpdate(uiio *u, uint32_t cur);
+
+/** \brief Display the final progress and end */
+void uiio_progressEnd(uiio *u, const char *msg);
+
+/** \brief Format the rate and ETA (i.e. "12.3 KiB/s, 0:04 left") */
+int uiio_formatRate(const uiio *u, char *dst, int dstlen);
+
 /** \param Get a valid uiio pointer.
  * \return Returns u if not NULL, otherwise a pointer to a default structure using stdio is returned */
 uiio *getUIIO(uiio *u);
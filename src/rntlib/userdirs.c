@@ -0,0 +1,81 @@
+/*	Raphnet adapter management tool
+	Copyright (C) 2007-2017  Raphael Assenat <raph@raphnet.net>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "userdirs.h"
+
+#define CACHE_SUBDIR	"gcn64tools"
+
+static int makeDir(const char *path)
+{
+	int res;
+
+#ifdef WINDOWS
+	res = mkdir(path);
+#else
+	res = mkdir(path, 0755);
+#endif
+	if (res && errno != EEXIST) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int rnt_getCacheFilename(const char *name, char *dst, int dstlen)
+{
+	char dir[512];
+	const char *base;
+	int n;
+
+#ifdef WINDOWS
+	base = getenv("LOCALAPPDATA");
+	if (!base)
+		return -1;
+	n = snprintf(dir, sizeof(dir), "%s\\" CACHE_SUBDIR, base);
+#else
+	base = getenv("XDG_CACHE_HOME");
+	if (base && base[0]) {
+		n = snprintf(dir, sizeof(dir), "%s/" CACHE_SUBDIR, base);
+	} else {
+		base = getenv("HOME");
+		if (!base)
+			return -1;
+
+		n = snprintf(dir, sizeof(dir), "%s/.cache", base);
+		if (n >= sizeof(dir) || makeDir(dir))
+			return -1;
+
+		n = snprintf(dir, sizeof(dir), "%s/.cache/" CACHE_SUBDIR, base);
+	}
+#endif
+	if (n >= sizeof(dir) || makeDir(dir))
+		return -1;
+
+#ifdef WINDOWS
+	n = snprintf(dst, dstlen, "%s\\%s", dir, name);
+#else
+	n = snprintf(dst, dstlen, "%s/%s", dir, name);
+#endif
+	if (n >= dstlen)
+		return -1;
+
+	return 0;
+}
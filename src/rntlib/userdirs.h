@@ -0,0 +1,13 @@
+#ifndef _userdirs_h__
+#define _userdirs_h__
+
+/** \brief Build the path of a file in the per-user cache directory
+ *
+ * The directory ($XDG_CACHE_HOME/gcn64tools, ~/.cache/gcn64tools or
+ * %LOCALAPPDATA%\gcn64tools) is created if needed.
+ *
+ * \return 0 on success, -1 if no suitable directory exists or the path does not fit
+ */
+int rnt_getCacheFilename(const char *name, char *dst, int dstlen);
+
+#endif // _userdirs_h__
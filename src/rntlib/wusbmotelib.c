@@ -151,6 +151,167 @@ int wusbmote_i2c_transactions(rnt_hdl_t hdl, struct i2c_transaction *transaction
 	return 0;
 }
 
+/* Transactions which do not fit in a single exchange are rejected by the planner */
+#define I2C_REQUEST_SIZE	63
+#define I2C_REQUEST_BUDGET	(I2C_REQUEST_SIZE - 1) // Minus the command byte
+#define I2C_ANSWER_BUDGET	(I2C_REQUEST_SIZE - 2) // Minus the command byte and the last unusable byte
+
+static struct wusbmote_i2c_timing default_timing = {
+	.gap_us = 0,
+	.adaptive = 1,
+	.max_gap_us = 40000,
+};
+
+struct wusbmote_i2c_timing *wusbmotelib_getDefaultI2CTiming(void)
+{
+	return &default_timing;
+}
+
+void wusbmotelib_setI2CGap(int gap_us, int adaptive)
+{
+	default_timing.gap_us = gap_us;
+	default_timing.adaptive = adaptive;
+}
+
+static int i2c_requestCost(const struct i2c_transaction *txn)
+{
+	return 4 + txn->wr_len;
+}
+
+static int i2c_answerCost(const struct i2c_transaction *txn)
+{
+	return 2 + txn->rd_len;
+}
+
+/** Count how many transactions (starting with the first) fit in one exchange */
+static int i2c_planGroup(const struct i2c_transaction *txns, int n_transactions)
+{
+	int i, rq = 0, ans = 0;
+
+	for (i=0; i<n_transactions; i++) {
+		rq += i2c_requestCost(&txns[i]);
+		ans += i2c_answerCost(&txns[i]);
+		if (rq > I2C_REQUEST_BUDGET || ans > I2C_ANSWER_BUDGET)
+			break;
+	}
+
+	return i;
+}
+
+int wusbmote_i2c_countExchanges(const struct i2c_transaction *transactions, int n_transactions)
+{
+	int n, count = 0;
+
+	while (n_transactions > 0) {
+		n = i2c_planGroup(transactions, n_transactions);
+		if (n < 1)
+			return -1;
+		transactions += n;
+		n_transactions -= n;
+		count++;
+	}
+
+	return count;
+}
+
+static int i2c_runBatch(rnt_hdl_t hdl, struct i2c_transaction *transactions, int n_transactions, struct wusbmote_i2c_timing *timing, int gap_us)
+{
+	int n, res, first = 1;
+
+	while (n_transactions > 0) {
+		n = i2c_planGroup(transactions, n_transactions);
+		if (n < 1) {
+			fprintf(stderr, "transaction does not fit in buffer\n");
+			return -1;
+		}
+
+		if (gap_us && !first) {
+			_delay_us(gap_us);
+		}
+		first = 0;
+
+		res = wusbmote_i2c_transactions(hdl, transactions, n);
+		if (res < 0) {
+			return res;
+		}
+		if (timing) {
+			timing->exchanges++;
+		}
+
+		transactions += n;
+		n_transactions -= n;
+	}
+
+	return 0;
+}
+
+/** Process any number of transactions, packing as many as possible per exchange.
+ *
+ * \param hdl The adapter handle
+ * \param transactions Pointer to an array of i2c_transaction.
+ * \param n_transactions Number of transactions.
+ * \param timing Gap between exchanges and statistics. NULL for no gap.
+ *
+ * When timing->adaptive is set and some transactions fail, they are retried with
+ * a longer gap (doubled each time, up to max_gap_us). The gap which worked is
+ * kept in timing for the next calls. Use only when all transactions are expected
+ * to succeed.
+ */
+int wusbmote_i2c_batch(rnt_hdl_t hdl, struct i2c_transaction *transactions, int n_transactions, struct wusbmote_i2c_timing *timing)
+{
+	uint8_t rd_lens[n_transactions];
+	int i, res, gap_us = timing ? timing->gap_us : 0;
+
+	for (i=0; i<n_transactions; i++) {
+		rd_lens[i] = transactions[i].rd_len;
+	}
+
+	res = i2c_runBatch(hdl, transactions, n_transactions, timing, gap_us);
+	if (res < 0 || !timing || !timing->adaptive) {
+		return res;
+	}
+
+	while (1) {
+		struct i2c_transaction *retry[n_transactions];
+		struct i2c_transaction tmp[n_transactions];
+		int n_retry = 0;
+
+		for (i=0; i<n_transactions; i++) {
+			if (transactions[i].result) {
+				retry[n_retry] = &transactions[i];
+				tmp[n_retry] = transactions[i];
+				tmp[n_retry].rd_len = rd_lens[i];
+				n_retry++;
+			}
+		}
+
+		if (!n_retry || gap_us >= timing->max_gap_us) {
+			break;
+		}
+
+		gap_us = gap_us ? gap_us * 2 : 1000;
+		if (gap_us > timing->max_gap_us) {
+			gap_us = timing->max_gap_us;
+		}
+		timing->retries += n_retry;
+
+		// Give the device some time before retrying
+		_delay_us(gap_us);
+		res = i2c_runBatch(hdl, tmp, n_retry, timing, gap_us);
+		if (res < 0) {
+			return res;
+		}
+
+		for (i=0; i<n_retry; i++) {
+			*retry[i] = tmp[i];
+		}
+
+		timing->gap_us = gap_us;
+	}
+
+	return 0;
+}
+
 /** Scan all I2C addresses to detect chip presence
  *
  * \param hdl The adapter handle
@@ -161,8 +322,10 @@ int wusbmote_i2c_transactions(rnt_hdl_t hdl, struct i2c_transaction *transaction
 int wusbmotelib_i2c_detect(rnt_hdl_t hdl, uint8_t chn, uint8_t *dstBuf, char verbose)
 {
 	int i, j, res;
-	uint8_t buf;
+	uint8_t buf[128];
 	uint8_t addresses[128];
+	struct i2c_transaction txns[128];
+	struct wusbmote_i2c_timing timing;
 	int addr_min = 0;
 	int addr_max = 0x7f;
 
@@ -173,21 +336,26 @@ int wusbmotelib_i2c_detect(rnt_hdl_t hdl, uint8_t chn, uint8_t *dstBuf, char ver
 	}
 
 	for (i=addr_min; i<=addr_max; i++) {
-		struct i2c_transaction txn = {
-			.chn = chn,
-			.wr_len = 0,
-			.rd_len = 1,
-			.rd_data = &buf,
-			.addr = i,
-		};
-
-		res = wusbmote_i2c_transaction(hdl, &txn);
-		if (res < 0) {
-			fprintf(stderr, "error executing transaction\n");
-			return -1;
-		}
+		txns[i - addr_min].chn = chn;
+		txns[i - addr_min].addr = i;
+		txns[i - addr_min].wr_len = 0;
+		txns[i - addr_min].rd_len = 1;
+		txns[i - addr_min].rd_data = &buf[i];
+	}
+
+	// Absent chips are expected to fail, so no adaptive retries here. The gap
+	// set with wusbmotelib_setI2CGap() still applies.
+	timing = default_timing;
+	timing.adaptive = 0;
+	res = wusbmote_i2c_batch(hdl, txns, addr_max - addr_min + 1, &timing);
+	default_timing.exchanges = timing.exchanges; // Keep the statistics
+	if (res < 0) {
+		fprintf(stderr, "error executing transaction\n");
+		return -1;
+	}
 
-		addresses[i] = txn.result == 0;
+	for (i=addr_min; i<=addr_max; i++) {
+		addresses[i] = txns[i - addr_min].result == 0;
 	}
 
 	if (verbose) {
@@ -245,25 +413,27 @@ int wusbmotelib_dumpMemory(rnt_hdl_t hdl, uint8_t chn, uint8_t *dstBuf, char ver
 {
 	int i,j,res;
 	uint8_t memory[256] = { };
+	uint8_t regs[16];
+	struct i2c_transaction txns[16];
+
+	for (i=0; i<16; i++) {
+		regs[i] = i * 0x10;
+		txns[i].chn = chn;
+		txns[i].addr = 0x52;
+		txns[i].wr_len = 1;
+		txns[i].wr_data = &regs[i];
+		txns[i].rd_len = 0x10;
+		txns[i].rd_data = memory + i * 0x10;
+	}
 
-	for (i=0x0; i<0x100; i+=0x10) {
-		uint8_t reg = i;
-		struct i2c_transaction txn = {
-			.chn = chn,
-			.wr_len = 1, .wr_data = &reg,
-			.rd_len = 0x10, .rd_data = memory + i,
-			.addr = 0x52,
-		};
-
-		_delay_us(40000);
-
-		res = wusbmote_i2c_transaction(hdl, &txn);
-		if (res < 0) {
-			fprintf(stderr, "error executing transaction\n");
-			return -1;
-		}
+	res = wusbmote_i2c_batch(hdl, txns, 16, &default_timing);
+	if (res < 0) {
+		fprintf(stderr, "error executing transaction\n");
+		return -1;
+	}
 
-		if (txn.result) {
+	for (i=0; i<16; i++) {
+		if (txns[i].result) {
 			fprintf(stderr, "I2C transaction failed\n");
 			return -1;
 		}
@@ -105,6 +105,37 @@ int wusbmote_i2c_transactions(rnt_hdl_t hdl, struct i2c_transaction *transaction
 
 #define wusbmote_i2c_transaction(hdl, i2c)	wusbmote_i2c_transactions(hdl, i2c, 1)
 
+struct wusbmote_i2c_timing {
+	/** Delay between exchanges in microseconds */
+	int gap_us;
+	/** When non-zero, failed transactions are retried with longer gaps */
+	int adaptive;
+	/** Longest gap tried when adapting */
+	int max_gap_us;
+
+	/** Statistics: Number of exchanges performed */
+	int exchanges;
+	/** Statistics: Number of transactions retried */
+	int retries;
+};
+
+/** Process any number of transactions, packed in as few exchanges as possible.
+ *
+ * \param hdl The adapter handle
+ * \param transactions Pointer to an array of i2c_transaction.
+ * \param n_transactions Number of transactions.
+ * \param timing Gap between exchanges, adaptation and statistics. May be NULL.
+ */
+int wusbmote_i2c_batch(rnt_hdl_t hdl, struct i2c_transaction *transactions, int n_transactions, struct wusbmote_i2c_timing *timing);
+
+/** Return the number of exchanges needed for a group of transactions, or -1 if one does not fit. */
+int wusbmote_i2c_countExchanges(const struct i2c_transaction *transactions, int n_transactions);
+
+/** Timing used by library functions (e.g. wusbmotelib_dumpMemory). The gap
+ * learned when adapting is kept there. */
+struct wusbmote_i2c_timing *wusbmotelib_getDefaultI2CTiming(void);
+void wusbmotelib_setI2CGap(int gap_us, int adaptive);
+
 /** Scan all I2C addresses to detect chip presence
  *
  * \param hdl The adapter handle
@@ -18,11 +18,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <zlib.h>
 #include "gcn64lib.h"
 #include "x2gcn64_adapters.h"
 #include "hexdump.h"
 #include "ihex.h"
 #include "delay.h"
+#include "timer.h"
 
 #ifdef WINDOWS
 #include "memmem.h"
@@ -32,6 +35,85 @@
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 #endif
 
+/* Reading a mapping takes several exchanges, so the mappings of GC to N64
+ * adapters are cached. Entries are keyed by handle and channel, and reset
+ * when the firmware version reported by the adapter changes. Adapters may
+ * be used from several threads (see fwfleet.h), hence the lock. */
+#define MAPPING_CACHE_ENTRIES	4
+
+struct mapping_cache_entry {
+	rnt_hdl_t hdl;
+	int channel;
+	char version[16];
+	unsigned int loaded; // Bit per mapping id
+	struct gc2n64_adapter_mapping mappings[GC2N64_NUM_MAPPINGS];
+};
+
+static struct mapping_cache_entry mapping_cache[MAPPING_CACHE_ENTRIES];
+static int mapping_cache_next; // Entry to replace when full
+static pthread_mutex_t mapping_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct mapping_cache_entry *findCacheEntry(rnt_hdl_t hdl, int channel)
+{
+	int i;
+
+	for (i=0; i<MAPPING_CACHE_ENTRIES; i++) {
+		if (mapping_cache[i].hdl && mapping_cache[i].hdl == hdl && mapping_cache[i].channel == channel) {
+			return &mapping_cache[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Get the entry of an adapter, creating or resetting it as needed */
+static struct mapping_cache_entry *getCacheEntry(rnt_hdl_t hdl, int channel, const char *version)
+{
+	struct mapping_cache_entry *entry;
+
+	entry = findCacheEntry(hdl, channel);
+	if (!entry) {
+		entry = &mapping_cache[mapping_cache_next];
+		mapping_cache_next = (mapping_cache_next + 1) % MAPPING_CACHE_ENTRIES;
+		entry->hdl = hdl;
+		entry->channel = channel;
+		entry->loaded = 0;
+	}
+
+	if (strncmp(entry->version, version, sizeof(entry->version))) {
+		strncpy(entry->version, version, sizeof(entry->version) - 1);
+		entry->version[sizeof(entry->version) - 1] = 0;
+		entry->loaded = 0;
+	}
+
+	return entry;
+}
+
+static void invalidateMapping(rnt_hdl_t hdl, int channel, int mapping_id)
+{
+	struct mapping_cache_entry *entry;
+
+	pthread_mutex_lock(&mapping_cache_lock);
+	entry = findCacheEntry(hdl, channel);
+	if (entry) {
+		entry->loaded &= ~(1 << mapping_id);
+	}
+	pthread_mutex_unlock(&mapping_cache_lock);
+}
+
+void x2gcn64_adapter_invalidateCache(rnt_hdl_t hdl, int channel)
+{
+	int i;
+
+	pthread_mutex_lock(&mapping_cache_lock);
+	for (i=0; i<MAPPING_CACHE_ENTRIES; i++) {
+		if (mapping_cache[i].hdl == hdl && (channel < 0 || mapping_cache[i].channel == channel)) {
+			memset(&mapping_cache[i], 0, sizeof(struct mapping_cache_entry));
+		}
+	}
+	pthread_mutex_unlock(&mapping_cache_lock);
+}
+
 int x2gcn64_adapter_echotest(rnt_hdl_t hdl, int channel, int verbose)
 {
 	unsigned char cmd[30];
@@ -70,6 +152,10 @@ int gc2n64_adapter_storeCurrentMapping(rnt_hdl_t hdl, int channel, int dst_slot)
 	cmd[1] = 0x04; // Save current mapping
 	cmd[2] = dst_slot;
 
+	if (dst_slot >= 0 && dst_slot < GC2N64_NUM_MAPPINGS) {
+		invalidateMapping(hdl, channel, dst_slot);
+	}
+
 	n = gcn64lib_rawSiCommand(hdl, channel, cmd, sizeof(cmd), cmd, 1);
 	if (n<0) {
 		return n;
@@ -80,7 +166,7 @@ int gc2n64_adapter_storeCurrentMapping(rnt_hdl_t hdl, int channel, int dst_slot)
 	}
 
 	if (cmd[0] == 0x00) {
-		return x2gcn64_adapter_waitNotBusy(hdl, channel, 0);
+		return x2gcn64_adapter_waitNotBusy(hdl, channel, X2GCN64_OP_STORE, 0);
 	}
 	else {
 		fprintf(stderr, "storeCurrentMapping: Command NACKed\n");
@@ -111,6 +197,9 @@ int gc2n64_adapter_setMapping(rnt_hdl_t hdl, int channel, struct gc2n64_adapter_
 	printf("Map data : ");
 	printHexBuf(mapdata, maplen);
 
+	// Sets the current mapping
+	invalidateMapping(hdl, channel, MAPPING_SLOT_BUILTIN_CURRENT);
+
 	togo = maplen;
 	done = 0;
 	chunk = 0;
@@ -206,6 +295,37 @@ int gc2n64_adapter_getMapping(rnt_hdl_t hdl, int channel, int mapping_id, struct
 	return 0;
 }
 
+struct gc2n64_adapter_mapping *gc2n64_adapter_getInfoMapping(rnt_hdl_t hdl, int channel, struct x2gcn64_adapter_info *inf, int mapping_id)
+{
+	struct gc2n64_adapter_info *gc2n64 = &inf->app.gc2n64;
+	struct mapping_cache_entry *entry;
+
+	if (inf->in_bootloader || inf->adapter_type != ADAPTER_TYPE_GC_TO_N64)
+		return NULL;
+	if (mapping_id < 0 || mapping_id >= GC2N64_NUM_MAPPINGS)
+		return NULL;
+
+	if (gc2n64->mappings_loaded & (1 << mapping_id))
+		return &gc2n64->mappings[mapping_id];
+
+	pthread_mutex_lock(&mapping_cache_lock);
+	entry = getCacheEntry(hdl, channel, inf->app.version);
+	if (!(entry->loaded & (1 << mapping_id))) {
+		memset(&entry->mappings[mapping_id], 0, sizeof(struct gc2n64_adapter_mapping));
+		if (gc2n64_adapter_getMapping(hdl, channel, mapping_id, &entry->mappings[mapping_id])) {
+			pthread_mutex_unlock(&mapping_cache_lock);
+			return NULL;
+		}
+		entry->loaded |= 1 << mapping_id;
+	}
+
+	gc2n64->mappings[mapping_id] = entry->mappings[mapping_id];
+	gc2n64->mappings_loaded |= 1 << mapping_id;
+	pthread_mutex_unlock(&mapping_cache_lock);
+
+	return &gc2n64->mappings[mapping_id];
+}
+
 const char *gc2n64_adapter_getMappingSlotName(unsigned char id, int default_context)
 {
 	switch (id)
@@ -467,6 +587,8 @@ void x2gcn64_adapter_printInfo(struct x2gcn64_adapter_info *inf)
 			printf("\tMempak disabled (v2.3): %s\n", inf->app.gc2n64.mempak_disabled ? "Yes":"No");
 			printf("\tGamecube controller: %s\n", inf->app.gc2n64.gc_controller_detected ? "Present":"Not present");
 			for (i=0; i<GC2N64_NUM_MAPPINGS; i++) {
+				if (!(inf->app.gc2n64.mappings_loaded & (1 << i)))
+					continue;
 				printf("\tMapping %d (%-13s): { ", i, gc2n64_adapter_getMappingSlotName(i, 0));
 				gc2n64_adapter_printMapping(&inf->app.gc2n64.mappings[i]);
 				printf(" }\n");
@@ -493,6 +615,7 @@ void x2gcn64_adapter_printInfo(struct x2gcn64_adapter_info *inf)
 
 int x2gcn64_adapter_getInfo(rnt_hdl_t hdl, int channel, struct x2gcn64_adapter_info *inf)
 {
+	struct mapping_cache_entry *entry;
 	unsigned char buf[32];
 	int n;
 
@@ -500,13 +623,18 @@ int x2gcn64_adapter_getInfo(rnt_hdl_t hdl, int channel, struct x2gcn64_adapter_i
 	buf[1] = 0x01; // Get device info
 
 	n = gcn64lib_rawSiCommand(hdl, channel, buf, 2, buf, sizeof(buf));
-	if (n<0)
+	if (n<0) {
+		// The adapter may have been disconnected
+		x2gcn64_adapter_invalidateCache(hdl, channel);
 		return n;
+	}
 
 	if (n > 0) {
 		// On N64, when receiving an all 0xFF reply, catch it here.
-		if (buf[0] == 0xff)
+		if (buf[0] == 0xff) {
+			x2gcn64_adapter_invalidateCache(hdl, channel);
 			return -1;
+		}
 
 		if (!inf)
 			return 0;
@@ -543,9 +671,13 @@ int x2gcn64_adapter_getInfo(rnt_hdl_t hdl, int channel, struct x2gcn64_adapter_i
 				inf->app.gc2n64.conversion_mode = buf[4];
 				inf->app.gc2n64.mempak_disabled = buf[5];
 				inf->app.gc2n64.gc_controller_detected = buf[8];
-				for (n=0; n<GC2N64_NUM_MAPPINGS; n++) {
-					gc2n64_adapter_getMapping(hdl, channel, n, &inf->app.gc2n64.mappings[n]);
-				}
+
+				// Mappings are read on demand, but those already cached are available
+				pthread_mutex_lock(&mapping_cache_lock);
+				entry = getCacheEntry(hdl, channel, inf->app.version);
+				inf->app.gc2n64.mappings_loaded = entry->loaded;
+				memcpy(inf->app.gc2n64.mappings, entry->mappings, sizeof(entry->mappings));
+				pthread_mutex_unlock(&mapping_cache_lock);
 			}
 
 			/* cc2n64 specific */
@@ -555,6 +687,7 @@ int x2gcn64_adapter_getInfo(rnt_hdl_t hdl, int channel, struct x2gcn64_adapter_i
 				inf->app.cc2n64.cc_controller_detected = buf[7];
 			}
 		} else {
+			x2gcn64_adapter_invalidateCache(hdl, channel);
 			inf->bootldr.mcu_page_size = buf[1];
 			inf->bootldr.bootloader_start_address = buf[2] << 8 | buf[3];
 			inf->bootldr.version[sizeof(inf->bootldr.version)-1]=0;
@@ -563,6 +696,7 @@ int x2gcn64_adapter_getInfo(rnt_hdl_t hdl, int channel, struct x2gcn64_adapter_i
 		}
 
 	} else {
+		x2gcn64_adapter_invalidateCache(hdl, channel);
 		printf("No answer (old version?)\n");
 		return -1;
 	}
@@ -593,32 +727,150 @@ int x2gcn64_adapter_boot_isBusy(rnt_hdl_t hdl, int channel)
 	return 0; // Idle
 }
 
-int x2gcn64_adapter_waitNotBusy(rnt_hdl_t hdl, int channel, int verbose)
+/* Busy polling. Most operations complete in a few milliseconds, so the
+ * first probe is sent after most of the typical duration learned for the
+ * operation, then probes are sent at exponentially growing intervals, up to
+ * WAIT_MAX_INTERVAL_US. The learned durations are shared by all the adapters
+ * (a batch of adapters behaves the same). Waits during which the adapter
+ * stopped answering are not learned from, as their duration says nothing
+ * about the operation itself. */
+#define WAIT_MIN_INTERVAL_US	200
+#define WAIT_MAX_INTERVAL_US	50000
+#define WAIT_NO_REPLY_TIMEOUT_US	10000000
+#define WAIT_SPINNER_INTERVAL_US	100000
+
+struct wait_op {
+	const char *name;
+	uint64_t typical_us; // Average duration (0: unknown yet)
+	struct x2gcn64_wait_stats stats;
+};
+
+static struct wait_op wait_ops[X2GCN64_NUM_OPS] = {
+	[X2GCN64_OP_ERASE] = { "erase" },
+	[X2GCN64_OP_WRITE] = { "page write" },
+	[X2GCN64_OP_STORE] = { "mapping store" },
+};
+static pthread_mutex_t wait_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void recordWait(int op, uint64_t elapsed_us, unsigned int probes, int learn)
+{
+	struct wait_op *wo = &wait_ops[op];
+
+	pthread_mutex_lock(&wait_lock);
+	wo->stats.waits++;
+	wo->stats.probes += probes;
+	wo->stats.total_us += elapsed_us;
+	if (elapsed_us > wo->stats.max_us) {
+		wo->stats.max_us = elapsed_us;
+	}
+	// Moving average. As completion is only noticed at the next probe, elapsed_us
+	// overestimates the duration. The first probe comes a bit earlier than the
+	// average to compensate.
+	if (learn) {
+		wo->typical_us = wo->typical_us ? (wo->typical_us * 7 + elapsed_us) / 8 : elapsed_us;
+	}
+	pthread_mutex_unlock(&wait_lock);
+}
+
+int x2gcn64_adapter_waitNotBusy(rnt_hdl_t hdl, int channel, int op, int verbose)
 {
 	char spinner[4] = { '|','/','-','\\' };
-	int busy, no_reply_count=0;
-	int c=0;
+	int busy, c=0, no_reply = 0;
+	unsigned int probes = 0;
+	uint64_t t_start, t_last_reply, t_spinner, now, interval;
+
+	if (op < 0 || op >= X2GCN64_NUM_OPS)
+		return -1;
+
+	pthread_mutex_lock(&wait_lock);
+	interval = wait_ops[op].typical_us * 3 / 4;
+	pthread_mutex_unlock(&wait_lock);
+	if (interval > WAIT_MAX_INTERVAL_US)
+		interval = WAIT_MAX_INTERVAL_US;
+
+	t_start = t_last_reply = t_spinner = getMicroseconds();
 
-	while ((busy = x2gcn64_adapter_boot_isBusy(hdl, channel)))
+	while (1)
 	{
+		if (interval) {
+			_delay_us(interval);
+		}
+
+		busy = x2gcn64_adapter_boot_isBusy(hdl, channel);
+		probes++;
 		if (busy < 0) {
 			return -1;
 		}
+
+		now = getMicroseconds();
+		if (!busy) {
+			break;
+		}
+
 		if (busy == 2) {
-			no_reply_count++;
-			if (no_reply_count > 200) {
+			no_reply = 1;
+			if (now - t_last_reply > WAIT_NO_REPLY_TIMEOUT_US) {
 				fprintf(stderr, "Adapter answer timeout\n");
 				return -1;
 			}
+		} else {
+			t_last_reply = now;
+		}
+
+		if (verbose && now - t_spinner >= WAIT_SPINNER_INTERVAL_US) {
+			printf("%c\b", spinner[c%4]); fflush(stdout);
+			c++;
+			t_spinner = now;
+		}
+
+		if (probes == 1) {
+			interval = WAIT_MIN_INTERVAL_US;
+		} else if (interval < WAIT_MAX_INTERVAL_US) {
+			interval *= 2;
+			if (interval > WAIT_MAX_INTERVAL_US)
+				interval = WAIT_MAX_INTERVAL_US;
 		}
-		printf("%c\b", spinner[c%4]); fflush(stdout);
-		c++;
-		_delay_us(50000);
 	}
 
+	recordWait(op, now - t_start, probes, !no_reply);
+
 	return 0;
 }
 
+void x2gcn64_adapter_getWaitStats(struct x2gcn64_wait_stats stats[X2GCN64_NUM_OPS])
+{
+	int i;
+
+	pthread_mutex_lock(&wait_lock);
+	for (i=0; i<X2GCN64_NUM_OPS; i++) {
+		stats[i] = wait_ops[i].stats;
+	}
+	pthread_mutex_unlock(&wait_lock);
+}
+
+void x2gcn64_adapter_printWaitStats(const struct x2gcn64_wait_stats since[X2GCN64_NUM_OPS])
+{
+	struct x2gcn64_wait_stats now[X2GCN64_NUM_OPS], d;
+	int i;
+
+	x2gcn64_adapter_getWaitStats(now);
+
+	for (i=0; i<X2GCN64_NUM_OPS; i++) {
+		d = now[i];
+		if (since) {
+			d.waits -= since[i].waits;
+			d.probes -= since[i].probes;
+			d.total_us -= since[i].total_us;
+		}
+		if (!d.waits)
+			continue;
+
+		printf("  busy waits (%s): %u, %d ms total, %.1f ms average, %.1f probes average\n",
+					wait_ops[i].name, d.waits, (int)(d.total_us / 1000),
+					d.total_us / 1000.0 / d.waits, d.probes / (double)d.waits);
+	}
+}
+
 int x2gcn64_adapter_boot_eraseAll(rnt_hdl_t hdl, int channel)
 {
 	unsigned char buf[64];
@@ -668,10 +920,252 @@ int x2gcn64_adapter_boot_readBlock(rnt_hdl_t hdl, int channel, unsigned int bloc
 	return 0;
 }
 
+int x2gcn64_flash_init(struct x2gcn64_flash *flash, const unsigned char *image, int size, int page_size)
+{
+	int i, len;
+
+	if (size <= 0 || size > X2GCN64_MAX_FIRMWARE_SIZE)
+		return -1;
+
+	if (page_size < X2GCN64_BLOCK_SIZE)
+		page_size = X2GCN64_BLOCK_SIZE;
+
+	flash->size = size;
+	flash->page_size = page_size;
+	flash->n_pages = (size + page_size - 1) / page_size;
+	if (image != flash->data) {
+		memcpy(flash->data, image, size);
+	}
+
+	for (i=0; i<flash->n_pages; i++) {
+		len = size - i * page_size;
+		if (len > page_size)
+			len = page_size;
+		flash->page_crc[i] = crc32(crc32(0, NULL, 0), flash->data + i * page_size, len);
+	}
+	flash->crc = crc32(crc32(0, NULL, 0), flash->data, size);
+
+	return 0;
+}
+
+int x2gcn64_flash_compare(const struct x2gcn64_flash *flash, const struct x2gcn64_flash *expected, unsigned char mismatch_map[X2GCN64_MAX_PAGES / 8])
+{
+	int i, differ = 0;
+
+	if (flash->size != expected->size || flash->page_size != expected->page_size)
+		return -1;
+
+	if (mismatch_map) {
+		memset(mismatch_map, 0, X2GCN64_MAX_PAGES / 8);
+	}
+
+	if (flash->crc == expected->crc)
+		return 0;
+
+	for (i=0; i<flash->n_pages; i++) {
+		if (flash->page_crc[i] != expected->page_crc[i]) {
+			if (mismatch_map) {
+				mismatch_map[i / 8] |= 1 << (i % 8);
+			}
+			differ++;
+		}
+	}
+
+	return differ;
+}
+
+#define MISMATCH_MAP_PAGES_PER_LINE	64
+
+void x2gcn64_flash_printMismatchMap(int n_pages, int page_size, const unsigned char mismatch_map[X2GCN64_MAX_PAGES / 8])
+{
+	int i;
+
+	printf("Pages (%d bytes) which differ (X):\n", page_size);
+	for (i=0; i<n_pages; i++) {
+		if (i % MISMATCH_MAP_PAGES_PER_LINE == 0) {
+			printf("  0x%04x ", i * page_size);
+		}
+		putchar(mismatch_map[i / 8] & (1 << (i % 8)) ? 'X' : '.');
+		if (i % MISMATCH_MAP_PAGES_PER_LINE == MISMATCH_MAP_PAGES_PER_LINE - 1 || i == n_pages - 1) {
+			putchar('\n');
+		}
+	}
+}
+
+#define BLOCK_READ_ATTEMPTS	3
+
+int x2gcn64_adapter_boot_readFlash(rnt_hdl_t hdl, int channel, const struct x2gcn64_adapter_info *inf,
+					struct x2gcn64_flash *flash, x2gcn64_progress_func progress, void *ctx)
+{
+	int i, attempt, size, n_blocks;
+
+	if (!inf->in_bootloader) {
+		fprintf(stderr, "readFlash: Not in bootloader\n");
+		return -1;
+	}
+
+	size = inf->bootldr.bootloader_start_address;
+	if (size <= 0 || size > X2GCN64_MAX_FIRMWARE_SIZE) {
+		fprintf(stderr, "readFlash: Invalid bootloader start address\n");
+		return -1;
+	}
+	n_blocks = (size + X2GCN64_BLOCK_SIZE - 1) / X2GCN64_BLOCK_SIZE;
+
+	for (i=0; i<n_blocks; i++) {
+		// Reading has no side effect, so failed reads are simply repeated
+		for (attempt = 0; attempt < BLOCK_READ_ATTEMPTS; attempt++) {
+			if (!x2gcn64_adapter_boot_readBlock(hdl, channel, i, flash->data + i * X2GCN64_BLOCK_SIZE))
+				break;
+		}
+		if (attempt == BLOCK_READ_ATTEMPTS) {
+			return -1;
+		}
+		if (progress) {
+			progress(ctx, i + 1, n_blocks);
+		}
+	}
+
+	return x2gcn64_flash_init(flash, flash->data, size, inf->bootldr.mcu_page_size);
+}
+
+static void printReadProgress(void *ctx, int done, int total)
+{
+	printf("Block %d / %d\r", done, total); fflush(stdout);
+}
+
+int x2gcn64_adapter_readFlash(rnt_hdl_t hdl, int channel, struct x2gcn64_flash *flash, int verbose)
+{
+	struct x2gcn64_adapter_info inf;
+	int res, started_in_app;
+
+	if (x2gcn64_adapter_getInfo(hdl, channel, &inf)) {
+		fprintf(stderr, "Failed to read adapter info\n");
+		return -1;
+	}
+
+	started_in_app = !inf.in_bootloader;
+	if (started_in_app) {
+		if (!inf.app.upgradeable) {
+			fprintf(stderr, "This adapter has no bootloader. Its flash cannot be read.\n");
+			return -1;
+		}
+		if (verbose) {
+			printf("Entering bootloader...\n");
+		}
+		if (x2gcn64_adapter_enterBootloader(hdl, channel) ||
+				x2gcn64_adapter_getInfo(hdl, channel, &inf) || !inf.in_bootloader) {
+			fprintf(stderr, "Failed to enter the bootloader\n");
+			return -1;
+		}
+	}
+
+	res = x2gcn64_adapter_boot_readFlash(hdl, channel, &inf, flash, verbose ? printReadProgress : NULL, NULL);
+	if (verbose) {
+		printf("\n");
+	}
+
+	if (started_in_app) {
+		if (verbose) {
+			printf("Restarting the application...\n");
+		}
+		if (x2gcn64_adapter_bootApplication(hdl, channel)) {
+			res = -1;
+		}
+	}
+
+	return res;
+}
+
+int x2gcn64_adapter_saveFlash(rnt_hdl_t hdl, int channel, const char *filename)
+{
+	struct x2gcn64_flash *flash;
+	const char *ext;
+	FILE *fptr;
+	int ret = 0;
+
+	flash = malloc(sizeof(struct x2gcn64_flash));
+	if (!flash) {
+		perror("malloc");
+		return -1;
+	}
+
+	if (x2gcn64_adapter_readFlash(hdl, channel, flash, 1)) {
+		free(flash);
+		return -1;
+	}
+	printf("Read %d bytes, crc32 %08x\n", flash->size, flash->crc);
+
+	ext = strrchr(filename, '.');
+	if (ext && (!strcmp(ext, ".hex") || !strcmp(ext, ".ihex"))) {
+		ret = save_ihex(filename, flash->data, flash->size);
+	} else {
+		fptr = fopen(filename, "wb");
+		if (!fptr) {
+			perror(filename);
+			ret = -1;
+		} else {
+			if (fwrite(flash->data, flash->size, 1, fptr) != 1) {
+				perror(filename);
+				ret = -1;
+			}
+			fclose(fptr);
+		}
+	}
+
+	free(flash);
+	return ret;
+}
+
+int x2gcn64_adapter_compareFlash(rnt_hdl_t hdl, int channel, const char *hexfile)
+{
+	struct x2gcn64_flash *flash, *expected;
+	unsigned char map[X2GCN64_MAX_PAGES / 8];
+	int differ, ret = -1;
+
+	flash = malloc(sizeof(struct x2gcn64_flash));
+	expected = malloc(sizeof(struct x2gcn64_flash));
+	if (!flash || !expected) {
+		perror("malloc");
+		goto done;
+	}
+
+	memset(expected->data, 0xff, X2GCN64_MAX_FIRMWARE_SIZE);
+	if (load_ihex(hexfile, expected->data, X2GCN64_MAX_FIRMWARE_SIZE) < 0) {
+		fprintf(stderr, "Could not load hex file\n");
+		goto done;
+	}
+
+	if (x2gcn64_adapter_readFlash(hdl, channel, flash, 1)) {
+		goto done;
+	}
+
+	// Pages not populated by the hex file are expected to be erased
+	x2gcn64_flash_init(expected, expected->data, flash->size, flash->page_size);
+	differ = x2gcn64_flash_compare(flash, expected, map);
+	if (differ < 0) {
+		fprintf(stderr, "Sizes do not match\n");
+		goto done;
+	}
+
+	printf("Flash crc32 %08x, expected %08x\n", flash->crc, expected->crc);
+	if (differ) {
+		printf("%d of %d pages differ\n", differ, flash->n_pages);
+		x2gcn64_flash_printMismatchMap(flash->n_pages, flash->page_size, map);
+	} else {
+		printf("Flash content matches %s\n", hexfile);
+		ret = 0;
+	}
+
+done:
+	free(flash);
+	free(expected);
+	return ret;
+}
+
 int x2gcn64_adapter_dumpFlash(rnt_hdl_t hdl, int channel)
 {
 	int i;
-	unsigned char buf[0x10000];
+	struct x2gcn64_flash *flash;
 	struct x2gcn64_adapter_info inf;
 
 	i = x2gcn64_adapter_getInfo(hdl, channel, &inf);
@@ -683,13 +1177,25 @@ int x2gcn64_adapter_dumpFlash(rnt_hdl_t hdl, int channel)
 		return -1;
 	}
 
-	// Atmega168 : 16K
-	for (i=0; i<16*1024; i+= 32)
+	flash = malloc(sizeof(struct x2gcn64_flash));
+	if (!flash) {
+		perror("malloc");
+		return -1;
+	}
+
+	// The size comes from the bootloader information (application area only)
+	if (x2gcn64_adapter_boot_readFlash(hdl, channel, &inf, flash, NULL, NULL)) {
+		free(flash);
+		return -1;
+	}
+
+	for (i=0; i<flash->size; i+= 32)
 	{
-		x2gcn64_adapter_boot_readBlock(hdl, channel, i/32, buf + i);
 		printf("0x%04x: ", i);
-		printHexBuf(buf + i, 32);
+		printHexBuf(flash->data + i, 32);
 	}
+
+	free(flash);
 	return 0;
 }
 
@@ -760,53 +1266,160 @@ int x2gcn64_adapter_bootApplication(rnt_hdl_t hdl, int channel)
 	return 0;
 }
 
-// Note: eraseAll needs to be performed first
-int x2gcn64_adapter_sendFirmwareBlocks(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len)
+/** \brief Build a programming plan for a firmware image
+ *
+ * Flash is 0xFF after x2gcn64_adapter_boot_eraseAll(), so pages
+ * containing only 0xFF bytes (unpopulated by the hex file or explicitly
+ * erased-equivalent) need not be sent. Decisions are made per MCU page
+ * since the bootloader programs whole pages.
+ *
+ * \param firmware Image, with unpopulated bytes set to 0xFF
+ * \param len Number of bytes to consider (usually the bootloader start address)
+ * \param page_size MCU page size. Values smaller than a block are rounded up.
+ */
+int x2gcn64_adapter_makeProgramPlan(const unsigned char *firmware, int len, int page_size, struct x2gcn64_program_plan *plan)
+{
+	int page, i, blocks_per_page;
+
+	if (len < 0 || len > X2GCN64_MAX_FIRMWARE_SIZE)
+		return -1;
+
+	memset(plan, 0, sizeof(struct x2gcn64_program_plan));
+
+	if (page_size < X2GCN64_BLOCK_SIZE)
+		page_size = X2GCN64_BLOCK_SIZE;
+	blocks_per_page = page_size / X2GCN64_BLOCK_SIZE;
+
+	plan->page_size = blocks_per_page * X2GCN64_BLOCK_SIZE;
+	plan->n_blocks = (len + X2GCN64_BLOCK_SIZE - 1) / X2GCN64_BLOCK_SIZE;
+
+	for (page = 0; page < plan->n_blocks; page += blocks_per_page) {
+		int start = page * X2GCN64_BLOCK_SIZE;
+		int end = start + plan->page_size;
+
+		if (end > len)
+			end = len;
+
+		for (i = start; i < end; i++) {
+			if (firmware[i] != 0xff)
+				break;
+		}
+		if (i == end)
+			continue;
+
+		for (i = page; i < page + blocks_per_page && i < plan->n_blocks; i++) {
+			plan->program[i / 8] |= 1 << (i % 8);
+			plan->n_program++;
+		}
+	}
+
+	return 0;
+}
+
+void x2gcn64_adapter_printProgramPlan(const struct x2gcn64_program_plan *plan)
+{
+	int i, start = -1;
+
+	printf("Programming plan: %d of %d blocks (page size %d bytes)\n",
+			plan->n_program, plan->n_blocks, plan->page_size);
+
+	for (i = 0; i <= plan->n_blocks; i++) {
+		int used = i < plan->n_blocks && X2GCN64_PLAN_HAS_BLOCK(plan, i);
+
+		if (used && start < 0) {
+			start = i;
+		} else if (!used && start >= 0) {
+			printf("  0x%04x - 0x%04x\n", start * X2GCN64_BLOCK_SIZE, i * X2GCN64_BLOCK_SIZE - 1);
+			start = -1;
+		}
+	}
+}
+
+int x2gcn64_adapter_boot_writeBlock(rnt_hdl_t hdl, int channel, unsigned int block_id, const unsigned char src[32], int verbose)
 {
 	unsigned char buf[64];
-	int i, block_id;
 	int n;
 
-	for (i=0; i<len; i+=32) {
-		block_id = i / 32;
-		buf[0] = 'R';
-		buf[1] = 0xf2;
-		buf[2] = block_id >> 8;
-		buf[3] = block_id & 0xff;
-		memcpy(buf + 4, firmware+i, 32);
-
-		printf("Block %d / %d\r", block_id+1, len / 32); fflush(stdout);
+	buf[0] = 'R';
+	buf[1] = 0xf2;
+	buf[2] = block_id >> 8;
+	buf[3] = block_id & 0xff;
+	memcpy(buf + 4, src, X2GCN64_BLOCK_SIZE);
 
-		n = gcn64lib_rawSiCommand(hdl, channel, buf, 4 + 32, buf, 4);
-		if (n<0) {
+	n = gcn64lib_rawSiCommand(hdl, channel, buf, 4 + 32, buf, 4);
+	if (n<0) {
+		if (verbose) {
 			fprintf(stderr, "\nRaw command failed\n");
-			return n;
 		}
+		return n;
+	}
 
-		if (n != 4) {
+	if (n != 4) {
+		if (verbose) {
 			fprintf(stderr, "\nInvalid upload block answer\n");
-			return -1;
 		}
+		return -1;
+	}
 
-		// [0] ACK (should be 0x00)
-		// [1] Need to poll?
-		// [2] Block ID high
-		// [3] Block ID low
+	// [0] ACK (should be 0x00)
+	// [1] Need to poll?
+	// [2] Block ID high
+	// [3] Block ID low
 
-		if (buf[0] != 0x00) {
+	if (buf[0] != 0x00) {
+		if (verbose) {
 			fprintf(stderr, "Busy\n");
-			return -1;
 		}
+		return -1;
+	}
 
-		if (buf[1]) {
-			if (x2gcn64_adapter_waitNotBusy(hdl, channel, 1)) {
+	if (buf[1]) {
+		if (x2gcn64_adapter_waitNotBusy(hdl, channel, X2GCN64_OP_WRITE, verbose)) {
+			if (verbose) {
 				fprintf(stderr, "Error waiting not busy\n");
-				return -1;
 			}
+			return -1;
 		}
+	}
+
+	return 0;
+}
 
-//		printf("\n");
-//		printf("Block ID: 0x%04x\n", (buf[2]<<8) | buf[3]);
+static int sendFirmwareBlock(rnt_hdl_t hdl, int channel, const unsigned char *firmware, int block_id)
+{
+	return x2gcn64_adapter_boot_writeBlock(hdl, channel, block_id, firmware + block_id * X2GCN64_BLOCK_SIZE, 1);
+}
+
+static int verifyFirmwareBlock(rnt_hdl_t hdl, int channel, const unsigned char *firmware, int block_id)
+{
+	unsigned char buf[32];
+	int addr = block_id * X2GCN64_BLOCK_SIZE;
+
+	if (x2gcn64_adapter_boot_readBlock(hdl, channel, block_id, buf)) {
+		return -1;
+	}
+
+	if (memcmp(buf, firmware + addr, 32)) {
+		printf("\nMismatch in block address 0x%04x\n", addr);
+		printf("Written: "); printHexBuf(firmware + addr, 32);
+		printf("   Read: "); printHexBuf(buf, 32);
+		return -1;
+	}
+
+	return 0;
+}
+
+// Note: eraseAll needs to be performed first
+int x2gcn64_adapter_sendFirmwareBlocks(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len)
+{
+	int i, res;
+
+	for (i=0; i<len; i+=32) {
+		printf("Block %d / %d\r", i/32+1, len / 32); fflush(stdout);
+
+		res = sendFirmwareBlock(hdl, channel, firmware, i/32);
+		if (res)
+			return res;
 	}
 
 	return 0;
@@ -814,40 +1427,86 @@ int x2gcn64_adapter_sendFirmwareBlocks(rnt_hdl_t hdl, int channel, unsigned char
 
 int x2gcn64_adapter_verifyFirmware(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len)
 {
-	unsigned char buf[32];
 	int i;
 
 	for (i=0; i<len; i+=32) {
+		if (verifyFirmwareBlock(hdl, channel, firmware, i/32))
+			return -1;
+
+		printf("Block %d / %d ok\r", i/32 + 1, len / 32); fflush(stdout);
+	}
+	return 0;
+}
+
+/** \brief Send only the blocks selected by a programming plan
+ *
+ * Note: eraseAll needs to be performed first
+ */
+int x2gcn64_adapter_sendFirmwarePlan(rnt_hdl_t hdl, int channel, const unsigned char *firmware, const struct x2gcn64_program_plan *plan)
+{
+	int i, res, done = 0;
+
+	for (i=0; i<plan->n_blocks; i++) {
+		if (!X2GCN64_PLAN_HAS_BLOCK(plan, i))
+			continue;
 
-		x2gcn64_adapter_boot_readBlock(hdl, channel, i/32, buf);
-		if (memcmp(buf, firmware + i, 32)) {
-			printf("\nMismatch in block address 0x%04x\n", i);
-			printf("Written: "); printHexBuf(firmware + i, 32);
-			printf("   Read: "); printHexBuf(buf, 32);
+		res = sendFirmwareBlock(hdl, channel, firmware, i);
+		if (res)
+			return res;
+
+		done++;
+		printf("Block %d / %d\r", done, plan->n_program); fflush(stdout);
+	}
+	printf("\n");
+
+	return 0;
+}
+
+/** \brief Read back and compare the blocks selected by a programming plan */
+int x2gcn64_adapter_verifyFirmwarePlan(rnt_hdl_t hdl, int channel, const unsigned char *firmware, const struct x2gcn64_program_plan *plan)
+{
+	int i, done = 0;
+
+	for (i=0; i<plan->n_blocks; i++) {
+		if (!X2GCN64_PLAN_HAS_BLOCK(plan, i))
+			continue;
+
+		if (verifyFirmwareBlock(hdl, channel, firmware, i))
 			return -1;
-		} else {
-			printf("Block %d / %d ok\r", i/32 + 1, len / 32); fflush(stdout);
-		}
+
+		done++;
+		printf("Block %d / %d ok\r", done, plan->n_program); fflush(stdout);
 	}
+	printf("\n");
+
 	return 0;
 }
 
+#define BOOTLOADER_MIN_INTERVAL_US	10000
+#define BOOTLOADER_MAX_INTERVAL_US	1000000
+
 int x2gcn64_adapter_waitForBootloader(rnt_hdl_t hdl, int channel, int timeout_s)
 {
 	struct x2gcn64_adapter_info inf;
-	int i;
+	uint64_t t_start, interval = BOOTLOADER_MIN_INTERVAL_US;
 	int n;
 
-	for (i=0; i<=timeout_s; i++) {
+	t_start = getMicroseconds();
+
+	do {
 		n = x2gcn64_adapter_getInfo(hdl, channel, &inf);
 		// Errors (caused by timeouts) are just ignored since they are expected.
-		if (n == 0) {
+		if (n == 0 && inf.in_bootloader) {
 			x2gcn64_adapter_printInfo(&inf);
-			if (inf.in_bootloader)
-				return 0;
+			return 0;
 		}
-		_delay_s(1);
-	}
+		_delay_us(interval);
+		if (interval < BOOTLOADER_MAX_INTERVAL_US) {
+			interval *= 2;
+			if (interval > BOOTLOADER_MAX_INTERVAL_US)
+				interval = BOOTLOADER_MAX_INTERVAL_US;
+		}
+	} while (getMicroseconds() - t_start < (uint64_t)timeout_s * 1000000);
 
 	return -1;
 }
@@ -866,7 +1525,16 @@ const char *x2gcn64_getAdapterSignature(int type)
 	return NULL;
 }
 
-#define FIRMWARE_BUF_SIZE	0x10000
+#define FIRMWARE_BUF_SIZE	X2GCN64_MAX_FIRMWARE_SIZE
+
+static uint64_t printPhaseTime(const char *phase, uint64_t t_phase)
+{
+	uint64_t now = getMilliseconds();
+
+	printf("  %s: %d ms\n", phase, (int)(now - t_phase));
+
+	return now;
+}
 
 /**
  * \param signature If NULL, reads adapter info and automatically use the corresponding signature.
@@ -877,6 +1545,9 @@ int x2gcn64_adapter_updateFirmware(rnt_hdl_t hdl, int channel, const char *hexfi
 	int max_addr;
 	int ret = 0, res;
 	struct x2gcn64_adapter_info inf;
+	struct x2gcn64_program_plan plan;
+	uint64_t t_start, t_phase;
+	struct x2gcn64_wait_stats waits[X2GCN64_NUM_OPS];
 
 	if (!signature) {
 		res = x2gcn64_adapter_getInfo(hdl, channel, &inf);
@@ -890,6 +1561,9 @@ int x2gcn64_adapter_updateFirmware(rnt_hdl_t hdl, int channel, const char *hexfi
 		}
 	}
 
+	t_start = t_phase = getMilliseconds();
+	x2gcn64_adapter_getWaitStats(waits);
+
 	////////////////////
 	printf("step [1/7] : Load .hex file...\n");
 	buf = malloc(FIRMWARE_BUF_SIZE);
@@ -917,14 +1591,15 @@ int x2gcn64_adapter_updateFirmware(rnt_hdl_t hdl, int channel, const char *hexfi
 	}
 
 	printf("Firmware size: %d bytes\n", max_addr+1);
-
+	t_phase = printPhaseTime("load", t_phase);
 
 	////////////////////
 	printf("step [2/7] : Get adapter info...\n");
 	res = x2gcn64_adapter_getInfo(hdl, channel, &inf);
 	if (res < 0) {
 		fprintf(stderr, "Failed to read adapter info\n");
-		return -1;
+		ret = -1;
+		goto err;
 	}
 	x2gcn64_adapter_printInfo(&inf);
 
@@ -954,37 +1629,50 @@ int x2gcn64_adapter_updateFirmware(rnt_hdl_t hdl, int channel, const char *hexfi
 			goto err;
 		}
 	}
+	t_phase = printPhaseTime("enter bootloader", t_phase);
+
+	// Note: The plan covers everything up to the bootloader, even if the firmware was
+	// shorter (it usually is). This is to make sure that the marker we placed at the end
+	// gets written. Pages left all 0xFF are skipped since erasing already did the job.
+	if (x2gcn64_adapter_makeProgramPlan(buf, inf.bootldr.bootloader_start_address, inf.bootldr.mcu_page_size, &plan)) {
+		fprintf(stderr, "Invalid bootloader start address\n");
+		ret = -1;
+		goto err;
+	}
+	x2gcn64_adapter_printProgramPlan(&plan);
 
 	////////////////////
 	printf("step [4/7] : Erase current firmware... "); fflush(stdout);
 	x2gcn64_adapter_boot_eraseAll(hdl, channel);
 
-	if (x2gcn64_adapter_waitNotBusy(hdl, channel, 1)) {
+	if (x2gcn64_adapter_waitNotBusy(hdl, channel, X2GCN64_OP_ERASE, 1)) {
 		ret = -1;
 		goto err;
 	}
 	printf("Ok\n");
-
+	t_phase = printPhaseTime("erase", t_phase);
 
 	printf("step [5/7] : Write new firmware...\n");
-	// Note: We write up to the bootloader, even if the firmware was shorter (it usually is).
-	// This is to make sure that the marker we placed at the end gets written.
-	res = x2gcn64_adapter_sendFirmwareBlocks(hdl, channel, buf, inf.bootldr.bootloader_start_address);
+	res = x2gcn64_adapter_sendFirmwarePlan(hdl, channel, buf, &plan);
 	if (res < 0) {
 		ret = -1;
 		goto err;
 	}
+	t_phase = printPhaseTime("write", t_phase);
 
 	printf("step [6/7] : Verify firmware...\n");
-	res = x2gcn64_adapter_verifyFirmware(hdl, channel, buf, inf.bootldr.bootloader_start_address);
+	res = x2gcn64_adapter_verifyFirmwarePlan(hdl, channel, buf, &plan);
 	if (res < 0) {
 		printf("Verify failed : Update failed\n");
 		ret = -1;
 		goto err;
 	}
+	t_phase = printPhaseTime("verify", t_phase);
 
 	printf("step [7/7] : Launch new firmware.\n");
 	x2gcn64_adapter_bootApplication(hdl, channel);
+	printf("Update completed in %d ms\n", (int)(getMilliseconds() - t_start));
+	x2gcn64_adapter_printWaitStats(waits);
 
 err:
 	free(buf);
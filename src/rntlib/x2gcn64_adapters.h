@@ -52,6 +52,8 @@ struct gc2n64_adapter_info {
 	unsigned char gc_controller_detected;
 	// new in v2.3
 	unsigned char mempak_disabled;
+	// Mappings are only read on demand (see gc2n64_adapter_getInfoMapping). Bit per mapping id.
+	unsigned int mappings_loaded;
 	struct gc2n64_adapter_mapping mappings[GC2N64_NUM_MAPPINGS];
 };
 
@@ -85,14 +87,52 @@ struct x2gcn64_adapter_info {
 
 /* Generic/Common functions */
 int x2gcn64_adapter_echotest(rnt_hdl_t hdl, int channel, int verbose);
+
+/** \brief Get the adapter information, with a single exchange
+ *
+ * The mappings of GC to N64 adapters are not read. Only those already
+ * cached (read earlier from the same adapter) are filled in
+ * inf->app.gc2n64, see gc2n64_adapter_getInfoMapping().
+ */
 int x2gcn64_adapter_getInfo(rnt_hdl_t hdl,  int channel, struct x2gcn64_adapter_info *inf);
+/** \brief Print the adapter information (only the mappings already loaded) */
 void x2gcn64_adapter_printInfo(struct x2gcn64_adapter_info *inf);
 const char *x2gcn64_adapter_getConversionModeName(struct x2gcn64_adapter_info *adapter);
 
-int x2gcn64_adapter_waitNotBusy(rnt_hdl_t hdl, int channel, int verbose);
+/* Operations the adapter can be busy with. Each has its own typical duration. */
+#define X2GCN64_OP_ERASE	0
+#define X2GCN64_OP_WRITE	1 // Page write
+#define X2GCN64_OP_STORE	2 // Mapping stored to EEPROM
+#define X2GCN64_NUM_OPS		3
+
+struct x2gcn64_wait_stats {
+	unsigned int waits;
+	unsigned int probes; // Busy requests sent
+	uint64_t total_us; // Time spent waiting
+	uint64_t max_us;
+};
+
+/**
+ * \brief Wait until the adapter is done with an operation
+ *
+ * The polling interval adapts to the typical duration of the operation,
+ * learned from the previous waits.
+ *
+ * \param op X2GCN64_OP_*
+ * \param verbose Show a spinner while waiting
+ */
+int x2gcn64_adapter_waitNotBusy(rnt_hdl_t hdl, int channel, int op, int verbose);
+/** \brief Get the statistics (since the start) of the waits for each operation */
+void x2gcn64_adapter_getWaitStats(struct x2gcn64_wait_stats stats[X2GCN64_NUM_OPS]);
+/** \brief Print the waits since a x2gcn64_adapter_getWaitStats() snapshot (NULL: since the start) */
+void x2gcn64_adapter_printWaitStats(const struct x2gcn64_wait_stats since[X2GCN64_NUM_OPS]);
 int x2gcn64_adapter_boot_isBusy(rnt_hdl_t hdl, int channel);
 int x2gcn64_adapter_boot_eraseAll(rnt_hdl_t hdl, int channel);
 int x2gcn64_adapter_boot_readBlock(rnt_hdl_t hdl, int channel, unsigned int block_id, unsigned char dst[32]);
+/** \brief Program a block (eraseAll needs to be performed first) and wait until done
+ * \param verbose Print errors and show a spinner while waiting
+ */
+int x2gcn64_adapter_boot_writeBlock(rnt_hdl_t hdl, int channel, unsigned int block_id, const unsigned char src[32], int verbose);
 int x2gcn64_adapter_dumpFlash(rnt_hdl_t hdl, int channel);
 int x2gcn64_adapter_enterBootloader(rnt_hdl_t hdl, int channel);
 int x2gcn64_adapter_bootApplication(rnt_hdl_t hdl, int channel);
@@ -100,8 +140,81 @@ int x2gcn64_adapter_sendFirmwareBlocks(rnt_hdl_t hdl, int channel, unsigned char
 int x2gcn64_adapter_verifyFirmware(rnt_hdl_t hdl, int channel, unsigned char *firmware, int len);
 int x2gcn64_adapter_waitForBootloader(rnt_hdl_t hdl, int channel, int timeout_s);
 
+#define X2GCN64_BLOCK_SIZE			32
+#define X2GCN64_MAX_FIRMWARE_SIZE	0x10000
+
+struct x2gcn64_program_plan {
+	int page_size; // Granularity of skip decisions (bytes)
+	int n_blocks; // Blocks covered by the plan
+	int n_program; // Blocks to send
+	unsigned char program[X2GCN64_MAX_FIRMWARE_SIZE / X2GCN64_BLOCK_SIZE / 8];
+};
+
+#define X2GCN64_PLAN_HAS_BLOCK(plan, id)	((plan)->program[(id) / 8] & (1 << ((id) % 8)))
+
+int x2gcn64_adapter_makeProgramPlan(const unsigned char *firmware, int len, int page_size, struct x2gcn64_program_plan *plan);
+void x2gcn64_adapter_printProgramPlan(const struct x2gcn64_program_plan *plan);
+int x2gcn64_adapter_sendFirmwarePlan(rnt_hdl_t hdl, int channel, const unsigned char *firmware, const struct x2gcn64_program_plan *plan);
+int x2gcn64_adapter_verifyFirmwarePlan(rnt_hdl_t hdl, int channel, const unsigned char *firmware, const struct x2gcn64_program_plan *plan);
+
 int x2gcn64_adapter_updateFirmware(rnt_hdl_t hdl, int channel, const char *hexfile, const char *signature);
 
+#define X2GCN64_MAX_PAGES	(X2GCN64_MAX_FIRMWARE_SIZE / X2GCN64_BLOCK_SIZE)
+
+/** \brief Content of the application area of the flash (everything up to the bootloader) */
+struct x2gcn64_flash {
+	int size;
+	int page_size;
+	int n_pages;
+	unsigned char data[X2GCN64_MAX_FIRMWARE_SIZE];
+	uint32_t page_crc[X2GCN64_MAX_PAGES]; // CRC32 of each page
+	uint32_t crc; // CRC32 of the whole area
+};
+
+typedef void (*x2gcn64_progress_func)(void *ctx, int done, int total);
+
+/**
+ * \brief Fill a flash structure from an image (eg: a hex file), to be compared with x2gcn64_flash_compare()
+ * \param image Image, with unpopulated bytes set to 0xFF. At least size bytes.
+ * \param size Size of the application area (the bootloader start address)
+ * \return 0 on success, -1 if the size is invalid
+ */
+int x2gcn64_flash_init(struct x2gcn64_flash *flash, const unsigned char *image, int size, int page_size);
+
+/**
+ * \brief Compare flash contents page by page, using the page CRCs
+ * \param mismatch_map Bit per page, set for pages which differ. May be NULL.
+ * \return The number of pages which differ, or -1 if the sizes or page sizes are not the same
+ */
+int x2gcn64_flash_compare(const struct x2gcn64_flash *flash, const struct x2gcn64_flash *expected, unsigned char mismatch_map[X2GCN64_MAX_PAGES / 8]);
+void x2gcn64_flash_printMismatchMap(int n_pages, int page_size, const unsigned char mismatch_map[X2GCN64_MAX_PAGES / 8]);
+
+/**
+ * \brief Read the application area of the flash. The adapter must be in the bootloader.
+ *
+ * The size and page size come from the bootloader information.
+ *
+ * \param inf Information from x2gcn64_adapter_getInfo(), in bootloader
+ * \param progress Called after each block. May be NULL.
+ */
+int x2gcn64_adapter_boot_readFlash(rnt_hdl_t hdl, int channel, const struct x2gcn64_adapter_info *inf,
+					struct x2gcn64_flash *flash, x2gcn64_progress_func progress, void *ctx);
+
+/**
+ * \brief Read the application area of the flash, entering the bootloader if needed
+ *
+ * If the application was running, it is restarted after reading.
+ *
+ * \param verbose Print the progress
+ */
+int x2gcn64_adapter_readFlash(rnt_hdl_t hdl, int channel, struct x2gcn64_flash *flash, int verbose);
+/** \brief Save the application area of the flash to a file (hex if the name ends with .hex, binary otherwise) */
+int x2gcn64_adapter_saveFlash(rnt_hdl_t hdl, int channel, const char *filename);
+/** \brief Compare the application area of the flash with a hex file, printing the pages which differ
+ * \return 0 if the content matches, -1 otherwise
+ */
+int x2gcn64_adapter_compareFlash(rnt_hdl_t hdl, int channel, const char *hexfile);
+
 
 /* Gamecube to N64 adapter specific */
 void gc2n64_adapter_printMapping(struct gc2n64_adapter_mapping *map);
@@ -114,6 +227,22 @@ void gc2n64_adapter_printMapping(struct gc2n64_adapter_mapping *map);
 const char *gc2n64_adapter_getMappingSlotName(unsigned char id, int default_context);
 
 int gc2n64_adapter_getMapping(rnt_hdl_t hdl, int channel, int mapping_id, struct gc2n64_adapter_mapping *dst_mapping);
+
+/** \brief Get a mapping, reading it from the adapter only if not already loaded in inf or cached
+ *
+ * Mappings read from an adapter are cached (per handle and channel) until
+ * changed by gc2n64_adapter_setMapping() or gc2n64_adapter_storeCurrentMapping(),
+ * the firmware version changes, the adapter stops answering or the handle is
+ * closed. Mappings changed by other means (on the controller) require
+ * x2gcn64_adapter_invalidateCache().
+ *
+ * \param inf Information from x2gcn64_adapter_getInfo()
+ * \return The mapping (in inf), or NULL on error
+ */
+struct gc2n64_adapter_mapping *gc2n64_adapter_getInfoMapping(rnt_hdl_t hdl, int channel, struct x2gcn64_adapter_info *inf, int mapping_id);
+
+/** \brief Forget the cached mappings of an adapter (channel -1 for all channels) */
+void x2gcn64_adapter_invalidateCache(rnt_hdl_t hdl, int channel);
 int gc2n64_adapter_setMapping(rnt_hdl_t hdl, int channel, struct gc2n64_adapter_mapping *mapping);
 int gc2n64_adapter_storeCurrentMapping(rnt_hdl_t hdl, int channel, int dst_slot);
 
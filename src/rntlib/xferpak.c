@@ -202,12 +202,8 @@ int xferpak_writeCart(xferpak *xpak, unsigned int start_addr, unsigned int len,
 		xferpak_setBank(xpak, (addr + start_addr) >> 14);
 
 		if (xpak->u) {
-			xpak->u->cur_progress += 32;
-			// Don't call update too often for performance reason
-			if (!(xpak->u->cur_progress & 0x1FF)) {
-				if (xpak->u->update(xpak->u)) {
-					return XFERPAK_USER_CANCELLED;
-				}
+			if (uiio_progressUpdate(xpak->u, xpak->u->cur_progress + 32)) {
+				return XFERPAK_USER_CANCELLED;
 			}
 		}
 
@@ -235,12 +231,8 @@ int xferpak_readCart(xferpak *xpak, unsigned int start_addr, unsigned int len, u
 		xferpak_setBank(xpak, (addr + start_addr) >> 14);
 
 		if (xpak->u) {
-			xpak->u->cur_progress += 32;
-			// Don't call update too often for performance reason
-			if (!(xpak->u->cur_progress & 0x1FF)) {
-				if (xpak->u->update(xpak->u)) {
-					return XFERPAK_USER_CANCELLED;
-				}
+			if (uiio_progressUpdate(xpak->u, xpak->u->cur_progress + 32)) {
+				return XFERPAK_USER_CANCELLED;
 			}
 		}
 
@@ -1027,9 +1019,7 @@ static int xferpak_gb_readMEMORY(xferpak *xpak, struct gbcart_info *inf, int typ
 
 	/* Prepare the progress */
 	if (xpak->u) {
-		xpak->u->cur_progress = 0;
-		xpak->u->max_progress = memory_size;
-		xpak->u->progressStart(xpak->u);
+		uiio_progressStart(xpak->u, memory_size, 1);
 	}
 
 	/* Do it */
@@ -1098,7 +1088,7 @@ static int xferpak_gb_readMEMORY(xferpak *xpak, struct gbcart_info *inf, int typ
 	{
 		/* error return */
 		if (xpak->u) {
-			xpak->u->progressEnd(xpak->u, "Aborted");
+			uiio_progressEnd(xpak->u, "Aborted");
 		}
 
 		free(mem);
@@ -1106,7 +1096,7 @@ static int xferpak_gb_readMEMORY(xferpak *xpak, struct gbcart_info *inf, int typ
 	}
 
 	if (xpak->u) {
-		xpak->u->progressEnd(xpak->u, type == MEMORY_TYPE_ROM ? "Done reading ROM":"Done reading RAM");
+		uiio_progressEnd(xpak->u, type == MEMORY_TYPE_ROM ? "Done reading ROM":"Done reading RAM");
 	}
 	*membuffer = mem;
 
@@ -1131,9 +1121,7 @@ int xferpak_gb_writeRAM(xferpak *xpak, unsigned int mem_size, const unsigned cha
 
 	/* Prepare the progress */
 	if (xpak->u) {
-		xpak->u->cur_progress = 0;
-		xpak->u->max_progress = cartinfo.ram_size;
-		xpak->u->progressStart(xpak->u);
+		uiio_progressStart(xpak->u, cartinfo.ram_size, 1);
 	}
 
 	switch(GB_MBC_MASK(cartinfo.flags))
@@ -1157,13 +1145,13 @@ int xferpak_gb_writeRAM(xferpak *xpak, unsigned int mem_size, const unsigned cha
 			fprintf(stderr, "Cartridge type not yet supported\n");
 
 			if (xpak->u)
-				xpak->u->progressEnd(xpak->u, "Aborted");
+				uiio_progressEnd(xpak->u, "Aborted");
 
 			return XFERPAK_UNSUPPORTED;
 	}
 
 	if (xpak->u)
-		xpak->u->progressEnd(xpak->u, "Done writing RAM");
+		uiio_progressEnd(xpak->u, "Done writing RAM");
 
 	return res;
 }
@@ -4,60 +4,131 @@
 #include "uiio_gtk.h"
 
 static GtkWindow *g_mainwin;
+static GThread *g_mainthread;
 
 GtkWidget *g_progressDialog, *g_progressBar;
 
-static int uiio_gtk_error(const char *fmt, ...)
+/* uiio functions may be called from the adapter I/O thread. Anything
+ * touching GTK is then run from the main loop, and the caller waits. */
+struct main_call {
+	GSourceFunc func;
+	gpointer data;
+	GMutex lock;
+	GCond cond;
+	int done;
+};
+
+static gboolean mainCallWrapper(gpointer data)
 {
+	struct main_call *call = data;
+
+	call->func(call->data);
+
+	g_mutex_lock(&call->lock);
+	call->done = 1;
+	g_cond_signal(&call->cond);
+	g_mutex_unlock(&call->lock);
+
+	return FALSE;
+}
+
+static void runInMainLoop(GSourceFunc func, gpointer data)
+{
+	struct main_call call = { .func = func, .data = data };
+
+	if (g_thread_self() == g_mainthread) {
+		func(data);
+		return;
+	}
+
+	g_mutex_init(&call.lock);
+	g_cond_init(&call.cond);
+
+	g_mutex_lock(&call.lock);
+	gdk_threads_add_idle(mainCallWrapper, &call);
+	while (!call.done) {
+		g_cond_wait(&call.cond, &call.lock);
+	}
+	g_mutex_unlock(&call.lock);
+
+	g_mutex_clear(&call.lock);
+	g_cond_clear(&call.cond);
+}
+
+struct message {
+	int type;
+	char text[512];
+	gint response;
+};
+
+static gboolean showError(gpointer data)
+{
+	struct message *msg = data;
 	GtkDialogFlags errorDialogFlags = GTK_DIALOG_DESTROY_WITH_PARENT;
 	GtkWidget *errorDialog;
-	char messagebuffer[512];
-	va_list ap;
-	int i;
-
-	va_start(ap, fmt);
-	i = vsnprintf(messagebuffer, 512, fmt, ap);
-	va_end(ap);
 
 	errorDialog = gtk_message_dialog_new(g_mainwin,
 									errorDialogFlags,
 									GTK_MESSAGE_ERROR,
 									GTK_BUTTONS_CLOSE,
-									messagebuffer);
+									"%s", msg->text);
 	gtk_dialog_run(GTK_DIALOG(errorDialog));
 	gtk_widget_destroy(errorDialog);
 
-	return i;
+	return FALSE;
 }
 
-static int uiio_gtk_ask(int type, const char *fmt, ...)
+static int uiio_gtk_error(const char *fmt, ...)
 {
-	GtkDialogFlags confirmationDialogFlags = GTK_DIALOG_DESTROY_WITH_PARENT;
-	GtkWidget *confirmationDialog;
-	char messagebuffer[512];
+	struct message msg;
 	va_list ap;
-	gint res;
+	int i;
 
 	va_start(ap, fmt);
-	vsnprintf(messagebuffer, 512, fmt, ap);
+	i = vsnprintf(msg.text, sizeof(msg.text), fmt, ap);
 	va_end(ap);
 
+	runInMainLoop(showError, &msg);
+
+	return i;
+}
+
+static gboolean showQuestion(gpointer data)
+{
+	struct message *msg = data;
+	GtkDialogFlags confirmationDialogFlags = GTK_DIALOG_DESTROY_WITH_PARENT;
+	GtkWidget *confirmationDialog;
+
 	confirmationDialog = gtk_message_dialog_new(g_mainwin,
 									confirmationDialogFlags,
 									GTK_MESSAGE_QUESTION,
 									0,
-									messagebuffer);
+									"%s", msg->text);
 
-	if (type == UIIO_YESNO || type == UIIO_NOYES) {
+	if (msg->type == UIIO_YESNO || msg->type == UIIO_NOYES) {
 		gtk_dialog_add_buttons(GTK_DIALOG(confirmationDialog), "No", 1, "Yes", 2, NULL);
-	} else if (type == UIIO_CONTINUE_ABORT) {
+	} else if (msg->type == UIIO_CONTINUE_ABORT) {
 		gtk_dialog_add_buttons(GTK_DIALOG(confirmationDialog), "Abort", 3, "Continue", 4, NULL);
 	}
 
-	res = gtk_dialog_run(GTK_DIALOG(confirmationDialog));
+	msg->response = gtk_dialog_run(GTK_DIALOG(confirmationDialog));
 	gtk_widget_destroy(confirmationDialog);
 
-	switch(res) {
+	return FALSE;
+}
+
+static int uiio_gtk_ask(int type, const char *fmt, ...)
+{
+	struct message msg = { .type = type };
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(msg.text, sizeof(msg.text), fmt, ap);
+	va_end(ap);
+
+	runInMainLoop(showQuestion, &msg);
+
+	switch(msg.response) {
 		case 1: return UIIO_NO;
 		case 2: return UIIO_YES;
 		case 3: return UIIO_ABORT;
@@ -72,15 +143,16 @@ static void cancel_progress(GtkDialog *dialog, gint response_id, gpointer user_d
 {
 	uiio *u = user_data;
 
-	if (u->progress_status < UIIO_PROGRESS_STARTED)
+	if (g_atomic_int_get(&u->progress_status) < UIIO_PROGRESS_STARTED)
 		return;
 
 	// Any response ID means cancel
-	u->progress_status = UIIO_PROGRESS_CANCELLED;
+	g_atomic_int_set(&u->progress_status, UIIO_PROGRESS_CANCELLED);
 }
 
-static void progressStart(uiio *uiio)
+static gboolean showProgressDialog(gpointer data)
 {
+	uiio *uiio = data;
 	GtkDialogFlags flags = GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT;
 	GtkWidget *content;
 
@@ -111,42 +183,100 @@ static void progressStart(uiio *uiio)
 
 	gtk_widget_show_all(g_progressDialog);
 
-	uiio->progress_status = UIIO_PROGRESS_STARTED;
+	g_atomic_int_set(&uiio->progress_status, UIIO_PROGRESS_STARTED);
+
+	return FALSE;
 }
 
-static void progressEnd(uiio *uiio, const char *message)
+static void progressStart(uiio *uiio)
 {
-	printf("progressEnd: %d\n", uiio->progress_status);
-	if (uiio->progress_status < UIIO_PROGRESS_STARTED)
-		return;
+	runInMainLoop(showProgressDialog, uiio);
+}
+
+struct progress_end {
+	uiio *uiio;
+	const char *message;
+};
+
+static gboolean closeProgressDialog(gpointer data)
+{
+	struct progress_end *end = data;
+	uiio *uiio = end->uiio;
 
 	gtk_dialog_set_response_sensitive(GTK_DIALOG(g_progressDialog), GTK_RESPONSE_CANCEL, FALSE);
 	gtk_dialog_set_response_sensitive(GTK_DIALOG(g_progressDialog), GTK_RESPONSE_CLOSE, TRUE);
 
-	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(g_progressBar), message);
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(g_progressBar), end->message);
 
 	if (!uiio->multi_progress) {
 		(void)gtk_dialog_run(GTK_DIALOG(g_progressDialog));
 		// The only option is to close the dialog. Ignore the return value.
 		gtk_widget_destroy(g_progressDialog);
 		g_progressDialog = NULL;
+		g_progressBar = NULL;
+	}
+	g_atomic_int_set(&uiio->progress_status, UIIO_PROGRESS_STOPPED);
+
+	return FALSE;
+}
+
+static void progressEnd(uiio *uiio, const char *message)
+{
+	struct progress_end end = { .uiio = uiio, .message = message };
+
+	printf("progressEnd: %d\n", uiio->progress_status);
+	if (g_atomic_int_get(&uiio->progress_status) < UIIO_PROGRESS_STARTED)
+		return;
+
+	runInMainLoop(closeProgressDialog, &end);
+}
+
+static void setProgressBar(uiio *uiio)
+{
+	char rate[64], text[256];
+
+	if (!g_progressBar)
+		return;
+
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(g_progressBar), uiio->cur_progress / (float)uiio->max_progress);
+	if (uiio_formatRate(uiio, rate, sizeof(rate)) > 0) {
+		snprintf(text, sizeof(text), "%s (%s)", uiio->caption, rate);
+		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(g_progressBar), text);
+	} else {
+		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(g_progressBar), uiio->caption);
 	}
-	uiio->progress_status = UIIO_PROGRESS_STOPPED;
+}
+
+static gint g_update_pending;
+
+static gboolean showProgress(gpointer data)
+{
+	uiio *uiio = data;
+
+	g_atomic_int_set(&g_update_pending, 0);
+	if (g_atomic_int_get(&uiio->progress_status) >= UIIO_PROGRESS_STARTED) {
+		setProgressBar(uiio);
+	}
+
+	return FALSE;
 }
 
 static int progressUpdate(uiio *uiio)
 {
-	if (uiio->progress_status < UIIO_PROGRESS_STARTED)
+	if (g_atomic_int_get(&uiio->progress_status) < UIIO_PROGRESS_STARTED)
 		return 0;
 
-	while (gtk_events_pending ())
-		  gtk_main_iteration ();
+	if (g_thread_self() == g_mainthread) {
+		while (gtk_events_pending ())
+			  gtk_main_iteration ();
 
-	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(g_progressBar), uiio->cur_progress / (float)uiio->max_progress);
-	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(g_progressBar), uiio->caption);
+		setProgressBar(uiio);
+	} else if (g_atomic_int_compare_and_exchange(&g_update_pending, 0, 1)) {
+		// Coalesce updates: at most one pending redraw
+		gdk_threads_add_idle(showProgress, uiio);
+	}
 
-	if (uiio->progress_status == UIIO_PROGRESS_CANCELLED) {
-		uiio->progress_status = UIIO_PROGRESS_STARTED;
+	if (g_atomic_int_compare_and_exchange(&uiio->progress_status, UIIO_PROGRESS_CANCELLED, UIIO_PROGRESS_STARTED)) {
 		return 1;
 	}
 
@@ -167,6 +297,7 @@ uiio *getUIIO_gtk(uiio *u, GtkWindow *mainWindow)
 	uiio_gtk.update = progressUpdate,
 
 	g_mainwin = mainWindow;
+	g_mainthread = g_thread_self();
 
 	return &uiio_gtk;
 }